@@ -33,6 +33,7 @@
 #include "winerror.h"
 #include "winternl.h"
 #include "winnls.h"
+#include "winioctl.h"
 #include "fileapi.h"
 
 #undef DeleteFile  /* needed for FILE_DISPOSITION_INFO */
@@ -1205,6 +1206,168 @@ static void test_CopyFileEx(void)
     ok(!ret, "DeleteFileA unexpectedly succeeded\n");
 }
 
+static void fill_pattern(char *buffer, DWORD size, DWORD pos)
+{
+    DWORD i;
+    for (i = 0; i < size; i++) buffer[i] = (pos + i) * 7 + (pos + i) / 4093;
+}
+
+static void create_pattern_file(const char *name, DWORD size, DWORD seed)
+{
+    char buffer[4096];
+    DWORD i, count;
+    HANDLE file;
+    BOOL ret;
+
+    file = CreateFileA(name, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, 0);
+    ok(file != INVALID_HANDLE_VALUE, "CreateFileA error %d\n", GetLastError());
+    for (i = 0; i < size; i += count)
+    {
+        count = min(size - i, sizeof(buffer));
+        fill_pattern(buffer, count, seed + i);
+        ret = WriteFile(file, buffer, count, &count, NULL);
+        ok(ret, "WriteFile error %d\n", GetLastError());
+    }
+    CloseHandle(file);
+}
+
+/* check that a file range contains the pattern of another file range, or zeroes if seed is ~0u */
+static BOOL check_file_data(HANDLE file, DWORD offset, DWORD size, DWORD seed)
+{
+    char buffer[4096], expect[4096];
+    DWORD count;
+
+    SetFilePointer(file, offset, NULL, FILE_BEGIN);
+    while (size)
+    {
+        if (!ReadFile(file, buffer, min(size, sizeof(buffer)), &count, NULL) || !count) return FALSE;
+        if (seed == ~0u) memset(expect, 0, count);
+        else fill_pattern(expect, count, seed + offset);
+        if (memcmp(buffer, expect, count)) return FALSE;
+        offset += count;
+        size -= count;
+    }
+    return TRUE;
+}
+
+static void test_CopyFile_data(void)
+{
+    static const DWORD sizes[] = {1, 4095, 4096, 65536 * 3 + 1234, 8 * 1024 * 1024 + 17};
+    char temp_path[MAX_PATH], source[MAX_PATH], dest[MAX_PATH];
+    HANDLE file;
+    DWORD i;
+    BOOL ret;
+
+    GetTempPathA(MAX_PATH, temp_path);
+    ret = GetTempFileNameA(temp_path, "cpy", 0, source);
+    ok(ret, "GetTempFileNameA error %d\n", GetLastError());
+    ret = GetTempFileNameA(temp_path, "cpy", 0, dest);
+    ok(ret, "GetTempFileNameA error %d\n", GetLastError());
+
+    for (i = 0; i < ARRAY_SIZE(sizes); i++)
+    {
+        create_pattern_file(source, sizes[i], 0);
+        ret = CopyFileA(source, dest, FALSE);
+        ok(ret, "%u: CopyFileA error %d\n", sizes[i], GetLastError());
+
+        file = CreateFileA(dest, GENERIC_READ, 0, NULL, OPEN_EXISTING, 0, 0);
+        ok(file != INVALID_HANDLE_VALUE, "CreateFileA error %d\n", GetLastError());
+        ok(GetFileSize(file, NULL) == sizes[i], "%u: got size %u\n", sizes[i], GetFileSize(file, NULL));
+        ok(check_file_data(file, 0, sizes[i], 0), "%u: wrong data\n", sizes[i]);
+        CloseHandle(file);
+    }
+
+    /* an empty source truncates an existing destination */
+    create_pattern_file(source, 0, 0);
+    ret = CopyFileA(source, dest, FALSE);
+    ok(ret, "CopyFileA error %d\n", GetLastError());
+    file = CreateFileA(dest, GENERIC_READ, 0, NULL, OPEN_EXISTING, 0, 0);
+    ok(GetFileSize(file, NULL) == 0, "got size %u\n", GetFileSize(file, NULL));
+    CloseHandle(file);
+
+    ret = DeleteFileA(source);
+    ok(ret, "DeleteFileA error %d\n", GetLastError());
+    ret = DeleteFileA(dest);
+    ok(ret, "DeleteFileA error %d\n", GetLastError());
+}
+
+static void test_duplicate_extents(void)
+{
+    static const DWORD cluster = 4096, src_size = 3 * 4096 + 100, dst_size = 4 * 4096;
+    static const struct
+    {
+        DWORD src_offset, dst_offset, count;
+        BOOL valid;
+    }
+    tests[] =
+    {
+        {0,       0,           0,           TRUE},
+        {cluster, 2 * cluster, cluster,     TRUE},
+        {0,       0,           4 * cluster, TRUE},   /* last cluster past the end of the source */
+        {100,     0,           cluster,     FALSE},  /* unaligned source offset */
+        {0,       100,         cluster,     FALSE},  /* unaligned target offset */
+        {0,       0,           1000,        FALSE},  /* unaligned size */
+        {0,       dst_size,    cluster,     FALSE},  /* past the end of the target */
+        {0,       3 * cluster, 2 * cluster, FALSE},  /* extends past the end of the target */
+        {cluster, 0,           4 * cluster, FALSE},  /* extends past the end of the source */
+    };
+    char temp_path[MAX_PATH], source[MAX_PATH], dest[MAX_PATH];
+    DUPLICATE_EXTENTS_DATA data;
+    HANDLE src, dst;
+    DWORD i, size, error, seed;
+    BOOL ret;
+
+    GetTempPathA(MAX_PATH, temp_path);
+    GetTempFileNameA(temp_path, "dup", 0, source);
+    GetTempFileNameA(temp_path, "dup", 0, dest);
+    create_pattern_file(source, src_size, 0);
+    src = CreateFileA(source, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, 0);
+    ok(src != INVALID_HANDLE_VALUE, "CreateFileA error %d\n", GetLastError());
+
+    for (i = 0; i < ARRAY_SIZE(tests); i++)
+    {
+        dst = CreateFileA(dest, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, 0);
+        ok(dst != INVALID_HANDLE_VALUE, "CreateFileA error %d\n", GetLastError());
+        SetFilePointer(dst, dst_size, NULL, FILE_BEGIN);
+        SetEndOfFile(dst);
+
+        data.FileHandle = src;
+        data.SourceFileOffset.QuadPart = tests[i].src_offset;
+        data.TargetFileOffset.QuadPart = tests[i].dst_offset;
+        data.ByteCount.QuadPart = tests[i].count;
+        SetLastError(0xdeadbeef);
+        ret = DeviceIoControl(dst, FSCTL_DUPLICATE_EXTENTS_TO_FILE, &data, sizeof(data), NULL, 0, &size, NULL);
+        error = GetLastError();
+        if (!tests[i].valid)
+            ok(!ret && (error == ERROR_INVALID_PARAMETER || error == ERROR_INVALID_FUNCTION),
+               "%u: got ret %d error %u\n", i, ret, error);
+        else
+            ok(ret || error == ERROR_INVALID_FUNCTION || error == ERROR_NOT_SUPPORTED,
+               "%u: got error %u\n", i, error);
+
+        /* the target is never extended */
+        ok(GetFileSize(dst, NULL) == dst_size, "%u: got size %u\n", i, GetFileSize(dst, NULL));
+        if (ret && tests[i].count)
+        {
+            size = min(tests[i].count, src_size - tests[i].src_offset);
+            seed = tests[i].src_offset - tests[i].dst_offset;
+            ok(check_file_data(dst, 0, tests[i].dst_offset, ~0u), "%u: data before the range changed\n", i);
+            ok(check_file_data(dst, tests[i].dst_offset, size, seed), "%u: wrong data in the range\n", i);
+            ok(check_file_data(dst, tests[i].dst_offset + size, dst_size - tests[i].dst_offset - size, ~0u),
+               "%u: data after the range changed\n", i);
+        }
+        else  /* nothing may have been copied instead */
+            ok(check_file_data(dst, 0, dst_size, ~0u), "%u: target data changed\n", i);
+        CloseHandle(dst);
+    }
+
+    CloseHandle(src);
+    ret = DeleteFileA(source);
+    ok(ret, "DeleteFileA error %d\n", GetLastError());
+    ret = DeleteFileA(dest);
+    ok(ret, "DeleteFileA error %d\n", GetLastError());
+}
+
 /*
  *   Debugging routine to dump a buffer in a hexdump-like fashion.
  */
@@ -4563,6 +4726,84 @@ static void test_ReOpenFile(void)
     CloseHandle(file);
 }
 
+static void test_scatter_gather_data(void)
+{
+    static const DWORD file_size = 4 * 1024 * 1024, extent_size = 1024 * 1024;
+    char temp_path[MAX_PATH], filename[MAX_PATH];
+    DWORD i, j, pages, tx;
+    FILE_SEGMENT_ELEMENT *fse;
+    unsigned char *page;
+    OVERLAPPED ovl;
+    SYSTEM_INFO si;
+    HANDLE hfile;
+    char *buf;
+    BOOL br;
+
+    GetTempPathA( MAX_PATH, temp_path );
+    GetTempFileNameA( temp_path, "sgt", 0, filename );
+    hfile = CreateFileA( filename, GENERIC_READ | GENERIC_WRITE, 0, 0, CREATE_ALWAYS,
+                         FILE_FLAG_NO_BUFFERING | FILE_FLAG_OVERLAPPED | FILE_ATTRIBUTE_NORMAL, 0 );
+    ok( hfile != INVALID_HANDLE_VALUE, "CreateFile failed err %u\n", GetLastError() );
+    if (hfile == INVALID_HANDLE_VALUE) return;
+
+    GetSystemInfo( &si );
+    pages = extent_size / si.dwPageSize;
+    buf = VirtualAlloc( NULL, extent_size, MEM_COMMIT, PAGE_READWRITE );
+    fse = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY, (pages + 1) * sizeof(*fse) );
+    memset( &ovl, 0, sizeof(ovl) );
+    ovl.hEvent = CreateEventW( NULL, TRUE, FALSE, NULL );
+
+    /* whole extents, with the pages in reverse order in memory */
+    for (j = 0; j < pages; j++) fse[j].Buffer = buf + (pages - 1 - j) * si.dwPageSize;
+
+    for (i = 0; i < file_size / extent_size; i++)
+    {
+        for (j = 0; j < pages; j++) memset( fse[j].Buffer, i * pages + j, si.dwPageSize );
+        S(U(ovl)).Offset = i * extent_size;
+        if (!WriteFileGather( hfile, fse, extent_size, NULL, &ovl ))
+            ok( GetLastError() == ERROR_IO_PENDING, "WriteFileGather failed err %u\n", GetLastError() );
+        br = GetOverlappedResult( hfile, &ovl, &tx, TRUE );
+        ok( br && tx == extent_size, "GetOverlappedResult failed err %u, tx %u\n", GetLastError(), tx );
+    }
+
+    /* the pages were written to the file in segment order */
+    for (i = 0; i < file_size / si.dwPageSize; i++)
+    {
+        memset( buf, 0xcc, si.dwPageSize );
+        S(U(ovl)).Offset = i * si.dwPageSize;
+        if (!ReadFile( hfile, buf, si.dwPageSize, NULL, &ovl ))
+            ok( GetLastError() == ERROR_IO_PENDING, "ReadFile failed err %u\n", GetLastError() );
+        br = GetOverlappedResult( hfile, &ovl, &tx, TRUE );
+        ok( br && tx == si.dwPageSize, "GetOverlappedResult failed err %u, tx %u\n", GetLastError(), tx );
+        page = (unsigned char *)buf;
+        ok( page[0] == (unsigned char)i && page[si.dwPageSize - 1] == page[0],
+            "wrong data in page %u: %02x %02x\n", i, page[0], page[si.dwPageSize - 1] );
+    }
+
+    /* and are read back into the segments in the same order */
+    for (i = 0; i < file_size / extent_size; i++)
+    {
+        memset( buf, 0xcc, extent_size );
+        S(U(ovl)).Offset = i * extent_size;
+        if (!ReadFileScatter( hfile, fse, extent_size, NULL, &ovl ))
+            ok( GetLastError() == ERROR_IO_PENDING, "ReadFileScatter failed err %u\n", GetLastError() );
+        br = GetOverlappedResult( hfile, &ovl, &tx, TRUE );
+        ok( br && tx == extent_size, "GetOverlappedResult failed err %u, tx %u\n", GetLastError(), tx );
+        for (j = 0; j < pages; j++)
+        {
+            page = fse[j].Buffer;
+            ok( page[0] == (unsigned char)(i * pages + j) && page[si.dwPageSize - 1] == page[0],
+                "wrong data in page %u of extent %u\n", j, i );
+        }
+    }
+
+    CloseHandle( ovl.hEvent );
+    CloseHandle( hfile );
+    HeapFree( GetProcessHeap(), 0, fse );
+    VirtualFree( buf, 0, MEM_RELEASE );
+    DeleteFileA( filename );
+}
+
 static void test_WriteFileGather(void)
 {
     char temp_path[MAX_PATH], filename[MAX_PATH];
@@ -5431,6 +5672,126 @@ static void test_overlapped_read(void)
     ok(ret, "Unexpected error %u.\n", GetLastError());
 }
 
+static DWORD queue_depth_apc_count, queue_depth_apc_bytes;
+
+static void CALLBACK queue_depth_apc(DWORD error, DWORD count, OVERLAPPED *ovl)
+{
+    ok(!error, "got error %u\n", error);
+    queue_depth_apc_count++;
+    queue_depth_apc_bytes = count;
+}
+
+static void test_overlapped_queue_depth(void)
+{
+    static const DWORD file_size = 8 * 1024 * 1024, block_size = 65536;
+    static const DWORD depths[] = {1, 4, 16, 64};
+    char temp_path[MAX_PATH], file_name[MAX_PATH];
+    DWORD i, j, count, next, done, blocks = file_size / block_size;
+    OVERLAPPED ov[64], *povl;
+    HANDLE hfile, port;
+    char *buffers, *buffer, *completed;
+    ULONG_PTR key, value;
+    BOOL ret;
+
+    GetTempPathA(MAX_PATH, temp_path);
+    ret = GetTempFileNameA(temp_path, "qd", 0, file_name);
+    ok(ret, "GetTempFileNameA error %d\n", GetLastError());
+    buffers = HeapAlloc(GetProcessHeap(), 0, ARRAY_SIZE(ov) * block_size);
+    completed = HeapAlloc(GetProcessHeap(), 0, blocks);
+
+    hfile = CreateFileA(file_name, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, 0);
+    ok(hfile != INVALID_HANDLE_VALUE, "CreateFileA error %d\n", GetLastError());
+    for (i = 0; i < blocks; i++)
+    {
+        for (j = 0; j < block_size / sizeof(value); j++)
+            ((ULONG_PTR *)buffers)[j] = i * block_size / sizeof(value) + j;
+        ret = WriteFile(hfile, buffers, block_size, &count, NULL);
+        ok(ret && count == block_size, "WriteFile error %d\n", GetLastError());
+    }
+    CloseHandle(hfile);
+
+    hfile = CreateFileA(file_name, GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, 0);
+    ok(hfile != INVALID_HANDLE_VALUE, "CreateFileA error %d\n", GetLastError());
+    port = CreateIoCompletionPort(hfile, NULL, 0xdead, 0);
+    ok(port != NULL, "CreateIoCompletionPort error %d\n", GetLastError());
+
+    for (i = 0; i < ARRAY_SIZE(depths); i++)
+    {
+        memset(completed, 0, blocks);
+        for (next = 0; next < depths[i]; next++)
+        {
+            memset(&ov[next], 0, sizeof(ov[next]));
+            ov[next].Offset = next * block_size;
+            ret = ReadFile(hfile, buffers + next * block_size, block_size, NULL, &ov[next]);
+            ok(ret || GetLastError() == ERROR_IO_PENDING, "ReadFile error %d\n", GetLastError());
+        }
+        for (done = 0; done < blocks; done++)
+        {
+            ret = GetQueuedCompletionStatus(port, &count, &key, &povl, 5000);
+            ok(ret, "GetQueuedCompletionStatus error %d\n", GetLastError());
+            if (!ret) break;
+            ok(key == 0xdead, "got key %lx\n", key);
+            ok(count == block_size, "got count %u\n", count);
+
+            j = povl - ov;
+            buffer = buffers + j * block_size;
+            value = povl->Offset;
+            ok(((ULONG_PTR *)buffer)[0] == value / sizeof(value) &&
+               ((ULONG_PTR *)buffer)[block_size / sizeof(value) - 1] == (value + block_size) / sizeof(value) - 1,
+               "wrong data at offset %u\n", povl->Offset);
+            /* completions may come in any order, but each block only once */
+            ok(!completed[povl->Offset / block_size], "offset %u completed twice\n", povl->Offset);
+            completed[povl->Offset / block_size] = 1;
+
+            if (next < blocks)
+            {
+                povl->Offset = next++ * block_size;
+                ret = ReadFile(hfile, buffer, block_size, NULL, povl);
+                ok(ret || GetLastError() == ERROR_IO_PENDING, "ReadFile error %d\n", GetLastError());
+            }
+        }
+        ok(done == blocks, "depth %u: got %u completions\n", depths[i], done);
+        ret = GetQueuedCompletionStatus(port, &count, &key, &povl, 0);
+        ok(!ret && !povl, "depth %u: got an extra completion\n", depths[i]);
+    }
+    CloseHandle(port);
+    CloseHandle(hfile);
+
+    /* without an event, completion is reported through the file handle */
+    hfile = CreateFileA(file_name, GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, 0);
+    ok(hfile != INVALID_HANDLE_VALUE, "CreateFileA error %d\n", GetLastError());
+    memset(&ov[0], 0, sizeof(ov[0]));
+    ov[0].Offset = file_size - block_size / 2;
+    ret = ReadFile(hfile, buffers, block_size, NULL, &ov[0]);
+    ok(ret || GetLastError() == ERROR_IO_PENDING, "ReadFile error %d\n", GetLastError());
+    ret = GetOverlappedResult(hfile, &ov[0], &count, TRUE);
+    ok(ret, "GetOverlappedResult error %d\n", GetLastError());
+    ok(count == block_size / 2, "got count %u\n", count);
+
+    memset(&ov[0], 0, sizeof(ov[0]));
+    ov[0].Offset = file_size;
+    ret = ReadFile(hfile, buffers, block_size, NULL, &ov[0]);
+    if (!ret && GetLastError() == ERROR_IO_PENDING)
+        ret = GetOverlappedResult(hfile, &ov[0], &count, TRUE);
+    ok(!ret && GetLastError() == ERROR_HANDLE_EOF, "got ret %d error %d\n", ret, GetLastError());
+
+    queue_depth_apc_count = 0;
+    memset(&ov[0], 0, sizeof(ov[0]));
+    ov[0].Offset = block_size;
+    ret = ReadFileEx(hfile, buffers, block_size, &ov[0], queue_depth_apc);
+    ok(ret, "ReadFileEx error %d\n", GetLastError());
+    ok(SleepEx(5000, TRUE) == WAIT_IO_COMPLETION, "expected WAIT_IO_COMPLETION\n");
+    ok(queue_depth_apc_count == 1, "got %u APC calls\n", queue_depth_apc_count);
+    ok(queue_depth_apc_bytes == block_size, "got %u bytes\n", queue_depth_apc_bytes);
+    ok(((ULONG_PTR *)buffers)[0] == block_size / sizeof(value), "wrong data\n");
+    CloseHandle(hfile);
+
+    HeapFree(GetProcessHeap(), 0, completed);
+    HeapFree(GetProcessHeap(), 0, buffers);
+    ret = DeleteFileA(file_name);
+    ok(ret, "DeleteFileA error %d\n", GetLastError());
+}
+
 static void test_file_readonly_access(void)
 {
     static const DWORD default_sharing = FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE;
@@ -5730,6 +6091,161 @@ static void test_move_file(void)
     SetCurrentDirectoryA( cwd );
 }
 
+struct handle_reuse_params
+{
+    char path[MAX_PATH];
+    char data;
+    unsigned int mismatches;
+};
+
+static DWORD WINAPI handle_reuse_thread( void *arg )
+{
+    struct handle_reuse_params *params = arg;
+    DWORD size;
+    HANDLE file;
+    char data;
+    BOOL ret;
+    int i;
+
+    for (i = 0; i < 2000; i++)
+    {
+        file = CreateFileA( params->path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, 0 );
+        if (file == INVALID_HANDLE_VALUE) continue;
+        data = 0;
+        ret = ReadFile( file, &data, 1, &size, NULL );
+        if (!ret || size != 1 || data != params->data) params->mismatches++;
+        CloseHandle( file );
+    }
+    return 0;
+}
+
+/* handles are reused quickly when threads open and close files concurrently; a
+ * thread must never see the fd of a file another thread opened under the same
+ * handle value */
+static void test_concurrent_handle_reuse(void)
+{
+    struct handle_reuse_params params[4];
+    char temp_path[MAX_PATH];
+    HANDLE threads[4], file;
+    DWORD size;
+    BOOL ret;
+    int i;
+
+    GetTempPathA( MAX_PATH, temp_path );
+    for (i = 0; i < ARRAY_SIZE(params); i++)
+    {
+        GetTempFileNameA( temp_path, "wt", 0, params[i].path );
+        params[i].data = 'a' + i;
+        params[i].mismatches = 0;
+        file = CreateFileA( params[i].path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, 0 );
+        ok( file != INVALID_HANDLE_VALUE, "failed to create file, error %u\n", GetLastError() );
+        ret = WriteFile( file, &params[i].data, 1, &size, NULL );
+        ok( ret && size == 1, "WriteFile failed, error %u\n", GetLastError() );
+        CloseHandle( file );
+    }
+
+    for (i = 0; i < ARRAY_SIZE(threads); i++)
+        threads[i] = CreateThread( NULL, 0, handle_reuse_thread, &params[i], 0, NULL );
+    size = WaitForMultipleObjects( ARRAY_SIZE(threads), threads, TRUE, 60000 );
+    ok( size == WAIT_OBJECT_0, "wait failed: %u\n", size );
+
+    for (i = 0; i < ARRAY_SIZE(threads); i++)
+    {
+        CloseHandle( threads[i] );
+        ok( !params[i].mismatches, "thread %d read the wrong file %u times\n", i, params[i].mismatches );
+        DeleteFileA( params[i].path );
+    }
+}
+
+static void test_case_insensitive_open(void)
+{
+    static const unsigned int nb_dirs = 16, nb_files = 128;
+    char temp_path[MAX_PATH], dir[MAX_PATH], path[MAX_PATH], *p;
+    unsigned int i, j, pass;
+    HANDLE file;
+    DWORD ret;
+
+    GetTempPathA(MAX_PATH, temp_path);
+    sprintf(dir, "%sCaseTest", temp_path);
+    ret = CreateDirectoryA(dir, NULL);
+    ok(ret, "CreateDirectory error %u\n", GetLastError());
+
+    for (i = 0; i < nb_dirs; i++)
+    {
+        sprintf(path, "%s\\SubDir%02u", dir, i);
+        ret = CreateDirectoryA(path, NULL);
+        ok(ret, "CreateDirectory error %u\n", GetLastError());
+        for (j = 0; j < nb_files; j++)
+        {
+            sprintf(path, "%s\\SubDir%02u\\File%03u.Txt", dir, i, j);
+            file = CreateFileA(path, GENERIC_WRITE, 0, NULL, CREATE_NEW, 0, 0);
+            ok(file != INVALID_HANDLE_VALUE, "CreateFile %s error %u\n", path, GetLastError());
+            CloseHandle(file);
+        }
+    }
+
+    /* the first pass reads the directories, the second one looks them up again */
+    for (pass = 0; pass < 2; pass++)
+    {
+        for (i = 0; i < nb_dirs; i++)
+        {
+            for (j = 0; j < nb_files; j++)
+            {
+                sprintf(path, "%s\\SUBDIR%02u\\FILE%03u.TXT", dir, i, j);
+                file = CreateFileA(path, GENERIC_READ, 0, NULL, OPEN_EXISTING, 0, 0);
+                ok(file != INVALID_HANDLE_VALUE, "CreateFile %s error %u\n", path, GetLastError());
+                CloseHandle(file);
+            }
+            sprintf(path, "%s\\SUBDIR%02u\\MISSING.TXT", dir, i);
+            file = CreateFileA(path, GENERIC_READ, 0, NULL, OPEN_EXISTING, 0, 0);
+            ok(file == INVALID_HANDLE_VALUE, "CreateFile %s succeeded\n", path);
+            ok(GetLastError() == ERROR_FILE_NOT_FOUND, "got error %u\n", GetLastError());
+        }
+    }
+
+    /* changes to the directory have to be seen right away */
+    sprintf(path, "%s\\SubDir00\\NewFile.Txt", dir);
+    file = CreateFileA(path, GENERIC_WRITE, 0, NULL, CREATE_NEW, 0, 0);
+    ok(file != INVALID_HANDLE_VALUE, "CreateFile %s error %u\n", path, GetLastError());
+    CloseHandle(file);
+    sprintf(path, "%s\\SUBDIR00\\NEWFILE.TXT", dir);
+    file = CreateFileA(path, GENERIC_READ, 0, NULL, OPEN_EXISTING, 0, 0);
+    ok(file != INVALID_HANDLE_VALUE, "CreateFile %s error %u\n", path, GetLastError());
+    CloseHandle(file);
+
+    sprintf(path, "%s\\SubDir00\\NewFile.Txt", dir);
+    strcpy(temp_path, path);
+    p = strrchr(temp_path, '\\');
+    strcpy(p + 1, "Renamed.Txt");
+    ret = MoveFileA(path, temp_path);
+    ok(ret, "MoveFile error %u\n", GetLastError());
+    sprintf(path, "%s\\SUBDIR00\\NEWFILE.TXT", dir);
+    file = CreateFileA(path, GENERIC_READ, 0, NULL, OPEN_EXISTING, 0, 0);
+    ok(file == INVALID_HANDLE_VALUE, "CreateFile %s succeeded\n", path);
+    sprintf(path, "%s\\SUBDIR00\\RENAMED.TXT", dir);
+    file = CreateFileA(path, GENERIC_READ, 0, NULL, OPEN_EXISTING, 0, 0);
+    ok(file != INVALID_HANDLE_VALUE, "CreateFile %s error %u\n", path, GetLastError());
+    CloseHandle(file);
+
+    ret = DeleteFileA(temp_path);
+    ok(ret, "DeleteFile error %u\n", GetLastError());
+    file = CreateFileA(path, GENERIC_READ, 0, NULL, OPEN_EXISTING, 0, 0);
+    ok(file == INVALID_HANDLE_VALUE, "CreateFile %s succeeded\n", path);
+
+    for (i = 0; i < nb_dirs; i++)
+    {
+        for (j = 0; j < nb_files; j++)
+        {
+            sprintf(path, "%s\\SubDir%02u\\File%03u.Txt", dir, i, j);
+            DeleteFileA(path);
+        }
+        sprintf(path, "%s\\SubDir%02u", dir, i);
+        RemoveDirectoryA(path);
+    }
+    ret = RemoveDirectoryA(dir);
+    ok(ret, "RemoveDirectory error %u\n", GetLastError());
+}
+
 START_TEST(file)
 {
     char temp_path[MAX_PATH];
@@ -5757,6 +6273,8 @@ START_TEST(file)
     test_CopyFileW();
     test_CopyFile2();
     test_CopyFileEx();
+    test_CopyFile_data();
+    test_duplicate_extents();
     test_CreateFile();
     test_CreateFileA();
     test_CreateFileW();
@@ -5793,6 +6311,7 @@ START_TEST(file)
     test_OpenFileById();
     test_SetFileValidData();
     test_WriteFileGather();
+    test_scatter_gather_data();
     test_file_access();
     test_GetFinalPathNameByHandleA();
     test_GetFinalPathNameByHandleW();
@@ -5800,10 +6319,13 @@ START_TEST(file)
     test_GetFileAttributesExW();
     test_post_completion();
     test_overlapped_read();
+    test_overlapped_queue_depth();
     test_file_readonly_access();
     test_find_file_stream();
     test_SetFileTime();
     test_ReOpenFile();
     test_hard_link();
     test_move_file();
+    test_concurrent_handle_reuse();
+    test_case_insensitive_open();
 }
@@ -42,6 +42,7 @@
 static LPVOID (WINAPI *pHeapAlloc)(HANDLE,DWORD,SIZE_T);
 static LPVOID (WINAPI *pHeapReAlloc)(HANDLE,DWORD,LPVOID,SIZE_T);
 static BOOL (WINAPI *pHeapQueryInformation)(HANDLE, HEAP_INFORMATION_CLASS, PVOID, SIZE_T, PSIZE_T);
+static BOOL (WINAPI *pHeapSetInformation)(HANDLE, HEAP_INFORMATION_CLASS, PVOID, SIZE_T);
 static BOOL (WINAPI *pGetPhysicallyInstalledSystemMemory)(ULONGLONG *);
 static ULONG (WINAPI *pRtlGetNtGlobalFlags)(void);
 
@@ -889,6 +890,112 @@ static void test_HeapQueryInformation(void)
     ok(info == 0 || info == 1 || info == 2, "expected 0, 1 or 2, got %u\n", info);
 }
 
+#define LFH_THREADS 4
+#define LFH_BLOCKS  512
+
+static BYTE *lfh_blocks[LFH_BLOCKS];  /* blocks shared between the threads */
+
+static void check_lfh_block( HANDLE heap, BYTE *p )
+{
+    SIZE_T size = HeapSize( heap, 0, p );
+
+    ok( !size || (p[0] == LOBYTE(size) && p[size - 1] == LOBYTE(size)),
+        "block %p of size %lu overwritten\n", p, size );
+    HeapFree( heap, 0, p );
+}
+
+static DWORD WINAPI lfh_thread( void *heap )
+{
+    DWORD i, seed = GetCurrentThreadId();
+    SIZE_T size;
+    BYTE *p;
+
+    for (i = 0; i < 100000; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        size = (seed >> 8) % 20000;
+        p = HeapAlloc( heap, 0, size );
+        ok( p != NULL, "HeapAlloc %lu failed\n", size );
+        if (!p) continue;
+        ok( HeapSize( heap, 0, p ) == size, "got size %lu, expected %lu\n", HeapSize( heap, 0, p ), size );
+        memset( p, LOBYTE(size), size );
+        /* the block is most likely freed by another thread */
+        if ((p = InterlockedExchangePointer( (void **)&lfh_blocks[seed % LFH_BLOCKS], p )))
+            check_lfh_block( heap, p );
+    }
+    return 0;
+}
+
+static void test_heap_lfh(void)
+{
+    HANDLE heap, threads[LFH_THREADS];
+    ULONG info;
+    BYTE *p, *p2;
+    DWORD i;
+    BOOL ret;
+
+    pHeapSetInformation = (void *)GetProcAddress(GetModuleHandleA("kernel32.dll"), "HeapSetInformation");
+    if (!pHeapSetInformation || !pHeapQueryInformation)
+    {
+        win_skip("HeapSetInformation is not available\n");
+        return;
+    }
+
+    heap = HeapCreate( HEAP_NO_SERIALIZE, 0, 0 );
+    ok( heap != NULL, "HeapCreate failed\n" );
+    info = 2;
+    ret = pHeapSetInformation( heap, HeapCompatibilityInformation, &info, sizeof(info) );
+    ok( !ret, "HeapSetInformation succeeded on a non-serialized heap\n" );
+    HeapDestroy( heap );
+
+    heap = HeapCreate( 0, 0, 0 );
+    ok( heap != NULL, "HeapCreate failed\n" );
+    info = 2;
+    ret = pHeapSetInformation( heap, HeapCompatibilityInformation, &info, sizeof(info) );
+    if (!ret)
+    {
+        skip( "cannot enable the low fragmentation heap (running under a debugger?)\n" );
+        HeapDestroy( heap );
+        return;
+    }
+    info = 0xdeadbeef;
+    ret = pHeapQueryInformation( heap, HeapCompatibilityInformation, &info, sizeof(info), NULL );
+    ok( ret, "HeapQueryInformation error %u\n", GetLastError() );
+    ok( info == 2, "expected 2, got %u\n", info );
+
+    p = HeapAlloc( heap, HEAP_ZERO_MEMORY, 100 );
+    ok( p != NULL, "HeapAlloc failed\n" );
+    for (i = 0; i < 100; i++) if (p[i]) break;
+    ok( i == 100, "memory not zeroed at %u\n", i );
+    ok( HeapSize( heap, 0, p ) == 100, "got size %lu\n", HeapSize( heap, 0, p ) );
+    ok( HeapValidate( heap, 0, p ), "HeapValidate failed\n" );
+    memset( p, 0x55, 100 );
+
+    p2 = HeapReAlloc( heap, HEAP_REALLOC_IN_PLACE_ONLY, p, 90 );
+    ok( p2 == p, "HeapReAlloc moved the block\n" );
+    ok( HeapSize( heap, 0, p ) == 90, "got size %lu\n", HeapSize( heap, 0, p ) );
+    p2 = HeapReAlloc( heap, HEAP_ZERO_MEMORY, p, 3000 );
+    ok( p2 != NULL, "HeapReAlloc failed\n" );
+    ok( HeapSize( heap, 0, p2 ) == 3000, "got size %lu\n", HeapSize( heap, 0, p2 ) );
+    for (i = 0; i < 90; i++) if (p2[i] != 0x55) break;
+    ok( i == 90, "memory not preserved at %u\n", i );
+    for (; i < 3000; i++) if (p2[i]) break;
+    ok( i == 3000, "memory not zeroed at %u\n", i );
+    ret = HeapFree( heap, 0, p2 );
+    ok( ret, "HeapFree failed\n" );
+    ok( HeapValidate( heap, 0, NULL ), "HeapValidate failed\n" );
+
+    /* blocks are allocated in one thread and freed in another one */
+    for (i = 0; i < LFH_THREADS; i++)
+        threads[i] = CreateThread( NULL, 0, lfh_thread, heap, 0, NULL );
+    WaitForMultipleObjects( LFH_THREADS, threads, TRUE, INFINITE );
+    for (i = 0; i < LFH_THREADS; i++) CloseHandle( threads[i] );
+    for (i = 0; i < LFH_BLOCKS; i++) if (lfh_blocks[i]) check_lfh_block( heap, lfh_blocks[i] );
+
+    ok( HeapValidate( heap, 0, NULL ), "HeapValidate failed\n" );
+    HeapDestroy( heap );
+}
+
 static void test_heap_checks( DWORD flags )
 {
     BYTE old, *p, *p2;
@@ -1245,6 +1352,7 @@ START_TEST(heap)
     test_sized_HeapReAlloc((1 << 20), 1);
 
     test_HeapQueryInformation();
+    test_heap_lfh();
     test_GetPhysicallyInstalledSystemMemory();
 
     if (pRtlGetNtGlobalFlags)
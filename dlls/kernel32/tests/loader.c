@@ -3957,6 +3957,212 @@ static void test_LoadPackagedLibrary(void)
             h, GetLastError());
 }
 
+static void test_export_lookup(void)
+{
+    const IMAGE_EXPORT_DIRECTORY *exports;
+    const DWORD *names, *functions;
+    const WORD *ordinals;
+    HMODULE module;
+    ULONG size;
+    DWORD i, pass;
+    void *proc;
+
+    if (!(module = LoadLibraryA( "opengl32.dll" )))
+    {
+        skip( "opengl32.dll not available\n" );
+        return;
+    }
+    exports = pRtlImageDirectoryEntryToData( module, TRUE, IMAGE_DIRECTORY_ENTRY_EXPORT, &size );
+    ok( exports != NULL, "no export directory\n" );
+    if (!exports) goto done;
+    names = (const DWORD *)((char *)module + exports->AddressOfNames);
+    ordinals = (const WORD *)((char *)module + exports->AddressOfNameOrdinals);
+    functions = (const DWORD *)((char *)module + exports->AddressOfFunctions);
+
+    /* after the first lookups, the module switches to a hash table of its exports */
+    for (pass = 0; pass < 2; pass++)
+    {
+        for (i = 0; i < exports->NumberOfNames; i++)
+        {
+            const char *name = (const char *)module + names[i];
+            DWORD rva = functions[ordinals[i]];
+
+            proc = GetProcAddress( module, name );
+            /* skip forwarded functions */
+            if (rva >= (char *)exports - (char *)module && rva < (char *)exports - (char *)module + size)
+                continue;
+            ok( proc == (char *)module + rva, "%s: got %p, expected %p\n", name, proc, (char *)module + rva );
+        }
+        ok( !GetProcAddress( module, "wine_nonexistent_export" ), "found nonexistent export\n" );
+        ok( !GetProcAddress( module, "GLCLEAR" ), "export lookup is case insensitive\n" );
+    }
+done:
+    FreeLibrary( module );
+}
+
+static DWORD spawn_child_process(const char *cmdline)
+{
+    STARTUPINFOA si = { sizeof(si) };
+    PROCESS_INFORMATION pi;
+    DWORD ret;
+
+    ret = CreateProcessA(NULL, (char *)cmdline, NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi);
+    ok(ret, "CreateProcess(%s) error %d\n", cmdline, GetLastError());
+    if (!ret) return ~0u;
+    ret = WaitForSingleObject(pi.hProcess, 10000);
+    ok(ret == WAIT_OBJECT_0, "child process failed to terminate\n");
+    if (ret != WAIT_OBJECT_0) TerminateProcess(pi.hProcess, 0);
+    GetExitCodeProcess(pi.hProcess, &ret);
+    CloseHandle(pi.hThread);
+    CloseHandle(pi.hProcess);
+    return ret;
+}
+
+/* called in the child process to check that all its imports are bound to the right functions */
+static void check_imports(void)
+{
+    const IMAGE_IMPORT_DESCRIPTOR *descr;
+    const IMAGE_THUNK_DATA *names, *thunks;
+    const IMAGE_IMPORT_BY_NAME *import;
+    HMODULE module = GetModuleHandleA( NULL ), dll;
+    const char *dll_name;
+    void *expect;
+    ULONG size;
+
+    descr = pRtlImageDirectoryEntryToData( module, TRUE, IMAGE_DIRECTORY_ENTRY_IMPORT, &size );
+    ok( descr != NULL, "no import directory\n" );
+    if (!descr) return;
+
+    for (; descr->Name && descr->FirstThunk; descr++)
+    {
+        dll_name = RVAToAddr( descr->Name, module );
+        dll = GetModuleHandleA( dll_name );
+        ok( dll != NULL, "%s not loaded\n", dll_name );
+        if (!dll || !U(*descr).OriginalFirstThunk) continue;
+
+        names = RVAToAddr( U(*descr).OriginalFirstThunk, module );
+        thunks = RVAToAddr( descr->FirstThunk, module );
+        for (; names->u1.AddressOfData; names++, thunks++)
+        {
+            if (IMAGE_SNAP_BY_ORDINAL( names->u1.Ordinal )) continue;
+            import = RVAToAddr( names->u1.AddressOfData, module );
+            expect = GetProcAddress( dll, (const char *)import->Name );
+            ok( (void *)thunks->u1.Function == expect, "%s.%s bound to %p, expected %p\n",
+                dll_name, import->Name, (void *)thunks->u1.Function, expect );
+        }
+    }
+}
+
+static void *image_rva_to_ptr( char *data, DWORD size, DWORD rva )
+{
+    IMAGE_NT_HEADERS *nt = (IMAGE_NT_HEADERS *)(data + ((IMAGE_DOS_HEADER *)data)->e_lfanew);
+    IMAGE_SECTION_HEADER *sec = IMAGE_FIRST_SECTION( nt );
+    DWORD i, offset;
+
+    for (i = 0; i < nt->FileHeader.NumberOfSections; i++)
+    {
+        if (rva < sec[i].VirtualAddress || rva >= sec[i].VirtualAddress + sec[i].SizeOfRawData) continue;
+        offset = rva - sec[i].VirtualAddress + sec[i].PointerToRawData;
+        return offset < size ? data + offset : NULL;
+    }
+    return NULL;
+}
+
+/* swap the names of two kernel32 imports of the same length, as if the exe had been rebuilt */
+static BOOL swap_image_imports( char *data, DWORD size, const char *name1, const char *name2 )
+{
+    IMAGE_NT_HEADERS *nt = (IMAGE_NT_HEADERS *)(data + ((IMAGE_DOS_HEADER *)data)->e_lfanew);
+    IMAGE_IMPORT_BY_NAME *import, *import1 = NULL, *import2 = NULL;
+    IMAGE_IMPORT_DESCRIPTOR *descr;
+    IMAGE_THUNK_DATA *thunk;
+    const char *dll_name;
+
+    descr = image_rva_to_ptr( data, size, nt->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT].VirtualAddress );
+    for (; descr && descr->Name; descr++)
+    {
+        if (!(dll_name = image_rva_to_ptr( data, size, descr->Name ))) continue;
+        if (lstrcmpiA( dll_name, "kernel32.dll" )) continue;
+        for (thunk = image_rva_to_ptr( data, size, U(*descr).OriginalFirstThunk );
+             thunk && thunk->u1.AddressOfData; thunk++)
+        {
+            if (IMAGE_SNAP_BY_ORDINAL( thunk->u1.Ordinal )) continue;
+            if (!(import = image_rva_to_ptr( data, size, thunk->u1.AddressOfData ))) continue;
+            if (!strcmp( (char *)import->Name, name1 )) import1 = import;
+            if (!strcmp( (char *)import->Name, name2 )) import2 = import;
+        }
+    }
+    if (!import1 || !import2) return FALSE;
+
+    memcpy( import1->Name, name2, strlen(name2) );
+    memcpy( import2->Name, name1, strlen(name1) );
+    nt->FileHeader.TimeDateStamp++;
+    return TRUE;
+}
+
+static void test_import_cache(void)
+{
+    /* functions not called before check_imports() */
+    static const char *swaps[][2] =
+    {
+        { "GetTempPathA", "CreateMutexA" },
+        { "GetTempFileNameA", "CreateDirectoryA" },
+    };
+    char temp_path[MAX_PATH], exe_name[MAX_PATH], cmdline[MAX_PATH + 32];
+    char **argv, *data;
+    DWORD size, ret, i;
+    HANDLE file;
+
+    winetest_get_mainargs( &argv );
+    GetTempPathA( MAX_PATH, temp_path );
+    sprintf( exe_name, "%sldrimports.exe", temp_path );
+    if (!CopyFileA( argv[0], exe_name, FALSE ))
+    {
+        skip( "failed to copy %s, error %u\n", argv[0], GetLastError() );
+        return;
+    }
+    sprintf( cmdline, "\"%s\" loader check_imports", exe_name );
+
+    /* the first run fills the cache, the next ones use it */
+    ret = spawn_child_process( cmdline );
+    ok( !ret, "expected exit code 0, got %u\n", ret );
+    ret = spawn_child_process( cmdline );
+    ok( !ret, "expected exit code 0, got %u\n", ret );
+    SetEnvironmentVariableA( "WINE_PARALLEL_LOADER", "1" );
+    ret = spawn_child_process( cmdline );
+    ok( !ret, "expected exit code 0, got %u\n", ret );
+    SetEnvironmentVariableA( "WINE_PARALLEL_LOADER", NULL );
+
+    /* rewrite the exe in place, so that it keeps its file id */
+    file = CreateFileA( exe_name, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, 0 );
+    ok( file != INVALID_HANDLE_VALUE, "failed to open %s, error %u\n", exe_name, GetLastError() );
+    size = GetFileSize( file, NULL );
+    data = HeapAlloc( GetProcessHeap(), 0, size );
+    ret = ReadFile( file, data, size, &size, NULL );
+    ok( ret, "ReadFile failed, error %u\n", GetLastError() );
+    for (i = 0; i < ARRAY_SIZE(swaps); i++)
+        if (swap_image_imports( data, size, swaps[i][0], swaps[i][1] )) break;
+    if (i < ARRAY_SIZE(swaps))
+    {
+        SetFilePointer( file, 0, NULL, FILE_BEGIN );
+        ret = WriteFile( file, data, size, &size, NULL );
+        ok( ret, "WriteFile failed, error %u\n", GetLastError() );
+    }
+    CloseHandle( file );
+    HeapFree( GetProcessHeap(), 0, data );
+
+    if (i < ARRAY_SIZE(swaps))
+    {
+        /* the stale bindings must be rejected, and the new ones cached */
+        ret = spawn_child_process( cmdline );
+        ok( !ret, "expected exit code 0, got %u\n", ret );
+        ret = spawn_child_process( cmdline );
+        ok( !ret, "expected exit code 0, got %u\n", ret );
+    }
+    else skip( "no imports to swap in %s\n", argv[0] );
+
+    DeleteFileA( exe_name );
+}
+
 START_TEST(loader)
 {
     int argc;
@@ -4013,6 +4219,11 @@ START_TEST(loader)
         *child_failures = -1;
 
     argc = winetest_get_mainargs(&argv);
+    if (argc > 2 && !strcmp(argv[2], "check_imports"))
+    {
+        check_imports();
+        return;
+    }
     if (argc > 4)
     {
         test_dll_phase = atoi(argv[4]);
@@ -4033,6 +4244,8 @@ START_TEST(loader)
     test_dll_file( "kernel32.dll", TRUE );
     test_dll_file( "advapi32.dll", TRUE );
     test_dll_file( "user32.dll", TRUE );
+    test_export_lookup();
+    test_import_cache();
     /* loader test must be last, it can corrupt the internal loader state on Windows */
     test_Loader();
 }
@@ -787,6 +787,67 @@ static void test_event(void)
     ok(ret, "got error %u\n", GetLastError());
 }
 
+static void test_many_events(void)
+{
+    static const int count = 1000000;
+    HANDLE *events, waits[MAXIMUM_WAIT_OBJECTS];
+    DWORD ret;
+    int i, created;
+
+    events = HeapAlloc(GetProcessHeap(), 0, count * sizeof(*events));
+
+    for (created = 0; created < count; created++)
+    {
+        /* alternate between auto-reset and manual-reset events */
+        if (!(events[created] = CreateEventA(NULL, created & 1, FALSE, NULL))) break;
+    }
+    ok(created == count, "failed to create event %d, error %u\n", created, GetLastError());
+
+    for (i = 0; i < created; i++)
+        if (!SetEvent(events[i])) break;
+    ok(i == created, "failed to set event %d, error %u\n", i, GetLastError());
+    for (i = 0; i < created; i++)
+        if ((ret = WaitForSingleObject(events[i], 0))) break;
+    ok(i == created, "wait for event %d returned %u\n", i, ret);
+
+    if (created >= 2)
+    {
+        ret = WaitForSingleObject(events[0], 0);
+        ok(ret == WAIT_TIMEOUT, "got %u\n", ret);
+        ret = WaitForSingleObject(events[1], 0);
+        ok(ret == WAIT_OBJECT_0, "got %u\n", ret);
+    }
+
+    /* actually block on some of them */
+    for (i = 0; i < created; i += 10000)
+    {
+        ResetEvent(events[i]);
+        ret = WaitForSingleObject(events[i], 1);
+        ok(ret == WAIT_TIMEOUT, "wait for event %d returned %u\n", i, ret);
+        SetEvent(events[i]);
+        ret = WaitForSingleObject(events[i], 1000);
+        ok(ret == WAIT_OBJECT_0, "wait for event %d returned %u\n", i, ret);
+    }
+
+    if (created >= MAXIMUM_WAIT_OBJECTS * 2)
+    {
+        for (i = 0; i < MAXIMUM_WAIT_OBJECTS; i++)
+        {
+            waits[i] = events[created - 2 * MAXIMUM_WAIT_OBJECTS + 2 * i];
+            ResetEvent(waits[i]);
+        }
+        ret = WaitForMultipleObjects(MAXIMUM_WAIT_OBJECTS, waits, FALSE, 1);
+        ok(ret == WAIT_TIMEOUT, "got %u\n", ret);
+        SetEvent(waits[MAXIMUM_WAIT_OBJECTS / 2]);
+        ret = WaitForMultipleObjects(MAXIMUM_WAIT_OBJECTS, waits, FALSE, 1000);
+        ok(ret == WAIT_OBJECT_0 + MAXIMUM_WAIT_OBJECTS / 2, "got %u\n", ret);
+    }
+
+    for (i = 0; i < created; i++)
+        CloseHandle(events[i]);
+    HeapFree(GetProcessHeap(), 0, events);
+}
+
 static void test_semaphore(void)
 {
     HANDLE handle, handle2, handles[2];
@@ -3156,6 +3217,79 @@ static void test_zigzag_event(void)
     trace("count: %d\n", zigzag_count[0]);
 }
 
+static HANDLE wait_any_events[MAXIMUM_WAIT_OBJECTS], wait_any_reply;
+static DWORD wait_any_count, wait_any_index;
+
+static DWORD CALLBACK wait_any_thread(void *arg)
+{
+    DWORD ret;
+
+    for (;;)
+    {
+        ret = WaitForMultipleObjects(wait_any_count, wait_any_events, FALSE, INFINITE);
+        if (ret == WAIT_OBJECT_0 + wait_any_count - 1) break;
+        wait_any_index = ret;
+        SetEvent(wait_any_reply);
+    }
+    return 0;
+}
+
+static void test_wait_any_count(DWORD count)
+{
+    HANDLE thread;
+    DWORD ret, i;
+
+    wait_any_count = count;
+    for (i = 0; i < count; i++)
+        wait_any_events[i] = CreateEventA(NULL, FALSE, FALSE, NULL);
+    wait_any_reply = CreateEventA(NULL, FALSE, FALSE, NULL);
+
+    thread = CreateThread(NULL, 0, wait_any_thread, NULL, 0, NULL);
+
+    /* signal each object but the last one in turn, and check that the
+     * blocked thread wakes up for that one */
+    for (i = 0; i < 4 * count; i++)
+    {
+        DWORD index = i % (count - 1);
+
+        SetEvent(wait_any_events[index]);
+        ret = WaitForSingleObject(wait_any_reply, 5000);
+        ok(!ret, "wait failed: %u\n", ret);
+        if (ret) break;
+        ok(wait_any_index == index, "expected %u, got %u\n", index, wait_any_index);
+    }
+
+    SetEvent(wait_any_events[count - 1]);
+    ret = WaitForSingleObject(thread, 5000);
+    ok(!ret, "wait failed: %u\n", ret);
+    CloseHandle(thread);
+
+    /* all the events were consumed by the thread */
+    ret = WaitForMultipleObjects(count, wait_any_events, FALSE, 0);
+    ok(ret == WAIT_TIMEOUT, "got %u\n", ret);
+
+    /* the lowest signaled index wins, and only that event is reset */
+    SetEvent(wait_any_events[count - 1]);
+    SetEvent(wait_any_events[0]);
+    ret = WaitForMultipleObjects(count, wait_any_events, FALSE, 0);
+    ok(ret == WAIT_OBJECT_0, "got %u\n", ret);
+    ret = WaitForMultipleObjects(count, wait_any_events, FALSE, 0);
+    ok(ret == WAIT_OBJECT_0 + count - 1, "got %u\n", ret);
+    ret = WaitForMultipleObjects(count, wait_any_events, FALSE, 0);
+    ok(ret == WAIT_TIMEOUT, "got %u\n", ret);
+
+    for (i = 0; i < count; i++)
+        CloseHandle(wait_any_events[i]);
+    CloseHandle(wait_any_reply);
+}
+
+static void test_wait_any(void)
+{
+    test_wait_any_count(2);
+    test_wait_any_count(16);
+    test_wait_any_count(MAXIMUM_WAIT_OBJECTS);
+}
+
 START_TEST(sync)
 {
     char **argv;
@@ -3203,6 +3337,7 @@ START_TEST(sync)
     test_mutex();
     test_slist();
     test_event();
+    test_many_events();
     test_semaphore();
     test_waitable_timer();
     test_iocp_callback();
@@ -3219,5 +3354,6 @@ START_TEST(sync)
     test_alertable_wait();
     test_apc_deadlock();
     test_zigzag_event();
+    test_wait_any();
     test_crit_section();
 }
@@ -1614,6 +1614,53 @@ static DWORD CALLBACK read_pipe( void *arg )
     return 0;
 }
 
+static void test_write_watch_gc(void)
+{
+    static const SIZE_T size = 64 * 1024 * 1024;
+    ULONG_PTR i, count, expect, pages = size / si.dwPageSize;
+    unsigned int cycle;
+    void **results;
+    ULONG granularity;
+    char *heap;
+    UINT ret;
+
+    if (!pGetWriteWatch || !pResetWriteWatch)
+    {
+        win_skip( "GetWriteWatch not supported\n" );
+        return;
+    }
+    heap = VirtualAlloc( NULL, size, MEM_RESERVE | MEM_COMMIT | MEM_WRITE_WATCH, PAGE_READWRITE );
+    if (!heap)
+    {
+        win_skip( "MEM_WRITE_WATCH not supported\n" );
+        return;
+    }
+    results = HeapAlloc( GetProcessHeap(), 0, pages * sizeof(*results) );
+
+    /* like a generational GC: dirty part of the heap, then collect and reset the dirty pages */
+    for (cycle = 0; cycle < 8; cycle++)
+    {
+        for (i = cycle, expect = 0; i < pages; i += 5, expect++) heap[i * si.dwPageSize + 8 * cycle] = cycle;
+
+        count = pages;
+        ret = pGetWriteWatch( WRITE_WATCH_FLAG_RESET, heap, size, results, &count, &granularity );
+        ok( !ret, "GetWriteWatch failed %u\n", GetLastError() );
+        ok( count == expect, "%u: got %lu pages, expected %lu\n", cycle, count, expect );
+        ok( granularity == si.dwPageSize, "got granularity %u\n", granularity );
+        for (i = 0; i < count; i++)
+            if (results[i] != heap + (cycle + 5 * i) * si.dwPageSize) break;
+        ok( i == count, "%u: wrong address %p at %lu\n", cycle, i < count ? results[i] : NULL, i );
+    }
+
+    count = pages;
+    ret = pGetWriteWatch( 0, heap, size, results, &count, &granularity );
+    ok( !ret, "GetWriteWatch failed %u\n", GetLastError() );
+    ok( !count, "got %lu pages after reset\n", count );
+
+    HeapFree( GetProcessHeap(), 0, results );
+    VirtualFree( heap, 0, MEM_RELEASE );
+}
+
 static void test_write_watch(void)
 {
     static const char pipename[] = "\\\\.\\pipe\\test_write_watch_pipe";
@@ -4208,6 +4255,121 @@ static void test_shared_memory_ro(BOOL is_child, DWORD child_access)
     CloseHandle(mapping);
 }
 
+static void test_large_pages(void)
+{
+    SIZE_T size, large = GetLargePageMinimum();
+    MEMORY_BASIC_INFORMATION info;
+    SIZE_T i, *data;
+    DWORD old_prot;
+    char *mem;
+    BOOL ret;
+
+    if (!large)
+    {
+        skip( "large pages not supported\n" );
+        return;
+    }
+    ok( !(large & (large - 1)), "large page size %#lx is not a power of 2\n", large );
+    size = 16 * large;
+
+    SetLastError( 0xdeadbeef );
+    mem = VirtualAlloc( NULL, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE );
+    if (!mem && GetLastError() == ERROR_PRIVILEGE_NOT_HELD)
+    {
+        skip( "no privilege to allocate large pages\n" );
+        return;
+    }
+    ok( mem != NULL, "VirtualAlloc failed %u\n", GetLastError() );
+    if (!mem) return;
+    ok( !((ULONG_PTR)mem & (large - 1)), "%p is not aligned to a large page\n", mem );
+
+    ret = VirtualQuery( mem + large + 1, &info, sizeof(info) );
+    ok( ret, "VirtualQuery failed %u\n", GetLastError() );
+    ok( info.BaseAddress == mem + large, "got base %p\n", info.BaseAddress );
+    ok( info.AllocationBase == mem, "got allocation base %p\n", info.AllocationBase );
+    ok( info.RegionSize == size - large, "got size %#lx\n", info.RegionSize );
+    ok( info.State == MEM_COMMIT, "got state %#x\n", info.State );
+    ok( info.Protect == PAGE_READWRITE, "got protection %#x\n", info.Protect );
+
+    ret = VirtualProtect( mem + large, large, PAGE_READONLY, &old_prot );
+    ok( ret, "VirtualProtect failed %u\n", GetLastError() );
+    ok( old_prot == PAGE_READWRITE, "got old protection %#x\n", old_prot );
+    ret = VirtualQuery( mem, &info, sizeof(info) );
+    ok( ret, "VirtualQuery failed %u\n", GetLastError() );
+    ok( info.RegionSize == large, "got size %#lx\n", info.RegionSize );
+    ret = VirtualProtect( mem + large, large, PAGE_READWRITE, &old_prot );
+    ok( ret, "VirtualProtect failed %u\n", GetLastError() );
+    ok( old_prot == PAGE_READONLY, "got old protection %#x\n", old_prot );
+
+    /* the memory starts zeroed, and keeps what is written to it */
+    data = (SIZE_T *)mem;
+    for (i = 0; i < size / sizeof(*data); i++) if (data[i]) break;
+    ok( i == size / sizeof(*data), "non-zero data at offset %#lx\n", i * sizeof(*data) );
+    for (i = 0; i < size / sizeof(*data); i++) data[i] = i;
+    for (i = 0; i < size / sizeof(*data); i++) if (data[i] != i) break;
+    ok( i == size / sizeof(*data), "wrong data at offset %#lx\n", i * sizeof(*data) );
+
+    ret = VirtualFree( mem, 0, MEM_RELEASE );
+    ok( ret, "VirtualFree failed %u\n", GetLastError() );
+
+    SetLastError( 0xdeadbeef );
+    mem = VirtualAlloc( NULL, large + 0x1000, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE );
+    ok( !mem, "VirtualAlloc succeeded\n" );
+    ok( GetLastError() == ERROR_INVALID_PARAMETER, "got error %u\n", GetLastError() );
+
+    SetLastError( 0xdeadbeef );
+    mem = VirtualAlloc( NULL, large, MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE );
+    ok( !mem, "VirtualAlloc succeeded\n" );
+    ok( GetLastError() == ERROR_INVALID_PARAMETER, "got error %u\n", GetLastError() );
+}
+
+static void test_VirtualQuery_regions(void)
+{
+    static const SIZE_T size = 256 * 1024 * 1024, chunk = 0x10000;
+    MEMORY_BASIC_INFORMATION info;
+    unsigned int i, count;
+    char *mem, *ptr;
+    void *ret;
+
+    mem = VirtualAlloc( NULL, size, MEM_RESERVE, PAGE_NOACCESS );
+    if (!mem)
+    {
+        skip( "cannot reserve %lu MB\n", size >> 20 );
+        return;
+    }
+
+    /* commit the start of each chunk, alternating protections */
+    for (i = 0; i < size / chunk; i++)
+    {
+        ret = VirtualAlloc( mem + i * chunk, (i % 3 + 1) * si.dwPageSize, MEM_COMMIT,
+                            (i & 1) ? PAGE_READONLY : PAGE_READWRITE );
+        ok( ret == mem + i * chunk, "%u: VirtualAlloc failed %u\n", i, GetLastError() );
+    }
+
+    for (ptr = mem, count = 0; ptr < mem + size; ptr += info.RegionSize, count++)
+    {
+        if (!VirtualQuery( ptr, &info, sizeof(info) )) break;
+        if (info.State == MEM_COMMIT)
+        {
+            i = (ptr - mem) / chunk;
+            ok( info.RegionSize == (i % 3 + 1) * si.dwPageSize, "%p: got size %#lx\n", ptr, info.RegionSize );
+            ok( info.Protect == ((i & 1) ? PAGE_READONLY : PAGE_READWRITE),
+                "%p: got protection %#x\n", ptr, info.Protect );
+        }
+        else ok( info.State == MEM_RESERVE, "%p: got state %#x\n", ptr, info.State );
+    }
+    ok( ptr == mem + size, "walk stopped at %p\n", ptr );
+    ok( count == 2 * size / chunk, "got %u regions\n", count );
+
+    ok( VirtualFree( mem, size, MEM_DECOMMIT ), "VirtualFree failed %u\n", GetLastError() );
+    VirtualQuery( mem, &info, sizeof(info) );
+    ok( info.AllocationBase == mem, "got allocation base %p\n", info.AllocationBase );
+    ok( info.RegionSize == size, "got size %#lx\n", info.RegionSize );
+    ok( info.State == MEM_RESERVE, "got state %#x\n", info.State );
+
+    VirtualFree( mem, 0, MEM_RELEASE );
+}
+
 START_TEST(virtual)
 {
     int argc;
@@ -4277,6 +4439,8 @@ START_TEST(virtual)
     test_VirtualProtect();
     test_VirtualAllocEx();
     test_VirtualAlloc();
+    test_large_pages();
+    test_VirtualQuery_regions();
     test_MapViewOfFile();
     test_NtAreMappedFilesTheSame();
     test_CreateFileMapping();
@@ -4284,6 +4448,7 @@ START_TEST(virtual)
     test_IsBadWritePtr();
     test_IsBadCodePtr();
     test_write_watch();
+    test_write_watch_gc();
 #if defined(__i386__) || defined(__x86_64__)
     test_stack_commit();
 #endif
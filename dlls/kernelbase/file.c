@@ -41,6 +41,7 @@
 
 #include "kernelbase.h"
 #include "wine/exception.h"
+#include "wine/fsctl.h"
 #include "wine/debug.h"
 
 #include "wine/heap.h"
@@ -493,6 +494,28 @@ BOOL WINAPI DECLSPEC_HOTPATCH AreFileApisANSI(void)
 }
 
 
+/* copy the file data without reading it ourselves, if the file system supports it */
+static BOOL copy_file_extents( HANDLE source, HANDLE dest, ULONGLONG size )
+{
+    DUPLICATE_EXTENTS_DATA data;
+    IO_STATUS_BLOCK io;
+    LARGE_INTEGER pos;
+    ULONGLONG copied;
+
+    data.FileHandle = source;
+    data.SourceFileOffset.QuadPart = 0;
+    data.TargetFileOffset.QuadPart = 0;
+    data.ByteCount.QuadPart = size;
+    if (NtFsControlFile( dest, 0, NULL, NULL, &io, FSCTL_WINE_COPY_FILE_DATA,
+                         &data, sizeof(data), &copied, sizeof(copied) ))
+        return FALSE;
+
+    /* anything appended to the source in the meantime is copied by the caller */
+    pos.QuadPart = copied;
+    return SetFilePointerEx( source, pos, NULL, FILE_BEGIN ) && SetFilePointerEx( dest, pos, NULL, FILE_BEGIN );
+}
+
+
 /***********************************************************************
  *	CopyFileExW   (kernelbase.@)
  */
@@ -563,6 +586,9 @@ BOOL WINAPI CopyFileExW( const WCHAR *source, const WCHAR *dest, LPPROGRESS_ROUT
         return FALSE;
     }
 
+    if (info.nFileSizeHigh || info.nFileSizeLow)
+        copy_file_extents( h1, h2, ((ULONGLONG)info.nFileSizeHigh << 32) | info.nFileSizeLow );
+
     while (ReadFile( h1, buffer, buffer_size, &count, NULL ) && count)
     {
         char *p = buffer;
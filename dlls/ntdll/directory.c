@@ -52,6 +52,7 @@ void init_directories(void)
 {
     static const WCHAR WineW[] = {'S','o','f','t','w','a','r','e','\\','W','i','n','e',0};
     static const WCHAR ShowDotFilesW[] = {'S','h','o','w','D','o','t','F','i','l','e','s',0};
+    static const WCHAR SortDirectoriesW[] = {'S','o','r','t','D','i','r','e','c','t','o','r','i','e','s',0};
     char tmp[80];
     HANDLE root, hkey;
     DWORD dummy;
@@ -76,6 +77,13 @@ void init_directories(void)
             WCHAR *str = (WCHAR *)((KEY_VALUE_PARTIAL_INFORMATION *)tmp)->Data;
             show_dot_files = IS_OPTION_TRUE( str[0] );
         }
+        /* by default, only directories too large to be sorted quickly are returned unsorted */
+        RtlInitUnicodeString( &nameW, SortDirectoriesW );
+        if (!NtQueryValueKey( hkey, &nameW, KeyValuePartialInformation, tmp, sizeof(tmp), &dummy ))
+        {
+            WCHAR *str = (WCHAR *)((KEY_VALUE_PARTIAL_INFORMATION *)tmp)->Data;
+            unix_funcs->set_sort_directories( IS_OPTION_TRUE( str[0] ));
+        }
         NtClose( hkey );
     }
     NtClose( root );
@@ -87,6 +87,8 @@ typedef struct
 #define ARENA_PENDING_MAGIC    0xbedead
 #define ARENA_FREE_MAGIC       0x45455246
 #define ARENA_LARGE_MAGIC      0x6752614c
+#define ARENA_LFH_MAGIC        0x48464c
+#define ARENA_LFH_FREE_MAGIC   0x46464c
 
 #define ARENA_INUSE_FILLER     0x55
 #define ARENA_TAIL_FILLER      0xab
@@ -164,6 +166,7 @@ typedef struct tagHEAP
     struct list     *freeList;      /* Free lists */
     struct wine_rb_tree freeTree;   /* Free tree */
     DWORD            freeMask[HEAP_NB_FREE_LISTS / (8 * sizeof(DWORD))];
+    struct lfh_bin  *lfh;           /* Low fragmentation heap bins, if enabled */
 } HEAP;
 
 #define HEAP_FREEMASK_BLOCK    (8 * sizeof(DWORD))
@@ -184,9 +187,55 @@ C_ASSERT( HEAP_NB_FREE_LISTS % HEAP_FREEMASK_BLOCK == 0 );
 #define HEAP_VALIDATE_ALL     0x20000000
 #define HEAP_VALIDATE_PARAMS  0x40000000
 
+/* Low fragmentation heap front end
+ *
+ * Small blocks are carved out of groups of same-sized blocks, which are
+ * themselves allocated as regular arenas. Each size class (bin) keeps a
+ * lock-free list of the groups that have free blocks, plus a few per-thread
+ * slots so that threads mostly work on different groups. A group belongs
+ * to whoever took it out of a list, and only the owner may allocate from
+ * it; blocks are returned by setting their bit in free_bits, from any thread.
+ */
+
+/* block sizes up to LFH_SMALL_SIZE are rounded to ALIGNMENT, bigger ones to LFH_LARGE_STEP */
+#define LFH_SMALL_SIZE        0x400
+#define LFH_LARGE_STEP        0x80
+#define LFH_MAX_SIZE          0x4000
+#define LFH_BIN_COUNT         (LFH_SMALL_SIZE / ALIGNMENT + (LFH_MAX_SIZE - LFH_SMALL_SIZE) / LFH_LARGE_STEP + 1)
+#define LFH_AFFINITY_SLOTS    16
+#define LFH_GROUP_SIZE        0x10000  /* target size of the blocks of a group */
+#define LFH_GROUP_MAX_BLOCKS  31
+#define LFH_GROUP_DETACHED    0x80000000  /* full group, not in any list */
+#define LFH_GROUP_MAGIC       ((DWORD)('L' | ('F'<<8) | ('H'<<16) | ('G'<<24)))
+
+struct lfh_group
+{
+    SLIST_ENTRY      entry;       /* entry in the bin free groups list */
+    HEAP            *heap;        /* heap the group belongs to */
+    struct lfh_bin  *bin;         /* bin the group belongs to */
+    DWORD            magic;       /* magic number */
+    DWORD            block_size;  /* data size of the blocks */
+    DWORD            count;       /* number of blocks */
+    LONG             free_bits;   /* bitmap of free blocks */
+};
+
+/* offset of the first block arena in a group */
+#define LFH_GROUP_HEADER_SIZE (((sizeof(struct lfh_group) + ALIGNMENT - 1) & ~(ALIGNMENT - 1)) + ARENA_OFFSET)
+
+struct lfh_bin
+{
+    SLIST_HEADER       groups;      /* groups that have free blocks */
+    struct lfh_group  *affinity[LFH_AFFINITY_SLOTS];  /* groups owned by thread slots */
+    DWORD              block_size;  /* data size of the blocks */
+};
+
+/* the rounding slack must fit in the unused_bytes field of the arena */
+C_ASSERT( LFH_LARGE_STEP + ARENA_OFFSET + HEAP_TAIL_EXTRA_SIZE <= 0x100 );
+
 static HEAP *processHeap;  /* main process heap */
 
 static BOOL HEAP_IsRealArena( HEAP *heapPtr, DWORD flags, LPCVOID block, BOOL quiet );
+static struct lfh_group *lfh_get_group( const HEAP *heap, const ARENA_INUSE *arena );
 
 /* get arena size for an rb tree entry */
 static inline DWORD get_arena_size( const struct wine_rb_entry *entry )
@@ -1481,6 +1530,7 @@ static BOOL HEAP_IsRealArena( HEAP *heapPtr,   /* [in] ptr to the heap */
             }
             else ret = validate_large_arena( heapPtr, large_arena, quiet );
         }
+        else if (heapPtr->lfh && lfh_get_group( heapPtr, arena )) ret = TRUE;
         else ret = HEAP_ValidateInUseArena( subheap, arena, quiet );
         goto done;
     }
@@ -1544,7 +1594,7 @@ static BOOL validate_block_pointer( HEAP *heap, SUBHEAP **ret_subheap, const ARE
         ret = HEAP_ValidateInUseArena( subheap, arena, QUIET );
     else if ((ULONG_PTR)arena % ALIGNMENT != ARENA_OFFSET)
         WARN( "Heap %p: unaligned arena pointer %p\n", subheap->heap, arena );
-    else if (arena->magic == ARENA_PENDING_MAGIC)
+    else if (arena->magic == ARENA_PENDING_MAGIC || arena->magic == ARENA_LFH_FREE_MAGIC)
         WARN( "Heap %p: block %p used after free\n", subheap->heap, arena + 1 );
     else if (arena->magic != ARENA_INUSE_MAGIC)
         WARN( "Heap %p: invalid in-use arena magic %08x for %p\n", subheap->heap, arena->magic, arena );
@@ -1562,6 +1612,325 @@ static BOOL validate_block_pointer( HEAP *heap, SUBHEAP **ret_subheap, const ARE
 }
 
 
+/***********************************************************************
+ *           heap_allocate_block
+ *
+ * Allocate a block from the sub-heaps or as a large block. Heap must be locked.
+ */
+static void *heap_allocate_block( HEAP *heap, DWORD flags, SIZE_T size, SIZE_T rounded_size )
+{
+    ARENA_FREE *pArena;
+    ARENA_INUSE *pInUse;
+    SUBHEAP *subheap;
+
+    if (rounded_size >= HEAP_MIN_LARGE_BLOCK_SIZE && (flags & HEAP_GROWABLE))
+        return allocate_large_block( heap, flags, size );
+
+    /* Locate a suitable free block */
+
+    if (!(pArena = HEAP_FindFreeBlock( heap, rounded_size, &subheap ))) return NULL;
+
+    /* Remove the arena from the free list */
+
+    HEAP_DeleteFreeBlock( heap, pArena );
+
+    /* Build the in-use arena */
+
+    pInUse = (ARENA_INUSE *)pArena;
+
+    /* in-use arena is smaller than free arena,
+     * so we have to add the difference to the size */
+    pInUse->size  = (pInUse->size & ~ARENA_FLAG_FREE) + sizeof(ARENA_FREE) - sizeof(ARENA_INUSE);
+    pInUse->magic = ARENA_INUSE_MAGIC;
+
+    /* Shrink the block */
+
+    HEAP_ShrinkBlock( subheap, pInUse, rounded_size );
+    pInUse->unused_bytes = (pInUse->size & ARENA_SIZE_MASK) - size;
+
+    notify_alloc( pInUse + 1, size, flags & HEAP_ZERO_MEMORY );
+    initialize_block( pInUse + 1, size, pInUse->unused_bytes, flags );
+    return pInUse + 1;
+}
+
+
+/* get the LFH bin index for a given rounded block size */
+static inline unsigned int lfh_get_bin_index( SIZE_T rounded_size )
+{
+    SIZE_T size = rounded_size - ARENA_OFFSET;
+
+    if (size <= LFH_SMALL_SIZE) return size / ALIGNMENT;
+    return LFH_SMALL_SIZE / ALIGNMENT + (size - LFH_SMALL_SIZE + LFH_LARGE_STEP - 1) / LFH_LARGE_STEP;
+}
+
+/* get the block data size used by a given LFH bin */
+static inline DWORD lfh_get_bin_block_size( unsigned int index )
+{
+    if (index <= LFH_SMALL_SIZE / ALIGNMENT) return index * ALIGNMENT + ARENA_OFFSET;
+    return LFH_SMALL_SIZE + (index - LFH_SMALL_SIZE / ALIGNMENT) * LFH_LARGE_STEP + ARENA_OFFSET;
+}
+
+/* get the arena of a block in an LFH group */
+static inline ARENA_INUSE *lfh_get_group_block( const struct lfh_group *group, unsigned int index )
+{
+    return (ARENA_INUSE *)((char *)group + LFH_GROUP_HEADER_SIZE +
+                           index * (sizeof(ARENA_INUSE) + group->block_size));
+}
+
+/* get the per-thread group slot of the current thread */
+static inline unsigned int lfh_get_affinity_slot(void)
+{
+    static LONG next_affinity;
+    ULONG affinity = NtCurrentTeb()->HeapVirtualAffinity;
+
+    if (!affinity)
+    {
+        while (!(affinity = InterlockedIncrement( &next_affinity ))) ;
+        NtCurrentTeb()->HeapVirtualAffinity = affinity;
+    }
+    return affinity % LFH_AFFINITY_SLOTS;
+}
+
+
+/***********************************************************************
+ *           lfh_get_group
+ *
+ * Return the LFH group containing an in-use block, or NULL if the block
+ * doesn't come from the LFH of this heap.
+ */
+static struct lfh_group *lfh_get_group( const HEAP *heap, const ARENA_INUSE *arena )
+{
+    const struct lfh_group *group;
+    DWORD offset;
+
+    if ((ULONG_PTR)arena % ALIGNMENT != ARENA_OFFSET) return NULL;
+    if (arena->magic != ARENA_LFH_MAGIC) return NULL;
+
+    offset = arena->size;
+    if (offset < LFH_GROUP_HEADER_SIZE || offset > LFH_GROUP_HEADER_SIZE +
+        (LFH_GROUP_MAX_BLOCKS - 1) * (sizeof(ARENA_INUSE) + lfh_get_bin_block_size( LFH_BIN_COUNT - 1 )))
+        return NULL;
+
+    group = (const struct lfh_group *)((const char *)arena - offset);
+    if (group->magic != LFH_GROUP_MAGIC || group->heap != heap) return NULL;
+    if ((offset - LFH_GROUP_HEADER_SIZE) % (sizeof(ARENA_INUSE) + group->block_size)) return NULL;
+    if ((offset - LFH_GROUP_HEADER_SIZE) / (sizeof(ARENA_INUSE) + group->block_size) >= group->count)
+        return NULL;
+    return (struct lfh_group *)group;
+}
+
+
+/***********************************************************************
+ *           lfh_create_group
+ *
+ * Allocate a new group for an LFH bin. The caller owns the group.
+ */
+static struct lfh_group *lfh_create_group( HEAP *heap, struct lfh_bin *bin )
+{
+    struct lfh_group *group;
+    SIZE_T stride = sizeof(ARENA_INUSE) + bin->block_size;
+    DWORD i, count = min( LFH_GROUP_MAX_BLOCKS, max( 1, LFH_GROUP_SIZE / stride ));
+    SIZE_T size = LFH_GROUP_HEADER_SIZE + count * stride;
+
+    RtlEnterCriticalSection( &heap->critSection );
+    group = heap_allocate_block( heap, heap->flags, size, ROUND_SIZE( size ));
+    RtlLeaveCriticalSection( &heap->critSection );
+    if (!group) return NULL;
+
+    group->heap       = heap;
+    group->bin        = bin;
+    group->magic      = LFH_GROUP_MAGIC;
+    group->block_size = bin->block_size;
+    group->count      = count;
+    group->free_bits  = (1u << count) - 1;
+    for (i = 0; i < count; i++)
+    {
+        ARENA_INUSE *arena = lfh_get_group_block( group, i );
+        arena->size  = (char *)arena - (char *)group;
+        arena->magic = ARENA_LFH_FREE_MAGIC;
+        arena->unused_bytes = 0;
+    }
+
+    TRACE( "heap %p: created group %p with %u blocks of %u bytes\n", heap, group, count, group->block_size );
+    return group;
+}
+
+
+/***********************************************************************
+ *           lfh_acquire_group
+ *
+ * Take ownership of a group with, hopefully, some free blocks in it.
+ *
+ * Groups are pushed to the bin list without locking, but popped only with
+ * the heap lock held. With a single consumer, no thread can be holding a
+ * stale list head while another one pops it, releases the group and pushes
+ * the same address again, so the list is not subject to ABA races.
+ */
+static struct lfh_group *lfh_acquire_group( HEAP *heap, struct lfh_bin *bin, unsigned int slot )
+{
+    struct lfh_group *group;
+
+    if ((group = InterlockedExchangePointer( (void **)&bin->affinity[slot], NULL ))) return group;
+
+    RtlEnterCriticalSection( &heap->critSection );
+    while ((group = (struct lfh_group *)RtlInterlockedPopEntrySList( &bin->groups )))
+    {
+        /* keep a single completely free group around, release the others */
+        if (group->free_bits != (1u << group->count) - 1 || !RtlQueryDepthSList( &bin->groups ))
+            break;
+        TRACE( "heap %p: releasing group %p\n", heap, group );
+        group->magic = 0;
+        RtlFreeHeap( heap, 0, group );
+    }
+    RtlLeaveCriticalSection( &heap->critSection );
+
+    return group ? group : lfh_create_group( heap, bin );
+}
+
+
+/***********************************************************************
+ *           lfh_allocate_block
+ */
+static void *lfh_allocate_block( HEAP *heap, DWORD flags, SIZE_T size, SIZE_T rounded_size )
+{
+    struct lfh_bin *bin = heap->lfh + lfh_get_bin_index( rounded_size );
+    unsigned int slot = lfh_get_affinity_slot();
+    struct lfh_group *group, *prev;
+    ARENA_INUSE *arena;
+    LONG bits, old;
+    DWORD index;
+
+    for (;;)
+    {
+        if (!(group = lfh_acquire_group( heap, bin, slot ))) return NULL;
+
+        /* other threads may free blocks concurrently, but only the owner can allocate them */
+        if ((bits = group->free_bits)) break;
+        /* the group is full, it will be put back in the list when one of its blocks is freed */
+        if (!(bits = InterlockedCompareExchange( &group->free_bits, LFH_GROUP_DETACHED, 0 ))) continue;
+        break;
+    }
+
+    BitScanForward( &index, bits );
+    do old = group->free_bits;
+    while (InterlockedCompareExchange( &group->free_bits, old & ~(1u << index), old ) != old);
+
+    /* give the group back to our slot, the previous one goes to the shared list */
+    if ((prev = InterlockedExchangePointer( (void **)&bin->affinity[slot], group )))
+        RtlInterlockedPushEntrySList( &bin->groups, &prev->entry );
+
+    arena = lfh_get_group_block( group, index );
+    arena->magic = ARENA_LFH_MAGIC;
+    arena->unused_bytes = bin->block_size - size;
+
+    notify_alloc( arena + 1, size, flags & HEAP_ZERO_MEMORY );
+    initialize_block( arena + 1, size, arena->unused_bytes, flags );
+    return arena + 1;
+}
+
+
+/***********************************************************************
+ *           lfh_free_block
+ *
+ * Return a block to its group. This can be called from any thread.
+ */
+static void lfh_free_block( HEAP *heap, DWORD flags, struct lfh_group *group, ARENA_INUSE *arena )
+{
+    unsigned int index = (arena->size - LFH_GROUP_HEADER_SIZE) / (sizeof(ARENA_INUSE) + group->block_size);
+    LONG old, bits;
+
+    notify_free( arena + 1 );
+    arena->magic = ARENA_LFH_FREE_MAGIC;
+    mark_block_free( arena + 1, group->block_size, flags );
+
+    do
+    {
+        old = group->free_bits;
+        bits = (old | (1u << index)) & ~LFH_GROUP_DETACHED;
+    }
+    while (InterlockedCompareExchange( &group->free_bits, bits, old ) != old);
+
+    /* the group was full and nobody owned it, it's ours to publish again */
+    if (old & LFH_GROUP_DETACHED) RtlInterlockedPushEntrySList( &group->bin->groups, &group->entry );
+}
+
+
+/***********************************************************************
+ *           lfh_realloc_block
+ */
+static void *lfh_realloc_block( HEAP *heap, DWORD flags, struct lfh_group *group,
+                                ARENA_INUSE *arena, SIZE_T size )
+{
+    SIZE_T old_size = group->block_size - arena->unused_bytes;
+    SIZE_T rounded_size = ROUND_SIZE(size) + HEAP_TAIL_EXTRA_SIZE;
+    void *ret;
+
+    if (rounded_size < size) goto oom;  /* overflow */
+    if (rounded_size < HEAP_MIN_DATA_SIZE) rounded_size = HEAP_MIN_DATA_SIZE;
+
+    if (rounded_size <= group->block_size && group->block_size - size <= 0xff)
+    {
+        notify_realloc( arena + 1, old_size, size );
+        arena->unused_bytes = group->block_size - size;
+        if (size > old_size)
+            initialize_block( (char *)(arena + 1) + old_size, size - old_size, arena->unused_bytes, flags );
+        else
+            mark_block_tail( (char *)(arena + 1) + size, arena->unused_bytes, flags );
+        return arena + 1;
+    }
+
+    if (flags & HEAP_REALLOC_IN_PLACE_ONLY) goto oom;
+    if (!(ret = RtlAllocateHeap( heap, flags & ~HEAP_ZERO_MEMORY, size ))) goto oom;
+    memcpy( ret, arena + 1, min( old_size, size ));
+    if (size > old_size && (flags & HEAP_ZERO_MEMORY)) memset( (char *)ret + old_size, 0, size - old_size );
+    lfh_free_block( heap, flags, group, arena );
+    return ret;
+
+oom:
+    if (flags & HEAP_GENERATE_EXCEPTIONS) RtlRaiseStatus( STATUS_NO_MEMORY );
+    RtlSetLastWin32ErrorAndNtStatusFromNtStatus( STATUS_NO_MEMORY );
+    return NULL;
+}
+
+
+/***********************************************************************
+ *           lfh_enable
+ */
+static NTSTATUS lfh_enable( HEAP *heap )
+{
+    struct lfh_bin *bins;
+    SIZE_T size = LFH_BIN_COUNT * sizeof(*bins);
+    unsigned int i;
+
+    if (heap->lfh) return STATUS_SUCCESS;
+
+    /* like on Windows, no LFH for non-serialized, fixed size or debug heaps */
+    if ((heap->flags & (HEAP_NO_SERIALIZE | HEAP_PAGE_ALLOCS | HEAP_VALIDATE |
+                        HEAP_TAIL_CHECKING_ENABLED | HEAP_FREE_CHECKING_ENABLED)) ||
+        !(heap->flags & HEAP_GROWABLE) || RUNNING_ON_VALGRIND)
+        return STATUS_UNSUCCESSFUL;
+
+    RtlEnterCriticalSection( &heap->critSection );
+    if (!heap->lfh)
+    {
+        if (!(bins = heap_allocate_block( heap, heap->flags | HEAP_ZERO_MEMORY, size, ROUND_SIZE( size ))))
+        {
+            RtlLeaveCriticalSection( &heap->critSection );
+            return STATUS_NO_MEMORY;
+        }
+        for (i = 0; i < LFH_BIN_COUNT; i++)
+        {
+            RtlInitializeSListHead( &bins[i].groups );
+            bins[i].block_size = lfh_get_bin_block_size( i );
+        }
+        InterlockedExchangePointer( (void **)&heap->lfh, bins );
+        TRACE( "heap %p: enabled low fragmentation heap\n", heap );
+    }
+    RtlLeaveCriticalSection( &heap->critSection );
+    return STATUS_SUCCESS;
+}
+
+
 /***********************************************************************
  *           heap_set_debug_flags
  */
@@ -1769,11 +2138,9 @@ HANDLE WINAPI RtlDestroyHeap( HANDLE heap )
  */
 void * WINAPI DECLSPEC_HOTPATCH RtlAllocateHeap( HANDLE heap, ULONG flags, SIZE_T size )
 {
-    ARENA_FREE *pArena;
-    ARENA_INUSE *pInUse;
-    SUBHEAP *subheap;
     HEAP *heapPtr = HEAP_GetPtr( heap );
     SIZE_T rounded_size;
+    void *ret;
 
     /* Validate the parameters */
 
@@ -1788,53 +2155,20 @@ void * WINAPI DECLSPEC_HOTPATCH RtlAllocateHeap( HANDLE heap, ULONG flags, SIZE_
     }
     if (rounded_size < HEAP_MIN_DATA_SIZE) rounded_size = HEAP_MIN_DATA_SIZE;
 
-    if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
-
-    if (rounded_size >= HEAP_MIN_LARGE_BLOCK_SIZE && (flags & HEAP_GROWABLE))
+    if (heapPtr->lfh && rounded_size - ARENA_OFFSET <= LFH_MAX_SIZE &&
+        (ret = lfh_allocate_block( heapPtr, flags, size, rounded_size )))
     {
-        void *ret = allocate_large_block( heap, flags, size );
-        if (!(flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heapPtr->critSection );
-        if (!ret && (flags & HEAP_GENERATE_EXCEPTIONS)) RtlRaiseStatus( STATUS_NO_MEMORY );
         TRACE("(%p,%08x,%08lx): returning %p\n", heap, flags, size, ret );
         return ret;
     }
 
-    /* Locate a suitable free block */
-
-    if (!(pArena = HEAP_FindFreeBlock( heapPtr, rounded_size, &subheap )))
-    {
-        TRACE("(%p,%08x,%08lx): returning NULL\n",
-                  heap, flags, size  );
-        if (!(flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heapPtr->critSection );
-        if (flags & HEAP_GENERATE_EXCEPTIONS) RtlRaiseStatus( STATUS_NO_MEMORY );
-        return NULL;
-    }
-
-    /* Remove the arena from the free list */
-
-    HEAP_DeleteFreeBlock( heapPtr, pArena );
-
-    /* Build the in-use arena */
-
-    pInUse = (ARENA_INUSE *)pArena;
-
-    /* in-use arena is smaller than free arena,
-     * so we have to add the difference to the size */
-    pInUse->size  = (pInUse->size & ~ARENA_FLAG_FREE) + sizeof(ARENA_FREE) - sizeof(ARENA_INUSE);
-    pInUse->magic = ARENA_INUSE_MAGIC;
-
-    /* Shrink the block */
-
-    HEAP_ShrinkBlock( subheap, pInUse, rounded_size );
-    pInUse->unused_bytes = (pInUse->size & ARENA_SIZE_MASK) - size;
-
-    notify_alloc( pInUse + 1, size, flags & HEAP_ZERO_MEMORY );
-    initialize_block( pInUse + 1, size, pInUse->unused_bytes, flags );
-
+    if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
+    ret = heap_allocate_block( heapPtr, flags, size, rounded_size );
     if (!(flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heapPtr->critSection );
 
-    TRACE("(%p,%08x,%08lx): returning %p\n", heap, flags, size, pInUse + 1 );
-    return pInUse + 1;
+    if (!ret && (flags & HEAP_GENERATE_EXCEPTIONS)) RtlRaiseStatus( STATUS_NO_MEMORY );
+    TRACE("(%p,%08x,%08lx): returning %p\n", heap, flags, size, ret );
+    return ret;
 }
 
 
@@ -1854,6 +2188,7 @@ void * WINAPI DECLSPEC_HOTPATCH RtlAllocateHeap( HANDLE heap, ULONG flags, SIZE_
  */
 BOOLEAN WINAPI DECLSPEC_HOTPATCH RtlFreeHeap( HANDLE heap, ULONG flags, void *ptr )
 {
+    struct lfh_group *group;
     ARENA_INUSE *pInUse;
     SUBHEAP *subheap;
     HEAP *heapPtr;
@@ -1871,13 +2206,21 @@ BOOLEAN WINAPI DECLSPEC_HOTPATCH RtlFreeHeap( HANDLE heap, ULONG flags, void *pt
 
     flags &= HEAP_NO_SERIALIZE;
     flags |= heapPtr->flags;
+
+    pInUse  = (ARENA_INUSE *)ptr - 1;
+    if (heapPtr->lfh && (group = lfh_get_group( heapPtr, pInUse )))
+    {
+        lfh_free_block( heapPtr, flags, group, pInUse );
+        TRACE("(%p,%08x,%p): returning TRUE\n", heap, flags, ptr );
+        return TRUE;
+    }
+
     if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
 
     /* Inform valgrind we are trying to free memory, so it can throw up an error message */
     notify_free( ptr );
 
     /* Some sanity checks */
-    pInUse  = (ARENA_INUSE *)ptr - 1;
     if (!validate_block_pointer( heapPtr, &subheap, pInUse )) goto error;
 
     if (!subheap)
@@ -1914,6 +2257,7 @@ error:
  */
 PVOID WINAPI RtlReAllocateHeap( HANDLE heap, ULONG flags, PVOID ptr, SIZE_T size )
 {
+    struct lfh_group *group;
     ARENA_INUSE *pArena;
     HEAP *heapPtr;
     SUBHEAP *subheap;
@@ -1932,13 +2276,21 @@ PVOID WINAPI RtlReAllocateHeap( HANDLE heap, ULONG flags, PVOID ptr, SIZE_T size
     flags &= HEAP_GENERATE_EXCEPTIONS | HEAP_NO_SERIALIZE | HEAP_ZERO_MEMORY |
              HEAP_REALLOC_IN_PLACE_ONLY;
     flags |= heapPtr->flags;
+
+    pArena = (ARENA_INUSE *)ptr - 1;
+    if (heapPtr->lfh && (group = lfh_get_group( heapPtr, pArena )))
+    {
+        ret = lfh_realloc_block( heapPtr, flags, group, pArena, size );
+        TRACE("(%p,%08x,%p,%08lx): returning %p\n", heap, flags, ptr, size, ret );
+        return ret;
+    }
+
     if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
 
     rounded_size = ROUND_SIZE(size) + HEAP_TAIL_EXTRA_SIZE;
     if (rounded_size < size) goto oom;  /* overflow */
     if (rounded_size < HEAP_MIN_DATA_SIZE) rounded_size = HEAP_MIN_DATA_SIZE;
 
-    pArena = (ARENA_INUSE *)ptr - 1;
     if (!validate_block_pointer( heapPtr, &subheap, pArena )) goto error;
     if (!subheap)
     {
@@ -2130,6 +2482,7 @@ BOOLEAN WINAPI RtlUnlockHeap( HANDLE heap )
 SIZE_T WINAPI RtlSizeHeap( HANDLE heap, ULONG flags, const void *ptr )
 {
     SIZE_T ret;
+    struct lfh_group *group;
     const ARENA_INUSE *pArena;
     SUBHEAP *subheap;
     HEAP *heapPtr = HEAP_GetPtr( heap );
@@ -2141,9 +2494,17 @@ SIZE_T WINAPI RtlSizeHeap( HANDLE heap, ULONG flags, const void *ptr )
     }
     flags &= HEAP_NO_SERIALIZE;
     flags |= heapPtr->flags;
-    if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
 
     pArena = (const ARENA_INUSE *)ptr - 1;
+    if (heapPtr->lfh && (group = lfh_get_group( heapPtr, pArena )))
+    {
+        ret = group->block_size - pArena->unused_bytes;
+        TRACE("(%p,%08x,%p): returning %08lx\n", heap, flags, ptr, ret );
+        return ret;
+    }
+
+    if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
+
     if (!validate_block_pointer( heapPtr, &subheap, pArena ))
     {
         RtlSetLastWin32ErrorAndNtStatusFromNtStatus( STATUS_INVALID_PARAMETER );
@@ -2351,6 +2712,8 @@ ULONG WINAPI RtlGetProcessHeaps( ULONG count, HANDLE *heaps )
 NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS info_class,
                                          PVOID info, SIZE_T size_in, PSIZE_T size_out)
 {
+    HEAP *heapPtr;
+
     switch (info_class)
     {
     case HeapCompatibilityInformation:
@@ -2359,7 +2722,8 @@ NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS inf
         if (size_in < sizeof(ULONG))
             return STATUS_BUFFER_TOO_SMALL;
 
-        *(ULONG *)info = 0; /* standard heap */
+        heapPtr = HEAP_GetPtr( heap );
+        *(ULONG *)info = heapPtr && heapPtr->lfh ? 2 : 0; /* low fragmentation or standard heap */
         return STATUS_SUCCESS;
 
     default:
@@ -2373,6 +2737,20 @@ NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS inf
  */
 NTSTATUS WINAPI RtlSetHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS info_class, PVOID info, SIZE_T size)
 {
+    HEAP *heapPtr;
+
+    switch (info_class)
+    {
+    case HeapCompatibilityInformation:
+        if (size < sizeof(ULONG)) return STATUS_BUFFER_TOO_SMALL;
+        if (*(ULONG *)info != 2) break;
+        if (!(heapPtr = HEAP_GetPtr( heap ))) return STATUS_INVALID_HANDLE;
+        return lfh_enable( heapPtr );
+
+    default:
+        break;
+    }
+
     FIXME("%p %d %p %ld stub\n", heap, info_class, info, size);
     return STATUS_SUCCESS;
 }
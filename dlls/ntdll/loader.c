@@ -79,6 +79,8 @@ static const WCHAR dotW[] = {'.',0};
 
 static BOOL imports_fixup_done = FALSE;  /* set once the imports have been fixed up, before attaching them */
 static BOOL process_detaching = FALSE;  /* set on process detach to avoid deadlocks with thread detach */
+static BOOL startup_timing;  /* set to measure the phases of process startup */
+static ULONGLONG startup_map_time, startup_reloc_time;  /* time spent mapping and relocating dlls */
 static int free_lib_count;   /* recursion depth of LdrUnloadDll calls */
 static ULONG path_safe_mode;  /* path mode set by RtlSetSearchPathMode */
 static ULONG dll_safe_mode = 1;  /* dll search mode */
@@ -119,6 +121,12 @@ struct file_id
     BYTE ObjectId[16];
 };
 
+struct export_hash_entry
+{
+    DWORD hash;   /* hash of the exported name */
+    DWORD index;  /* index in the names array plus one, 0 for free entries */
+};
+
 /* internal representation of loaded modules */
 typedef struct _wine_modref
 {
@@ -127,8 +135,14 @@ typedef struct _wine_modref
     int                   alloc_deps;
     int                   nDeps;
     struct _wine_modref **deps;
+    unsigned int          export_lookups;    /* number of exports looked up by name */
+    unsigned int          export_hash_mask;  /* size of the exports hash table minus one */
+    struct export_hash_entry *export_hash;   /* hash table of exported names */
 } WINE_MODREF;
 
+/* number of lookups by name after which a module gets a hash table of its exports */
+#define EXPORT_HASH_THRESHOLD  64
+
 static UINT tls_module_count;      /* number of modules with TLS directory */
 static IMAGE_TLS_DIRECTORY *tls_dirs;  /* array of TLS directories */
 LIST_ENTRY tls_links = { &tls_links, &tls_links };
@@ -181,11 +195,23 @@ static WINE_MODREF *last_failed_modref;
 static NTSTATUS load_dll( const WCHAR *load_path, const WCHAR *libname, const WCHAR *default_ext,
                           DWORD flags, WINE_MODREF** pwm );
 static NTSTATUS process_attach( WINE_MODREF *wm, LPVOID lpReserved );
+static WCHAR *get_env( const WCHAR *var );
+static void preload_imports( WINE_MODREF *wm, const IMAGE_IMPORT_DESCRIPTOR *imports, int count,
+                             LPCWSTR load_path );
 static FARPROC find_ordinal_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *exports,
                                     DWORD exp_size, DWORD ordinal, LPCWSTR load_path );
-static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *exports,
+static FARPROC find_named_export( WINE_MODREF *wm, const IMAGE_EXPORT_DIRECTORY *exports,
                                   DWORD exp_size, const char *name, int hint, LPCWSTR load_path );
 
+static inline ULONGLONG get_startup_counter(void)
+{
+    LARGE_INTEGER counter;
+
+    if (!startup_timing) return 0;
+    NtQueryPerformanceCounter( &counter, NULL );
+    return counter.QuadPart;
+}
+
 /* convert PE image VirtualAddress to Real Address */
 static inline void *get_rva( HMODULE module, DWORD va )
 {
@@ -612,6 +638,37 @@ static WINE_MODREF **grow_module_deps( WINE_MODREF *wm, int count )
     return deps;
 }
 
+/*************************************************************************
+ *		get_forward_module
+ *
+ * Find the module a function is forwarded to, loading it if necessary.
+ * The loader_section must be locked while calling this function.
+ */
+static WINE_MODREF *get_forward_module( const WCHAR *mod_name, LPCWSTR load_path )
+{
+    WINE_MODREF *wm;
+
+    if ((wm = find_basename_module( mod_name ))) return wm;
+
+    TRACE( "delay loading %s\n", debugstr_w(mod_name) );
+    if (load_dll( load_path, mod_name, dllW, 0, &wm ) == STATUS_SUCCESS &&
+        !(wm->ldr.Flags & LDR_DONT_RESOLVE_REFS))
+    {
+        if (!imports_fixup_done && current_modref)
+        {
+            WINE_MODREF **deps = grow_module_deps( current_modref, 1 );
+            if (deps) deps[current_modref->nDeps++] = wm;
+        }
+        else if (process_attach( wm, NULL ) != STATUS_SUCCESS)
+        {
+            LdrUnloadDll( wm->ldr.DllBase );
+            wm = NULL;
+        }
+    }
+    return wm;
+}
+
+
 /*************************************************************************
  *		find_forwarded_export
  *
@@ -637,30 +694,11 @@ static FARPROC find_forwarded_export( HMODULE module, const char *forward, LPCWS
         memcpy( mod_name + (end - forward), dllW, sizeof(dllW) );
     }
 
-    if (!(wm = find_basename_module( mod_name )))
+    if (!(wm = get_forward_module( mod_name, load_path )))
     {
-        TRACE( "delay loading %s for '%s'\n", debugstr_w(mod_name), forward );
-        if (load_dll( load_path, mod_name, dllW, 0, &wm ) == STATUS_SUCCESS &&
-            !(wm->ldr.Flags & LDR_DONT_RESOLVE_REFS))
-        {
-            if (!imports_fixup_done && current_modref)
-            {
-                WINE_MODREF **deps = grow_module_deps( current_modref, 1 );
-                if (deps) deps[current_modref->nDeps++] = wm;
-            }
-            else if (process_attach( wm, NULL ) != STATUS_SUCCESS)
-            {
-                LdrUnloadDll( wm->ldr.DllBase );
-                wm = NULL;
-            }
-        }
-
-        if (!wm)
-        {
-            ERR( "module not found for forward '%s' used by %s\n",
-                 forward, debugstr_w(get_modref(module)->ldr.FullDllName.Buffer) );
-            return NULL;
-        }
+        ERR( "module not found for forward '%s' used by %s\n",
+             forward, debugstr_w(get_modref(module)->ldr.FullDllName.Buffer) );
+        return NULL;
     }
     if ((exports = RtlImageDirectoryEntryToData( wm->ldr.DllBase, TRUE,
                                                  IMAGE_DIRECTORY_ENTRY_EXPORT, &exp_size )))
@@ -669,7 +707,7 @@ static FARPROC find_forwarded_export( HMODULE module, const char *forward, LPCWS
         if (*name == '#')  /* ordinal */
             proc = find_ordinal_export( wm->ldr.DllBase, exports, exp_size, atoi(name+1), load_path );
         else
-            proc = find_named_export( wm->ldr.DllBase, exports, exp_size, name, -1, load_path );
+            proc = find_named_export( wm, exports, exp_size, name, -1, load_path );
     }
 
     if (!proc)
@@ -724,15 +762,79 @@ static FARPROC find_ordinal_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY
 }
 
 
+/*************************************************************************
+ *		hash_export_name
+ */
+static inline DWORD hash_export_name( const char *name )
+{
+    DWORD hash = 0x811c9dc5;  /* FNV-1a */
+
+    while (*name) hash = (hash ^ (unsigned char)*name++) * 0x01000193;
+    return hash;
+}
+
+
+/*************************************************************************
+ *		create_export_hash
+ *
+ * Build the hash table of the names exported by a module.
+ * The loader_section must be locked while calling this function.
+ */
+static void create_export_hash( WINE_MODREF *wm, const IMAGE_EXPORT_DIRECTORY *exports )
+{
+    const DWORD *names = get_rva( wm->ldr.DllBase, exports->AddressOfNames );
+    unsigned int i, pos, mask = 15;
+
+    while (mask < exports->NumberOfNames * 2) mask = mask * 2 + 1;
+    if (!(wm->export_hash = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                             (mask + 1) * sizeof(*wm->export_hash) )))
+        return;
+    wm->export_hash_mask = mask;
+
+    for (i = 0; i < exports->NumberOfNames; i++)
+    {
+        DWORD hash = hash_export_name( get_rva( wm->ldr.DllBase, names[i] ));
+
+        for (pos = hash & mask; wm->export_hash[pos].index; pos = (pos + 1) & mask)
+            ;
+        wm->export_hash[pos].hash  = hash;
+        wm->export_hash[pos].index = i + 1;
+    }
+    TRACE( "created hash table of %u exports for %s\n", exports->NumberOfNames,
+           debugstr_w(wm->ldr.BaseDllName.Buffer) );
+}
+
+
+/*************************************************************************
+ *		find_hashed_export
+ *
+ * Find the index of an exported name in the hash table, or -1.
+ */
+static int find_hashed_export( const WINE_MODREF *wm, const DWORD *names, const char *name )
+{
+    DWORD hash = hash_export_name( name );
+    unsigned int pos;
+
+    for (pos = hash & wm->export_hash_mask; wm->export_hash[pos].index; pos = (pos + 1) & wm->export_hash_mask)
+    {
+        int index = wm->export_hash[pos].index - 1;
+        if (wm->export_hash[pos].hash == hash && !strcmp( get_rva( wm->ldr.DllBase, names[index] ), name ))
+            return index;
+    }
+    return -1;
+}
+
+
 /*************************************************************************
  *		find_named_export
  *
- * Find an exported function by name.
+ * Find an exported function by name in a loaded module.
  * The loader_section must be locked while calling this function.
  */
-static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *exports,
+static FARPROC find_named_export( WINE_MODREF *wm, const IMAGE_EXPORT_DIRECTORY *exports,
                                   DWORD exp_size, const char *name, int hint, LPCWSTR load_path )
 {
+    HMODULE module = wm->ldr.DllBase;
     const WORD *ordinals = get_rva( module, exports->AddressOfNameOrdinals );
     const DWORD *names = get_rva( module, exports->AddressOfNames );
     int min = 0, max = exports->NumberOfNames - 1;
@@ -745,6 +847,16 @@ static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *
             return find_ordinal_export( module, exports, exp_size, ordinals[hint], load_path );
     }
 
+    /* then the hash table, for modules that get many lookups */
+    if (!wm->export_hash && ++wm->export_lookups == EXPORT_HASH_THRESHOLD)
+        create_export_hash( wm, exports );
+    if (wm->export_hash)
+    {
+        int pos = find_hashed_export( wm, names, name );
+        if (pos == -1) return NULL;
+        return find_ordinal_export( module, exports, exp_size, ordinals[pos], load_path );
+    }
+
     /* then do a binary search */
     while (min <= max)
     {
@@ -760,6 +872,447 @@ static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *
 }
 
 
+/* The import address tables resolved while starting a process are cached in
+ * C:\windows\Prefetch, with one file per main executable. Each function is
+ * stored as an rva in the module it was found in, and the bindings are only
+ * used as long as all these modules are still the same files. */
+
+#define IMPORT_CACHE_MAGIC        0x504d4957  /* "WIMP" */
+#define IMPORT_CACHE_VERSION      1
+#define IMPORT_CACHE_MAX_MODULES  16
+#define IMPORT_CACHE_MAX_SIZE     (16 * 1024 * 1024)
+
+struct import_cache_module
+{
+    struct file_id id;          /* file the module was loaded from */
+    DWORD          timestamp;   /* image header fields that change when the module is rebuilt */
+    DWORD          checksum;
+    DWORD          size;
+    WCHAR          name[32];    /* base name, to find or load it like a forwarded module */
+};
+
+struct import_cache_binding
+{
+    DWORD module;  /* index of the module containing the function */
+    DWORD rva;     /* rva of the function in that module */
+};
+
+/* bindings of one import descriptor, followed by the modules and the bindings themselves */
+struct import_cache_entry
+{
+    struct import_cache_module importer;
+    DWORD descr;        /* rva of the import descriptor in the importer */
+    DWORD nb_modules;   /* the first module is the imported dll, the others are forward targets */
+    DWORD nb_bindings;  /* one per import address table entry */
+};
+
+struct import_cache_header
+{
+    DWORD magic;
+    DWORD version;
+    DWORD ptr_size;
+    DWORD count;  /* number of entries */
+    DWORD size;   /* size of the entries following the header */
+    DWORD crc;    /* checksum of the entries */
+};
+
+static BOOL import_cache_enabled;              /* set while the main exe imports are being resolved */
+static WCHAR *import_cache_path;
+static void *import_cache_data;                /* contents of the cache file */
+static const struct import_cache_entry **import_cache_entries;  /* sorted by importer and descriptor */
+static unsigned int import_cache_count;
+static const struct import_cache_entry **import_cache_used;  /* entries to write back */
+static unsigned int import_cache_used_count, import_cache_used_size;
+static BOOL import_cache_dirty;
+
+static inline struct import_cache_module *get_import_cache_modules( const struct import_cache_entry *entry )
+{
+    return (struct import_cache_module *)(entry + 1);
+}
+
+static inline struct import_cache_binding *get_import_cache_bindings( const struct import_cache_entry *entry )
+{
+    return (struct import_cache_binding *)(get_import_cache_modules( entry ) + entry->nb_modules);
+}
+
+static inline SIZE_T get_import_cache_entry_size( const struct import_cache_entry *entry )
+{
+    return sizeof(*entry) + entry->nb_modules * sizeof(struct import_cache_module) +
+           entry->nb_bindings * sizeof(struct import_cache_binding);
+}
+
+
+/*************************************************************************
+ *		get_import_cache_module
+ *
+ * Fill the cache identity of a module. Fails for modules without a file id.
+ */
+static BOOL get_import_cache_module( const WINE_MODREF *wm, struct import_cache_module *module )
+{
+    static const struct file_id zero_id;
+    const IMAGE_NT_HEADERS *nt = RtlImageNtHeader( wm->ldr.DllBase );
+
+    if (!memcmp( &wm->id, &zero_id, sizeof(zero_id) )) return FALSE;
+    if (wm->ldr.BaseDllName.Length >= sizeof(module->name)) return FALSE;
+
+    memset( module, 0, sizeof(*module) );
+    module->id        = wm->id;
+    module->timestamp = nt->FileHeader.TimeDateStamp;
+    module->checksum  = nt->OptionalHeader.CheckSum;
+    module->size      = nt->OptionalHeader.SizeOfImage;
+    memcpy( module->name, wm->ldr.BaseDllName.Buffer, wm->ldr.BaseDllName.Length );
+    return TRUE;
+}
+
+
+/*************************************************************************
+ *		is_import_cache_module
+ *
+ * Check that a loaded module is the one a cache entry refers to.
+ */
+static BOOL is_import_cache_module( const WINE_MODREF *wm, const struct import_cache_module *module )
+{
+    struct import_cache_module cur;
+
+    return get_import_cache_module( wm, &cur ) &&
+           !memcmp( &cur, module, FIELD_OFFSET( struct import_cache_module, name ));
+}
+
+
+static int compare_import_cache_entries( const void *ptr1, const void *ptr2 )
+{
+    const struct import_cache_entry *entry1 = *(const struct import_cache_entry * const *)ptr1;
+    const struct import_cache_entry *entry2 = *(const struct import_cache_entry * const *)ptr2;
+    int ret = memcmp( &entry1->importer.id, &entry2->importer.id, sizeof(entry1->importer.id) );
+
+    if (ret) return ret;
+    if (entry1->descr != entry2->descr) return entry1->descr < entry2->descr ? -1 : 1;
+    return 0;
+}
+
+
+/*************************************************************************
+ *		add_import_cache_entry
+ *
+ * Add an entry to the ones written back to the cache file.
+ */
+static void add_import_cache_entry( const struct import_cache_entry *entry )
+{
+    if (import_cache_used_count == import_cache_used_size)
+    {
+        unsigned int new_size = max( 64, import_cache_used_size * 2 );
+        const struct import_cache_entry **new_used;
+
+        if (import_cache_used)
+            new_used = RtlReAllocateHeap( GetProcessHeap(), 0, import_cache_used, new_size * sizeof(*new_used) );
+        else
+            new_used = RtlAllocateHeap( GetProcessHeap(), 0, new_size * sizeof(*new_used) );
+        if (!new_used) return;
+        import_cache_used = new_used;
+        import_cache_used_size = new_size;
+    }
+    import_cache_used[import_cache_used_count++] = entry;
+}
+
+
+/*************************************************************************
+ *		parse_import_cache
+ *
+ * Validate the contents of the cache file and index its entries.
+ */
+static BOOL parse_import_cache( void *data, SIZE_T size )
+{
+    const struct import_cache_header *header = data;
+    const char *ptr = (const char *)(header + 1), *end = (const char *)data + size;
+    unsigned int i;
+
+    if (header->magic != IMPORT_CACHE_MAGIC || header->version != IMPORT_CACHE_VERSION ||
+        header->ptr_size != sizeof(void *) || header->size != size - sizeof(*header) ||
+        header->count > header->size / sizeof(struct import_cache_entry))
+        return FALSE;
+    if (RtlComputeCrc32( 0, (const BYTE *)ptr, header->size ) != header->crc) return FALSE;
+
+    if (!(import_cache_entries = RtlAllocateHeap( GetProcessHeap(), 0,
+                                                  header->count * sizeof(*import_cache_entries) )))
+        return FALSE;
+
+    for (i = 0; i < header->count; i++)
+    {
+        const struct import_cache_entry *entry = (const struct import_cache_entry *)ptr;
+
+        if (end - ptr < sizeof(*entry) ||
+            !entry->nb_modules || entry->nb_modules > IMPORT_CACHE_MAX_MODULES ||
+            entry->nb_bindings > (end - ptr) / sizeof(struct import_cache_binding) ||
+            end - ptr < get_import_cache_entry_size( entry ))
+            break;
+        import_cache_entries[i] = entry;
+        ptr += get_import_cache_entry_size( entry );
+    }
+    if (i < header->count)
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, import_cache_entries );
+        import_cache_entries = NULL;
+        return FALSE;
+    }
+    import_cache_count = header->count;
+    qsort( import_cache_entries, import_cache_count, sizeof(*import_cache_entries),
+           compare_import_cache_entries );
+    return TRUE;
+}
+
+
+/*************************************************************************
+ *		load_import_cache
+ *
+ * Load the import cache of the main exe, before its imports are resolved.
+ */
+static void load_import_cache( WINE_MODREF *wm )
+{
+    static const WCHAR disableW[] = {'W','I','N','E','_','D','I','S','A','B','L','E','_',
+                                     'I','M','P','O','R','T','_','C','A','C','H','E',0};
+    static const WCHAR formatW[] = {'\\','?','?','\\','C',':','\\','w','i','n','d','o','w','s','\\',
+                                    'P','r','e','f','e','t','c','h','\\','%','s','-','%','0','8','X',
+                                    '.','i','m','p','o','r','t','s',0};
+    struct import_cache_module module;
+    FILE_STANDARD_INFORMATION info;
+    OBJECT_ATTRIBUTES attr;
+    UNICODE_STRING nt_name;
+    IO_STATUS_BLOCK io;
+    HANDLE handle;
+    WCHAR *env;
+    SIZE_T len;
+
+    /* relay and snoop return thunks instead of the exported functions */
+    if (TRACE_ON(relay) || TRACE_ON(snoop)) return;
+    if ((env = get_env( disableW )))
+    {
+        BOOL disable = wcstoul( env, NULL, 10 ) != 0;
+        RtlFreeHeap( GetProcessHeap(), 0, env );
+        if (disable) return;
+    }
+    if (!get_import_cache_module( wm, &module )) return;
+
+    len = ARRAY_SIZE(formatW) + wcslen( module.name ) + 8;
+    if (!(import_cache_path = RtlAllocateHeap( GetProcessHeap(), 0, len * sizeof(WCHAR) ))) return;
+    swprintf( import_cache_path, len, formatW, module.name,
+              RtlComputeCrc32( 0, (const BYTE *)&module.id, sizeof(module.id) ));
+    import_cache_enabled = TRUE;
+
+    RtlInitUnicodeString( &nt_name, import_cache_path );
+    InitializeObjectAttributes( &attr, &nt_name, OBJ_CASE_INSENSITIVE, 0, NULL );
+    if (NtOpenFile( &handle, GENERIC_READ | SYNCHRONIZE, &attr, &io, FILE_SHARE_READ,
+                    FILE_SYNCHRONOUS_IO_NONALERT | FILE_NON_DIRECTORY_FILE ))
+        return;
+
+    if (!NtQueryInformationFile( handle, &io, &info, sizeof(info), FileStandardInformation ) &&
+        info.EndOfFile.QuadPart >= sizeof(struct import_cache_header) &&
+        info.EndOfFile.QuadPart <= IMPORT_CACHE_MAX_SIZE &&
+        (import_cache_data = RtlAllocateHeap( GetProcessHeap(), 0, info.EndOfFile.QuadPart )))
+    {
+        if (NtReadFile( handle, 0, NULL, NULL, &io, import_cache_data, info.EndOfFile.QuadPart, NULL, NULL ) ||
+            io.Information != info.EndOfFile.QuadPart ||
+            !parse_import_cache( import_cache_data, info.EndOfFile.QuadPart ))
+        {
+            WARN( "ignoring invalid import cache %s\n", debugstr_w(import_cache_path) );
+            RtlFreeHeap( GetProcessHeap(), 0, import_cache_data );
+            import_cache_data = NULL;
+        }
+        else TRACE( "loaded %u entries from %s\n", import_cache_count, debugstr_w(import_cache_path) );
+    }
+    NtClose( handle );
+}
+
+
+/*************************************************************************
+ *		write_import_cache
+ */
+static void write_import_cache(void)
+{
+    static const WCHAR dirW[] = {'\\','?','?','\\','C',':','\\','w','i','n','d','o','w','s','\\',
+                                 'P','r','e','f','e','t','c','h',0};
+    struct import_cache_header *header;
+    OBJECT_ATTRIBUTES attr;
+    UNICODE_STRING nt_name;
+    IO_STATUS_BLOCK io;
+    HANDLE handle;
+    SIZE_T size = 0;
+    unsigned int i;
+    char *ptr;
+
+    for (i = 0; i < import_cache_used_count; i++) size += get_import_cache_entry_size( import_cache_used[i] );
+    if (!(header = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*header) + size ))) return;
+
+    header->magic    = IMPORT_CACHE_MAGIC;
+    header->version  = IMPORT_CACHE_VERSION;
+    header->ptr_size = sizeof(void *);
+    header->count    = import_cache_used_count;
+    header->size     = size;
+    for (i = 0, ptr = (char *)(header + 1); i < import_cache_used_count; i++)
+    {
+        memcpy( ptr, import_cache_used[i], get_import_cache_entry_size( import_cache_used[i] ));
+        ptr += get_import_cache_entry_size( import_cache_used[i] );
+    }
+    header->crc = RtlComputeCrc32( 0, (const BYTE *)(header + 1), size );
+
+    RtlInitUnicodeString( &nt_name, dirW );
+    InitializeObjectAttributes( &attr, &nt_name, OBJ_CASE_INSENSITIVE, 0, NULL );
+    if (!NtCreateFile( &handle, FILE_LIST_DIRECTORY | SYNCHRONIZE, &attr, &io, NULL, 0,
+                       FILE_SHARE_READ | FILE_SHARE_WRITE, FILE_OPEN_IF,
+                       FILE_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT, NULL, 0 ))
+        NtClose( handle );
+
+    /* the file is opened exclusively, readers and other writers simply skip it meanwhile */
+    RtlInitUnicodeString( &nt_name, import_cache_path );
+    if (!NtCreateFile( &handle, GENERIC_WRITE | SYNCHRONIZE, &attr, &io, NULL, FILE_ATTRIBUTE_NORMAL,
+                       0, FILE_OVERWRITE_IF, FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT, NULL, 0 ))
+    {
+        NtWriteFile( handle, 0, NULL, NULL, &io, header, sizeof(*header) + size, NULL, NULL );
+        NtClose( handle );
+        TRACE( "wrote %u entries to %s\n", import_cache_used_count, debugstr_w(import_cache_path) );
+    }
+    RtlFreeHeap( GetProcessHeap(), 0, header );
+}
+
+
+/*************************************************************************
+ *		save_import_cache
+ *
+ * Write back the cache if some imports were missing from it, and free it.
+ */
+static void save_import_cache(void)
+{
+    const char *data = import_cache_data;
+    unsigned int i;
+
+    if (!import_cache_enabled) return;
+    import_cache_enabled = FALSE;
+
+    if (import_cache_dirty) write_import_cache();
+
+    for (i = 0; i < import_cache_used_count; i++)
+    {
+        const char *entry = (const char *)import_cache_used[i];
+        if (data && entry >= data && entry < data + sizeof(struct import_cache_header) +
+            ((const struct import_cache_header *)data)->size) continue;
+        RtlFreeHeap( GetProcessHeap(), 0, (void *)entry );
+    }
+    RtlFreeHeap( GetProcessHeap(), 0, import_cache_used );
+    RtlFreeHeap( GetProcessHeap(), 0, import_cache_entries );
+    RtlFreeHeap( GetProcessHeap(), 0, import_cache_data );
+    RtlFreeHeap( GetProcessHeap(), 0, import_cache_path );
+    import_cache_used = NULL;
+    import_cache_entries = NULL;
+    import_cache_data = NULL;
+    import_cache_path = NULL;
+    import_cache_used_count = import_cache_used_size = import_cache_count = 0;
+}
+
+
+/*************************************************************************
+ *		apply_import_cache
+ *
+ * Fill an import address table from the cache.
+ * The loader_section must be locked while calling this function.
+ */
+static BOOL apply_import_cache( WINE_MODREF *imp, const IMAGE_IMPORT_DESCRIPTOR *descr,
+                                IMAGE_THUNK_DATA *thunk_list, SIZE_T count, LPCWSTR load_path )
+{
+    const struct import_cache_entry *key, *entry, **found;
+    const struct import_cache_module *modules;
+    const struct import_cache_binding *bindings;
+    struct import_cache_entry tmp;
+    char *bases[IMPORT_CACHE_MAX_MODULES];
+    WINE_MODREF *wm;
+    unsigned int i;
+
+    tmp.importer.id = current_modref->id;
+    tmp.descr = (char *)descr - (char *)current_modref->ldr.DllBase;
+    key = &tmp;
+    if (!import_cache_count ||
+        !(found = bsearch( &key, import_cache_entries, import_cache_count, sizeof(*import_cache_entries),
+                           compare_import_cache_entries )))
+        return FALSE;
+
+    entry = *found;
+    modules = get_import_cache_modules( entry );
+    bindings = get_import_cache_bindings( entry );
+    if (entry->nb_bindings != count) return FALSE;
+    if (!is_import_cache_module( current_modref, &entry->importer )) return FALSE;
+    if (!is_import_cache_module( imp, &modules[0] )) return FALSE;
+
+    bases[0] = imp->ldr.DllBase;
+    for (i = 1; i < entry->nb_modules; i++)
+    {
+        if (!(wm = get_forward_module( modules[i].name, load_path ))) return FALSE;
+        if (!is_import_cache_module( wm, &modules[i] )) return FALSE;
+        bases[i] = wm->ldr.DllBase;
+    }
+    for (i = 0; i < count; i++)
+        if (bindings[i].module >= entry->nb_modules || bindings[i].rva >= modules[bindings[i].module].size)
+            return FALSE;
+
+    for (i = 0; i < count; i++) thunk_list[i].u1.Function = (ULONG_PTR)(bases[bindings[i].module] + bindings[i].rva);
+    add_import_cache_entry( entry );
+    TRACE_(imports)( "--- %s: %u functions from cache\n", debugstr_w(imp->ldr.BaseDllName.Buffer), (UINT)count );
+    return TRUE;
+}
+
+
+/*************************************************************************
+ *		record_import_cache
+ *
+ * Add a resolved import address table to the cache.
+ * The loader_section must be locked while calling this function.
+ */
+static void record_import_cache( WINE_MODREF *imp, const IMAGE_IMPORT_DESCRIPTOR *descr,
+                                 const IMAGE_THUNK_DATA *thunk_list, SIZE_T count )
+{
+    struct import_cache_module importer, modules[IMPORT_CACHE_MAX_MODULES];
+    const char *bases[IMPORT_CACHE_MAX_MODULES];
+    struct import_cache_binding *bindings;
+    struct import_cache_entry *entry;
+    LDR_DATA_TABLE_ENTRY *mod;
+    unsigned int i, j, nb_modules = 1;
+
+    if (!get_import_cache_module( current_modref, &importer )) return;
+    if (!get_import_cache_module( imp, &modules[0] )) return;
+    bases[0] = imp->ldr.DllBase;
+
+    if (!(bindings = RtlAllocateHeap( GetProcessHeap(), 0, count * sizeof(*bindings) ))) return;
+    for (i = 0; i < count; i++)
+    {
+        const char *proc = (const char *)thunk_list[i].u1.Function;
+
+        for (j = 0; j < nb_modules; j++)
+            if (proc >= bases[j] && proc < bases[j] + modules[j].size) break;
+        if (j == nb_modules)
+        {
+            /* stubs for missing functions are not in any module */
+            if (nb_modules == IMPORT_CACHE_MAX_MODULES || LdrFindEntryForAddress( proc, &mod ) ||
+                !get_import_cache_module( CONTAINING_RECORD( mod, WINE_MODREF, ldr ), &modules[j] ))
+                goto done;
+            bases[nb_modules++] = mod->DllBase;
+        }
+        bindings[i].module = j;
+        bindings[i].rva    = proc - bases[j];
+    }
+
+    if (!(entry = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*entry) + nb_modules * sizeof(*modules) +
+                                   count * sizeof(*bindings) )))
+        goto done;
+    entry->importer    = importer;
+    entry->descr       = (char *)descr - (char *)current_modref->ldr.DllBase;
+    entry->nb_modules  = nb_modules;
+    entry->nb_bindings = count;
+    memcpy( get_import_cache_modules( entry ), modules, nb_modules * sizeof(*modules) );
+    memcpy( get_import_cache_bindings( entry ), bindings, count * sizeof(*bindings) );
+    add_import_cache_entry( entry );
+    import_cache_dirty = TRUE;
+done:
+    RtlFreeHeap( GetProcessHeap(), 0, bindings );
+}
+
+
 /*************************************************************************
  *		import_dll
  *
@@ -779,7 +1332,7 @@ static BOOL import_dll( HMODULE module, const IMAGE_IMPORT_DESCRIPTOR *descr, LP
     const char *name = get_rva( module, descr->Name );
     DWORD len = strlen(name);
     PVOID protect_base;
-    SIZE_T protect_size = 0;
+    SIZE_T protect_size = 0, nb_imports;
     DWORD protect_old;
 
     thunk_list = get_rva( module, (DWORD)descr->FirstThunk );
@@ -827,6 +1380,7 @@ static BOOL import_dll( HMODULE module, const IMAGE_IMPORT_DESCRIPTOR *descr, LP
     /* unprotect the import address table since it can be located in
      * readonly section */
     while (import_list[protect_size].u1.Ordinal) protect_size++;
+    nb_imports = protect_size;
     protect_base = thunk_list;
     protect_size *= sizeof(*thunk_list);
     NtProtectVirtualMemory( NtCurrentProcess(), &protect_base,
@@ -861,6 +1415,9 @@ static BOOL import_dll( HMODULE module, const IMAGE_IMPORT_DESCRIPTOR *descr, LP
         goto done;
     }
 
+    if (import_cache_enabled && apply_import_cache( wmImp, descr, thunk_list, nb_imports, load_path ))
+        goto done;
+
     while (import_list->u1.Ordinal)
     {
         if (IMAGE_SNAP_BY_ORDINAL(import_list->u1.Ordinal))
@@ -882,7 +1439,7 @@ static BOOL import_dll( HMODULE module, const IMAGE_IMPORT_DESCRIPTOR *descr, LP
         {
             IMAGE_IMPORT_BY_NAME *pe_name;
             pe_name = get_rva( module, (DWORD)import_list->u1.AddressOfData );
-            thunk_list->u1.Function = (ULONG_PTR)find_named_export( imp_mod, exports, exp_size,
+            thunk_list->u1.Function = (ULONG_PTR)find_named_export( wmImp, exports, exp_size,
                                                                     (const char*)pe_name->Name,
                                                                     pe_name->Hint, load_path );
             if (!thunk_list->u1.Function)
@@ -899,6 +1456,8 @@ static BOOL import_dll( HMODULE module, const IMAGE_IMPORT_DESCRIPTOR *descr, LP
         thunk_list++;
     }
 
+    if (import_cache_enabled) record_import_cache( wmImp, descr, thunk_list - nb_imports, nb_imports );
+
 done:
     /* restore old protection of the import address table */
     NtProtectVirtualMemory( NtCurrentProcess(), &protect_base, &protect_size, protect_old, &protect_old );
@@ -1109,7 +1668,7 @@ static NTSTATUS fixup_imports_ilonly( WINE_MODREF *wm, LPCWSTR load_path, void *
                                                  IMAGE_DIRECTORY_ENTRY_EXPORT, &exp_size )))
     {
         const char *name = (wm->ldr.Flags & LDR_IMAGE_IS_DLL) ? "_CorDllMain" : "_CorExeMain";
-        proc = find_named_export( imp->ldr.DllBase, exports, exp_size, name, -1, load_path );
+        proc = find_named_export( imp, exports, exp_size, name, -1, load_path );
     }
     if (!proc) return STATUS_PROCEDURE_NOT_FOUND;
     *entry = proc;
@@ -1150,6 +1709,8 @@ static NTSTATUS fixup_imports( WINE_MODREF *wm, LPCWSTR load_path )
     if (!create_module_activation_context( &wm->ldr ))
         RtlActivateActivationContext( 0, wm->ldr.ActivationContext, &cookie );
 
+    preload_imports( wm, imports, nb_imports, load_path );
+
     /* load the imported modules. They are automatically
      * added to the modref list of the process.
      */
@@ -1756,17 +2317,18 @@ NTSTATUS WINAPI LdrGetProcedureAddress(HMODULE module, const ANSI_STRING *name,
 {
     IMAGE_EXPORT_DIRECTORY *exports;
     DWORD exp_size;
+    WINE_MODREF *wm;
     NTSTATUS ret = STATUS_PROCEDURE_NOT_FOUND;
 
     RtlEnterCriticalSection( &loader_section );
 
     /* check if the module itself is invalid to return the proper error */
-    if (!get_modref( module )) ret = STATUS_DLL_NOT_FOUND;
+    if (!(wm = get_modref( module ))) ret = STATUS_DLL_NOT_FOUND;
     else if ((exports = RtlImageDirectoryEntryToData( module, TRUE,
                                                       IMAGE_DIRECTORY_ENTRY_EXPORT, &exp_size )))
     {
         LPCWSTR load_path = NtCurrentTeb()->Peb->ProcessParameters->DllPath.Buffer;
-        void *proc = name ? find_named_export( module, exports, exp_size, name->Buffer, -1, load_path )
+        void *proc = name ? find_named_export( wm, exports, exp_size, name->Buffer, -1, load_path )
                           : find_ordinal_export( module, exports, exp_size, ord - exports->Base, load_path );
         if (proc)
         {
@@ -1920,10 +2482,14 @@ static NTSTATUS build_module( LPCWSTR load_path, const UNICODE_STRING *nt_name,
     NTSTATUS status;
     WCHAR *basename, *tmp;
     ULONG basename_len;
+    ULONGLONG start;
 
     if (!(nt = RtlImageNtHeader( *module ))) return STATUS_INVALID_IMAGE_FORMAT;
 
-    if ((status = perform_relocations( *module, nt, image_info->map_size ))) return status;
+    start = get_startup_counter();
+    status = perform_relocations( *module, nt, image_info->map_size );
+    startup_reloc_time += get_startup_counter() - start;
+    if (status) return status;
 
     /* create the MODREF */
 
@@ -2420,6 +2986,46 @@ static NTSTATUS get_dll_load_path_search_flags( LPCWSTR module, DWORD flags, WCH
 }
 
 
+/***********************************************************************
+ *	map_dll_file
+ *
+ * Map the image section of an opened dll file.
+ */
+static NTSTATUS map_dll_file( HANDLE handle, const UNICODE_STRING *nt_name,
+                              void **module, pe_image_info_t *image_info )
+{
+    LARGE_INTEGER size;
+    SIZE_T len = 0;
+    NTSTATUS status;
+    HANDLE mapping;
+
+    size.QuadPart = 0;
+    status = NtCreateSection( &mapping, STANDARD_RIGHTS_REQUIRED | SECTION_QUERY |
+                              SECTION_MAP_READ | SECTION_MAP_EXECUTE,
+                              NULL, &size, PAGE_EXECUTE_READ, SEC_IMAGE, handle );
+    if (!status)
+    {
+        if (*module)
+        {
+            NtUnmapViewOfSection( NtCurrentProcess(), *module );
+            *module = NULL;
+        }
+        status = unix_funcs->virtual_map_section( mapping, module, 0, 0, NULL, &len,
+                                                  0, PAGE_EXECUTE_READ, image_info );
+        if (status == STATUS_IMAGE_NOT_AT_BASE) status = STATUS_SUCCESS;
+        NtClose( mapping );
+    }
+    if (!status && !is_valid_binary( *module, image_info ))
+    {
+        TRACE( "%s is for arch %x, continuing search\n", debugstr_us(nt_name), image_info->machine );
+        NtUnmapViewOfSection( NtCurrentProcess(), *module );
+        *module = NULL;
+        status = STATUS_IMAGE_MACHINE_TYPE_MISMATCH;
+    }
+    return status;
+}
+
+
 /***********************************************************************
  *	open_dll_file
  *
@@ -2431,11 +3037,9 @@ static NTSTATUS open_dll_file( UNICODE_STRING *nt_name, WINE_MODREF **pwm,
     FILE_BASIC_INFORMATION info;
     OBJECT_ATTRIBUTES attr;
     IO_STATUS_BLOCK io;
-    LARGE_INTEGER size;
     FILE_OBJECTID_BUFFER fid;
-    SIZE_T len = 0;
     NTSTATUS status;
-    HANDLE handle, mapping;
+    HANDLE handle;
 
     if ((*pwm = find_fullname_module( nt_name )))
     {
@@ -2479,31 +3083,8 @@ static NTSTATUS open_dll_file( UNICODE_STRING *nt_name, WINE_MODREF **pwm,
         }
     }
 
-    size.QuadPart = 0;
-    status = NtCreateSection( &mapping, STANDARD_RIGHTS_REQUIRED | SECTION_QUERY |
-                              SECTION_MAP_READ | SECTION_MAP_EXECUTE,
-                              NULL, &size, PAGE_EXECUTE_READ, SEC_IMAGE, handle );
+    status = map_dll_file( handle, nt_name, module, image_info );
     NtClose( handle );
-
-    if (!status)
-    {
-        if (*module)
-        {
-            NtUnmapViewOfSection( NtCurrentProcess(), *module );
-            *module = NULL;
-        }
-        status = unix_funcs->virtual_map_section( mapping, module, 0, 0, NULL, &len,
-                                                  0, PAGE_EXECUTE_READ, image_info );
-        if (status == STATUS_IMAGE_NOT_AT_BASE) status = STATUS_SUCCESS;
-        NtClose( mapping );
-    }
-    if (!status && !is_valid_binary( *module, image_info ))
-    {
-        TRACE( "%s is for arch %x, continuing search\n", debugstr_us(nt_name), image_info->machine );
-        NtUnmapViewOfSection( NtCurrentProcess(), *module );
-        *module = NULL;
-        status = STATUS_IMAGE_MACHINE_TYPE_MISMATCH;
-    }
     return status;
 }
 
@@ -2694,6 +3275,309 @@ done:
 }
 
 
+/* With WINE_PARALLEL_LOADER set, the dlls imported by the modules loaded at
+ * process startup are searched for and mapped by worker threads, while the
+ * loader thread keeps loading the modules in order. The workers don't touch
+ * the module lists, the loader thread picks up their mappings when it gets
+ * to the corresponding dll, and everything else still happens under the
+ * loader lock. */
+
+enum preload_state
+{
+    PRELOAD_QUEUED,
+    PRELOAD_RUNNING,
+    PRELOAD_DONE
+};
+
+struct preload_dll
+{
+    struct list        entry;        /* entry in preload_list */
+    struct list        queue_entry;  /* entry in preload_queue while queued */
+    enum preload_state state;
+    WCHAR             *load_path;
+    WCHAR             *name;         /* dll name, with extension */
+    UNICODE_STRING     nt_name;      /* file the dll was found in */
+    void              *module;       /* mapped image, NULL if not found */
+    pe_image_info_t    image_info;
+    struct file_id     id;
+    BOOL               has_id;
+};
+
+#define PRELOAD_MAX_WORKERS 4
+
+static BOOL preload_enabled;
+static unsigned int preload_workers;
+static BOOL preload_shutdown;
+static struct list preload_list = LIST_INIT( preload_list );   /* only accessed by the loader thread */
+static struct list preload_queue = LIST_INIT( preload_queue ); /* protected by preload_section */
+static RTL_CONDITION_VARIABLE preload_cv;
+static RTL_CRITICAL_SECTION preload_section;
+static RTL_CRITICAL_SECTION_DEBUG preload_critsect_debug =
+{
+    0, 0, &preload_section,
+    { &preload_critsect_debug.ProcessLocksList, &preload_critsect_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": preload_section") }
+};
+static RTL_CRITICAL_SECTION preload_section = { &preload_critsect_debug, -1, 0, 0, 0, 0 };
+
+
+/***********************************************************************
+ *	preload_dll_file
+ *
+ * Search the load path for a dll and map it. Runs in a worker thread.
+ */
+static void preload_dll_file( struct preload_dll *dll )
+{
+    const WCHAR *paths = dll->load_path;
+    FILE_OBJECTID_BUFFER fid;
+    OBJECT_ATTRIBUTES attr;
+    IO_STATUS_BLOCK io;
+    NTSTATUS status;
+    HANDLE handle;
+    WCHAR *name;
+    ULONG len = wcslen( paths ) + wcslen( dll->name ) + 2;
+
+    if (!(name = RtlAllocateHeap( GetProcessHeap(), 0, len * sizeof(WCHAR) ))) return;
+
+    while (*paths)
+    {
+        const WCHAR *ptr = paths;
+
+        while (*ptr && *ptr != ';') ptr++;
+        len = ptr - paths;
+        if (*ptr == ';') ptr++;
+        memcpy( name, paths, len * sizeof(WCHAR) );
+        if (len && name[len - 1] != '\\') name[len++] = '\\';
+        wcscpy( name + len, dll->name );
+        paths = ptr;
+
+        dll->nt_name.Buffer = NULL;
+        if (RtlDosPathNameToNtPathName_U_WithStatus( name, &dll->nt_name, NULL, NULL )) break;
+
+        InitializeObjectAttributes( &attr, &dll->nt_name, OBJ_CASE_INSENSITIVE, 0, NULL );
+        status = NtOpenFile( &handle, GENERIC_READ | SYNCHRONIZE, &attr, &io,
+                             FILE_SHARE_READ | FILE_SHARE_DELETE,
+                             FILE_SYNCHRONOUS_IO_NONALERT | FILE_NON_DIRECTORY_FILE );
+        if (!status)
+        {
+            if (!NtFsControlFile( handle, 0, NULL, NULL, &io, FSCTL_GET_OBJECT_ID, NULL, 0, &fid, sizeof(fid) ))
+            {
+                memcpy( &dll->id, fid.ObjectId, sizeof(dll->id) );
+                dll->has_id = TRUE;
+            }
+            status = map_dll_file( handle, &dll->nt_name, &dll->module, &dll->image_info );
+            NtClose( handle );
+            if (!status) break;
+            dll->has_id = FALSE;
+        }
+        RtlFreeUnicodeString( &dll->nt_name );
+        /* let the loader thread handle anything else than a missing file */
+        if (status != STATUS_OBJECT_PATH_NOT_FOUND && status != STATUS_OBJECT_NAME_NOT_FOUND &&
+            status != STATUS_IMAGE_MACHINE_TYPE_MISMATCH)
+            break;
+    }
+    RtlFreeHeap( GetProcessHeap(), 0, name );
+    TRACE( "preloaded %s from %s at %p\n", debugstr_w(dll->name), debugstr_us(&dll->nt_name), dll->module );
+}
+
+
+/***********************************************************************
+ *	preload_worker
+ */
+static void CALLBACK preload_worker( void *arg )
+{
+    struct preload_dll *dll;
+
+    RtlEnterCriticalSection( &preload_section );
+    for (;;)
+    {
+        while (!preload_shutdown && list_empty( &preload_queue ))
+            RtlSleepConditionVariableCS( &preload_cv, &preload_section, NULL );
+        if (preload_shutdown) break;
+
+        dll = LIST_ENTRY( list_head( &preload_queue ), struct preload_dll, queue_entry );
+        list_remove( &dll->queue_entry );
+        dll->state = PRELOAD_RUNNING;
+        RtlLeaveCriticalSection( &preload_section );
+
+        preload_dll_file( dll );
+
+        RtlEnterCriticalSection( &preload_section );
+        dll->state = PRELOAD_DONE;
+        RtlWakeAllConditionVariable( &preload_cv );
+    }
+    RtlLeaveCriticalSection( &preload_section );
+}
+
+
+/***********************************************************************
+ *	free_preload_dll
+ */
+static void free_preload_dll( struct preload_dll *dll )
+{
+    if (dll->module) NtUnmapViewOfSection( NtCurrentProcess(), dll->module );
+    RtlFreeUnicodeString( &dll->nt_name );
+    RtlFreeHeap( GetProcessHeap(), 0, dll->load_path );
+    RtlFreeHeap( GetProcessHeap(), 0, dll->name );
+    RtlFreeHeap( GetProcessHeap(), 0, dll );
+}
+
+
+/***********************************************************************
+ *	preload_imports
+ *
+ * Queue the not yet loaded imports of a module to the preload workers.
+ * The loader_section must be locked while calling this function.
+ */
+static void preload_imports( WINE_MODREF *wm, const IMAGE_IMPORT_DESCRIPTOR *imports, int count,
+                             LPCWSTR load_path )
+{
+    struct preload_dll *dll;
+    WCHAR buffer[64], *fullname;
+    BOOL queued = FALSE;
+    HANDLE thread;
+    int i;
+
+    if (!preload_enabled || !load_path || is_wow64) return;
+
+    for (i = 0; i < count; i++)
+    {
+        const char *name = get_rva( wm->ldr.DllBase, imports[i].Name );
+        DWORD len = strlen( name );
+        const WCHAR *ext;
+
+        while (len && name[len-1] == ' ') len--;  /* remove trailing spaces */
+        if (!len || len >= ARRAY_SIZE(buffer) - 4) continue;
+        ascii_to_unicode( buffer, name, len );
+        buffer[len] = 0;
+        if (!(ext = wcsrchr( buffer, '.' ))) wcscpy( buffer + len, dllW );
+
+        if (contains_path( buffer ) || find_basename_module( buffer )) continue;
+        if (find_actctx_dll( buffer, &fullname ) != STATUS_SXS_KEY_NOT_FOUND)
+        {
+            RtlFreeHeap( GetProcessHeap(), 0, fullname );
+            continue;
+        }
+        LIST_FOR_EACH_ENTRY( dll, &preload_list, struct preload_dll, entry )
+            if (!wcsicmp( dll->name, buffer ) && !wcscmp( dll->load_path, load_path )) break;
+        if (&dll->entry != &preload_list) continue;
+
+        if (!(dll = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*dll) ))) break;
+        dll->load_path = RtlAllocateHeap( GetProcessHeap(), 0, (wcslen( load_path ) + 1) * sizeof(WCHAR) );
+        dll->name = RtlAllocateHeap( GetProcessHeap(), 0, (wcslen( buffer ) + 1) * sizeof(WCHAR) );
+        if (!dll->load_path || !dll->name)
+        {
+            free_preload_dll( dll );
+            break;
+        }
+        wcscpy( dll->load_path, load_path );
+        wcscpy( dll->name, buffer );
+        dll->state = PRELOAD_QUEUED;
+        list_add_tail( &preload_list, &dll->entry );
+
+        RtlEnterCriticalSection( &preload_section );
+        list_add_tail( &preload_queue, &dll->queue_entry );
+        RtlLeaveCriticalSection( &preload_section );
+        queued = TRUE;
+    }
+    if (!queued) return;
+
+    RtlWakeAllConditionVariable( &preload_cv );
+    while (preload_workers < min( NtCurrentTeb()->Peb->NumberOfProcessors, PRELOAD_MAX_WORKERS ))
+    {
+        if (NtCreateThreadEx( &thread, THREAD_ALL_ACCESS, NULL, NtCurrentProcess(), preload_worker,
+                              NULL, THREAD_CREATE_FLAGS_LOADER_WORKER | THREAD_CREATE_FLAGS_SKIP_LOADER_INIT,
+                              0, 0, 0, NULL ))
+            break;
+        NtClose( thread );
+        preload_workers++;
+    }
+}
+
+
+/***********************************************************************
+ *	get_preload_dll
+ *
+ * Get the preloaded dll for a search, waiting for the worker if needed.
+ * The loader_section must be locked while calling this function.
+ */
+static struct preload_dll *get_preload_dll( LPCWSTR paths, LPCWSTR search )
+{
+    struct preload_dll *dll;
+
+    LIST_FOR_EACH_ENTRY( dll, &preload_list, struct preload_dll, entry )
+    {
+        if (wcsicmp( dll->name, search ) || wcscmp( dll->load_path, paths )) continue;
+        list_remove( &dll->entry );
+
+        RtlEnterCriticalSection( &preload_section );
+        if (dll->state == PRELOAD_QUEUED) list_remove( &dll->queue_entry );
+        else while (dll->state != PRELOAD_DONE)
+            RtlSleepConditionVariableCS( &preload_cv, &preload_section, NULL );
+        RtlLeaveCriticalSection( &preload_section );
+
+        if (dll->module) return dll;
+        free_preload_dll( dll );
+        return NULL;
+    }
+    return NULL;
+}
+
+
+/***********************************************************************
+ *	open_preloaded_dll
+ *
+ * Use the mapping of a preloaded dll, equivalent to open_dll_file.
+ */
+static NTSTATUS open_preloaded_dll( struct preload_dll *dll, UNICODE_STRING *nt_name, WINE_MODREF **pwm,
+                                    void **module, pe_image_info_t *image_info, struct file_id *id )
+{
+    if ((*pwm = find_fullname_module( nt_name )) ||
+        (dll->has_id && (*pwm = find_fileid_module( &dll->id ))))
+    {
+        NtUnmapViewOfSection( NtCurrentProcess(), *module );
+        *module = NULL;
+        return STATUS_SUCCESS;
+    }
+    if (*module) NtUnmapViewOfSection( NtCurrentProcess(), *module );
+    *module = dll->module;
+    *image_info = dll->image_info;
+    if (dll->has_id) *id = dll->id;
+    dll->module = NULL;
+    return STATUS_SUCCESS;
+}
+
+
+/***********************************************************************
+ *	finish_preload
+ *
+ * Stop the preload workers and release the mappings that were not used.
+ * The loader_section must be locked while calling this function.
+ */
+static void finish_preload(void)
+{
+    struct preload_dll *dll, *next;
+
+    if (!preload_enabled) return;
+    preload_enabled = FALSE;
+
+    RtlEnterCriticalSection( &preload_section );
+    preload_shutdown = TRUE;
+    list_init( &preload_queue );
+    RtlWakeAllConditionVariable( &preload_cv );
+    LIST_FOR_EACH_ENTRY( dll, &preload_list, struct preload_dll, entry )
+        while (dll->state == PRELOAD_RUNNING)
+            RtlSleepConditionVariableCS( &preload_cv, &preload_section, NULL );
+    RtlLeaveCriticalSection( &preload_section );
+
+    LIST_FOR_EACH_ENTRY_SAFE( dll, next, &preload_list, struct preload_dll, entry )
+    {
+        list_remove( &dll->entry );
+        free_preload_dll( dll );
+    }
+}
+
+
 /***********************************************************************
  *	search_dll_file
  *
@@ -2707,12 +3591,16 @@ static NTSTATUS search_dll_file( LPCWSTR paths, LPCWSTR search, UNICODE_STRING *
     BOOL found_image = FALSE;
     NTSTATUS status = STATUS_DLL_NOT_FOUND;
     ULONG len = wcslen( paths );
+    struct preload_dll *preload = get_preload_dll( paths, search );
 
     if (len < wcslen( system_dir )) len = wcslen( system_dir );
     len += wcslen( search ) + 2;
 
     if (!(name = RtlAllocateHeap( GetProcessHeap(), 0, len * sizeof(WCHAR) )))
+    {
+        if (preload) free_preload_dll( preload );
         return STATUS_NO_MEMORY;
+    }
 
     while (*paths)
     {
@@ -2728,7 +3616,10 @@ static NTSTATUS search_dll_file( LPCWSTR paths, LPCWSTR search, UNICODE_STRING *
         nt_name->Buffer = NULL;
         if ((status = RtlDosPathNameToNtPathName_U_WithStatus( name, nt_name, NULL, NULL ))) goto done;
 
-        status = open_dll_file( nt_name, pwm, module, image_info, id );
+        if (preload && RtlEqualUnicodeString( nt_name, &preload->nt_name, TRUE ))
+            status = open_preloaded_dll( preload, nt_name, pwm, module, image_info, id );
+        else
+            status = open_dll_file( nt_name, pwm, module, image_info, id );
         if (status == STATUS_IMAGE_MACHINE_TYPE_MISMATCH) found_image = TRUE;
         else if (status != STATUS_DLL_NOT_FOUND) goto done;
         RtlFreeUnicodeString( nt_name );
@@ -2745,6 +3636,7 @@ static NTSTATUS search_dll_file( LPCWSTR paths, LPCWSTR search, UNICODE_STRING *
     else status = STATUS_IMAGE_MACHINE_TYPE_MISMATCH;
 
 done:
+    if (preload) free_preload_dll( preload );
     RtlFreeHeap( GetProcessHeap(), 0, name );
     return status;
 }
@@ -2872,10 +3764,13 @@ static NTSTATUS load_dll( const WCHAR *load_path, const WCHAR *libname, const WC
     void *module;
     pe_image_info_t image_info;
     NTSTATUS nts;
+    ULONGLONG start;
 
     TRACE( "looking for %s in %s\n", debugstr_w(libname), debugstr_w(load_path) );
 
+    start = get_startup_counter();
     nts = find_dll_file( load_path, libname, default_ext, &nt_name, pwm, &module, &image_info, &id );
+    startup_map_time += get_startup_counter() - start;
 
     if (*pwm)  /* found already loaded module */
     {
@@ -3448,6 +4343,7 @@ void WINAPI LdrShutdownThread(void)
 
     /* don't do any detach calls if process is exiting */
     if (process_detaching) return;
+    if (NtCurrentTeb()->SameTebFlags & TEB_SAME_FLAGS_SKIP_LOADER_INIT) return;
 
     if (NtCurrentTeb()->FlsSlots)
     {
@@ -3523,6 +4419,7 @@ static void free_modref( WINE_MODREF *wm )
     if (cached_modref == wm) cached_modref = NULL;
     RtlFreeUnicodeString( &wm->ldr.FullDllName );
     RtlFreeHeap( GetProcessHeap(), 0, wm->deps );
+    RtlFreeHeap( GetProcessHeap(), 0, wm->export_hash );
     RtlFreeHeap( GetProcessHeap(), 0, wm );
 }
 
@@ -3670,6 +4567,8 @@ PIMAGE_NT_HEADERS WINAPI RtlImageNtHeader(HMODULE hModule)
  */
 void WINAPI LdrInitializeThunk( CONTEXT *context, void **entry, ULONG_PTR unknown3, ULONG_PTR unknown4 )
 {
+    static const WCHAR parallelW[] = {'W','I','N','E','_','P','A','R','A','L','L','E','L','_',
+                                      'L','O','A','D','E','R',0};
     static const unsigned int fls_slot_count = 8 * sizeof(NtCurrentTeb()->Peb->FlsBitmapBits);
     static int attach_done;
     int i;
@@ -3677,8 +4576,11 @@ void WINAPI LdrInitializeThunk( CONTEXT *context, void **entry, ULONG_PTR unknow
     ULONG_PTR cookie;
     WINE_MODREF *wm;
     LPCWSTR load_path = NtCurrentTeb()->Peb->ProcessParameters->DllPath.Buffer;
+    ULONGLONG start = 0, imports_time = 0;
+    WCHAR *env;
 
     if (process_detaching) return;
+    if (NtCurrentTeb()->SameTebFlags & TEB_SAME_FLAGS_SKIP_LOADER_INIT) return;
 
     RtlEnterCriticalSection( &loader_section );
 
@@ -3687,11 +4589,25 @@ void WINAPI LdrInitializeThunk( CONTEXT *context, void **entry, ULONG_PTR unknow
 
     if (!imports_fixup_done)
     {
+        if ((env = get_env( parallelW )))
+        {
+            preload_enabled = wcstoul( env, NULL, 10 ) != 0;
+            RtlFreeHeap( GetProcessHeap(), 0, env );
+        }
+        startup_timing = TRACE_ON(loaddll);
+        start = get_startup_counter();
+
         actctx_init();
         if (wm->ldr.Flags & LDR_COR_ILONLY)
             status = fixup_imports_ilonly( wm, load_path, entry );
         else
+        {
+            load_import_cache( wm );
             status = fixup_imports( wm, load_path );
+            if (!status) save_import_cache();
+        }
+        finish_preload();
+        imports_time = get_startup_counter() - start;
 
         if (status)
         {
@@ -3753,6 +4669,20 @@ void WINAPI LdrInitializeThunk( CONTEXT *context, void **entry, ULONG_PTR unknow
             }
         }
         attach_implicitly_loaded_dlls( context );
+        if (startup_timing)
+        {
+            LARGE_INTEGER counter, freq;
+
+            NtQueryPerformanceCounter( &counter, &freq );
+            TRACE_(loaddll)( "startup times: map %s us, relocate %s us, imports %s us, attach %s us\n",
+                             wine_dbgstr_longlong( startup_map_time * 1000000 / freq.QuadPart ),
+                             wine_dbgstr_longlong( startup_reloc_time * 1000000 / freq.QuadPart ),
+                             wine_dbgstr_longlong( (imports_time - startup_map_time - startup_reloc_time)
+                                                   * 1000000 / freq.QuadPart ),
+                             wine_dbgstr_longlong( (counter.QuadPart - start - imports_time)
+                                                   * 1000000 / freq.QuadPart ));
+            startup_timing = FALSE;
+        }
         unix_funcs->virtual_release_address_space();
         if (wm->ldr.TlsIndex != -1) call_tls_callbacks( wm->ldr.DllBase, DLL_PROCESS_ATTACH );
         if (wm->ldr.Flags & LDR_WINE_INTERNAL) unix_funcs->init_builtin_dll( wm->ldr.DllBase );
@@ -329,6 +329,127 @@ static void test_directory_sort( const WCHAR *testdir )
     pRtlFreeUnicodeString( &ntdirname );
 }
 
+/* count the entries returned for a directory, checking that each file is returned once */
+static UINT count_large_directory( HANDLE handle, FILE_INFORMATION_CLASS class, UNICODE_STRING *mask,
+                                   BYTE *seen, UINT nb_files )
+{
+    FILE_NAMES_INFORMATION *names;
+    FILE_BOTH_DIRECTORY_INFORMATION *both;
+    IO_STATUS_BLOCK io;
+    BYTE data[8192];
+    WCHAR name[MAX_PATH];
+    UINT data_pos, count = 0, index;
+    BOOLEAN restart = TRUE;
+    NTSTATUS status;
+    ULONG next, len;
+
+    memset( seen, 0, nb_files );
+    for (;;)
+    {
+        status = pNtQueryDirectoryFile( handle, NULL, NULL, NULL, &io, data, sizeof(data),
+                                        class, FALSE, mask, restart );
+        if (status == STATUS_NO_MORE_FILES) break;
+        ok( status == STATUS_SUCCESS, "failed to query directory; status %x\n", status );
+        if (status) break;
+        restart = FALSE;
+
+        for (data_pos = 0; data_pos < io.Information; data_pos += next)
+        {
+            if (class == FileNamesInformation)
+            {
+                names = (FILE_NAMES_INFORMATION *)(data + data_pos);
+                next = names->NextEntryOffset;
+                len = names->FileNameLength;
+                memcpy( name, names->FileName, len );
+            }
+            else
+            {
+                both = (FILE_BOTH_DIRECTORY_INFORMATION *)(data + data_pos);
+                next = both->NextEntryOffset;
+                len = both->FileNameLength;
+                memcpy( name, both->FileName, len );
+            }
+            name[len / sizeof(WCHAR)] = 0;
+
+            if (!mask && count == 0)
+                ok( !lstrcmpW( name, dotW ), "wrong first name %s\n", wine_dbgstr_w( name ));
+            else if (!mask && count == 1)
+                ok( !lstrcmpW( name, dotdotW ), "wrong second name %s\n", wine_dbgstr_w( name ));
+            else if (swscanf( name, L"large directory entry %u.txt", &index ) == 1 && index < nb_files)
+            {
+                ok( !seen[index], "file %u returned twice\n", index );
+                seen[index] = 1;
+            }
+            else ok( 0, "unexpected name %s\n", wine_dbgstr_w( name ));
+            count++;
+            if (!next) break;
+        }
+    }
+    return count;
+}
+
+static void test_large_directory(void)
+{
+    static const UINT nb_files = 5000;
+    WCHAR tmpdir[MAX_PATH], testdir[MAX_PATH], path[MAX_PATH];
+    UNICODE_STRING ntdirname, mask;
+    OBJECT_ATTRIBUTES attr;
+    IO_STATUS_BLOCK io;
+    NTSTATUS status;
+    HANDLE handle, file;
+    BYTE *seen;
+    UINT i, count;
+
+    GetTempPathW( MAX_PATH, tmpdir );
+    swprintf( testdir, MAX_PATH, L"%slargedir", tmpdir );
+    if (!CreateDirectoryW( testdir, NULL ))
+    {
+        skip( "failed to create %s, error %u\n", wine_dbgstr_w( testdir ), GetLastError() );
+        return;
+    }
+    for (i = 0; i < nb_files; i++)
+    {
+        swprintf( path, MAX_PATH, L"%s\\large directory entry %05u.txt", testdir, i );
+        file = CreateFileW( path, GENERIC_WRITE, 0, NULL, CREATE_NEW, 0, 0 );
+        ok( file != INVALID_HANDLE_VALUE, "failed to create %s, error %u\n", wine_dbgstr_w( path ), GetLastError() );
+        CloseHandle( file );
+    }
+
+    pRtlDosPathNameToNtPathName_U( testdir, &ntdirname, NULL, NULL );
+    InitializeObjectAttributes( &attr, &ntdirname, OBJ_CASE_INSENSITIVE, 0, NULL );
+    status = pNtOpenFile( &handle, SYNCHRONIZE | FILE_LIST_DIRECTORY, &attr, &io, FILE_SHARE_READ,
+                          FILE_SYNCHRONOUS_IO_NONALERT | FILE_OPEN_FOR_BACKUP_INTENT | FILE_DIRECTORY_FILE );
+    ok( status == STATUS_SUCCESS, "failed to open dir %s\n", wine_dbgstr_w( testdir ));
+
+    seen = HeapAlloc( GetProcessHeap(), 0, nb_files );
+
+    count = count_large_directory( handle, FileNamesInformation, NULL, seen, nb_files );
+    ok( count == nb_files + 2, "got %u entries\n", count );
+
+    /* restarting the scan goes back to the beginning of the directory */
+    count = count_large_directory( handle, FileBothDirectoryInformation, NULL, seen, nb_files );
+    ok( count == nb_files + 2, "got %u entries\n", count );
+    pNtClose( handle );
+
+    status = pNtOpenFile( &handle, SYNCHRONIZE | FILE_LIST_DIRECTORY, &attr, &io, FILE_SHARE_READ,
+                          FILE_SYNCHRONOUS_IO_NONALERT | FILE_OPEN_FOR_BACKUP_INTENT | FILE_DIRECTORY_FILE );
+    ok( status == STATUS_SUCCESS, "failed to open dir %s\n", wine_dbgstr_w( testdir ));
+    pRtlInitUnicodeString( &mask, L"*00?42.txt" );
+    count = count_large_directory( handle, FileBothDirectoryInformation, &mask, seen, nb_files );
+    ok( count == 10, "got %u entries\n", count );
+    pNtClose( handle );
+
+    HeapFree( GetProcessHeap(), 0, seen );
+    pRtlFreeUnicodeString( &ntdirname );
+
+    for (i = 0; i < nb_files; i++)
+    {
+        swprintf( path, MAX_PATH, L"%s\\large directory entry %05u.txt", testdir, i );
+        DeleteFileW( path );
+    }
+    RemoveDirectoryW( testdir );
+}
+
 static void test_NtQueryDirectoryFile_classes( HANDLE handle, UNICODE_STRING *mask )
 {
     IO_STATUS_BLOCK io;
@@ -939,5 +1060,6 @@ START_TEST(directory)
     test_directory_sort( sysdir );
     test_NtQueryDirectoryFile();
     test_NtQueryDirectoryFile_case();
+    test_large_directory();
     test_redirection();
 }
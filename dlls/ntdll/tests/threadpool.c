@@ -732,6 +732,107 @@ static void test_tp_work_scheduler(void)
     pTpReleasePool(pool);
 }
 
+static struct
+{
+    TP_CALLBACK_ENVIRON environment;
+    TP_WORK *work;
+    HANDLE done_event;
+    LONG pending;
+    LONG simple_count;
+    LONG work_count;
+} nested_info;
+
+static void nested_callback_done(void)
+{
+    if (!InterlockedDecrement(&nested_info.pending))
+        SetEvent(nested_info.done_event);
+}
+
+static void CALLBACK nested_work_cb(TP_CALLBACK_INSTANCE *instance, void *userdata, TP_WORK *work)
+{
+    InterlockedIncrement(&nested_info.work_count);
+    nested_callback_done();
+}
+
+static void CALLBACK nested_simple_cb(TP_CALLBACK_INSTANCE *instance, void *userdata)
+{
+    ULONG_PTR depth = (ULONG_PTR)userdata;
+    NTSTATUS status;
+
+    /* callbacks submitted from a worker thread have to be picked up by the other workers */
+    if (depth)
+    {
+        status = pTpSimpleTryPost(nested_simple_cb, (void *)(depth - 1), &nested_info.environment);
+        ok(!status, "TpSimpleTryPost failed with status %x\n", status);
+        status = pTpSimpleTryPost(nested_simple_cb, (void *)(depth - 1), &nested_info.environment);
+        ok(!status, "TpSimpleTryPost failed with status %x\n", status);
+    }
+    else
+        pTpPostWork(nested_info.work);
+
+    InterlockedIncrement(&nested_info.simple_count);
+    nested_callback_done();
+}
+
+static void test_tp_work_nested(void)
+{
+    static const DWORD max_threads[] = {1, 2, 4, 8};
+    TP_CLEANUP_GROUP *group;
+    TP_POOL *pool;
+    NTSTATUS status;
+    DWORD result;
+    unsigned int i, j;
+
+    nested_info.done_event = CreateEventW(NULL, FALSE, FALSE, NULL);
+    ok(nested_info.done_event != NULL, "CreateEventW failed\n");
+
+    for (i = 0; i < ARRAY_SIZE(max_threads); i++)
+    {
+        pool = NULL;
+        status = pTpAllocPool(&pool, NULL);
+        ok(!status, "TpAllocPool failed with status %x\n", status);
+        ok(pool != NULL, "expected pool != NULL\n");
+        pTpSetPoolMaxThreads(pool, max_threads[i]);
+
+        group = NULL;
+        status = pTpAllocCleanupGroup(&group);
+        ok(!status, "TpAllocCleanupGroup failed with status %x\n", status);
+        ok(group != NULL, "expected group != NULL\n");
+
+        memset(&nested_info.environment, 0, sizeof(nested_info.environment));
+        nested_info.environment.Version = 1;
+        nested_info.environment.Pool = pool;
+        nested_info.environment.CleanupGroup = group;
+        nested_info.work = NULL;
+        status = pTpAllocWork(&nested_info.work, nested_work_cb, NULL, &nested_info.environment);
+        ok(!status, "TpAllocWork failed with status %x\n", status);
+        ok(nested_info.work != NULL, "expected work != NULL\n");
+
+        /* each of the 8 initial callbacks spawns a tree of 2^11 - 1 simple
+         * callbacks, and every leaf posts the work item once */
+        nested_info.simple_count = 0;
+        nested_info.work_count = 0;
+        nested_info.pending = 8 * ((2 << 10) - 1) + (8 << 10);
+
+        for (j = 0; j < 8; j++)
+        {
+            status = pTpSimpleTryPost(nested_simple_cb, (void *)10, &nested_info.environment);
+            ok(!status, "TpSimpleTryPost failed with status %x\n", status);
+        }
+        result = WaitForSingleObject(nested_info.done_event, 10000);
+        ok(result == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", result);
+
+        pTpReleaseCleanupGroupMembers(group, FALSE, NULL);
+        ok(nested_info.simple_count == 8 * ((2 << 10) - 1), "got %u simple callbacks\n", nested_info.simple_count);
+        ok(nested_info.work_count == 8 << 10, "got %u work callbacks\n", nested_info.work_count);
+
+        pTpReleaseCleanupGroup(group);
+        pTpReleasePool(pool);
+    }
+
+    CloseHandle(nested_info.done_event);
+}
+
 static void CALLBACK simple_release_cb(TP_CALLBACK_INSTANCE *instance, void *userdata)
 {
     HANDLE *semaphores = userdata;
@@ -1924,6 +2025,90 @@ static void test_tp_multi_wait(void)
     CloseHandle(semaphore);
 }
 
+static struct
+{
+    HANDLE done_event;
+    LONG pending;
+    LONG signaled;
+    LONG *calls;
+} many_waits_info;
+
+static void CALLBACK many_waits_cb(TP_CALLBACK_INSTANCE *instance, void *userdata, TP_WAIT *wait, TP_WAIT_RESULT result)
+{
+    if (result == WAIT_OBJECT_0)
+        InterlockedIncrement(&many_waits_info.signaled);
+    else
+        ok(0, "unexpected result %u\n", result);
+    InterlockedIncrement(&many_waits_info.calls[(ULONG_PTR)userdata]);
+    if (!InterlockedDecrement(&many_waits_info.pending))
+        SetEvent(many_waits_info.done_event);
+}
+
+static void test_tp_many_waits(void)
+{
+    static const int count = 10000;
+    TP_CALLBACK_ENVIRON environment;
+    DWORD result;
+    HANDLE *events;
+    TP_WAIT **waits;
+    NTSTATUS status;
+    TP_POOL *pool;
+    int i;
+
+    events = HeapAlloc(GetProcessHeap(), 0, count * sizeof(*events));
+    waits = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, count * sizeof(*waits));
+    many_waits_info.calls = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, count * sizeof(*many_waits_info.calls));
+
+    many_waits_info.done_event = CreateEventW(NULL, FALSE, FALSE, NULL);
+    ok(many_waits_info.done_event != NULL, "failed to create event\n");
+    many_waits_info.pending = count;
+    many_waits_info.signaled = 0;
+
+    pool = NULL;
+    status = pTpAllocPool(&pool, NULL);
+    ok(!status, "TpAllocPool failed with status %x\n", status);
+    ok(pool != NULL, "expected pool != NULL\n");
+
+    memset(&environment, 0, sizeof(environment));
+    environment.Version = 1;
+    environment.Pool = pool;
+
+    /* register a large number of waits at once */
+    for (i = 0; i < count; i++)
+    {
+        events[i] = CreateEventW(NULL, FALSE, FALSE, NULL);
+        ok(events[i] != NULL, "failed to create event %d\n", i);
+
+        status = pTpAllocWait(&waits[i], many_waits_cb, (void *)(ULONG_PTR)i, &environment);
+        ok(!status, "TpAllocWait failed with status %x\n", status);
+        pTpSetWait(waits[i], events[i], NULL);
+    }
+
+    for (i = 0; i < count; i++)
+        SetEvent(events[i]);
+    result = WaitForSingleObject(many_waits_info.done_event, 30000);
+    ok(result == WAIT_OBJECT_0, "WaitForSingleObject returned %u\n", result);
+    ok(many_waits_info.signaled == count, "expected %d signaled waits, got %d\n",
+       count, many_waits_info.signaled);
+    /* each wait fires exactly once */
+    for (i = 0; i < count; i++)
+        if (many_waits_info.calls[i] != 1) break;
+    ok(i == count, "wait %d called %d times\n", i, i < count ? many_waits_info.calls[i] : 1);
+
+    for (i = 0; i < count; i++)
+    {
+        pTpWaitForWait(waits[i], FALSE);
+        pTpReleaseWait(waits[i]);
+        CloseHandle(events[i]);
+    }
+
+    pTpReleasePool(pool);
+    CloseHandle(many_waits_info.done_event);
+    HeapFree(GetProcessHeap(), 0, many_waits_info.calls);
+    HeapFree(GetProcessHeap(), 0, waits);
+    HeapFree(GetProcessHeap(), 0, events);
+}
+
 struct io_cb_ctx
 {
     unsigned int count;
@@ -2244,6 +2429,7 @@ START_TEST(threadpool)
     test_tp_simple();
     test_tp_work();
     test_tp_work_scheduler();
+    test_tp_work_nested();
     test_tp_group_wait();
     test_tp_group_cancel();
     test_tp_instance();
@@ -2252,6 +2438,7 @@ START_TEST(threadpool)
     test_tp_window_length();
     test_tp_wait();
     test_tp_multi_wait();
+    test_tp_many_waits();
     test_tp_io();
     test_kernel32_tp_io();
 }
@@ -122,8 +122,30 @@ struct timer_queue
  */
 
 #define THREADPOOL_WORKER_TIMEOUT 5000
+#define THREADPOOL_LOCAL_BURST 16
 #define MAXIMUM_WAITQUEUE_OBJECTS (MAXIMUM_WAIT_OBJECTS - 1)
 
+/* queue of objects with pending callbacks */
+struct threadpool_queue
+{
+    RTL_SRWLOCK             lock;
+    /* Pools of work items, locked via .lock, order matches TP_CALLBACK_PRIORITY - high, normal, low. */
+    struct list             pools[3];
+    /* number of entries in each pool, may be read without holding .lock */
+    LONG                    count[3];
+};
+
+/* internal worker thread representation */
+struct threadpool_worker
+{
+    struct list             entry;
+    struct threadpool      *pool;
+    /* work items submitted from callbacks running on this worker */
+    struct threadpool_queue queue;
+    /* number of consecutive work items taken from the local queue */
+    unsigned int            local_burst;
+};
+
 /* internal threadpool representation */
 struct threadpool
 {
@@ -131,14 +153,18 @@ struct threadpool
     LONG                    objcount;
     BOOL                    shutdown;
     CRITICAL_SECTION        cs;
-    /* Pools of work items, locked via .cs, order matches TP_CALLBACK_PRIORITY - high, normal, low. */
-    struct list             pools[3];
+    /* work items submitted from outside of the pool, and requeued work items */
+    struct threadpool_queue queue;
     RTL_CONDITION_VARIABLE  update_event;
     /* information about worker threads, locked via .cs */
+    struct list             workers;
+    struct list             free_workers;
     int                     max_workers;
     int                     min_workers;
     int                     num_workers;
-    int                     num_busy_workers;
+    /* interlocked, may be read without holding .cs */
+    LONG                    num_busy_workers;
+    LONG                    num_idle_workers;
     HANDLE                  compl_port;
     TP_POOL_STACK_INFORMATION stack_info;
 };
@@ -177,7 +203,10 @@ struct threadpool_object
     /* information about the group, locked via .group->cs */
     struct list             group_entry;
     BOOL                    is_group_member;
-    /* information about the pool, locked via .pool->cs */
+    /* information about the pool, locked via .lock */
+    RTL_SRWLOCK             lock;
+    struct threadpool_queue *queue;
+    unsigned int            queue_generation;
     struct list             pool_entry;
     RTL_CONDITION_VARIABLE  finished_event;
     RTL_CONDITION_VARIABLE  group_finished_event;
@@ -221,7 +250,7 @@ struct threadpool_object
         struct
         {
             PTP_IO_CALLBACK callback;
-            /* locked via .pool->cs */
+            /* locked via .lock */
             unsigned int    pending_count, completion_count, completion_max;
             struct io_completion *completions;
         } io;
@@ -310,9 +339,14 @@ struct waitqueue_bucket
 {
     struct list             bucket_entry;
     LONG                    objcount;
+    LONG                    capacity;
     struct list             reserved;
     struct list             waiting;
     HANDLE                  update_event;
+    /* larger wait buffers, not yet picked up by the wait queue thread */
+    struct threadpool_object **objects;
+    HANDLE                 *handles;
+    LONG                    size;
 };
 
 /* global I/O completion queue object */
@@ -383,6 +417,8 @@ static inline struct threadpool_instance *impl_from_TP_CALLBACK_INSTANCE( TP_CAL
 
 static void CALLBACK threadpool_worker_proc( void *param );
 static void tp_object_submit( struct threadpool_object *object, BOOL signaled );
+static void tp_object_submit_locked( struct threadpool_object *object, BOOL signaled );
+static void tp_threadpool_wake( struct threadpool *pool, LONG num_busy_workers );
 static void tp_object_prepare_shutdown( struct threadpool_object *object );
 static BOOL tp_object_release( struct threadpool_object *object );
 static struct threadpool *default_threadpool = NULL;
@@ -1380,6 +1416,77 @@ static void CALLBACK timerqueue_thread_proc( void *param )
     RtlExitUserThread( 0 );
 }
 
+/***********************************************************************
+ *           tp_queue_init    (internal)
+ */
+static void tp_queue_init( struct threadpool_queue *queue )
+{
+    unsigned int i;
+
+    RtlInitializeSRWLock( &queue->lock );
+    for (i = 0; i < ARRAY_SIZE(queue->pools); ++i)
+    {
+        list_init( &queue->pools[i] );
+        queue->count[i] = 0;
+    }
+}
+
+/***********************************************************************
+ *           tp_queue_pop    (internal)
+ *
+ * Removes the first object of the given priority from a queue. The caller
+ * receives an additional reference, and has to verify with the object lock
+ * held that the object was not cancelled in the meantime.
+ */
+static struct threadpool_object *tp_queue_pop( struct threadpool_queue *queue, unsigned int priority,
+                                               unsigned int *generation )
+{
+    struct threadpool_object *object = NULL;
+    struct list *ptr;
+
+    if (!*(volatile LONG *)&queue->count[priority])
+        return NULL;
+
+    RtlAcquireSRWLockExclusive( &queue->lock );
+    if ((ptr = list_head( &queue->pools[priority] )))
+    {
+        object = LIST_ENTRY( ptr, struct threadpool_object, pool_entry );
+        list_remove( &object->pool_entry );
+        queue->count[priority]--;
+        object->queue = NULL;
+        *generation = object->queue_generation;
+        InterlockedIncrement( &object->refcount );
+    }
+    RtlReleaseSRWLockExclusive( &queue->lock );
+
+    return object;
+}
+
+/***********************************************************************
+ *           tp_queue_is_empty    (internal)
+ */
+static BOOL tp_queue_is_empty( const struct threadpool_queue *queue )
+{
+    unsigned int i;
+
+    for (i = 0; i < ARRAY_SIZE(queue->count); ++i)
+        if (*(volatile const LONG *)&queue->count[i]) return FALSE;
+
+    return TRUE;
+}
+
+/***********************************************************************
+ *           tp_current_worker    (internal)
+ *
+ * Returns the worker structure if the current thread is a worker of the given pool.
+ * The pointer is stored in the TEB field used for ThreadPoolData on Windows.
+ */
+static inline struct threadpool_worker *tp_current_worker( struct threadpool *pool )
+{
+    struct threadpool_worker *worker = NtCurrentTeb()->Reserved5[2];
+    return (worker && worker->pool == pool) ? worker : NULL;
+}
+
 /***********************************************************************
  *           tp_new_worker_thread    (internal)
  *
@@ -1387,17 +1494,38 @@ static void CALLBACK timerqueue_thread_proc( void *param )
  */
 static NTSTATUS tp_new_worker_thread( struct threadpool *pool )
 {
+    struct threadpool_worker *worker;
+    struct list *ptr;
     HANDLE thread;
     NTSTATUS status;
 
+    /* Worker structures are kept until the pool is destroyed, objects may
+     * still point to the queue of a worker which is about to terminate. */
+    if ((ptr = list_head( &pool->free_workers )))
+    {
+        worker = LIST_ENTRY( ptr, struct threadpool_worker, entry );
+        list_remove( &worker->entry );
+    }
+    else
+    {
+        if (!(worker = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*worker) )))
+            return STATUS_NO_MEMORY;
+        worker->pool = pool;
+        tp_queue_init( &worker->queue );
+    }
+    worker->local_burst = 0;
+
     status = RtlCreateUserThread( GetCurrentProcess(), NULL, FALSE, NULL, 0, 0,
-                                  threadpool_worker_proc, pool, &thread, NULL );
+                                  threadpool_worker_proc, worker, &thread, NULL );
     if (status == STATUS_SUCCESS)
     {
         InterlockedIncrement( &pool->refcount );
+        list_add_tail( &pool->workers, &worker->entry );
         pool->num_workers++;
         NtClose( thread );
     }
+    else
+        list_add_tail( &pool->free_workers, &worker->entry );
     return status;
 }
 
@@ -1475,17 +1603,53 @@ static void tp_timerqueue_unlock( struct threadpool_object *timer )
     RtlLeaveCriticalSection( &timerqueue.cs );
 }
 
+/***********************************************************************
+ *           tp_waitqueue_reserve    (internal)
+ *
+ * Makes sure the wait queue thread of a bucket has buffers for count
+ * objects. Buckets for handles that fsync or esync can wait on in larger
+ * batches may outgrow the initial ones. Must be called with waitqueue.cs
+ * held.
+ */
+static NTSTATUS tp_waitqueue_reserve( struct waitqueue_bucket *bucket, LONG count )
+{
+    struct threadpool_object **objects;
+    HANDLE *handles;
+    LONG size;
+
+    if (count <= bucket->size) return STATUS_SUCCESS;
+
+    size = min( max( count, bucket->size * 2 ), bucket->capacity );
+    objects = RtlAllocateHeap( GetProcessHeap(), 0, size * sizeof(*objects) );
+    handles = RtlAllocateHeap( GetProcessHeap(), 0, (size + 1) * sizeof(*handles) );
+    if (!objects || !handles)
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, objects );
+        RtlFreeHeap( GetProcessHeap(), 0, handles );
+        return STATUS_NO_MEMORY;
+    }
+
+    /* the thread hasn't picked up the previous ones, so they are not in use */
+    RtlFreeHeap( GetProcessHeap(), 0, bucket->objects );
+    RtlFreeHeap( GetProcessHeap(), 0, bucket->handles );
+    bucket->objects = objects;
+    bucket->handles = handles;
+    bucket->size = size;
+    NtSetEvent( bucket->update_event, NULL );
+    return STATUS_SUCCESS;
+}
+
 /***********************************************************************
  *           waitqueue_thread_proc    (internal)
  */
 static void CALLBACK waitqueue_thread_proc( void *param )
 {
-    struct threadpool_object *objects[MAXIMUM_WAITQUEUE_OBJECTS];
-    HANDLE handles[MAXIMUM_WAITQUEUE_OBJECTS + 1];
+    struct threadpool_object *objects_buffer[MAXIMUM_WAITQUEUE_OBJECTS], **objects = objects_buffer;
+    HANDLE handles_buffer[MAXIMUM_WAITQUEUE_OBJECTS + 1], *handles = handles_buffer;
+    DWORD num_handles, index, size = MAXIMUM_WAITQUEUE_OBJECTS;
     struct waitqueue_bucket *bucket = param;
     struct threadpool_object *wait, *next;
     LARGE_INTEGER now, timeout;
-    DWORD num_handles;
     NTSTATUS status;
 
     TRACE( "starting wait queue thread\n" );
@@ -1494,6 +1658,19 @@ static void CALLBACK waitqueue_thread_proc( void *param )
 
     for (;;)
     {
+        if (bucket->objects)
+        {
+            /* Switch to the larger buffers allocated by tp_waitqueue_reserve.
+             * They are refilled on every iteration, so there is nothing to copy. */
+            if (objects != objects_buffer) RtlFreeHeap( GetProcessHeap(), 0, objects );
+            if (handles != handles_buffer) RtlFreeHeap( GetProcessHeap(), 0, handles );
+            objects = bucket->objects;
+            handles = bucket->handles;
+            size = bucket->size;
+            bucket->objects = NULL;
+            bucket->handles = NULL;
+        }
+
         NtQuerySystemTime( &now );
         timeout.QuadPart = TIMEOUT_INFINITE;
         num_handles = 0;
@@ -1509,12 +1686,11 @@ static void CALLBACK waitqueue_thread_proc( void *param )
                 list_add_tail( &bucket->reserved, &wait->u.wait.wait_entry );
                 tp_object_submit( wait, FALSE );
             }
-            else
+            else if (num_handles < size)
             {
                 if (wait->u.wait.timeout < timeout.QuadPart)
                     timeout.QuadPart = wait->u.wait.timeout;
 
-                assert( num_handles < MAXIMUM_WAITQUEUE_OBJECTS );
                 InterlockedIncrement( &wait->refcount );
                 objects[num_handles] = wait;
                 handles[num_handles] = wait->u.wait.handle;
@@ -1539,19 +1715,19 @@ static void CALLBACK waitqueue_thread_proc( void *param )
         {
             handles[num_handles] = bucket->update_event;
             RtlLeaveCriticalSection( &waitqueue.cs );
-            status = NtWaitForMultipleObjects( num_handles + 1, handles, TRUE, FALSE, &timeout );
+            status = unix_funcs->wait_objects_any( num_handles + 1, handles, &timeout, &index );
             RtlEnterCriticalSection( &waitqueue.cs );
 
-            if (status >= STATUS_WAIT_0 && status < STATUS_WAIT_0 + num_handles)
+            if (status == STATUS_WAIT_0 && index < num_handles)
             {
-                wait = objects[status - STATUS_WAIT_0];
+                wait = objects[index];
                 assert( wait->type == TP_OBJECT_TYPE_WAIT );
                 if (wait->u.wait.bucket)
                 {
-                    /* Wait object signaled. */
-                    assert( wait->u.wait.bucket == bucket );
+                    /* Wait object signaled. It may have been moved to
+                     * another bucket by TpSetWait in the meantime. */
                     list_remove( &wait->u.wait.wait_entry );
-                    list_add_tail( &bucket->reserved, &wait->u.wait.wait_entry );
+                    list_add_tail( &wait->u.wait.bucket->reserved, &wait->u.wait.wait_entry );
                     tp_object_submit( wait, TRUE );
                 }
                 else
@@ -1569,13 +1745,15 @@ static void CALLBACK waitqueue_thread_proc( void *param )
 
         /* Try to merge bucket with other threads. */
         if (waitqueue.num_buckets > 1 && bucket->objcount &&
-            bucket->objcount <= MAXIMUM_WAITQUEUE_OBJECTS * 1 / 3)
+            bucket->objcount <= bucket->capacity * 1 / 3)
         {
             struct waitqueue_bucket *other_bucket;
             LIST_FOR_EACH_ENTRY( other_bucket, &waitqueue.buckets, struct waitqueue_bucket, bucket_entry )
             {
                 if (other_bucket != bucket && other_bucket->objcount &&
-                    other_bucket->objcount + bucket->objcount <= MAXIMUM_WAITQUEUE_OBJECTS * 2 / 3)
+                    other_bucket->capacity == bucket->capacity &&
+                    other_bucket->objcount + bucket->objcount <= bucket->capacity * 2 / 3 &&
+                    !tp_waitqueue_reserve( other_bucket, other_bucket->objcount + bucket->objcount ))
                 {
                     other_bucket->objcount += bucket->objcount;
                     bucket->objcount = 0;
@@ -1622,51 +1800,48 @@ static void CALLBACK waitqueue_thread_proc( void *param )
     assert( list_empty( &bucket->waiting ) );
     NtClose( bucket->update_event );
 
+    if (objects != objects_buffer) RtlFreeHeap( GetProcessHeap(), 0, objects );
+    if (handles != handles_buffer) RtlFreeHeap( GetProcessHeap(), 0, handles );
+    RtlFreeHeap( GetProcessHeap(), 0, bucket->objects );
+    RtlFreeHeap( GetProcessHeap(), 0, bucket->handles );
     RtlFreeHeap( GetProcessHeap(), 0, bucket );
     RtlExitUserThread( 0 );
 }
 
 /***********************************************************************
- *           tp_waitqueue_lock    (internal)
+ *           tp_waitqueue_get_bucket    (internal)
+ *
+ * Returns a bucket with room for another wait object, creating a new one
+ * and its wait queue thread if necessary. Must be called with waitqueue.cs
+ * held, and the caller has to add the wait object before releasing it.
  */
-static NTSTATUS tp_waitqueue_lock( struct threadpool_object *wait )
+static NTSTATUS tp_waitqueue_get_bucket( LONG capacity, struct waitqueue_bucket **ret )
 {
     struct waitqueue_bucket *bucket;
     NTSTATUS status;
     HANDLE thread;
-    assert( wait->type == TP_OBJECT_TYPE_WAIT );
-
-    wait->u.wait.signaled       = 0;
-    wait->u.wait.bucket         = NULL;
-    wait->u.wait.wait_pending   = FALSE;
-    wait->u.wait.timeout        = 0;
-    wait->u.wait.handle         = INVALID_HANDLE_VALUE;
-
-    RtlEnterCriticalSection( &waitqueue.cs );
 
     /* Try to assign to existing bucket if possible. */
     LIST_FOR_EACH_ENTRY( bucket, &waitqueue.buckets, struct waitqueue_bucket, bucket_entry )
     {
-        if (bucket->objcount < MAXIMUM_WAITQUEUE_OBJECTS)
+        if (bucket->capacity == capacity && bucket->objcount < capacity)
         {
-            list_add_tail( &bucket->reserved, &wait->u.wait.wait_entry );
-            wait->u.wait.bucket = bucket;
-            bucket->objcount++;
-
-            status = STATUS_SUCCESS;
-            goto out;
+            if (tp_waitqueue_reserve( bucket, bucket->objcount + 1 )) return STATUS_NO_MEMORY;
+            *ret = bucket;
+            return STATUS_SUCCESS;
         }
     }
 
     /* Create a new bucket and corresponding worker thread. */
     bucket = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*bucket) );
     if (!bucket)
-    {
-        status = STATUS_NO_MEMORY;
-        goto out;
-    }
+        return STATUS_NO_MEMORY;
 
     bucket->objcount = 0;
+    bucket->capacity = capacity;
+    bucket->objects  = NULL;
+    bucket->handles  = NULL;
+    bucket->size     = MAXIMUM_WAITQUEUE_OBJECTS;
     list_init( &bucket->reserved );
     list_init( &bucket->waiting );
 
@@ -1675,29 +1850,52 @@ static NTSTATUS tp_waitqueue_lock( struct threadpool_object *wait )
     if (status)
     {
         RtlFreeHeap( GetProcessHeap(), 0, bucket );
-        goto out;
+        return status;
     }
 
     status = RtlCreateUserThread( GetCurrentProcess(), NULL, FALSE, NULL, 0, 0,
                                   waitqueue_thread_proc, bucket, &thread, NULL );
-    if (status == STATUS_SUCCESS)
+    if (status)
     {
-        list_add_tail( &waitqueue.buckets, &bucket->bucket_entry );
-        waitqueue.num_buckets++;
+        NtClose( bucket->update_event );
+        RtlFreeHeap( GetProcessHeap(), 0, bucket );
+        return status;
+    }
+
+    NtClose( thread );
+    list_add_tail( &waitqueue.buckets, &bucket->bucket_entry );
+    waitqueue.num_buckets++;
 
+    *ret = bucket;
+    return STATUS_SUCCESS;
+}
+
+/***********************************************************************
+ *           tp_waitqueue_lock    (internal)
+ */
+static NTSTATUS tp_waitqueue_lock( struct threadpool_object *wait )
+{
+    struct waitqueue_bucket *bucket;
+    NTSTATUS status;
+    assert( wait->type == TP_OBJECT_TYPE_WAIT );
+
+    wait->u.wait.signaled       = 0;
+    wait->u.wait.bucket         = NULL;
+    wait->u.wait.wait_pending   = FALSE;
+    wait->u.wait.timeout        = 0;
+    wait->u.wait.handle         = INVALID_HANDLE_VALUE;
+
+    RtlEnterCriticalSection( &waitqueue.cs );
+
+    /* The handle is not known yet, so start out in a regular bucket. */
+    status = tp_waitqueue_get_bucket( MAXIMUM_WAITQUEUE_OBJECTS, &bucket );
+    if (status == STATUS_SUCCESS)
+    {
         list_add_tail( &bucket->reserved, &wait->u.wait.wait_entry );
         wait->u.wait.bucket = bucket;
         bucket->objcount++;
-
-        NtClose( thread );
-    }
-    else
-    {
-        NtClose( bucket->update_event );
-        RtlFreeHeap( GetProcessHeap(), 0, bucket );
     }
 
-out:
     RtlLeaveCriticalSection( &waitqueue.cs );
     return status;
 }
@@ -1745,15 +1943,18 @@ static void CALLBACK ioqueue_thread_proc( void *param )
 
         if (key)
         {
+            LONG num_busy_workers;
+
             io = (struct threadpool_object *)key;
+            num_busy_workers = *(volatile LONG *)&io->pool->num_busy_workers;
 
-            RtlEnterCriticalSection( &io->pool->cs );
+            RtlAcquireSRWLockExclusive( &io->lock );
 
             if (!array_reserve((void **)&io->u.io.completions, &io->u.io.completion_max,
                     io->u.io.completion_count + 1, sizeof(*io->u.io.completions)))
             {
                 ERR("Failed to allocate memory.\n");
-                RtlLeaveCriticalSection( &io->pool->cs );
+                RtlReleaseSRWLockExclusive( &io->lock );
                 continue;
             }
 
@@ -1761,9 +1962,11 @@ static void CALLBACK ioqueue_thread_proc( void *param )
             completion->iosb = iosb;
             completion->cvalue = value;
 
-            tp_object_submit( io, FALSE );
+            tp_object_submit_locked( io, FALSE );
+
+            RtlReleaseSRWLockExclusive( &io->lock );
 
-            RtlLeaveCriticalSection( &io->pool->cs );
+            tp_threadpool_wake( io->pool, num_busy_workers );
         }
 
         if (!ioqueue.objcount)
@@ -1854,7 +2057,6 @@ static NTSTATUS tp_threadpool_alloc( struct threadpool **out )
 {
     IMAGE_NT_HEADERS *nt = RtlImageNtHeader( NtCurrentTeb()->Peb->ImageBaseAddress );
     struct threadpool *pool;
-    unsigned int i;
 
     pool = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*pool) );
     if (!pool)
@@ -1867,14 +2069,16 @@ static NTSTATUS tp_threadpool_alloc( struct threadpool **out )
     RtlInitializeCriticalSection( &pool->cs );
     pool->cs.DebugInfo->Spare[0] = (DWORD_PTR)(__FILE__ ": threadpool.cs");
 
-    for (i = 0; i < ARRAY_SIZE(pool->pools); ++i)
-        list_init( &pool->pools[i] );
+    tp_queue_init( &pool->queue );
     RtlInitializeConditionVariable( &pool->update_event );
 
+    list_init( &pool->workers );
+    list_init( &pool->free_workers );
     pool->max_workers             = 500;
     pool->min_workers             = 0;
     pool->num_workers             = 0;
     pool->num_busy_workers        = 0;
+    pool->num_idle_workers        = 0;
     pool->stack_info.StackReserve = nt->OptionalHeader.SizeOfStackReserve;
     pool->stack_info.StackCommit  = nt->OptionalHeader.SizeOfStackCommit;
 
@@ -1906,7 +2110,7 @@ static void tp_threadpool_shutdown( struct threadpool *pool )
  */
 static BOOL tp_threadpool_release( struct threadpool *pool )
 {
-    unsigned int i;
+    struct threadpool_worker *worker, *next;
 
     if (InterlockedDecrement( &pool->refcount ))
         return FALSE;
@@ -1915,8 +2119,14 @@ static BOOL tp_threadpool_release( struct threadpool *pool )
 
     assert( pool->shutdown );
     assert( !pool->objcount );
-    for (i = 0; i < ARRAY_SIZE(pool->pools); ++i)
-        assert( list_empty( &pool->pools[i] ) );
+    assert( list_empty( &pool->workers ) );
+    assert( tp_queue_is_empty( &pool->queue ) );
+
+    LIST_FOR_EACH_ENTRY_SAFE( worker, next, &pool->free_workers, struct threadpool_worker, entry )
+    {
+        assert( tp_queue_is_empty( &worker->queue ) );
+        RtlFreeHeap( GetProcessHeap(), 0, worker );
+    }
 
     pool->cs.DebugInfo->Spare[0] = 0;
     RtlDeleteCriticalSection( &pool->cs );
@@ -2096,6 +2306,9 @@ static void tp_object_initialize( struct threadpool_object *object, struct threa
     memset( &object->group_entry, 0, sizeof(object->group_entry) );
     object->is_group_member         = FALSE;
 
+    RtlInitializeSRWLock( &object->lock );
+    object->queue                   = NULL;
+    object->queue_generation        = 0;
     memset( &object->pool_entry, 0, sizeof(object->pool_entry) );
     RtlInitializeConditionVariable( &object->finished_event );
     RtlInitializeConditionVariable( &object->group_finished_event );
@@ -2118,7 +2331,7 @@ static void tp_object_initialize( struct threadpool_object *object, struct threa
             TP_CALLBACK_ENVIRON_V3 *environment_v3 = (TP_CALLBACK_ENVIRON_V3 *)environment;
 
             object->priority = environment_v3->CallbackPriority;
-            assert( object->priority < ARRAY_SIZE(pool->pools) );
+            assert( object->priority < ARRAY_SIZE(pool->queue.pools) );
         }
 
         if (environment->ActivationContext)
@@ -2155,50 +2368,125 @@ static void tp_object_initialize( struct threadpool_object *object, struct threa
         tp_object_release( object );
 }
 
-static void tp_object_prio_queue( struct threadpool_object *object )
+/***********************************************************************
+ *           tp_object_enqueue    (internal)
+ *
+ * Appends an object to a queue. Has to be called with the object lock held.
+ */
+static void tp_object_enqueue( struct threadpool_object *object, struct threadpool_queue *queue )
 {
-    ++object->pool->num_busy_workers;
-    list_add_tail( &object->pool->pools[object->priority], &object->pool_entry );
+    assert( !object->queue );
+
+    InterlockedIncrement( &object->pool->num_busy_workers );
+
+    RtlAcquireSRWLockExclusive( &queue->lock );
+    list_add_tail( &queue->pools[object->priority], &object->pool_entry );
+    queue->count[object->priority]++;
+    object->queue = queue;
+    object->queue_generation++;
+    RtlReleaseSRWLockExclusive( &queue->lock );
 }
 
 /***********************************************************************
- *           tp_object_submit    (internal)
+ *           tp_object_dequeue    (internal)
  *
- * Submits a threadpool object to the associated threadpool. This
- * function has to be VOID because TpPostWork can never fail on Windows.
+ * Removes an object from its queue, unless a worker thread is already
+ * dequeuing it. Has to be called with the object lock held.
  */
-static void tp_object_submit( struct threadpool_object *object, BOOL signaled )
+static void tp_object_dequeue( struct threadpool_object *object )
+{
+    struct threadpool_queue *queue = *(struct threadpool_queue * volatile *)&object->queue;
+
+    /* The queue can only be reset by tp_queue_pop while we hold the object lock. */
+    if (!queue) return;
+
+    RtlAcquireSRWLockExclusive( &queue->lock );
+    if (object->queue == queue)
+    {
+        list_remove( &object->pool_entry );
+        queue->count[object->priority]--;
+        object->queue = NULL;
+        InterlockedDecrement( &object->pool->num_busy_workers );
+    }
+    RtlReleaseSRWLockExclusive( &queue->lock );
+}
+
+/***********************************************************************
+ *           tp_object_submit_locked    (internal)
+ *
+ * Queues a callback for a threadpool object. Has to be called with the
+ * object lock held.
+ */
+static void tp_object_submit_locked( struct threadpool_object *object, BOOL signaled )
 {
     struct threadpool *pool = object->pool;
-    NTSTATUS status = STATUS_UNSUCCESSFUL;
+    struct threadpool_worker *worker;
 
     assert( !object->shutdown );
     assert( !pool->shutdown );
 
-    RtlEnterCriticalSection( &pool->cs );
-
-    /* Start new worker threads if required. */
-    if (pool->num_busy_workers >= pool->num_workers &&
-        pool->num_workers < pool->max_workers)
-        status = tp_new_worker_thread( pool );
-
-    /* Queue work item and increment refcount. */
+    /* Queue work item and increment refcount. Callbacks submitted from a worker
+     * thread go to its local queue, other worker threads steal them if needed. */
     InterlockedIncrement( &object->refcount );
     if (!object->num_pending_callbacks++)
-        tp_object_prio_queue( object );
+    {
+        worker = tp_current_worker( pool );
+        tp_object_enqueue( object, worker ? &worker->queue : &pool->queue );
+    }
 
     /* Count how often the object was signaled. */
     if (object->type == TP_OBJECT_TYPE_WAIT && signaled)
         object->u.wait.signaled++;
+}
 
-    /* No new thread started - wake up one existing thread. */
-    if (status != STATUS_SUCCESS)
+/***********************************************************************
+ *           tp_threadpool_wake    (internal)
+ *
+ * Makes sure that a worker thread picks up newly queued work items.
+ * The number of busy workers has to be sampled before queuing them.
+ */
+static void tp_threadpool_wake( struct threadpool *pool, LONG num_busy_workers )
+{
+    NTSTATUS status = STATUS_UNSUCCESSFUL;
+
+    /* Start new worker threads if required. */
+    if (num_busy_workers >= *(volatile int *)&pool->num_workers &&
+        *(volatile int *)&pool->num_workers < *(volatile int *)&pool->max_workers)
     {
+        RtlEnterCriticalSection( &pool->cs );
+        if (pool->num_workers < pool->max_workers)
+            status = tp_new_worker_thread( pool );
+        RtlLeaveCriticalSection( &pool->cs );
+    }
+
+    /* No new thread started - wake up one existing thread. Workers only go to
+     * sleep after checking the queues with .cs held, so there is no need to
+     * enter it if none of them is idle. */
+    if (status != STATUS_SUCCESS && *(volatile LONG *)&pool->num_idle_workers)
+    {
+        RtlEnterCriticalSection( &pool->cs );
         assert( pool->num_workers > 0 );
         RtlWakeConditionVariable( &pool->update_event );
+        RtlLeaveCriticalSection( &pool->cs );
     }
+}
 
-    RtlLeaveCriticalSection( &pool->cs );
+/***********************************************************************
+ *           tp_object_submit    (internal)
+ *
+ * Submits a threadpool object to the associated threadpool. This
+ * function has to be VOID because TpPostWork can never fail on Windows.
+ */
+static void tp_object_submit( struct threadpool_object *object, BOOL signaled )
+{
+    struct threadpool *pool = object->pool;
+    LONG num_busy_workers = *(volatile LONG *)&pool->num_busy_workers;
+
+    RtlAcquireSRWLockExclusive( &object->lock );
+    tp_object_submit_locked( object, signaled );
+    RtlReleaseSRWLockExclusive( &object->lock );
+
+    tp_threadpool_wake( pool, num_busy_workers );
 }
 
 /***********************************************************************
@@ -2208,22 +2496,21 @@ static void tp_object_submit( struct threadpool_object *object, BOOL signaled )
  */
 static void tp_object_cancel( struct threadpool_object *object )
 {
-    struct threadpool *pool = object->pool;
     LONG pending_callbacks = 0;
 
-    RtlEnterCriticalSection( &pool->cs );
+    RtlAcquireSRWLockExclusive( &object->lock );
     if (object->num_pending_callbacks)
     {
         pending_callbacks = object->num_pending_callbacks;
         object->num_pending_callbacks = 0;
-        list_remove( &object->pool_entry );
+        tp_object_dequeue( object );
 
         if (object->type == TP_OBJECT_TYPE_WAIT)
             object->u.wait.signaled = 0;
     }
     if (object->type == TP_OBJECT_TYPE_IO)
         object->u.io.pending_count = 0;
-    RtlLeaveCriticalSection( &pool->cs );
+    RtlReleaseSRWLockExclusive( &object->lock );
 
     while (pending_callbacks--)
         tp_object_release( object );
@@ -2250,17 +2537,15 @@ static BOOL object_is_finished( struct threadpool_object *object, BOOL group )
  */
 static void tp_object_wait( struct threadpool_object *object, BOOL group_wait )
 {
-    struct threadpool *pool = object->pool;
-
-    RtlEnterCriticalSection( &pool->cs );
+    RtlAcquireSRWLockExclusive( &object->lock );
     while (!object_is_finished( object, group_wait ))
     {
         if (group_wait)
-            RtlSleepConditionVariableCS( &object->group_finished_event, &pool->cs, NULL );
+            RtlSleepConditionVariableSRW( &object->group_finished_event, &object->lock, NULL, 0 );
         else
-            RtlSleepConditionVariableCS( &object->finished_event, &pool->cs, NULL );
+            RtlSleepConditionVariableSRW( &object->finished_event, &object->lock, NULL, 0 );
     }
-    RtlLeaveCriticalSection( &pool->cs );
+    RtlReleaseSRWLockExclusive( &object->lock );
 }
 
 /***********************************************************************
@@ -2320,18 +2605,91 @@ static BOOL tp_object_release( struct threadpool_object *object )
     return TRUE;
 }
 
-static struct list *threadpool_get_next_item( const struct threadpool *pool )
+/***********************************************************************
+ *           tp_threadpool_has_work    (internal)
+ *
+ * Checks if any queue of the pool contains work items. Has to be called
+ * with the pool lock held.
+ */
+static BOOL tp_threadpool_has_work( struct threadpool *pool )
 {
-    struct list *ptr;
+    struct threadpool_worker *worker;
+
+    if (!tp_queue_is_empty( &pool->queue ))
+        return TRUE;
+
+    LIST_FOR_EACH_ENTRY( worker, &pool->workers, struct threadpool_worker, entry )
+    {
+        if (!tp_queue_is_empty( &worker->queue ))
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+/***********************************************************************
+ *           tp_worker_steal    (internal)
+ *
+ * Takes the highest priority work item from the local queue of another worker.
+ */
+static struct threadpool_object *tp_worker_steal( struct threadpool_worker *worker, unsigned int *generation )
+{
+    struct threadpool *pool = worker->pool;
+    struct threadpool_object *object = NULL;
+    struct threadpool_worker *victim;
     unsigned int i;
 
-    for (i = 0; i < ARRAY_SIZE(pool->pools); ++i)
+    RtlEnterCriticalSection( &pool->cs );
+    for (i = 0; i < ARRAY_SIZE(pool->queue.pools) && !object; ++i)
     {
-        if ((ptr = list_head( &pool->pools[i] )))
-            break;
+        LIST_FOR_EACH_ENTRY( victim, &pool->workers, struct threadpool_worker, entry )
+        {
+            if (victim == worker) continue;
+            if ((object = tp_queue_pop( &victim->queue, i, generation ))) break;
+        }
+    }
+    RtlLeaveCriticalSection( &pool->cs );
+
+    return object;
+}
+
+/***********************************************************************
+ *           tp_worker_next_object    (internal)
+ *
+ * Returns the next work item for a worker thread, with an additional reference.
+ * Work items of higher priority always go first. For equal priority the local
+ * queue is preferred, but the shared queue is checked first after a burst of
+ * local work items, so that work submitted from outside of the pool cannot be
+ * starved by callbacks which keep resubmitting themselves.
+ */
+static struct threadpool_object *tp_worker_next_object( struct threadpool_worker *worker,
+                                                        unsigned int *generation )
+{
+    struct threadpool *pool = worker->pool;
+    struct threadpool_object *object;
+    unsigned int i;
+
+    for (i = 0; i < ARRAY_SIZE(pool->queue.pools); ++i)
+    {
+        if (worker->local_burst < THREADPOOL_LOCAL_BURST &&
+            (object = tp_queue_pop( &worker->queue, i, generation )))
+        {
+            worker->local_burst++;
+            return object;
+        }
+        if ((object = tp_queue_pop( &pool->queue, i, generation )))
+        {
+            worker->local_burst = 0;
+            return object;
+        }
+        if ((object = tp_queue_pop( &worker->queue, i, generation )))
+        {
+            worker->local_burst = 0;
+            return object;
+        }
     }
 
-    return ptr;
+    return tp_worker_steal( worker, generation );
 }
 
 /***********************************************************************
@@ -2342,27 +2700,38 @@ static void CALLBACK threadpool_worker_proc( void *param )
     TP_CALLBACK_INSTANCE *callback_instance;
     struct threadpool_instance instance;
     struct io_completion completion;
-    struct threadpool *pool = param;
+    struct threadpool_worker *worker = param;
+    struct threadpool *pool = worker->pool;
+    struct threadpool_object *object;
     TP_WAIT_RESULT wait_result = 0;
+    unsigned int generation;
     LARGE_INTEGER timeout;
-    struct list *ptr;
     NTSTATUS status;
 
     TRACE( "starting worker thread for pool %p\n", pool );
 
-    RtlEnterCriticalSection( &pool->cs );
+    NtCurrentTeb()->Reserved5[2] = worker;
+
     for (;;)
     {
-        while ((ptr = threadpool_get_next_item( pool )))
+        while ((object = tp_worker_next_object( worker, &generation )))
         {
-            struct threadpool_object *object = LIST_ENTRY( ptr, struct threadpool_object, pool_entry );
-            assert( object->num_pending_callbacks > 0 );
+            RtlAcquireSRWLockExclusive( &object->lock );
+
+            /* The object might have been cancelled, and possibly queued again,
+             * while it was removed from the queue. */
+            if (object->queue_generation != generation || !object->num_pending_callbacks)
+            {
+                RtlReleaseSRWLockExclusive( &object->lock );
+                InterlockedDecrement( &pool->num_busy_workers );
+                tp_object_release( object );
+                continue;
+            }
 
             /* If further pending callbacks are queued, move the work item to
-             * the end of the pool list. Otherwise remove it from the pool. */
-            list_remove( &object->pool_entry );
+             * the end of the shared queue. */
             if (--object->num_pending_callbacks)
-                tp_object_prio_queue( object );
+                tp_object_enqueue( object, &pool->queue );
 
             /* For wait objects check if they were signaled or have timed out. */
             if (object->type == TP_OBJECT_TYPE_WAIT)
@@ -2377,10 +2746,12 @@ static void CALLBACK threadpool_worker_proc( void *param )
                 object->u.io.pending_count--;
             }
 
-            /* Leave critical section and do the actual callback. */
+            /* Leave the object lock and do the actual callback. The reference
+             * owned by the pending callback is kept until it has finished. */
             object->num_associated_callbacks++;
             object->num_running_callbacks++;
-            RtlLeaveCriticalSection( &pool->cs );
+            RtlReleaseSRWLockExclusive( &object->lock );
+            tp_object_release( object );
 
             /* Initialize threadpool instance struct. */
             callback_instance = (TP_CALLBACK_INSTANCE *)&instance;
@@ -2484,9 +2855,8 @@ static void CALLBACK threadpool_worker_proc( void *param )
             }
 
         skip_cleanup:
-            RtlEnterCriticalSection( &pool->cs );
-            assert(pool->num_busy_workers);
-            pool->num_busy_workers--;
+            InterlockedDecrement( &pool->num_busy_workers );
+            RtlAcquireSRWLockExclusive( &object->lock );
 
             /* Simple callbacks are automatically shutdown after execution. */
             if (object->type == TP_OBJECT_TYPE_SIMPLE)
@@ -2506,29 +2876,53 @@ static void CALLBACK threadpool_worker_proc( void *param )
                     RtlWakeAllConditionVariable( &object->finished_event );
             }
 
+            RtlReleaseSRWLockExclusive( &object->lock );
             tp_object_release( object );
         }
 
-        /* Shutdown worker thread if requested. */
-        if (pool->shutdown)
+        /* Announce that this thread is about to go idle before checking the queues
+         * for the last time, tp_threadpool_wake relies on this ordering. */
+        RtlEnterCriticalSection( &pool->cs );
+        InterlockedIncrement( &pool->num_idle_workers );
+
+        if (tp_threadpool_has_work( pool ))
+            status = STATUS_SUCCESS;
+        else if (pool->shutdown)
+        {
+            /* Shutdown worker thread if requested. */
+            InterlockedDecrement( &pool->num_idle_workers );
             break;
+        }
+        else
+        {
+            /* Wait for new tasks or until the timeout expires. */
+            timeout.QuadPart = (ULONGLONG)THREADPOOL_WORKER_TIMEOUT * -10000;
+            status = RtlSleepConditionVariableCS( &pool->update_event, &pool->cs, &timeout );
+        }
 
-        /* Wait for new tasks or until the timeout expires. A thread only terminates
-         * when no new tasks are available, and the number of threads can be
-         * decreased without violating the min_workers limit. An exception is when
-         * min_workers == 0, then objcount is used to detect if the last thread
-         * can be terminated. */
-        timeout.QuadPart = (ULONGLONG)THREADPOOL_WORKER_TIMEOUT * -10000;
-        if (RtlSleepConditionVariableCS( &pool->update_event, &pool->cs, &timeout ) == STATUS_TIMEOUT &&
-            !threadpool_get_next_item( pool ) && (pool->num_workers > max( pool->min_workers, 1 ) ||
-            (!pool->min_workers && !pool->objcount)))
+        InterlockedDecrement( &pool->num_idle_workers );
+
+        /* A thread only terminates when no new tasks are available, and the number
+         * of threads can be decreased without violating the min_workers limit. An
+         * exception is when min_workers == 0, then objcount is used to detect if the
+         * last thread can be terminated. */
+        if (status == STATUS_TIMEOUT && !tp_threadpool_has_work( pool ) &&
+            (pool->num_workers > max( pool->min_workers, 1 ) || (!pool->min_workers && !pool->objcount)))
         {
             break;
         }
+        RtlLeaveCriticalSection( &pool->cs );
     }
+
+    /* The local queue is empty, and only this thread adds work items to it. */
+    assert( tp_queue_is_empty( &worker->queue ) );
+    list_remove( &worker->entry );
+    list_add_tail( &pool->free_workers, &worker->entry );
     pool->num_workers--;
     RtlLeaveCriticalSection( &pool->cs );
 
+    NtCurrentTeb()->Reserved5[2] = NULL;
+
     TRACE( "terminating worker thread for pool %p\n", pool );
     tp_threadpool_release( pool );
     RtlExitUserThread( 0 );
@@ -2721,7 +3115,7 @@ void WINAPI TpCancelAsyncIoOperation( TP_IO *io )
 
     TRACE( "%p\n", io );
 
-    RtlEnterCriticalSection( &this->pool->cs );
+    RtlAcquireSRWLockExclusive( &this->lock );
 
     this->u.io.pending_count--;
     if (object_is_finished( this, TRUE ))
@@ -2729,7 +3123,7 @@ void WINAPI TpCancelAsyncIoOperation( TP_IO *io )
     if (object_is_finished( this, FALSE ))
         RtlWakeAllConditionVariable( &this->finished_event );
 
-    RtlLeaveCriticalSection( &this->pool->cs );
+    RtlReleaseSRWLockExclusive( &this->lock );
 }
 
 /***********************************************************************
@@ -2849,7 +3243,6 @@ VOID WINAPI TpDisassociateCallback( TP_CALLBACK_INSTANCE *instance )
 {
     struct threadpool_instance *this = impl_from_TP_CALLBACK_INSTANCE( instance );
     struct threadpool_object *object = this->object;
-    struct threadpool *pool;
 
     TRACE( "%p\n", instance );
 
@@ -2862,14 +3255,13 @@ VOID WINAPI TpDisassociateCallback( TP_CALLBACK_INSTANCE *instance )
     if (!this->associated)
         return;
 
-    pool = object->pool;
-    RtlEnterCriticalSection( &pool->cs );
+    RtlAcquireSRWLockExclusive( &object->lock );
 
     object->num_associated_callbacks--;
     if (object_is_finished( object, FALSE ))
         RtlWakeAllConditionVariable( &object->finished_event );
 
-    RtlLeaveCriticalSection( &pool->cs );
+    RtlReleaseSRWLockExclusive( &object->lock );
     this->associated = FALSE;
 }
 
@@ -3180,11 +3572,16 @@ VOID WINAPI TpSetTimer( TP_TIMER *timer, LARGE_INTEGER *timeout, LONG period, LO
 VOID WINAPI TpSetWait( TP_WAIT *wait, HANDLE handle, LARGE_INTEGER *timeout )
 {
     struct threadpool_object *this = impl_from_TP_WAIT( wait );
+    LONG capacity = MAXIMUM_WAITQUEUE_OBJECTS;
     ULONGLONG timestamp = TIMEOUT_INFINITE;
     BOOL submit_wait = FALSE;
 
     TRACE( "%p %p %p\n", wait, handle, timeout );
 
+    /* With fsync or esync, many handles can share a single wait queue thread. */
+    if (handle)
+        capacity = unix_funcs->get_max_wait_objects( handle ) - 1;
+
     RtlEnterCriticalSection( &waitqueue.cs );
 
     assert( this->u.wait.bucket );
@@ -3192,9 +3589,19 @@ VOID WINAPI TpSetWait( TP_WAIT *wait, HANDLE handle, LARGE_INTEGER *timeout )
 
     if (handle || this->u.wait.wait_pending)
     {
-        struct waitqueue_bucket *bucket = this->u.wait.bucket;
+        struct waitqueue_bucket *bucket = this->u.wait.bucket, *new_bucket;
         list_remove( &this->u.wait.wait_entry );
 
+        /* Move to a bucket of matching size, or stay if none can be created. */
+        if (handle && bucket->capacity != capacity &&
+            !tp_waitqueue_get_bucket( capacity, &new_bucket ))
+        {
+            bucket->objcount--;
+            NtSetEvent( bucket->update_event, NULL );
+            bucket = this->u.wait.bucket = new_bucket;
+            bucket->objcount++;
+        }
+
         /* Convert relative timeout to absolute timestamp. */
         if (handle && timeout)
         {
@@ -3274,11 +3681,11 @@ void WINAPI TpStartAsyncIoOperation( TP_IO *io )
 
     TRACE( "%p\n", io );
 
-    RtlEnterCriticalSection( &this->pool->cs );
+    RtlAcquireSRWLockExclusive( &this->lock );
 
     this->u.io.pending_count++;
 
-    RtlLeaveCriticalSection( &this->pool->cs );
+    RtlReleaseSRWLockExclusive( &this->lock );
 }
 
 /***********************************************************************
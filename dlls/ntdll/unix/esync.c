@@ -29,6 +29,9 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#ifdef HAVE_SCHED_H
+# include <sched.h>
+#endif
 #ifdef HAVE_POLL_H
 #include <poll.h>
 #endif
@@ -41,6 +44,9 @@
 #ifdef HAVE_SYS_POLL_H
 # include <sys/poll.h>
 #endif
+#ifdef HAVE_SYS_RESOURCE_H
+# include <sys/resource.h>
+#endif
 #ifdef HAVE_SYS_STAT_H
 # include <sys/stat.h>
 #endif
@@ -107,11 +113,17 @@ struct event
 };
 C_ASSERT(sizeof(struct event) == 8);
 
+/* Flags in event->locked. */
+#define ESYNC_EVENT_LOCKED  1   /* the spinlock */
+#define ESYNC_EVENT_HAS_FD  2   /* set by the server once the event got an eventfd */
+
 static char shm_name[29];
 static int shm_fd;
 static void **shm_addrs;
 static int shm_addrs_size;  /* length of the allocated shm_addrs array */
 static long pagesize;
+static ULONG max_wait_objects = MAXIMUM_WAIT_OBJECTS;  /* limit for esync_wait_objects_any() */
+static unsigned int lock_spincount = 100;   /* spins before yielding on a locked event */
 
 static pthread_mutex_t shm_addrs_mutex = PTHREAD_MUTEX_INITIALIZER;
 
@@ -217,7 +229,6 @@ static NTSTATUS get_object( HANDLE handle, struct esync **obj )
     NTSTATUS ret = STATUS_SUCCESS;
     enum esync_type type = 0;
     unsigned int shm_idx = 0;
-    obj_handle_t fd_handle;
     sigset_t sigset;
     int fd = -1;
 
@@ -247,8 +258,10 @@ static NTSTATUS get_object( HANDLE handle, struct esync **obj )
             {
                 type = reply->type;
                 shm_idx = reply->shm_idx;
-                fd = receive_fd( &fd_handle );
-                assert( wine_server_ptr_handle(fd_handle) == handle );
+                if (reply->has_fd)
+                {
+                    fd = receive_thread_fd();
+                }
             }
         }
         SERVER_END_REQ;
@@ -284,7 +297,8 @@ NTSTATUS esync_close( HANDLE handle )
     {
         if (InterlockedExchange((int *)&esync_list[entry][idx].type, 0))
         {
-            close( esync_list[entry][idx].fd );
+            if (esync_list[entry][idx].fd != -1)
+                close( esync_list[entry][idx].fd );
             return STATUS_SUCCESS;
         }
     }
@@ -298,16 +312,14 @@ static NTSTATUS create_esync( enum esync_type type, HANDLE *handle, ACCESS_MASK
     NTSTATUS ret;
     data_size_t len;
     struct object_attributes *objattr;
-    obj_handle_t fd_handle;
     unsigned int shm_idx;
     sigset_t sigset;
-    int fd;
+    int fd = -1;
 
     if ((ret = alloc_object_attributes( attr, &objattr, &len ))) return ret;
 
-    /* We have to synchronize on the fd cache CS so that our calls to
-     * receive_fd don't race with theirs. */
-    server_enter_uninterrupted_section( &fd_cache_mutex, &sigset );
+    /* signals must stay blocked until we have received the fd */
+    pthread_sigmask( SIG_BLOCK, &server_block_set, &sigset );
     SERVER_START_REQ( create_esync )
     {
         req->access  = access;
@@ -321,12 +333,11 @@ static NTSTATUS create_esync( enum esync_type type, HANDLE *handle, ACCESS_MASK
             *handle = wine_server_ptr_handle( reply->handle );
             type = reply->type;
             shm_idx = reply->shm_idx;
-            fd = receive_fd( &fd_handle );
-            assert( wine_server_ptr_handle(fd_handle) == *handle );
+            if (reply->has_fd) fd = receive_thread_fd();
         }
     }
     SERVER_END_REQ;
-    server_leave_uninterrupted_section( &fd_cache_mutex, &sigset );
+    pthread_sigmask( SIG_SETMASK, &sigset, NULL );
 
     if (!ret || ret == STATUS_OBJECT_NAME_EXISTS)
     {
@@ -342,12 +353,11 @@ static NTSTATUS open_esync( enum esync_type type, HANDLE *handle,
     ACCESS_MASK access, const OBJECT_ATTRIBUTES *attr )
 {
     NTSTATUS ret;
-    obj_handle_t fd_handle;
     unsigned int shm_idx;
     sigset_t sigset;
-    int fd;
+    int fd = -1;
 
-    server_enter_uninterrupted_section( &fd_cache_mutex, &sigset );
+    pthread_sigmask( SIG_BLOCK, &server_block_set, &sigset );
     SERVER_START_REQ( open_esync )
     {
         req->access     = access;
@@ -361,12 +371,11 @@ static NTSTATUS open_esync( enum esync_type type, HANDLE *handle,
             *handle = wine_server_ptr_handle( reply->handle );
             type = reply->type;
             shm_idx = reply->shm_idx;
-            fd = receive_fd( &fd_handle );
-            assert( wine_server_ptr_handle(fd_handle) == *handle );
+            if (reply->has_fd) fd = receive_thread_fd();
         }
     }
     SERVER_END_REQ;
-    server_leave_uninterrupted_section( &fd_cache_mutex, &sigset );
+    pthread_sigmask( SIG_SETMASK, &sigset, NULL );
 
     if (!ret)
     {
@@ -468,13 +477,128 @@ NTSTATUS esync_open_event( HANDLE *handle, ACCESS_MASK access,
 
 static inline void small_pause(void)
 {
-#ifdef __i386__
+#if defined(__i386__) || defined(__x86_64__)
     __asm__ __volatile__( "rep;nop" : : : "memory" );
 #else
     __asm__ __volatile__( "" : : : "memory" );
 #endif
 }
 
+/* The lock is only held for a syscall, but the holder may get preempted.
+ * Spinning past that only burns the time slice the holder needs, and on a
+ * single CPU it can't help at all, so yield instead. */
+static void lock_event( struct event *event )
+{
+    unsigned int spin = 0;
+    int flags;
+
+    for (;;)
+    {
+        flags = event->locked & ~ESYNC_EVENT_LOCKED;
+        if (InterlockedCompareExchange( &event->locked, flags | ESYNC_EVENT_LOCKED, flags ) == flags)
+            break;
+        if (spin++ < lock_spincount)
+            small_pause();
+        else
+        {
+#ifdef HAVE_SCHED_H
+            sched_yield();
+#endif
+        }
+    }
+}
+
+static void unlock_event( struct event *event )
+{
+    __atomic_fetch_and( &event->locked, ~ESYNC_EVENT_LOCKED, __ATOMIC_SEQ_CST );
+}
+
+/* Events only get an eventfd once somebody has to block on them; until then
+ * their state lives in shared memory alone, and is authoritative. This
+ * returns the fd of an event, fetching it from the server if it has one but
+ * we didn't get it yet. If alloc is set, an fd is allocated if needed.
+ *
+ * The server takes the event lock to allocate the fd, so this must not be
+ * called while holding it. */
+static int get_event_fd( HANDLE handle, struct esync *obj, BOOL alloc )
+{
+    struct event *event = obj->shm;
+    sigset_t sigset;
+    int fd = -1;
+
+    if (obj->fd != -1) return obj->fd;
+    if (!alloc && !(__atomic_load_n( &event->locked, __ATOMIC_SEQ_CST ) & ESYNC_EVENT_HAS_FD))
+        return -1;
+
+    server_enter_uninterrupted_section( &fd_cache_mutex, &sigset );
+    if (obj->fd == -1)
+    {
+        SERVER_START_REQ( get_esync_fd )
+        {
+            req->handle = wine_server_obj_handle( handle );
+            req->alloc  = alloc;
+            if (!wine_server_call( req ) && reply->has_fd)
+            {
+                fd = receive_thread_fd();
+            }
+        }
+        SERVER_END_REQ;
+
+        if (fd != -1)
+        {
+            TRACE("Got fd %d for event %p.\n", fd, handle);
+            obj->fd = fd;
+        }
+    }
+    server_leave_uninterrupted_section( &fd_cache_mutex, &sigset );
+
+    return obj->fd;
+}
+
+/* Lock a manual-reset event, and return its fd, if it has one. */
+static int lock_event_fd( HANDLE handle, struct esync *obj )
+{
+    struct event *event = obj->shm;
+    int fd;
+
+    for (;;)
+    {
+        fd = get_event_fd( handle, obj, FALSE );
+        lock_event( event );
+        if (fd != -1 || !(event->locked & ESYNC_EVENT_HAS_FD)) return fd;
+        unlock_event( event );
+    }
+}
+
+/* Try to grab an auto-reset event without blocking. As long as the event has
+ * no fd, this has to happen under the lock, so that the server can't give it
+ * one in between and let somebody else grab it from there as well. */
+static BOOL grab_auto_event( HANDLE handle, struct esync *obj )
+{
+    struct event *event = obj->shm;
+    uint64_t value;
+    int fd;
+
+    if (obj->fd == -1)
+    {
+        BOOL grabbed = FALSE;
+        int flags;
+
+        lock_event( event );
+        if (!((flags = event->locked) & ESYNC_EVENT_HAS_FD))
+            grabbed = InterlockedCompareExchange( &event->signaled, 0, 1 );
+        unlock_event( event );
+
+        if (!(flags & ESYNC_EVENT_HAS_FD)) return grabbed;
+    }
+
+    if ((fd = get_event_fd( handle, obj, FALSE )) == -1) return FALSE;
+    if (read( fd, &value, sizeof(value) ) != sizeof(value)) return FALSE;
+
+    event->signaled = 0;
+    return TRUE;
+}
+
 /* Manual-reset events are actually racier than other objects in terms of shm
  * state. With other objects, races don't matter, because we only treat the shm
  * state as a hint that lets us skip poll()—we still have to read(). But with
@@ -530,6 +654,7 @@ NTSTATUS esync_set_event( HANDLE handle )
     struct esync *obj;
     struct event *event;
     NTSTATUS ret;
+    int fd = -1;
 
     TRACE("%p.\n", handle);
 
@@ -539,8 +664,7 @@ NTSTATUS esync_set_event( HANDLE handle )
     if (obj->type == ESYNC_MANUAL_EVENT)
     {
         /* Acquire the spinlock. */
-        while (InterlockedCompareExchange( &event->locked, 1, 0 ))
-            small_pause();
+        fd = lock_event_fd( handle, obj );
     }
 
     /* For manual-reset events, as long as we're in a lock, we can take the
@@ -554,14 +678,19 @@ NTSTATUS esync_set_event( HANDLE handle )
 
     if (!InterlockedExchange( &event->signaled, 1 ) || obj->type == ESYNC_AUTO_EVENT)
     {
-        if (write( obj->fd, &value, sizeof(value) ) == -1)
+        /* An auto-reset event may have gotten an fd just now, in which case
+         * the server either saw our change or we see the flag. */
+        if (obj->type == ESYNC_AUTO_EVENT)
+            fd = get_event_fd( handle, obj, FALSE );
+
+        if (fd != -1 && write( fd, &value, sizeof(value) ) == -1)
             ERR("write: %s\n", strerror(errno));
     }
 
     if (obj->type == ESYNC_MANUAL_EVENT)
     {
         /* Release the spinlock. */
-        event->locked = 0;
+        unlock_event( event );
     }
 
     return STATUS_SUCCESS;
@@ -573,6 +702,7 @@ NTSTATUS esync_reset_event( HANDLE handle )
     struct esync *obj;
     struct event *event;
     NTSTATUS ret;
+    int fd = -1;
 
     TRACE("%p.\n", handle);
 
@@ -582,8 +712,7 @@ NTSTATUS esync_reset_event( HANDLE handle )
     if (obj->type == ESYNC_MANUAL_EVENT)
     {
         /* Acquire the spinlock. */
-        while (InterlockedCompareExchange( &event->locked, 1, 0 ))
-            small_pause();
+        fd = lock_event_fd( handle, obj );
     }
 
     /* For manual-reset events, as long as we're in a lock, we can take the
@@ -594,7 +723,10 @@ NTSTATUS esync_reset_event( HANDLE handle )
      * leaving this function, so we always have to read(). */
     if (InterlockedExchange( &event->signaled, 0 ) || obj->type == ESYNC_AUTO_EVENT)
     {
-        if (read( obj->fd, &value, sizeof(value) ) == -1 && errno != EWOULDBLOCK && errno != EAGAIN)
+        if (obj->type == ESYNC_AUTO_EVENT)
+            fd = get_event_fd( handle, obj, FALSE );
+
+        if (fd != -1 && read( fd, &value, sizeof(value) ) == -1 && errno != EWOULDBLOCK && errno != EAGAIN)
         {
             ERR("read: %s\n", strerror(errno));
         }
@@ -603,7 +735,7 @@ NTSTATUS esync_reset_event( HANDLE handle )
     if (obj->type == ESYNC_MANUAL_EVENT)
     {
         /* Release the spinlock. */
-        event->locked = 0;
+        unlock_event( event );
     }
 
     return STATUS_SUCCESS;
@@ -614,22 +746,27 @@ NTSTATUS esync_pulse_event( HANDLE handle )
     uint64_t value = 1;
     struct esync *obj;
     NTSTATUS ret;
+    int fd;
 
     TRACE("%p.\n", handle);
 
     if ((ret = get_object( handle, &obj ))) return ret;
 
+    /* Nobody can be blocked on an event without an fd. */
+    if ((fd = get_event_fd( handle, obj, FALSE )) == -1)
+        return esync_reset_event( handle );
+
     /* This isn't really correct; an application could miss the write.
      * Unfortunately we can't really do much better. Fortunately this is rarely
      * used (and publicly deprecated). */
-    if (write( obj->fd, &value, sizeof(value) ) == -1)
+    if (write( fd, &value, sizeof(value) ) == -1)
         return errno_to_status( errno );
 
     /* Try to give other threads a chance to wake up. Hopefully erring on this
      * side is the better thing to do... */
     NtYieldExecution();
 
-    read( obj->fd, &value, sizeof(value) );
+    read( fd, &value, sizeof(value) );
 
     return STATUS_SUCCESS;
 }
@@ -645,9 +782,16 @@ NTSTATUS esync_query_event( HANDLE handle, void *info, ULONG *ret_len )
 
     if ((ret = get_object( handle, &obj ))) return ret;
 
-    fd.fd = obj->fd;
-    fd.events = POLLIN;
-    out->EventState = poll( &fd, 1, 0 );
+    if ((fd.fd = get_event_fd( handle, obj, FALSE )) == -1)
+    {
+        struct event *event = obj->shm;
+        out->EventState = event->signaled;
+    }
+    else
+    {
+        fd.events = POLLIN;
+        out->EventState = poll( &fd, 1, 0 );
+    }
     out->EventType = (obj->type == ESYNC_AUTO_EVENT ? SynchronizationEvent : NotificationEvent);
     if (ret_len) *ret_len = sizeof(*out);
 
@@ -807,14 +951,17 @@ static BOOL update_grabbed_object( struct esync *obj )
 }
 
 /* A value of STATUS_NOT_IMPLEMENTED returned from this function means that we
- * need to delegate to server_select(). */
+ * need to delegate to server_select(). The caller provides the object and
+ * pollfd arrays, which must have room for count and count + 1 entries
+ * respectively. When waiting for any object, STATUS_WAIT_0 or
+ * STATUS_ABANDONED_WAIT_0 is returned and the object index is stored in
+ * *index. */
 static NTSTATUS __esync_wait_objects( DWORD count, const HANDLE *handles, BOOLEAN wait_any,
-                             BOOLEAN alertable, const LARGE_INTEGER *timeout )
+                             BOOLEAN alertable, const LARGE_INTEGER *timeout,
+                             struct esync **objs, struct pollfd *fds, DWORD *index )
 {
     static const LARGE_INTEGER zero;
 
-    struct esync *objs[MAXIMUM_WAIT_OBJECTS];
-    struct pollfd fds[MAXIMUM_WAIT_OBJECTS + 1];
     int has_esync = 0, has_server = 0;
     BOOL msgwait = FALSE;
     LONGLONG timeleft;
@@ -828,21 +975,16 @@ static NTSTATUS __esync_wait_objects( DWORD count, const HANDLE *handles, BOOLEA
     /* Grab the APC fd if we don't already have it. */
     if (alertable && ntdll_get_thread_data()->esync_apc_fd == -1)
     {
-        obj_handle_t fd_handle;
         sigset_t sigset;
         int fd = -1;
 
-        server_enter_uninterrupted_section( &fd_cache_mutex, &sigset );
+        pthread_sigmask( SIG_BLOCK, &server_block_set, &sigset );
         SERVER_START_REQ( get_esync_apc_fd )
         {
-            if (!(ret = wine_server_call( req )))
-            {
-                fd = receive_fd( &fd_handle );
-                assert( fd_handle == GetCurrentThreadId() );
-            }
+            if (!(ret = wine_server_call( req ))) fd = receive_thread_fd();
         }
         SERVER_END_REQ;
-        server_leave_uninterrupted_section( &fd_cache_mutex, &sigset );
+        pthread_sigmask( SIG_SETMASK, &sigset, NULL );
 
         ntdll_get_thread_data()->esync_apc_fd = fd;
     }
@@ -917,22 +1059,25 @@ static NTSTATUS __esync_wait_objects( DWORD count, const HANDLE *handles, BOOLEA
                     {
                         TRACE("Woken up by handle %p [%d].\n", handles[i], i);
                         mutex->count++;
-                        return i;
+                        *index = i;
+                        return STATUS_WAIT_0;
                     }
                     else if (!mutex->count)
                     {
                         if ((size = read( obj->fd, &value, sizeof(value) )) == sizeof(value))
                         {
+                            ret = STATUS_WAIT_0;
                             if (mutex->tid == ~0)
                             {
                                 TRACE("Woken up by abandoned mutex %p [%d].\n", handles[i], i);
-                                i += STATUS_ABANDONED_WAIT_0;
+                                ret = STATUS_ABANDONED_WAIT_0;
                             }
                             else
                                 TRACE("Woken up by handle %p [%d].\n", handles[i], i);
                             mutex->tid = GetCurrentThreadId();
                             mutex->count++;
-                            return i;
+                            *index = i;
+                            return ret;
                         }
                     }
                     break;
@@ -947,7 +1092,8 @@ static NTSTATUS __esync_wait_objects( DWORD count, const HANDLE *handles, BOOLEA
                         {
                             TRACE("Woken up by handle %p [%d].\n", handles[i], i);
                             InterlockedDecrement( &semaphore->count );
-                            return i;
+                            *index = i;
+                            return STATUS_WAIT_0;
                         }
                     }
                     break;
@@ -956,14 +1102,11 @@ static NTSTATUS __esync_wait_objects( DWORD count, const HANDLE *handles, BOOLEA
                 {
                     struct event *event = obj->shm;
 
-                    if (event->signaled)
+                    if (event->signaled && grab_auto_event( handles[i], obj ))
                     {
-                        if ((size = read( obj->fd, &value, sizeof(value) )) == sizeof(value))
-                        {
-                            TRACE("Woken up by handle %p [%d].\n", handles[i], i);
-                            event->signaled = 0;
-                            return i;
-                        }
+                        TRACE("Woken up by handle %p [%d].\n", handles[i], i);
+                        *index = i;
+                        return STATUS_WAIT_0;
                     }
                     break;
                 }
@@ -974,7 +1117,8 @@ static NTSTATUS __esync_wait_objects( DWORD count, const HANDLE *handles, BOOLEA
                     if (event->signaled)
                     {
                         TRACE("Woken up by handle %p [%d].\n", handles[i], i);
-                        return i;
+                        *index = i;
+                        return STATUS_WAIT_0;
                     }
                     break;
                 }
@@ -990,6 +1134,15 @@ static NTSTATUS __esync_wait_objects( DWORD count, const HANDLE *handles, BOOLEA
 
             fds[i].fd = obj ? obj->fd : -1;
             fds[i].events = POLLIN;
+
+            /* We checked events without an fd above, so we only need one if
+             * we may actually block. */
+            if (obj && fds[i].fd == -1 && (!timeout || update_timeout( end ))
+                    && (fds[i].fd = get_event_fd( handles[i], obj, TRUE )) == -1)
+            {
+                ERR("Failed to get an fd for handle %p.\n", handles[i]);
+                return STATUS_INSUFFICIENT_RESOURCES;
+            }
         }
         if (alertable)
         {
@@ -1033,7 +1186,8 @@ static NTSTATUS __esync_wait_objects( DWORD count, const HANDLE *handles, BOOLEA
                             if (fds[i].revents & POLLIN)
                             {
                                 TRACE("Woken up by handle %p [%d].\n", handles[i], i);
-                                return i;
+                                *index = i;
+                                return STATUS_WAIT_0;
                             }
                         }
                         else
@@ -1042,9 +1196,10 @@ static NTSTATUS __esync_wait_objects( DWORD count, const HANDLE *handles, BOOLEA
                             {
                                 /* We found our object. */
                                 TRACE("Woken up by handle %p [%d].\n", handles[i], i);
+                                *index = i;
                                 if (update_grabbed_object( obj ))
-                                    return STATUS_ABANDONED_WAIT_0 + i;
-                                return i;
+                                    return STATUS_ABANDONED_WAIT_0;
+                                return STATUS_WAIT_0;
                             }
                         }
                     }
@@ -1081,6 +1236,15 @@ static NTSTATUS __esync_wait_objects( DWORD count, const HANDLE *handles, BOOLEA
          * signaled. In either case anyone who tries to wait on A or B will be
          * waiting for an instant while we put things back. */
 
+        for (i = 0; i < count; i++)
+        {
+            if (objs[i] && objs[i]->fd == -1 && get_event_fd( handles[i], objs[i], TRUE ) == -1)
+            {
+                ERR("Failed to get an fd for handle %p.\n", handles[i]);
+                return STATUS_INSUFFICIENT_RESOURCES;
+            }
+        }
+
         while (1)
         {
 tryagain:
@@ -1242,8 +1406,11 @@ static void server_set_msgwait( int in_msgwait )
 NTSTATUS esync_wait_objects( DWORD count, const HANDLE *handles, BOOLEAN wait_any,
                              BOOLEAN alertable, const LARGE_INTEGER *timeout )
 {
+    struct esync *objs[MAXIMUM_WAIT_OBJECTS];
+    struct pollfd fds[MAXIMUM_WAIT_OBJECTS + 1];
     BOOL msgwait = FALSE;
     struct esync *obj;
+    DWORD index = 0;
     NTSTATUS ret;
 
     if (count && !get_object( handles[count - 1], &obj ) && obj->type == ESYNC_QUEUE)
@@ -1252,7 +1419,9 @@ NTSTATUS esync_wait_objects( DWORD count, const HANDLE *handles, BOOLEAN wait_an
         server_set_msgwait( 1 );
     }
 
-    ret = __esync_wait_objects( count, handles, wait_any, alertable, timeout );
+    ret = __esync_wait_objects( count, handles, wait_any, alertable, timeout, objs, fds, &index );
+    if (ret == STATUS_WAIT_0 || ret == STATUS_ABANDONED_WAIT_0)
+        ret += index;
 
     if (msgwait)
         server_set_msgwait( 0 );
@@ -1260,6 +1429,44 @@ NTSTATUS esync_wait_objects( DWORD count, const HANDLE *handles, BOOLEAN wait_an
     return ret;
 }
 
+/* Returns how many handles esync_wait_objects_any() can wait on together with
+ * the given one. Message queues need the msgwait dance above, so they are
+ * limited to regular waits. */
+ULONG esync_get_max_wait_objects( HANDLE handle )
+{
+    struct esync *obj;
+
+    if (get_object( handle, &obj ) || obj->type == ESYNC_QUEUE)
+        return MAXIMUM_WAIT_OBJECTS;
+    return max_wait_objects;
+}
+
+/* Non-alertable wait for any of a set of esync objects, possibly larger than
+ * MAXIMUM_WAIT_OBJECTS. The index of the signaled object is returned
+ * separately, since it may not fit into the status code. Returns
+ * STATUS_NOT_SUPPORTED if the set is too large to be polled at once, and
+ * STATUS_NO_MEMORY if the arrays for it can't be allocated. */
+NTSTATUS esync_wait_objects_any( DWORD count, const HANDLE *handles,
+                                 const LARGE_INTEGER *timeout, DWORD *index )
+{
+    struct esync *objs_buffer[MAXIMUM_WAIT_OBJECTS], **objs = objs_buffer;
+    struct pollfd fds_buffer[MAXIMUM_WAIT_OBJECTS + 1], *fds = fds_buffer;
+    NTSTATUS ret = STATUS_NO_MEMORY;
+
+    if (count > max_wait_objects) return STATUS_NOT_SUPPORTED;
+
+    if (count > MAXIMUM_WAIT_OBJECTS)
+    {
+        objs = malloc( count * sizeof(*objs) );
+        fds = malloc( (count + 1) * sizeof(*fds) );
+    }
+    if (objs && fds)
+        ret = __esync_wait_objects( count, handles, TRUE, FALSE, timeout, objs, fds, index );
+    if (objs != objs_buffer) free( objs );
+    if (fds != fds_buffer) free( fds );
+    return ret;
+}
+
 NTSTATUS esync_signal_and_wait( HANDLE signal, HANDLE wait, BOOLEAN alertable,
     const LARGE_INTEGER *timeout )
 {
@@ -1327,7 +1534,18 @@ void esync_init(void)
     }
 
     pagesize = sysconf( _SC_PAGESIZE );
+    if (sysconf( _SC_NPROCESSORS_ONLN ) <= 1) lock_spincount = 0;
 
     shm_addrs = calloc( 128, sizeof(shm_addrs[0]) );
     shm_addrs_size = 128;
+
+#ifdef HAVE_SYS_RESOURCE_H
+    {
+        /* poll() refuses to take more descriptors than the process may have open */
+        struct rlimit rlimit;
+
+        if (!getrlimit( RLIMIT_NOFILE, &rlimit ) && rlimit.rlim_cur > MAXIMUM_WAIT_OBJECTS)
+            max_wait_objects = min( rlimit.rlim_cur, 0x10000 );
+    }
+#endif
 }
@@ -47,15 +47,16 @@ extern NTSTATUS esync_release_mutex( HANDLE *handle, LONG *prev ) DECLSPEC_HIDDE
 
 extern NTSTATUS esync_wait_objects( DWORD count, const HANDLE *handles, BOOLEAN wait_any,
                                     BOOLEAN alertable, const LARGE_INTEGER *timeout ) DECLSPEC_HIDDEN;
+extern ULONG esync_get_max_wait_objects( HANDLE handle ) DECLSPEC_HIDDEN;
+extern NTSTATUS esync_wait_objects_any( DWORD count, const HANDLE *handles,
+                                        const LARGE_INTEGER *timeout, DWORD *index ) DECLSPEC_HIDDEN;
 extern NTSTATUS esync_signal_and_wait( HANDLE signal, HANDLE wait, BOOLEAN alertable,
     const LARGE_INTEGER *timeout ) DECLSPEC_HIDDEN;
 
 
-/* We have to synchronize on the fd cache mutex so that our calls to receive_fd
- * don't race with theirs. It looks weird, I know.
- *
- * If we weren't trying to avoid touching the code I'd rename the mutex to
- * "server_fd_mutex" or something similar. */
+/* We borrow the fd cache mutex to serialize filling our own object cache. Fds
+ * are received with receive_thread_fd(), which only needs server signals to be
+ * blocked since the request. */
 extern pthread_mutex_t fd_cache_mutex;
 
-extern int receive_fd( obj_handle_t *handle ) DECLSPEC_HIDDEN;
+extern int receive_thread_fd(void) DECLSPEC_HIDDEN;
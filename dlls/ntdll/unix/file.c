@@ -56,6 +56,9 @@
 #ifdef HAVE_SYS_SOCKET_H
 #include <sys/socket.h>
 #endif
+#ifdef HAVE_SYS_UIO_H
+# include <sys/uio.h>
+#endif
 #ifdef HAVE_SYS_TIME_H
 # include <sys/time.h>
 #endif
@@ -91,6 +94,19 @@
 #ifdef HAVE_SYS_IOCTL_H
 #include <sys/ioctl.h>
 #endif
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
+#if defined(HAVE_LINUX_IO_URING_H) && defined(__NR_io_uring_setup)
+# include <sys/mman.h>
+# include <linux/io_uring.h>
+# ifdef IORING_FEAT_RW_CUR_POS
+#  define USE_IO_URING
+# endif
+#endif
 #ifdef HAVE_LINUX_IOCTL_H
 #include <linux/ioctl.h>
 #endif
@@ -124,7 +140,9 @@
 #define WINE_MOUNTMGR_EXTENSIONS
 #include "ddk/mountmgr.h"
 #include "wine/server.h"
+#include "wine/fsctl.h"
 #include "wine/list.h"
+#include "wine/rbtree.h"
 #include "wine/debug.h"
 #include "unix_private.h"
 #include "ntifs.h"
@@ -162,6 +180,18 @@ typedef struct
 /* Case-insensitivity attribute */
 #define EXT4_CASEFOLD_FL 0x40000000
 
+/* Define the ioctl to share the blocks of a file range with another file */
+#ifndef FICLONERANGE
+struct file_clone_range
+{
+    LONGLONG  src_fd;
+    ULONGLONG src_offset;
+    ULONGLONG src_length;
+    ULONGLONG dest_offset;
+};
+#define FICLONERANGE _IOW(0x94, 13, struct file_clone_range)
+#endif
+
 #ifndef O_DIRECTORY
 # define O_DIRECTORY 0200000 /* must be directory */
 #endif
@@ -172,6 +202,10 @@ typedef struct
 
 #endif  /* linux */
 
+#ifndef IOV_MAX
+# define IOV_MAX 1024
+#endif
+
 #define IS_SEPARATOR(ch)   ((ch) == '\\' || (ch) == '/')
 
 #define INVALID_NT_CHARS   '*','?','<','>','|','"'
@@ -213,7 +247,7 @@ struct dir_data_buffer
 struct dir_data_names
 {
     const WCHAR *long_name;          /* long file name in Unicode */
-    const WCHAR *short_name;         /* short file name in Unicode */
+    const WCHAR *short_name;         /* short file name in Unicode, NULL if not generated yet */
     const char  *unix_name;          /* Unix file name in host encoding */
 };
 
@@ -225,16 +259,24 @@ struct dir_data
     struct file_identity    id;      /* directory file identity */
     struct dir_data_names  *names;   /* directory file names */
     struct dir_data_buffer *buffer;  /* head of data buffers list */
+    DIR                    *stream;  /* directory being streamed, NULL if all the names are cached */
+    BOOL                    eof;     /* end of the streamed directory has been reached */
+    UNICODE_STRING          mask;    /* mask for the streamed directory entries */
 };
 
 static const unsigned int dir_data_buffer_initial_size = 4096;
 static const unsigned int dir_data_cache_initial_size  = 256;
 static const unsigned int dir_data_names_initial_size  = 64;
 
+/* directories larger than this are returned in readdir order, a batch at a time */
+static const unsigned int dir_data_stream_threshold    = 4096;
+static const unsigned int dir_data_stream_batch_size   = 512;
+
 static struct dir_data **dir_data_cache;
 static unsigned int dir_data_cache_size;
 
 static BOOL show_dot_files;
+static int sort_directories = -1;  /* -1: sort unless the directory is streamed */
 static mode_t start_umask;
 
 /* at some point we may want to allow Winelib apps to set this */
@@ -425,7 +467,8 @@ static BOOL add_dir_data_names( struct dir_data *data, const WCHAR *long_name,
         data->names = names;
     }
 
-    if (short_name[0])
+    if (!short_name) names[data->count].short_name = NULL;
+    else if (short_name[0])
     {
         if (!(names[data->count].short_name = add_dir_data_nameW( data, short_name ))) return FALSE;
     }
@@ -437,18 +480,28 @@ static BOOL add_dir_data_names( struct dir_data *data, const WCHAR *long_name,
     return TRUE;
 }
 
-/* free the complete directory data structure */
-static void free_dir_data( struct dir_data *data )
+/* free the names already returned from the directory data */
+static void reset_dir_data( struct dir_data *data )
 {
     struct dir_data_buffer *buffer, *next;
 
-    if (!data) return;
-
     for (buffer = data->buffer; buffer; buffer = next)
     {
         next = buffer->next;
         free( buffer );
     }
+    data->buffer = NULL;
+    data->count = data->pos = 0;
+}
+
+/* free the complete directory data structure */
+static void free_dir_data( struct dir_data *data )
+{
+    if (!data) return;
+
+    reset_dir_data( data );
+    if (data->stream) closedir( data->stream );
+    free( data->mask.Buffer );
     free( data->names );
     free( data );
 }
@@ -1423,17 +1476,10 @@ static BOOL append_entry( struct dir_data *data, const char *long_name,
     if (long_len == ARRAY_SIZE(long_nameW)) return TRUE;
     long_nameW[long_len] = 0;
 
+    short_len = 0;
     if (short_name)
-    {
         short_len = ntdll_umbstowcs( short_name, strlen(short_name),
                                      short_nameW, ARRAY_SIZE( short_nameW ) - 1 );
-    }
-    else  /* generate a short name if necessary */
-    {
-        short_len = 0;
-        if (!is_legal_8dot3_name( long_nameW, long_len ))
-            short_len = hash_short_file_name( long_nameW, long_len, short_nameW );
-    }
     short_nameW[short_len] = 0;
     wcsupr( short_nameW );
 
@@ -1442,11 +1488,39 @@ static BOOL append_entry( struct dir_data *data, const char *long_name,
 
     if (mask && !match_filename( long_nameW, long_len, mask ))
     {
+        /* otherwise the short name is only generated when an info class returns it */
+        if (!short_name && !is_legal_8dot3_name( long_nameW, long_len ))
+        {
+            short_len = hash_short_file_name( long_nameW, long_len, short_nameW );
+            short_nameW[short_len] = 0;
+            wcsupr( short_nameW );
+        }
         if (!short_len) return TRUE;  /* no short name to match */
         if (!match_filename( short_nameW, short_len, mask )) return TRUE;
     }
 
-    return add_dir_data_names( data, long_nameW, short_nameW, long_name );
+    return add_dir_data_names( data, long_nameW, (short_name || short_len) ? short_nameW : NULL,
+                               long_name );
+}
+
+
+/***********************************************************************
+ *           get_dir_data_short_name
+ *
+ * Return the short name of a directory entry, generating it if necessary.
+ */
+static const WCHAR *get_dir_data_short_name( const struct dir_data_names *names, WCHAR buffer[13] )
+{
+    int len;
+
+    if (names->short_name) return names->short_name;
+
+    len = wcslen( names->long_name );
+    if (is_legal_8dot3_name( names->long_name, len )) len = 0;
+    else len = hash_short_file_name( names->long_name, len, buffer );
+    buffer[len] = 0;
+    wcsupr( buffer );
+    return buffer;
 }
 
 
@@ -2006,6 +2080,8 @@ static NTSTATUS get_dir_data_entry( struct dir_data *dir_data, void *info_ptr, I
     union file_directory_info *info;
     struct stat st;
     ULONG name_len, start, dir_size, attributes;
+    const WCHAR *short_name;
+    WCHAR short_nameW[13];
 
     if (get_file_info( names->unix_name, &st, &attributes ) == -1)
     {
@@ -2060,15 +2136,17 @@ static NTSTATUS get_dir_data_entry( struct dir_data *dir_data, void *info_ptr, I
 
     case FileBothDirectoryInformation:
         info->both.EaSize = 0; /* FIXME */
-        info->both.ShortNameLength = wcslen( names->short_name ) * sizeof(WCHAR);
-        memcpy( info->both.ShortName, names->short_name, info->both.ShortNameLength );
+        short_name = get_dir_data_short_name( names, short_nameW );
+        info->both.ShortNameLength = wcslen( short_name ) * sizeof(WCHAR);
+        memcpy( info->both.ShortName, short_name, info->both.ShortNameLength );
         info->both.FileNameLength = name_len;
         break;
 
     case FileIdBothDirectoryInformation:
         info->id_both.EaSize = 0; /* FIXME */
-        info->id_both.ShortNameLength = wcslen( names->short_name ) * sizeof(WCHAR);
-        memcpy( info->id_both.ShortName, names->short_name, info->id_both.ShortNameLength );
+        short_name = get_dir_data_short_name( names, short_nameW );
+        info->id_both.ShortNameLength = wcslen( short_name ) * sizeof(WCHAR);
+        memcpy( info->id_both.ShortName, short_name, info->id_both.ShortNameLength );
         info->id_both.FileNameLength = name_len;
         break;
 
@@ -2214,34 +2292,111 @@ static NTSTATUS read_directory_data_stat( struct dir_data *data, const char *uni
 }
 
 
+/***********************************************************************
+ *           read_directory_stream
+ *
+ * Read up to 'limit' entries from a directory stream; helper for NtQueryDirectoryFile.
+ */
+static NTSTATUS read_directory_stream( struct dir_data *data, const UNICODE_STRING *mask,
+                                       unsigned int limit )
+{
+    struct dirent *de;
+    unsigned int count = 0;
+
+    while (count < limit)
+    {
+        if (!(de = readdir( data->stream )))
+        {
+            data->eof = TRUE;
+            break;
+        }
+        if (!strcmp( de->d_name, "." ) || !strcmp( de->d_name, ".." )) continue;
+        if (!append_entry( data, de->d_name, NULL, mask )) return STATUS_NO_MEMORY;
+        count++;
+    }
+    return STATUS_SUCCESS;
+}
+
+
 /***********************************************************************
  *           read_directory_readdir
  *
  * Read a directory using the POSIX readdir interface; helper for NtQueryDirectoryFile.
+ * Directories that turn out to be too large are left open, to be streamed in
+ * batches instead of being read and sorted as a whole.
  */
 static NTSTATUS read_directory_data_readdir( struct dir_data *data, const UNICODE_STRING *mask )
 {
-    struct dirent *de;
     NTSTATUS status = STATUS_NO_MEMORY;
-    DIR *dir = opendir( "." );
+    unsigned int limit = ~0u;
 
-    if (!dir) return STATUS_NO_SUCH_FILE;
+    if (!(data->stream = opendir( "." ))) return STATUS_NO_SUCH_FILE;
+
+    if (sort_directories == -1) limit = dir_data_stream_threshold;
+    else if (!sort_directories) limit = dir_data_stream_batch_size;
 
     if (!append_entry( data, ".", NULL, mask )) goto done;
     if (!append_entry( data, "..", NULL, mask )) goto done;
-    while ((de = readdir( dir )))
-    {
-        if (!strcmp( de->d_name, "." ) || !strcmp( de->d_name, ".." )) continue;
-        if (!append_entry( data, de->d_name, NULL, mask )) goto done;
-    }
+    if ((status = read_directory_stream( data, mask, limit ))) goto done;
+    if (data->eof || !mask) goto done;
+
+    /* keep the mask for the next batches */
+    status = STATUS_NO_MEMORY;
+    if (!(data->mask.Buffer = malloc( mask->Length + sizeof(WCHAR) ))) goto done;
+    memcpy( data->mask.Buffer, mask->Buffer, mask->Length );
+    data->mask.Length = data->mask.MaximumLength = mask->Length;
     status = STATUS_SUCCESS;
 
 done:
-    closedir( dir );
+    if (status || data->eof)
+    {
+        closedir( data->stream );
+        data->stream = NULL;
+    }
     return status;
 }
 
 
+/***********************************************************************
+ *           next_dir_data_batch
+ *
+ * Replace the returned entries of a streamed directory by the next batch.
+ */
+static BOOL next_dir_data_batch( struct dir_data *data )
+{
+    const UNICODE_STRING *mask = data->mask.Buffer ? &data->mask : NULL;
+
+    while (data->stream && !data->eof)
+    {
+        reset_dir_data( data );
+        if (read_directory_stream( data, mask, dir_data_stream_batch_size )) return FALSE;
+        if (data->count) return TRUE;
+    }
+    return FALSE;
+}
+
+
+/***********************************************************************
+ *           restart_dir_data
+ *
+ * Go back to the first entry of the directory data.
+ */
+static void restart_dir_data( struct dir_data *data )
+{
+    const UNICODE_STRING *mask = data->mask.Buffer ? &data->mask : NULL;
+
+    if (!data->stream)
+    {
+        data->pos = 0;
+        return;
+    }
+    reset_dir_data( data );
+    rewinddir( data->stream );
+    data->eof = FALSE;
+    if (append_entry( data, ".", NULL, mask )) append_entry( data, "..", NULL, mask );
+}
+
+
 /***********************************************************************
  *           read_directory_data
  *
@@ -2306,11 +2461,19 @@ static NTSTATUS init_cached_dir_data( struct dir_data **data_ret, int fd, const
         return status;
     }
 
-    /* sort filenames, but not "." and ".." */
-    i = 0;
-    if (i < data->count && !strcmp( data->names[i].unix_name, "." )) i++;
-    if (i < data->count && !strcmp( data->names[i].unix_name, ".." )) i++;
-    if (i < data->count) qsort( data->names + i, data->count - i, sizeof(*data->names), name_compare );
+    if (data->stream)
+    {
+        /* streamed directories are returned in readdir order */
+        if (!data->count) next_dir_data_batch( data );
+    }
+    else if (sort_directories)
+    {
+        /* sort filenames, but not "." and ".." */
+        i = 0;
+        if (i < data->count && !strcmp( data->names[i].unix_name, "." )) i++;
+        if (i < data->count && !strcmp( data->names[i].unix_name, ".." )) i++;
+        if (i < data->count) qsort( data->names + i, data->count - i, sizeof(*data->names), name_compare );
+    }
 
     if (data->count)
     {
@@ -2319,7 +2482,7 @@ static NTSTATUS init_cached_dir_data( struct dir_data **data_ret, int fd, const
         data->id.ino = st.st_ino;
     }
 
-    TRACE( "mask %s found %u files\n", debugstr_us( mask ), data->count );
+    TRACE( "mask %s found %u files%s\n", debugstr_us( mask ), data->count, data->stream ? " so far" : "" );
     for (i = 0; i < data->count; i++)
         TRACE( "%s %s\n", debugstr_w(data->names[i].long_name), debugstr_w(data->names[i].short_name) );
 
@@ -2450,10 +2613,11 @@ NTSTATUS WINAPI NtQueryDirectoryFile( HANDLE handle, HANDLE event, PIO_APC_ROUTI
         {
             union file_directory_info *last_info = NULL;
 
-            if (restart_scan) data->pos = 0;
+            if (restart_scan) restart_dir_data( data );
 
-            while (!status && data->pos < data->count)
+            while (!status)
             {
+                if (data->pos == data->count && !next_dir_data_batch( data )) break;
                 status = get_dir_data_entry( data, buffer, io, length, info_class, &last_info );
                 if (!status || status == STATUS_BUFFER_OVERFLOW) data->pos++;
                 if (single_entry && last_info) break;
@@ -2477,6 +2641,344 @@ NTSTATUS WINAPI NtQueryDirectoryFile( HANDLE handle, HANDLE event, PIO_APC_ROUTI
 }
 
 
+/* Case-insensitive lookups that need a directory scan are answered from a
+ * per-process cache of directory contents, indexed by upcased name. The
+ * cached directories are watched with inotify, and dropped as soon as
+ * anything changes in them. Directories on network and FUSE file systems
+ * are never cached, since inotify doesn't see changes made by other hosts
+ * or by the file system itself. */
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+#define DIR_CACHE_MAX_SIZE      (16 * 1024 * 1024)  /* memory used by all the cached directories */
+#define DIR_CACHE_MAX_DIR_SIZE  (DIR_CACHE_MAX_SIZE / 4)
+#define DIR_CACHE_MAX_WATCHES   512  /* inotify watches are a per-user resource, shared with other processes */
+#define DIR_CACHE_WATCH_MASK    (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+                                 IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT | IN_ONLYDIR)
+
+struct dir_cache_name
+{
+    unsigned int   hash;       /* hash of the upcased name */
+    unsigned short len;        /* length of the upcased name */
+    unsigned short unix_len;   /* length of the name on disk */
+    WCHAR          name[1];    /* upcased name, followed by the name on disk */
+};
+
+struct dir_cache
+{
+    struct wine_rb_entry  entry;  /* entry in dir_cache_tree */
+    struct list           lru;    /* entry in dir_cache_lru, most recently used first */
+    struct file_identity  id;
+    int                   wd;     /* inotify watch descriptor, -1 if the directory can't be cached */
+    unsigned int          mask;   /* size of the hash table minus one */
+    unsigned int         *table;  /* offsets plus one of the names in data, 0 for free entries, NULL if not cached */
+    char                 *data;   /* dir_cache_name records */
+    size_t                size;   /* memory used by the table and names */
+};
+
+static int compare_dir_cache( const void *key, const struct wine_rb_entry *entry )
+{
+    const struct file_identity *id = key;
+    const struct dir_cache *cache = WINE_RB_ENTRY_VALUE( entry, const struct dir_cache, entry );
+
+    if (id->dev != cache->id.dev) return id->dev < cache->id.dev ? -1 : 1;
+    if (id->ino != cache->id.ino) return id->ino < cache->id.ino ? -1 : 1;
+    return 0;
+}
+
+static pthread_mutex_t dir_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct wine_rb_tree dir_cache_tree = { compare_dir_cache };
+static struct list dir_cache_lru = LIST_INIT( dir_cache_lru );
+static size_t dir_cache_size;
+static unsigned int dir_cache_watches;
+static int dir_cache_inotify = -2;  /* -2 until initialized, -1 if unavailable */
+
+static inline unsigned int hash_dir_cache_name( const WCHAR *name, int len )
+{
+    unsigned int hash = 0x811c9dc5;  /* FNV-1a */
+
+    while (len--) hash = (hash ^ *name++) * 0x01000193;
+    return hash;
+}
+
+static inline struct dir_cache_name *get_dir_cache_name( const struct dir_cache *cache, unsigned int pos )
+{
+    return (struct dir_cache_name *)(cache->data + cache->table[pos] - 1);
+}
+
+static inline const char *get_dir_cache_unix_name( const struct dir_cache_name *name )
+{
+    return (const char *)(name->name + name->len);
+}
+
+/* dir_cache_mutex must be held by caller */
+static void free_dir_cache( struct dir_cache *cache, BOOL remove_watch )
+{
+    wine_rb_remove( &dir_cache_tree, &cache->entry );
+    list_remove( &cache->lru );
+    if (cache->wd != -1)
+    {
+        if (remove_watch) inotify_rm_watch( dir_cache_inotify, cache->wd );
+        dir_cache_watches--;
+    }
+    dir_cache_size -= cache->size;
+    free( cache->table );
+    free( cache->data );
+    free( cache );
+}
+
+/* drop the directories that changed since the last lookup; dir_cache_mutex must be held by caller */
+static void update_dir_cache(void)
+{
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *event;
+    struct dir_cache *cache, *next;
+    ssize_t size;
+    char *ptr;
+
+    while ((size = read( dir_cache_inotify, buffer, sizeof(buffer) )) > 0)
+    {
+        for (ptr = buffer; ptr < buffer + size; ptr += sizeof(*event) + event->len)
+        {
+            event = (const struct inotify_event *)ptr;
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                /* events were lost, drop everything */
+                LIST_FOR_EACH_ENTRY_SAFE( cache, next, &dir_cache_lru, struct dir_cache, lru )
+                    free_dir_cache( cache, TRUE );
+                continue;
+            }
+            LIST_FOR_EACH_ENTRY( cache, &dir_cache_lru, struct dir_cache, lru )
+            {
+                if (cache->wd != event->wd) continue;
+                TRACE( "dropping cached directory %x:%x\n", (int)cache->id.dev, (int)cache->id.ino );
+                free_dir_cache( cache, !(event->mask & IN_IGNORED) );
+                break;
+            }
+        }
+    }
+}
+
+/* check whether inotify reliably reports the changes made to a directory */
+static BOOL is_dir_cacheable( int fd )
+{
+#if defined(__linux__) && defined(HAVE_FSTATFS)
+    struct statfs stfs;
+
+    if (fstatfs( fd, &stfs ) == -1) return FALSE;
+    switch (stfs.f_type)
+    {
+    case 0x6969:      /* nfs */
+    case 0xff534d42:  /* cifs */
+    case 0xfe534d42:  /* smb2 */
+    case 0x517b:      /* smbfs */
+    case 0x65735546:  /* fuse */
+        return FALSE;
+    }
+#endif
+    return TRUE;
+}
+
+/* make room for a new inotify watch; dir_cache_mutex must be held by caller */
+static void trim_dir_cache_watches(void)
+{
+    struct dir_cache *cache, *prev;
+
+    LIST_FOR_EACH_ENTRY_SAFE_REV( cache, prev, &dir_cache_lru, struct dir_cache, lru )
+    {
+        if (dir_cache_watches < DIR_CACHE_MAX_WATCHES) break;
+        if (cache->wd != -1) free_dir_cache( cache, TRUE );
+    }
+}
+
+/* read a directory into a new cache entry; dir_cache_mutex must be held by caller */
+static struct dir_cache *create_dir_cache( const char *dir_name, const struct file_identity *id )
+{
+    WCHAR buffer[MAX_DIR_ENTRY_LEN];
+    struct dir_cache_name *name;
+    struct dir_cache *cache;
+    size_t data_size = 0, data_alloc = 4096, rec_size;
+    unsigned int i, pos, count = 0, mask = 15;
+    struct dirent *de;
+    DIR *dir;
+    char *data;
+    int len, unix_len, wd;
+
+    if (!(dir = opendir( dir_name ))) return NULL;
+    if (!is_dir_cacheable( dirfd( dir ) ))
+    {
+        /* remember that the directory can't be cached, so that it's only checked once */
+        closedir( dir );
+        if (!(cache = calloc( 1, sizeof(*cache) ))) return NULL;
+        cache->id   = *id;
+        cache->wd   = -1;
+        cache->size = sizeof(*cache);
+        TRACE( "not caching %s\n", debugstr_a(dir_name) );
+        return cache;
+    }
+
+    /* start watching before reading, so that no change can be missed */
+    trim_dir_cache_watches();
+    if ((wd = inotify_add_watch( dir_cache_inotify, dir_name, DIR_CACHE_WATCH_MASK )) == -1)
+    {
+        closedir( dir );
+        return NULL;
+    }
+    if (!(data = malloc( data_alloc ))) goto failed_dir;
+
+    while ((de = readdir( dir )))
+    {
+        len = ntdll_umbstowcs( de->d_name, strlen(de->d_name), buffer, MAX_DIR_ENTRY_LEN );
+        unix_len = strlen( de->d_name );
+        rec_size = (offsetof( struct dir_cache_name, name[len] ) + unix_len + 1 + 3) & ~3;
+        if (data_size + rec_size > DIR_CACHE_MAX_DIR_SIZE) goto failed_data;
+        if (data_size + rec_size > data_alloc)
+        {
+            char *new_data;
+            data_alloc = max( data_alloc * 2, data_size + rec_size );
+            if (!(new_data = realloc( data, data_alloc ))) goto failed_data;
+            data = new_data;
+        }
+        name = (struct dir_cache_name *)(data + data_size);
+        for (i = 0; i < len; i++) name->name[i] = towupper( buffer[i] );
+        name->hash = hash_dir_cache_name( name->name, len );
+        name->len = len;
+        name->unix_len = unix_len;
+        memcpy( (char *)(name->name + len), de->d_name, unix_len + 1 );
+        data_size += rec_size;
+        count++;
+    }
+    closedir( dir );
+
+    while (mask < count * 2) mask = mask * 2 + 1;
+    if (!(cache = malloc( sizeof(*cache) ))) goto failed_cache;
+    if (!(cache->table = calloc( mask + 1, sizeof(*cache->table) )))
+    {
+        free( cache );
+        goto failed_cache;
+    }
+    cache->id     = *id;
+    cache->wd     = wd;
+    cache->mask   = mask;
+    cache->data   = data;
+    cache->size   = data_size + (mask + 1) * sizeof(*cache->table);
+    dir_cache_watches++;
+
+    for (i = 0; i < data_size; i += (offsetof( struct dir_cache_name, name[name->len] ) + name->unix_len + 1 + 3) & ~3)
+    {
+        name = (struct dir_cache_name *)(data + i);
+        for (pos = name->hash & mask; cache->table[pos]; pos = (pos + 1) & mask)
+        {
+            const struct dir_cache_name *other = get_dir_cache_name( cache, pos );
+            /* keep the first one of names differing only by case */
+            if (other->len == name->len && !memcmp( other->name, name->name, name->len * sizeof(WCHAR) )) break;
+        }
+        if (!cache->table[pos]) cache->table[pos] = i + 1;
+    }
+    return cache;
+
+failed_data:
+    free( data );
+failed_dir:
+    closedir( dir );
+    goto failed;
+failed_cache:
+    free( data );
+failed:
+    inotify_rm_watch( dir_cache_inotify, wd );
+    return NULL;
+}
+
+/***********************************************************************
+ *           lookup_dir_cache
+ *
+ * Look up a name case-insensitively in the cached contents of a directory.
+ * On success, the name on disk is stored in unix_name.
+ * Returns -1 if the directory can't be cached.
+ */
+static int lookup_dir_cache( const char *dir_name, const WCHAR *name, int length, char *unix_name )
+{
+    WCHAR upcase[MAX_DIR_ENTRY_LEN];
+    struct wine_rb_entry *entry;
+    struct file_identity id;
+    struct dir_cache *cache;
+    unsigned int pos, hash;
+    struct stat st;
+    int i, ret = 0;
+
+    if (length > MAX_DIR_ENTRY_LEN) return -1;
+    if (stat( dir_name, &st ) == -1) return -1;
+    id.dev = st.st_dev;
+    id.ino = st.st_ino;
+    for (i = 0; i < length; i++) upcase[i] = towupper( name[i] );
+    hash = hash_dir_cache_name( upcase, length );
+
+    pthread_mutex_lock( &dir_cache_mutex );
+
+    if (dir_cache_inotify == -2)
+    {
+        dir_cache_inotify = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+        if (dir_cache_inotify == -1) WARN( "inotify not available, directory cache disabled\n" );
+    }
+    if (dir_cache_inotify == -1)
+    {
+        pthread_mutex_unlock( &dir_cache_mutex );
+        return -1;
+    }
+
+    update_dir_cache();
+
+    if ((entry = wine_rb_get( &dir_cache_tree, &id )))
+    {
+        cache = WINE_RB_ENTRY_VALUE( entry, struct dir_cache, entry );
+        list_remove( &cache->lru );
+    }
+    else
+    {
+        if (!(cache = create_dir_cache( dir_name, &id )))
+        {
+            pthread_mutex_unlock( &dir_cache_mutex );
+            return -1;
+        }
+        while (dir_cache_size + cache->size > DIR_CACHE_MAX_SIZE && !list_empty( &dir_cache_lru ))
+            free_dir_cache( LIST_ENTRY( list_tail( &dir_cache_lru ), struct dir_cache, lru ), TRUE );
+        wine_rb_put( &dir_cache_tree, &cache->id, &cache->entry );
+        dir_cache_size += cache->size;
+        if (cache->table) TRACE( "cached %s, %u bytes\n", debugstr_a(dir_name), (unsigned int)cache->size );
+    }
+    list_add_head( &dir_cache_lru, &cache->lru );
+
+    if (!cache->table)
+    {
+        pthread_mutex_unlock( &dir_cache_mutex );
+        return -1;
+    }
+
+    for (pos = hash & cache->mask; cache->table[pos]; pos = (pos + 1) & cache->mask)
+    {
+        const struct dir_cache_name *entry_name = get_dir_cache_name( cache, pos );
+
+        if (entry_name->hash != hash || entry_name->len != length) continue;
+        if (memcmp( entry_name->name, upcase, length * sizeof(WCHAR) )) continue;
+        memcpy( unix_name, get_dir_cache_unix_name( entry_name ), entry_name->unix_len + 1 );
+        ret = 1;
+        break;
+    }
+
+    pthread_mutex_unlock( &dir_cache_mutex );
+    return ret;
+}
+
+#else  /* HAVE_SYS_INOTIFY_H */
+
+static int lookup_dir_cache( const char *dir_name, const WCHAR *name, int length, char *unix_name )
+{
+    return -1;
+}
+
+#endif  /* HAVE_SYS_INOTIFY_H */
+
+
 /***********************************************************************
  *           find_file_in_dir
  *
@@ -2521,6 +3023,19 @@ static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, i
 
     if (!is_name_8_dot_3 && !get_dir_case_sensitivity( unix_name )) goto not_found;
 
+    /* short names are not cached, they need to be checked against the hashed long names */
+    if (!is_name_8_dot_3)
+    {
+        switch (lookup_dir_cache( unix_name, name, length, unix_name + pos ))
+        {
+        case 1:
+            unix_name[pos - 1] = '/';
+            goto success;
+        case 0:
+            goto not_found;
+        }
+    }
+
     /* now look for it through the directory */
 
 #ifdef VFAT_IOCTL_READDIR_BOTH
@@ -3526,6 +4041,15 @@ void CDECL set_show_dot_files( BOOL enable )
 }
 
 
+/***********************************************************************
+ *           set_sort_directories
+ */
+void CDECL set_sort_directories( BOOL enable )
+{
+    sort_directories = enable;
+}
+
+
 /******************************************************************************
  *              open_unix_file
  *
@@ -4764,21 +5288,448 @@ static NTSTATUS server_write_file( HANDLE handle, HANDLE event, PIO_APC_ROUTINE
     return status;
 }
 
-/* do an ioctl call through the server */
-static NTSTATUS server_ioctl_file( HANDLE handle, HANDLE event,
-                                   PIO_APC_ROUTINE apc, PVOID apc_context,
-                                   IO_STATUS_BLOCK *io, ULONG code,
-                                   const void *in_buffer, ULONG in_size,
-                                   PVOID out_buffer, ULONG out_size )
+/***********************************************************************
+ *           vectored_io
+ *
+ * Read or write a whole iovec array, at the current position if offset is -1.
+ * The array is modified. Returns the number of bytes transferred, or -1 with errno
+ * set if nothing could be transferred.
+ */
+static ssize_t vectored_io( int fd, struct iovec *iov, unsigned int count, off_t offset, BOOL write )
 {
-    struct async_irp *async;
-    NTSTATUS status;
-    HANDLE wait_handle;
-    ULONG options;
+    ssize_t res, total = 0;
+    int n;
 
-    if (!(async = (struct async_irp *)alloc_fileio( sizeof(*async), irp_completion, handle )))
-        return STATUS_NO_MEMORY;
-    async->buffer  = out_buffer;
+    while (count)
+    {
+        n = min( count, IOV_MAX );
+        if (offset == -1) res = write ? writev( fd, iov, n ) : readv( fd, iov, n );
+#if defined(HAVE_PREADV) && defined(HAVE_PWRITEV)
+        else if (write) res = pwritev( fd, iov, n, offset + total );
+        else res = preadv( fd, iov, n, offset + total );
+#else
+        else if (write) res = pwrite( fd, iov->iov_base, iov->iov_len, offset + total );
+        else res = pread( fd, iov->iov_base, iov->iov_len, offset + total );
+#endif
+        /* the buffer may be write-watched, read it one entry at a time */
+        if (res == -1 && errno == EFAULT && !write)
+        {
+            if (offset == -1) res = virtual_locked_read( fd, iov->iov_base, iov->iov_len );
+            else res = virtual_locked_pread( fd, iov->iov_base, iov->iov_len, offset + total );
+        }
+        if (res == -1)
+        {
+            if (errno == EINTR) continue;
+            return total ? total : -1;
+        }
+        if (!res) break;
+        total += res;
+        while (count && (size_t)res >= iov->iov_len)
+        {
+            res -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (res)
+        {
+            iov->iov_base = (char *)iov->iov_base + res;
+            iov->iov_len -= res;
+        }
+    }
+    return total;
+}
+
+#ifdef USE_IO_URING
+
+/* remove the first len bytes from an iovec array, returns the new count */
+static unsigned int skip_iovec( struct iovec *iov, unsigned int count, size_t len )
+{
+    unsigned int i = 0;
+
+    while (i < count && len >= iov[i].iov_len) len -= iov[i++].iov_len;
+    if (i < count)
+    {
+        iov[i].iov_base = (char *)iov[i].iov_base + len;
+        iov[i].iov_len -= len;
+    }
+    memmove( iov, iov + i, (count - i) * sizeof(*iov) );
+    return count - i;
+}
+
+/* transfer what can be done without blocking, returns -1 if nothing could be done */
+static ssize_t nowait_io( int fd, const struct iovec *iov, unsigned int count, off_t offset, BOOL write )
+{
+#if defined(HAVE_PREADV2) && defined(HAVE_PWRITEV2) && defined(RWF_NOWAIT)
+    if (write) return pwritev2( fd, iov, count, offset, RWF_NOWAIT );
+    return preadv2( fd, iov, count, offset, RWF_NOWAIT );
+#else
+    return -1;
+#endif
+}
+
+/* Overlapped I/O on regular files is submitted to an io_uring, so that requests from any
+ * number of threads can be in flight at the same time. The server tracks each request with
+ * an async on the file wait queue, and takes care of the event, the APC, the completion port
+ * and the file signaled state once a dedicated thread reports the completion. */
+
+enum uring_fileio_state
+{
+    URING_FILEIO_QUEUED,      /* submitted to the ring */
+    URING_FILEIO_CANCELLING,  /* cancelled by the server, the async callback waits for the result */
+    URING_FILEIO_DONE         /* result available */
+};
+
+struct async_fileio_uring
+{
+    struct async_fileio     io;
+    IO_STATUS_BLOCK        *iosb;
+    ULONG                   count;
+    ULONGLONG               offset;
+    ULONG_PTR               done;      /* transferred before submitting the request */
+    BOOL                    write;
+    enum uring_fileio_state state;
+    NTSTATUS                status;
+    ULONG_PTR               total;
+    unsigned int            iov_count;
+    struct iovec            iov[1];
+};
+
+static pthread_mutex_t uring_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t uring_cond = PTHREAD_COND_INITIALIZER;
+static pthread_once_t uring_once = PTHREAD_ONCE_INIT;
+static int uring_fd = -1;
+static unsigned int uring_sq_entries;
+static unsigned int uring_sq_mask;
+static unsigned int uring_cq_mask;
+static unsigned int *uring_sq_tail;
+static unsigned int *uring_cq_head;
+static unsigned int *uring_cq_tail;
+static struct io_uring_sqe *uring_sqes;
+static struct io_uring_cqe *uring_cqes;
+static unsigned int uring_inflight;  /* requests whose completion hasn't been reaped yet */
+
+static inline int io_uring_enter( unsigned int to_submit, unsigned int min_complete, unsigned int flags )
+{
+    return syscall( __NR_io_uring_enter, uring_fd, to_submit, min_complete, flags, NULL, 0 );
+}
+
+/* submit a request right away, so that the unix fd can be closed on return; uring_mutex must be held */
+static BOOL submit_uring_sqe( unsigned char opcode, int fd, ULONG_PTR addr, unsigned int len,
+                              ULONGLONG offset, ULONG_PTR user_data )
+{
+    unsigned int tail = *uring_sq_tail;
+    struct io_uring_sqe *sqe = &uring_sqes[tail & uring_sq_mask];
+    int ret;
+
+    memset( sqe, 0, sizeof(*sqe) );
+    sqe->opcode    = opcode;
+    sqe->fd        = fd;
+    sqe->addr      = addr;
+    sqe->len       = len;
+    sqe->off       = offset;
+    sqe->user_data = user_data;
+    __atomic_store_n( uring_sq_tail, tail + 1, __ATOMIC_RELEASE );
+
+    while ((ret = io_uring_enter( 1, 0, 0 )) == -1 && errno == EINTR);
+    if (ret == 1) return TRUE;
+
+    WARN( "io_uring_enter failed: %s\n", ret == -1 ? strerror( errno ) : "not submitted" );
+    __atomic_store_n( uring_sq_tail, tail, __ATOMIC_RELEASE );
+    return FALSE;
+}
+
+/* read again through virtual_locked_pread, in case the buffer is write-watched */
+static int retry_uring_read( struct async_fileio_uring *fileio )
+{
+    int fd, needs_close, ret;
+
+    if (server_get_unix_fd( fileio->io.handle, FILE_READ_DATA, &fd, &needs_close, NULL, NULL ))
+        return -EFAULT;
+    ret = vectored_io( fd, fileio->iov, fileio->iov_count, fileio->offset, FALSE );
+    if (ret == -1) ret = -errno;
+    if (needs_close) close( fd );
+    return ret;
+}
+
+/* store the result of a request and report it to the server */
+static void complete_uring_fileio( struct async_fileio_uring *fileio, int res )
+{
+    NTSTATUS status;
+    ULONG_PTR total = 0;
+    BOOL cancelling;
+
+    if (res == -EFAULT && !fileio->write) res = retry_uring_read( fileio );
+    if (res < 0 && fileio->done) res = 0;  /* report the partial transfer */
+
+    if (res >= 0)
+    {
+        total = fileio->done + res;
+        status = (total || fileio->write || !fileio->count) ? STATUS_SUCCESS : STATUS_END_OF_FILE;
+    }
+    else if (res == -ECANCELED) status = STATUS_CANCELLED;
+    else if (res == -EFAULT && fileio->write) status = STATUS_INVALID_USER_BUFFER;
+    else status = errno_to_status( -res );
+
+    TRACE( "%p: status %x total %lu\n", fileio, status, total );
+
+    pthread_mutex_lock( &uring_mutex );
+    uring_inflight--;
+    fileio->status = status;
+    fileio->total  = total;
+    cancelling = fileio->state == URING_FILEIO_CANCELLING;
+    fileio->state = URING_FILEIO_DONE;
+    if (cancelling) pthread_cond_broadcast( &uring_cond );
+    else
+    {
+        fileio->iosb->Information = total;
+        fileio->iosb->u.Status = status;
+    }
+    pthread_mutex_unlock( &uring_mutex );
+
+    /* once the state is DONE, a concurrent cancellation takes care of the fileio */
+    if (cancelling) return;
+
+    SERVER_START_REQ( complete_client_async )
+    {
+        req->user_arg = wine_server_client_ptr( fileio );
+        req->status   = status;
+        req->total    = total;
+        status = wine_server_call( req );
+    }
+    SERVER_END_REQ;
+
+    /* otherwise the async was cancelled in the meantime, and the async callback releases it */
+    if (!status) release_fileio( &fileio->io );
+}
+
+/* async callback for cancelled requests */
+static NTSTATUS async_uring_proc( void *user, IO_STATUS_BLOCK *iosb, NTSTATUS status )
+{
+    struct async_fileio_uring *fileio = user;
+
+    pthread_mutex_lock( &uring_mutex );
+    if (fileio->state == URING_FILEIO_QUEUED)
+    {
+        fileio->state = URING_FILEIO_CANCELLING;
+        submit_uring_sqe( IORING_OP_ASYNC_CANCEL, -1, (ULONG_PTR)fileio, 0, 0, 0 );
+        /* the buffer belongs to the request until the kernel is done with it */
+        while (fileio->state != URING_FILEIO_DONE) pthread_cond_wait( &uring_cond, &uring_mutex );
+        iosb->Information = fileio->total;
+        iosb->u.Status = fileio->status;
+    }
+    status = fileio->status;
+    pthread_mutex_unlock( &uring_mutex );
+
+    release_fileio( &fileio->io );
+    return status;
+}
+
+/* thread reaping the completions of the ring */
+static void CALLBACK uring_thread( void *arg )
+{
+    struct async_fileio_uring *fileio;
+    struct io_uring_cqe *cqe;
+    unsigned int head;
+    int res;
+
+    for (;;)
+    {
+        if (io_uring_enter( 0, 1, IORING_ENTER_GETEVENTS ) == -1 && errno != EINTR)
+            ERR( "io_uring_enter failed: %s\n", strerror( errno ));
+
+        head = *uring_cq_head;
+        while (head != __atomic_load_n( uring_cq_tail, __ATOMIC_ACQUIRE ))
+        {
+            cqe = &uring_cqes[head & uring_cq_mask];
+            fileio = (struct async_fileio_uring *)(ULONG_PTR)cqe->user_data;
+            res = cqe->res;
+            __atomic_store_n( uring_cq_head, ++head, __ATOMIC_RELEASE );
+            if (fileio) complete_uring_fileio( fileio, res );  /* cancel requests have no user data */
+        }
+    }
+}
+
+static void init_uring(void)
+{
+    struct io_uring_params params;
+    HANDLE thread;
+    size_t ring_size;
+    void *ring, *sqes;
+    unsigned int i;
+    int fd;
+
+    if (getenv( "WINE_DISABLE_IO_URING" )) return;
+
+    memset( &params, 0, sizeof(params) );
+    if ((fd = syscall( __NR_io_uring_setup, 128, &params )) == -1)
+    {
+        TRACE( "io_uring not available: %s\n", strerror( errno ));
+        return;
+    }
+    /* IORING_OP_READ and IORING_OP_WRITE are available since the same kernel (5.6) as RW_CUR_POS */
+    if (!(params.features & IORING_FEAT_RW_CUR_POS) || !(params.features & IORING_FEAT_SINGLE_MMAP) ||
+        !(params.features & IORING_FEAT_NODROP))
+    {
+        close( fd );
+        return;
+    }
+
+    ring_size = max( params.sq_off.array + params.sq_entries * sizeof(unsigned int),
+                     params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe) );
+    ring = mmap( NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, IORING_OFF_SQ_RING );
+    if (ring == MAP_FAILED)
+    {
+        close( fd );
+        return;
+    }
+    sqes = mmap( NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                 MAP_SHARED, fd, IORING_OFF_SQES );
+    if (sqes == MAP_FAILED)
+    {
+        munmap( ring, ring_size );
+        close( fd );
+        return;
+    }
+
+    uring_sqes       = sqes;
+    uring_sq_entries = params.sq_entries;
+    uring_sq_mask    = *(unsigned int *)((char *)ring + params.sq_off.ring_mask);
+    uring_sq_tail    = (unsigned int *)((char *)ring + params.sq_off.tail);
+    uring_cq_mask    = *(unsigned int *)((char *)ring + params.cq_off.ring_mask);
+    uring_cq_head    = (unsigned int *)((char *)ring + params.cq_off.head);
+    uring_cq_tail    = (unsigned int *)((char *)ring + params.cq_off.tail);
+    uring_cqes       = (struct io_uring_cqe *)((char *)ring + params.cq_off.cqes);
+
+    /* submission entries are always used in order */
+    for (i = 0; i < uring_sq_entries; i++)
+        ((unsigned int *)((char *)ring + params.sq_off.array))[i] = i;
+
+    uring_fd = fd;
+    if (NtCreateThreadEx( &thread, THREAD_ALL_ACCESS, NULL, GetCurrentProcess(), uring_thread, NULL,
+                          THREAD_CREATE_FLAGS_HIDE_FROM_DEBUGGER | THREAD_CREATE_FLAGS_SKIP_LOADER_INIT,
+                          0, 0, 0, NULL ))
+    {
+        munmap( sqes, params.sq_entries * sizeof(struct io_uring_sqe) );
+        munmap( ring, ring_size );
+        close( fd );
+        uring_fd = -1;
+        return;
+    }
+    NtClose( thread );
+    TRACE( "using io_uring for overlapped file I/O\n" );
+}
+
+/***********************************************************************
+ *           queue_uring_fileio
+ *
+ * Start an overlapped read or write on a regular file.
+ * Returns STATUS_NOT_SUPPORTED if the caller needs to do it by itself. Transfers that
+ * don't need to wait for the disk are done right away, and STATUS_SUCCESS is returned
+ * with the transferred size in *result; the caller reports them like synchronous ones.
+ * Writes that extend the file are left to the caller, like Windows completes them
+ * synchronously.
+ */
+static NTSTATUS queue_uring_fileio( HANDLE handle, int fd, HANDLE event, PIO_APC_ROUTINE apc,
+                                    void *apc_user, IO_STATUS_BLOCK *io, const struct iovec *iov,
+                                    unsigned int iov_count, ULONG length, ULONGLONG offset, BOOL write,
+                                    ssize_t *result )
+{
+    struct async_fileio_uring *fileio;
+    struct stat st;
+    NTSTATUS status;
+    BOOL queued = FALSE;
+    ssize_t res;
+
+    pthread_once( &uring_once, init_uring );
+    if (uring_fd == -1 || iov_count > IOV_MAX) return STATUS_NOT_SUPPORTED;
+    if (write && (fstat( fd, &st ) == -1 || offset + length > st.st_size)) return STATUS_NOT_SUPPORTED;
+
+    if (!(fileio = (struct async_fileio_uring *)alloc_fileio( offsetof( struct async_fileio_uring, iov[iov_count] ),
+                                                              async_uring_proc, handle )))
+        return STATUS_NOT_SUPPORTED;
+
+    fileio->iosb      = io;
+    fileio->count     = length;
+    fileio->offset    = offset;
+    fileio->done      = 0;
+    fileio->write     = write;
+    fileio->state     = URING_FILEIO_QUEUED;
+    fileio->iov_count = iov_count;
+    memcpy( fileio->iov, iov, iov_count * sizeof(*iov) );
+
+    if ((res = nowait_io( fd, iov, iov_count, offset, write )) >= 0)
+    {
+        if (res == length || !res)  /* complete, or end of file */
+        {
+            free( fileio );
+            *result = res;
+            return STATUS_SUCCESS;
+        }
+        /* queue the rest of the transfer */
+        fileio->done = res;
+        fileio->offset += res;
+        fileio->iov_count = iov_count = skip_iovec( fileio->iov, iov_count, res );
+    }
+
+    io->u.Status = STATUS_PENDING;
+    io->Information = 0;
+
+    SERVER_START_REQ( register_client_async )
+    {
+        req->async  = server_async( handle, &fileio->io, event, apc, apc_user, io );
+        req->access = write ? FILE_WRITE_DATA : FILE_READ_DATA;
+        status = wine_server_call( req );
+    }
+    SERVER_END_REQ;
+
+    if (status)
+    {
+        free( fileio );
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    pthread_mutex_lock( &uring_mutex );
+    uring_inflight++;
+    if (uring_inflight <= uring_sq_entries)
+        queued = submit_uring_sqe( write ? IORING_OP_WRITEV : IORING_OP_READV, fd, (ULONG_PTR)fileio->iov,
+                                   iov_count, fileio->offset, (ULONG_PTR)fileio );
+    pthread_mutex_unlock( &uring_mutex );
+
+    if (!queued)  /* the ring is full, do it synchronously */
+    {
+        res = vectored_io( fd, fileio->iov, iov_count, fileio->offset, write );
+        complete_uring_fileio( fileio, res == -1 ? -errno : res );
+    }
+    return STATUS_PENDING;
+}
+
+#else  /* USE_IO_URING */
+
+static NTSTATUS queue_uring_fileio( HANDLE handle, int fd, HANDLE event, PIO_APC_ROUTINE apc,
+                                    void *apc_user, IO_STATUS_BLOCK *io, const struct iovec *iov,
+                                    unsigned int iov_count, ULONG length, ULONGLONG offset, BOOL write,
+                                    ssize_t *result )
+{
+    return STATUS_NOT_SUPPORTED;
+}
+
+#endif  /* USE_IO_URING */
+
+/* do an ioctl call through the server */
+static NTSTATUS server_ioctl_file( HANDLE handle, HANDLE event,
+                                   PIO_APC_ROUTINE apc, PVOID apc_context,
+                                   IO_STATUS_BLOCK *io, ULONG code,
+                                   const void *in_buffer, ULONG in_size,
+                                   PVOID out_buffer, ULONG out_size )
+{
+    struct async_irp *async;
+    NTSTATUS status;
+    HANDLE wait_handle;
+    ULONG options;
+
+    if (!(async = (struct async_irp *)alloc_fileio( sizeof(*async), irp_completion, handle )))
+        return STATUS_NO_MEMORY;
+    async->buffer  = out_buffer;
     async->size    = out_size;
 
     SERVER_START_REQ( ioctl )
@@ -5014,6 +5965,7 @@ NTSTATUS WINAPI NtReadFile( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, vo
     enum server_fd_type type;
     ULONG_PTR cvalue = apc ? 0 : (ULONG_PTR)apc_user;
     BOOL send_completion = FALSE, async_read, timeout_init_done = FALSE;
+    struct iovec iov = { buffer, length };
 
     TRACE( "(%p,%p,%p,%p,%p,%p,0x%08x,%p,%p)\n",
            handle, event, apc, apc_user, io, buffer, length, offset, key );
@@ -5040,8 +5992,21 @@ NTSTATUS WINAPI NtReadFile( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, vo
 
         if (offset && offset->QuadPart != FILE_USE_FILE_POINTER_POSITION)
         {
-            /* async I/O doesn't make sense on regular files */
-            while ((result = virtual_locked_pread( unix_handle, buffer, length, offset->QuadPart )) == -1)
+            ssize_t done = 0;
+
+            status = STATUS_NOT_SUPPORTED;
+            if (async_read &&
+                (status = queue_uring_fileio( handle, unix_handle, event, apc, apc_user, io, &iov, 1,
+                                              length, offset->QuadPart, FALSE, &done )) == STATUS_PENDING)
+            {
+                if (needs_close) close( unix_handle );
+                return status;
+            }
+            result = done;
+
+            /* otherwise async I/O doesn't make sense on regular files */
+            while (status == STATUS_NOT_SUPPORTED &&
+                   (result = virtual_locked_pread( unix_handle, buffer, length, offset->QuadPart )) == -1)
             {
                 if (errno != EINTR)
                 {
@@ -5195,6 +6160,22 @@ err:
 }
 
 
+/* build the iovec array for a list of page-sized segments */
+static struct iovec *get_segments_iovec( FILE_SEGMENT_ELEMENT *segments, ULONG length, unsigned int *count )
+{
+    struct iovec *iov;
+    unsigned int i;
+
+    *count = (length + page_size - 1) / page_size;
+    if (!(iov = malloc( max( *count, 1 ) * sizeof(*iov) ))) return NULL;
+    for (i = 0; i < *count; i++)
+    {
+        iov[i].iov_base = segments[i].Buffer;
+        iov[i].iov_len  = min( length - i * page_size, page_size );
+    }
+    return iov;
+}
+
 /******************************************************************************
  *              NtReadFileScatter   (NTDLL.@)
  */
@@ -5202,15 +6183,18 @@ NTSTATUS WINAPI NtReadFileScatter( HANDLE file, HANDLE event, PIO_APC_ROUTINE ap
                                    IO_STATUS_BLOCK *io, FILE_SEGMENT_ELEMENT *segments,
                                    ULONG length, LARGE_INTEGER *offset, ULONG *key )
 {
-    int result, unix_handle, needs_close;
-    unsigned int options;
+    int unix_handle, needs_close;
+    unsigned int options, count;
     NTSTATUS status;
-    ULONG pos = 0, total = 0;
+    ssize_t result = 0;
+    ULONG total = 0;
+    off_t pos = -1;
     enum server_fd_type type;
     ULONG_PTR cvalue = apc ? 0 : (ULONG_PTR)apc_user;
     BOOL send_completion = FALSE;
+    struct iovec *iov;
 
-    TRACE( "(%p,%p,%p,%p,%p,%p,0x%08x,%p,%p),partial stub!\n",
+    TRACE( "(%p,%p,%p,%p,%p,%p,0x%08x,%p,%p)\n",
            file, event, apc, apc_user, io, segments, length, offset, key );
 
     if (!io) return STATUS_ACCESS_VIOLATION;
@@ -5225,30 +6209,39 @@ NTSTATUS WINAPI NtReadFileScatter( HANDLE file, HANDLE event, PIO_APC_ROUTINE ap
         status = STATUS_INVALID_PARAMETER;
         goto error;
     }
-
-    while (length)
+    if (offset && offset->QuadPart != FILE_USE_FILE_POINTER_POSITION)
     {
-        if (offset && offset->QuadPart != FILE_USE_FILE_POINTER_POSITION)
-            result = pread( unix_handle, (char *)segments->Buffer + pos,
-                            min( length - pos, page_size - pos ), offset->QuadPart + total );
-        else
-            result = read( unix_handle, (char *)segments->Buffer + pos, min( length - pos, page_size - pos ) );
-
-        if (result == -1)
+        if (offset->QuadPart < 0)
         {
-            if (errno == EINTR) continue;
-            status = errno_to_status( errno );
-            break;
-        }
-        if (!result) break;
-        total += result;
-        length -= result;
-        if ((pos += result) == page_size)
-        {
-            pos = 0;
-            segments++;
+            status = STATUS_INVALID_PARAMETER;
+            goto error;
         }
+        pos = offset->QuadPart;
+    }
+
+    if (!(iov = get_segments_iovec( segments, length, &count )))
+    {
+        status = STATUS_NO_MEMORY;
+        goto error;
+    }
+
+    status = STATUS_NOT_SUPPORTED;
+    if (pos != -1 &&
+        (status = queue_uring_fileio( file, unix_handle, event, apc, apc_user, io, iov, count,
+                                      length, pos, FALSE, &result )) == STATUS_PENDING)
+    {
+        free( iov );
+        if (needs_close) close( unix_handle );
+        return status;
     }
+    if (status == STATUS_NOT_SUPPORTED) result = vectored_io( unix_handle, iov, count, pos, FALSE );
+
+    status = STATUS_SUCCESS;
+    if (result == -1)
+        status = errno_to_status( errno );
+    else
+        total = result;
+    free( iov );
 
     if (total == 0) status = STATUS_END_OF_FILE;
 
@@ -5289,6 +6282,7 @@ NTSTATUS WINAPI NtWriteFile( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, v
     ULONG_PTR cvalue = apc ? 0 : (ULONG_PTR)apc_user;
     BOOL send_completion = FALSE, async_write, append_write = FALSE, timeout_init_done = FALSE;
     LARGE_INTEGER offset_eof;
+    struct iovec iov = { (void *)buffer, length };
 
     TRACE( "(%p,%p,%p,%p,%p,%p,0x%08x,%p,%p)\n",
            handle, event, apc, apc_user, io, buffer, length, offset, key );
@@ -5333,7 +6327,9 @@ NTSTATUS WINAPI NtWriteFile( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, v
         if (offset && offset->QuadPart != FILE_USE_FILE_POINTER_POSITION)
         {
             off_t off = offset->QuadPart;
+            ssize_t done = 0;
 
+            status = STATUS_NOT_SUPPORTED;
             if (offset->QuadPart == FILE_WRITE_TO_END_OF_FILE)
             {
                 struct stat st;
@@ -5350,9 +6346,18 @@ NTSTATUS WINAPI NtWriteFile( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, v
                 status = STATUS_INVALID_PARAMETER;
                 goto done;
             }
+            else if (async_write &&
+                     (status = queue_uring_fileio( handle, unix_handle, event, apc, apc_user, io, &iov, 1,
+                                                   length, off, TRUE, &done )) == STATUS_PENDING)
+            {
+                if (needs_close) close( unix_handle );
+                return status;
+            }
+            result = done;
 
-            /* async I/O doesn't make sense on regular files */
-            while ((result = pwrite( unix_handle, buffer, length, off )) == -1)
+            /* otherwise async I/O doesn't make sense on regular files */
+            while (status == STATUS_NOT_SUPPORTED &&
+                   (result = pwrite( unix_handle, buffer, length, off )) == -1)
             {
                 if (errno != EINTR)
                 {
@@ -5504,15 +6509,18 @@ NTSTATUS WINAPI NtWriteFileGather( HANDLE file, HANDLE event, PIO_APC_ROUTINE ap
                                    IO_STATUS_BLOCK *io, FILE_SEGMENT_ELEMENT *segments,
                                    ULONG length, LARGE_INTEGER *offset, ULONG *key )
 {
-    int result, unix_handle, needs_close;
-    unsigned int options;
+    int unix_handle, needs_close;
+    unsigned int options, count;
     NTSTATUS status;
-    ULONG pos = 0, total = 0;
+    ssize_t result = 0;
+    ULONG total = 0;
+    off_t pos = -1;
     enum server_fd_type type;
     ULONG_PTR cvalue = apc ? 0 : (ULONG_PTR)apc_user;
     BOOL send_completion = FALSE;
+    struct iovec *iov;
 
-    TRACE( "(%p,%p,%p,%p,%p,%p,0x%08x,%p,%p),partial stub!\n",
+    TRACE( "(%p,%p,%p,%p,%p,%p,0x%08x,%p,%p)\n",
            file, event, apc, apc_user, io, segments, length, offset, key );
 
     if (length % page_size) return STATUS_INVALID_PARAMETER;
@@ -5528,40 +6536,41 @@ NTSTATUS WINAPI NtWriteFileGather( HANDLE file, HANDLE event, PIO_APC_ROUTINE ap
         status = STATUS_INVALID_PARAMETER;
         goto done;
     }
-
-    while (length)
+    if (offset && offset->QuadPart != FILE_USE_FILE_POINTER_POSITION)
     {
-        if (offset && offset->QuadPart != FILE_USE_FILE_POINTER_POSITION)
-            result = pwrite( unix_handle, (char *)segments->Buffer + pos,
-                             page_size - pos, offset->QuadPart + total );
-        else
-            result = write( unix_handle, (char *)segments->Buffer + pos, page_size - pos );
-
-        if (result == -1)
+        if (offset->QuadPart < 0)
         {
-            if (errno == EINTR) continue;
-            if (errno == EFAULT)
-            {
-                status = STATUS_INVALID_USER_BUFFER;
-                goto done;
-            }
-            status = errno_to_status( errno );
-            break;
-        }
-        if (!result)
-        {
-            status = STATUS_DISK_FULL;
-            break;
-        }
-        total += result;
-        length -= result;
-        if ((pos += result) == page_size)
-        {
-            pos = 0;
-            segments++;
+            status = STATUS_INVALID_PARAMETER;
+            goto done;
         }
+        pos = offset->QuadPart;
     }
 
+    if (!(iov = get_segments_iovec( segments, length, &count )))
+    {
+        status = STATUS_NO_MEMORY;
+        goto done;
+    }
+
+    status = STATUS_NOT_SUPPORTED;
+    if (pos != -1 &&
+        (status = queue_uring_fileio( file, unix_handle, event, apc, apc_user, io, iov, count,
+                                      length, pos, TRUE, &result )) == STATUS_PENDING)
+    {
+        free( iov );
+        if (needs_close) close( unix_handle );
+        return status;
+    }
+    if (status == STATUS_NOT_SUPPORTED) result = vectored_io( unix_handle, iov, count, pos, TRUE );
+
+    status = STATUS_SUCCESS;
+    if (result == -1)
+        status = errno == EFAULT ? STATUS_INVALID_USER_BUFFER : errno_to_status( errno );
+    else if ((total = result) < length)
+        status = STATUS_DISK_FULL;
+    free( iov );
+    if (status == STATUS_INVALID_USER_BUFFER) goto done;
+
     send_completion = cvalue != 0;
 
  done:
@@ -6188,6 +7197,150 @@ cleanup:
 }
 
 
+/***********************************************************************
+ *           clone_file_range
+ *
+ * Make a file range share the blocks of another one.
+ * Returns STATUS_INVALID_DEVICE_REQUEST if the filesystem doesn't support it.
+ */
+static NTSTATUS clone_file_range( int src_fd, int dst_fd, ULONGLONG src_offset, ULONGLONG dst_offset,
+                                  ULONGLONG size )
+{
+#ifdef linux
+    struct file_clone_range range;
+
+    range.src_fd      = src_fd;
+    range.src_offset  = src_offset;
+    range.src_length  = size;
+    range.dest_offset = dst_offset;
+    if (!ioctl( dst_fd, FICLONERANGE, &range )) return STATUS_SUCCESS;
+    TRACE( "FICLONERANGE failed: %s\n", strerror( errno ));
+#endif
+    return STATUS_INVALID_DEVICE_REQUEST;
+}
+
+
+/***********************************************************************
+ *           copy_file_data
+ *
+ * Copy a file range without going through user space, by sharing the blocks if the
+ * filesystem supports it, or else having the kernel copy the data. *copied is only less
+ * than size at the end of the source file.
+ * Returns STATUS_INVALID_DEVICE_REQUEST if none of this is supported.
+ */
+static NTSTATUS copy_file_data( int src_fd, int dst_fd, ULONGLONG src_offset, ULONGLONG dst_offset,
+                                ULONGLONG size, ULONGLONG *copied )
+{
+#ifdef linux
+    static const size_t max_chunk = 0x40000000;
+    off_t src_pos = src_offset;
+    ssize_t ret;
+
+    *copied = 0;
+    if (!size) return STATUS_SUCCESS;
+
+    if (!clone_file_range( src_fd, dst_fd, src_offset, dst_offset, size ))
+    {
+        *copied = size;
+        return STATUS_SUCCESS;
+    }
+
+#ifdef __NR_copy_file_range
+    {
+        off_t dst_pos = dst_offset;
+
+        do
+        {
+            ret = syscall( __NR_copy_file_range, src_fd, &src_pos, dst_fd, &dst_pos,
+                           min( size - *copied, max_chunk ), 0 );
+            if (ret > 0) *copied += ret;
+        } while (*copied < size && ret > 0);
+
+        if (ret >= 0) return STATUS_SUCCESS;  /* done, or end of the source file */
+        if (*copied) return errno_to_status( errno );  /* failed halfway */
+        TRACE( "copy_file_range failed: %s\n", strerror( errno ));
+    }
+#endif
+
+#ifdef HAVE_SYS_SENDFILE_H
+    {
+        NTSTATUS status = STATUS_INVALID_DEVICE_REQUEST;
+        off_t pos;
+
+        /* sendfile writes at the current position, which needs to be restored afterwards */
+        if ((pos = lseek( dst_fd, 0, SEEK_CUR )) == -1) return errno_to_status( errno );
+        if (lseek( dst_fd, dst_offset, SEEK_SET ) == -1) return errno_to_status( errno );
+        do
+        {
+            ret = sendfile( dst_fd, src_fd, &src_pos, min( size - *copied, max_chunk ));
+            if (ret > 0) *copied += ret;
+        } while (*copied < size && ret > 0);
+
+        if (ret >= 0) status = STATUS_SUCCESS;
+        else if (*copied) status = errno_to_status( errno );
+        else TRACE( "sendfile failed: %s\n", strerror( errno ));
+        lseek( dst_fd, pos, SEEK_SET );
+        return status;
+    }
+#endif
+#endif  /* linux */
+    return STATUS_INVALID_DEVICE_REQUEST;
+}
+
+
+/***********************************************************************
+ *           duplicate_extents
+ *
+ * Implementation of FSCTL_DUPLICATE_EXTENTS_TO_FILE and FSCTL_WINE_COPY_FILE_DATA.
+ */
+static NTSTATUS duplicate_extents( HANDLE handle, const DUPLICATE_EXTENTS_DATA *data, ULONGLONG *copied )
+{
+    /* the allocation unit reported by FileFsSizeInformation */
+    static const ULONGLONG cluster_size = 4096;
+    ULONGLONG src_offset = data->SourceFileOffset.QuadPart, dst_offset = data->TargetFileOffset.QuadPart;
+    ULONGLONG size = data->ByteCount.QuadPart, src_end, dst_end;
+    int src_fd, dst_fd, src_needs_close, dst_needs_close;
+    struct stat src_st, dst_st;
+    NTSTATUS status;
+
+    if ((status = server_get_unix_fd( data->FileHandle, FILE_READ_DATA, &src_fd, &src_needs_close,
+                                      NULL, NULL )))
+        return status;
+    if ((status = server_get_unix_fd( handle, FILE_WRITE_DATA, &dst_fd, &dst_needs_close, NULL, NULL )))
+    {
+        if (src_needs_close) close( src_fd );
+        return status;
+    }
+
+    if (fstat( src_fd, &src_st ) == -1 || fstat( dst_fd, &dst_st ) == -1)
+        status = errno_to_status( errno );
+    else if (!S_ISREG( src_st.st_mode ) || !S_ISREG( dst_st.st_mode ))
+        status = STATUS_INVALID_PARAMETER;
+    else if (copied)
+        status = copy_file_data( src_fd, dst_fd, src_offset, dst_offset, size, copied );
+    else
+    {
+        /* both ranges are whole clusters, and may only extend past the end of the file
+         * up to the end of its last cluster; the target file is never extended */
+        src_end = (src_st.st_size + cluster_size - 1) & ~(cluster_size - 1);
+        dst_end = (dst_st.st_size + cluster_size - 1) & ~(cluster_size - 1);
+        if ((src_offset | dst_offset | size) & (cluster_size - 1) ||
+            src_offset > src_end || size > src_end - src_offset ||
+            dst_offset > dst_end || size > dst_end - dst_offset)
+            status = STATUS_INVALID_PARAMETER;
+        else if (size)
+        {
+            size = min( size, min( src_st.st_size - src_offset, dst_st.st_size - dst_offset ));
+            status = clone_file_range( src_fd, dst_fd, src_offset, dst_offset, size );
+        }
+    }
+
+    if (src_needs_close) close( src_fd );
+    if (dst_needs_close) close( dst_fd );
+    return status;
+}
+
+
 /******************************************************************************
  *              NtFsControlFile   (NTDLL.@)
  */
@@ -6311,6 +7464,20 @@ NTSTATUS WINAPI NtFsControlFile( HANDLE handle, HANDLE event, PIO_APC_ROUTINE ap
         break;
     }
 
+    case FSCTL_DUPLICATE_EXTENTS_TO_FILE:
+        io->Information = 0;
+        if (in_size < sizeof(DUPLICATE_EXTENTS_DATA)) status = STATUS_INVALID_PARAMETER;
+        else status = duplicate_extents( handle, in_buffer, NULL );
+        break;
+
+    case FSCTL_WINE_COPY_FILE_DATA:
+        io->Information = 0;
+        if (in_size < sizeof(DUPLICATE_EXTENTS_DATA) || out_size < sizeof(ULONGLONG))
+            status = STATUS_INVALID_PARAMETER;
+        else if (!(status = duplicate_extents( handle, in_buffer, out_buffer )))
+            io->Information = sizeof(ULONGLONG);
+        break;
+
     case FSCTL_SET_SPARSE:
         TRACE("FSCTL_SET_SPARSE: Ignoring request\n");
         io->Information = 0;
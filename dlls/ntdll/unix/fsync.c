@@ -31,6 +31,7 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #ifdef HAVE_SYS_MMAN_H
 # include <sys/mman.h>
 #endif
@@ -55,6 +56,7 @@
 #include "fsync.h"
 
 WINE_DEFAULT_DEBUG_CHANNEL(fsync);
+WINE_DECLARE_DEBUG_CHANNEL(fsyncstats);
 
 #include "pshpack4.h"
 struct futex_wait_block
@@ -77,10 +79,70 @@ static inline void small_pause(void)
 #endif
 }
 
-static inline int futex_wait_multiple( const struct futex_wait_block *futexes,
+/* The upstream interface, available since Linux 5.16. Unlike the out of tree
+ * FUTEX_WAIT_MULTIPLE opcode, it takes an absolute timeout. */
+struct futex_waitv
+{
+    ULONGLONG val;
+    ULONGLONG uaddr;
+    unsigned int flags;
+    unsigned int __reserved;
+};
+
+#define FUTEX_32                2
+#define FUTEX_WAITV_MAX         128
+
+#ifndef __NR_futex_waitv
+#define __NR_futex_waitv        449
+#endif
+
+static BOOL use_futex_waitv;
+
+static inline int futex_waitv( const struct futex_waitv *futexes, int count,
+        const struct timespec *timeout )
+{
+    return syscall( __NR_futex_waitv, futexes, count, 0, timeout, CLOCK_MONOTONIC );
+}
+
+/* Returns 0 when woken, and -1 with errno set otherwise, with either backend. */
+static int futex_wait_multiple( const struct futex_wait_block *futexes,
         int count, const struct timespec *timeout )
 {
-    return syscall( __NR_futex, futexes, 31, count, timeout, 0, 0 );
+    struct futex_waitv waitv[FUTEX_WAITV_MAX];
+    struct timespec end;
+    int i;
+
+    if (!use_futex_waitv)
+        return syscall( __NR_futex, futexes, 31, count, timeout, 0, 0 );
+
+    if (count > FUTEX_WAITV_MAX)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        waitv[i].val = (unsigned int)futexes[i].val;
+        waitv[i].uaddr = (ULONG_PTR)futexes[i].addr;
+        waitv[i].flags = FUTEX_32;
+        waitv[i].__reserved = 0;
+    }
+
+    if (timeout)
+    {
+        clock_gettime( CLOCK_MONOTONIC, &end );
+        end.tv_sec += timeout->tv_sec;
+        end.tv_nsec += timeout->tv_nsec;
+        if (end.tv_nsec >= 1000000000)
+        {
+            end.tv_sec++;
+            end.tv_nsec -= 1000000000;
+        }
+    }
+
+    /* futex_waitv() returns the index of the futex that woke us up. */
+    return futex_waitv( waitv, count, timeout ? &end : NULL ) < 0 ? -1 : 0;
 }
 
 static inline int futex_wake( int *addr, int val )
@@ -93,7 +155,8 @@ static inline int futex_wait( int *addr, int val, struct timespec *timeout )
     return syscall( __NR_futex, addr, 0, val, timeout, 0, 0 );
 }
 
-static unsigned int spincount = 100;
+/* Spinning is adaptive unless WINEFSYNC_SPINCOUNT is set. */
+static int spincount = -1;
 
 int do_fsync(void)
 {
@@ -103,8 +166,19 @@ int do_fsync(void)
     if (do_fsync_cached == -1)
     {
         static const struct timespec zero;
+
+        /* Both calls fail, but only with ENOSYS if the interface is missing.
+         * Prefer the upstream one. */
+        use_futex_waitv = TRUE;
         futex_wait_multiple( NULL, 0, &zero );
+        if (errno == ENOSYS)
+        {
+            use_futex_waitv = FALSE;
+            futex_wait_multiple( NULL, 0, &zero );
+        }
         do_fsync_cached = getenv("WINEFSYNC") && atoi(getenv("WINEFSYNC")) && errno != ENOSYS;
+        if (do_fsync_cached)
+            TRACE("Using %s.\n", use_futex_waitv ? "futex_waitv" : "FUTEX_WAIT_MULTIPLE");
         if (getenv("WINEFSYNC_SPINCOUNT"))
             spincount = atoi(getenv("WINEFSYNC_SPINCOUNT"));
     }
@@ -118,10 +192,22 @@ int do_fsync(void)
 #endif
 }
 
+/* Collected only while the fsyncstats channel is enabled. */
+struct fsync_stats
+{
+    unsigned int waits;     /* contended waits that acquired the object */
+    unsigned int spin_hits; /* ... of which without sleeping */
+    unsigned int sleeps;    /* futex waits */
+    ULONGLONG spins;        /* total pause iterations */
+    ULONGLONG sleep_ns;     /* total time spent in futex waits */
+};
+
 struct fsync
 {
     enum fsync_type type;
     void *shm;              /* pointer to shm section */
+    int spin;               /* adaptive spin limit, in pause iterations */
+    struct fsync_stats stats;
 };
 
 struct semaphore
@@ -145,6 +231,100 @@ struct mutex
 };
 C_ASSERT(sizeof(struct mutex) == 8);
 
+/* Adaptive spinning.
+ *
+ * Every object keeps a spin limit, which is moved towards twice the time the
+ * last contended waits on it actually took, measured in pause iterations. If
+ * the object is usually released quickly (e.g. between a producer and a
+ * consumer thread) we spin long enough to avoid the futex round trip;
+ * if waits tend to block for longer, the limit decays towards zero. The limit
+ * is capped by a fixed time budget, and we never spin on a single CPU, where
+ * the owner can't make progress while we do. */
+
+#define FSYNC_SPIN_MIN          8
+#define FSYNC_SPIN_INITIAL      100
+#define FSYNC_SPIN_BUDGET_NS    20000
+
+static unsigned int spin_ns = 1;    /* calibrated cost of one pause iteration */
+static int max_spin = FSYNC_SPIN_INITIAL;
+
+static ULONGLONG monotonic_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec * (ULONGLONG)1000000000 + ts.tv_nsec;
+}
+
+static void init_spin_policy(void)
+{
+    long cpus = sysconf( _SC_NPROCESSORS_ONLN );
+    ULONGLONG start;
+    int i;
+
+    start = monotonic_ns();
+    for (i = 0; i < 1000; i++) small_pause();
+    spin_ns = max( 1, (monotonic_ns() - start) / 1000 );
+
+    max_spin = cpus > 1 ? FSYNC_SPIN_BUDGET_NS / spin_ns : 0;
+    TRACE_(fsyncstats)("%ld cpus, %u ns per spin, max spin %d.\n", cpus, spin_ns, max_spin);
+}
+
+static inline int get_spin_limit( struct fsync *obj )
+{
+    if (spincount >= 0) return spincount;
+    return __atomic_load_n( &obj->spin, __ATOMIC_RELAXED );
+}
+
+/* Called after the object was acquired, or after we gave up spinning on it.
+ * Uncontended acquisitions tell us nothing and don't touch the object, so
+ * that they don't bounce its cache line between threads. */
+static void record_spin( struct fsync *obj, unsigned int spins, ULONGLONG sleep_ns, BOOL acquired )
+{
+    if (TRACE_ON(fsyncstats))
+    {
+        if (spins) __atomic_fetch_add( &obj->stats.spins, spins, __ATOMIC_RELAXED );
+        if (acquired && (spins || sleep_ns))
+        {
+            __atomic_fetch_add( &obj->stats.waits, 1, __ATOMIC_RELAXED );
+            if (!sleep_ns) __atomic_fetch_add( &obj->stats.spin_hits, 1, __ATOMIC_RELAXED );
+        }
+    }
+
+    if (acquired && (spins || sleep_ns) && spincount < 0)
+    {
+        ULONGLONG held = spins + sleep_ns / spin_ns;
+        int target = held <= max_spin ? min( 2 * held + FSYNC_SPIN_MIN, max_spin ) : 0;
+        int spin = __atomic_load_n( &obj->spin, __ATOMIC_RELAXED );
+
+        if (target != spin)
+        {
+            /* move by an eighth of the gap, rounded away from zero so that it converges */
+            int step = (target - spin + (target > spin ? 7 : -7)) / 8;
+            __atomic_store_n( &obj->spin, spin + step, __ATOMIC_RELAXED );
+        }
+    }
+}
+
+static void record_sleep( struct fsync *obj, ULONGLONG sleep_ns )
+{
+    if (!obj || !TRACE_ON(fsyncstats)) return;
+    __atomic_fetch_add( &obj->stats.sleeps, 1, __ATOMIC_RELAXED );
+    __atomic_fetch_add( &obj->stats.sleep_ns, sleep_ns, __ATOMIC_RELAXED );
+}
+
+static void dump_stats( HANDLE handle, struct fsync *obj )
+{
+    const struct fsync_stats *stats = &obj->stats;
+
+    if (!stats->waits && !stats->sleeps) return;
+    TRACE_(fsyncstats)("%p: %u contended waits, %u spin hits, %s spins, %u sleeps, "
+                       "avg sleep %u us, spin limit %d\n", handle, stats->waits, stats->spin_hits,
+                       wine_dbgstr_longlong( stats->spins ), stats->sleeps,
+                       stats->sleeps ? (unsigned int)(stats->sleep_ns / stats->sleeps / 1000) : 0,
+                       obj->spin);
+}
+
 static char shm_name[29];
 static int shm_fd;
 static void **shm_addrs;
@@ -229,7 +409,11 @@ static struct fsync *add_to_list( HANDLE handle, enum fsync_type type, void *shm
     }
 
     if (!__sync_val_compare_and_swap((int *)&fsync_list[entry][idx].type, 0, type ))
+    {
         fsync_list[entry][idx].shm = shm;
+        fsync_list[entry][idx].spin = min( FSYNC_SPIN_INITIAL, max_spin );
+        memset( &fsync_list[entry][idx].stats, 0, sizeof(fsync_list[entry][idx].stats) );
+    }
 
     return &fsync_list[entry][idx];
 }
@@ -295,6 +479,8 @@ NTSTATUS fsync_close( HANDLE handle )
 
     if (entry < FSYNC_LIST_ENTRIES && fsync_list[entry])
     {
+        if (TRACE_ON(fsyncstats) && fsync_list[entry][idx].type)
+            dump_stats( handle, &fsync_list[entry][idx] );
         if (__atomic_exchange_n( &fsync_list[entry][idx].type, 0, __ATOMIC_SEQ_CST ))
             return STATUS_SUCCESS;
     }
@@ -410,6 +596,7 @@ void fsync_init(void)
     }
 
     pagesize = sysconf( _SC_PAGESIZE );
+    init_spin_policy();
 
     shm_addrs = calloc( 128, sizeof(shm_addrs[0]) );
     shm_addrs_size = 128;
@@ -714,17 +901,20 @@ static NTSTATUS do_single_wait( int *addr, int val, ULONGLONG *end, BOOLEAN aler
         return STATUS_PENDING;
 }
 
+/* The caller provides the object and futex arrays, which must have room for
+ * count and count + 1 entries respectively. */
 static NTSTATUS __fsync_wait_objects( DWORD count, const HANDLE *handles,
-    BOOLEAN wait_any, BOOLEAN alertable, const LARGE_INTEGER *timeout )
+    BOOLEAN wait_any, BOOLEAN alertable, const LARGE_INTEGER *timeout,
+    struct fsync **objs, struct futex_wait_block *futexes )
 {
     static const LARGE_INTEGER zero = {0};
 
-    struct futex_wait_block futexes[MAXIMUM_WAIT_OBJECTS + 1];
-    struct fsync *objs[MAXIMUM_WAIT_OBJECTS];
     int has_fsync = 0, has_server = 0;
     BOOL msgwait = FALSE;
     int dummy_futex = 0;
+    ULONGLONG slept = 0, start;
     unsigned int spin;
+    int spin_limit;
     LONGLONG timeleft;
     LARGE_INTEGER now;
     DWORD waitcount;
@@ -838,16 +1028,19 @@ static NTSTATUS __fsync_wait_objects( DWORD count, const HANDLE *handles,
                          * to use a dedicated interlocked_dec_if_nonzero()
                          * helper, but nesting loops like that is probably not
                          * great for performance... */
-                        for (spin = 0; spin <= spincount || current; ++spin)
+                        spin_limit = get_spin_limit( obj );
+                        for (spin = 0; spin <= spin_limit || current; ++spin)
                         {
                             if ((current = __atomic_load_n( &semaphore->count, __ATOMIC_SEQ_CST ))
                                     && __sync_val_compare_and_swap( &semaphore->count, current, current - 1 ) == current)
                             {
                                 TRACE("Woken up by handle %p [%d].\n", handles[i], i);
+                                record_spin( obj, spin, slept, TRUE );
                                 return i;
                             }
                             small_pause();
                         }
+                        record_spin( obj, spin, slept, FALSE );
 
                         futexes[i].addr = &semaphore->count;
                         futexes[i].val = 0;
@@ -865,22 +1058,26 @@ static NTSTATUS __fsync_wait_objects( DWORD count, const HANDLE *handles,
                             return i;
                         }
 
-                        for (spin = 0; spin <= spincount; ++spin)
+                        spin_limit = get_spin_limit( obj );
+                        for (spin = 0; spin <= spin_limit; ++spin)
                         {
                             if (!(tid = __sync_val_compare_and_swap( &mutex->tid, 0, GetCurrentThreadId() )))
                             {
                                 TRACE("Woken up by handle %p [%d].\n", handles[i], i);
+                                record_spin( obj, spin, slept, TRUE );
                                 mutex->count = 1;
                                 return i;
                             }
                             else if (tid == ~0 && (tid = __sync_val_compare_and_swap( &mutex->tid, ~0, GetCurrentThreadId() )) == ~0)
                             {
                                 TRACE("Woken up by abandoned mutex %p [%d].\n", handles[i], i);
+                                record_spin( obj, spin, slept, TRUE );
                                 mutex->count = 1;
                                 return STATUS_ABANDONED_WAIT_0 + i;
                             }
                             small_pause();
                         }
+                        record_spin( obj, spin, slept, FALSE );
 
                         futexes[i].addr = &mutex->tid;
                         futexes[i].val  = tid;
@@ -891,15 +1088,18 @@ static NTSTATUS __fsync_wait_objects( DWORD count, const HANDLE *handles,
                     {
                         struct event *event = obj->shm;
 
-                        for (spin = 0; spin <= spincount; ++spin)
+                        spin_limit = get_spin_limit( obj );
+                        for (spin = 0; spin <= spin_limit; ++spin)
                         {
                             if (__sync_val_compare_and_swap( &event->signaled, 1, 0 ))
                             {
                                 TRACE("Woken up by handle %p [%d].\n", handles[i], i);
+                                record_spin( obj, spin, slept, TRUE );
                                 return i;
                             }
                             small_pause();
                         }
+                        record_spin( obj, spin, slept, FALSE );
 
                         futexes[i].addr = &event->signaled;
                         futexes[i].val = 0;
@@ -911,15 +1111,18 @@ static NTSTATUS __fsync_wait_objects( DWORD count, const HANDLE *handles,
                     {
                         struct event *event = obj->shm;
 
-                        for (spin = 0; spin <= spincount; ++spin)
+                        spin_limit = get_spin_limit( obj );
+                        for (spin = 0; spin <= spin_limit; ++spin)
                         {
                             if (__atomic_load_n( &event->signaled, __ATOMIC_SEQ_CST ))
                             {
                                 TRACE("Woken up by handle %p [%d].\n", handles[i], i);
+                                record_spin( obj, spin, slept, TRUE );
                                 return i;
                             }
                             small_pause();
                         }
+                        record_spin( obj, spin, slept, FALSE );
 
                         futexes[i].addr = &event->signaled;
                         futexes[i].val = 0;
@@ -965,7 +1168,9 @@ static NTSTATUS __fsync_wait_objects( DWORD count, const HANDLE *handles,
                 TRACE("Wait timed out.\n");
                 return STATUS_TIMEOUT;
             }
-            else if (timeout)
+
+            start = monotonic_ns();
+            if (timeout)
             {
                 LONGLONG timeleft = update_timeout( end );
                 struct timespec tmo_p;
@@ -977,6 +1182,12 @@ static NTSTATUS __fsync_wait_objects( DWORD count, const HANDLE *handles,
             else
                 ret = futex_wait_multiple( futexes, waitcount, NULL );
 
+            /* Charge the time to whichever object we grab on the next pass. */
+            start = monotonic_ns() - start;
+            slept += start;
+            for (i = 0; i < count; i++)
+                record_sleep( objs[i], start );
+
             /* FUTEX_WAIT_MULTIPLE can succeed or return -EINTR, -EAGAIN,
              * -EFAULT/-EACCES, -ETIMEDOUT. In the first three cases we need to
              * try again, bad address is already handled by the fact that we
@@ -1223,6 +1434,8 @@ static void server_set_msgwait( int in_msgwait )
 NTSTATUS fsync_wait_objects( DWORD count, const HANDLE *handles, BOOLEAN wait_any,
                              BOOLEAN alertable, const LARGE_INTEGER *timeout )
 {
+    struct futex_wait_block futexes[MAXIMUM_WAIT_OBJECTS + 1];
+    struct fsync *objs[MAXIMUM_WAIT_OBJECTS];
     BOOL msgwait = FALSE;
     struct fsync *obj;
     NTSTATUS ret;
@@ -1233,7 +1446,7 @@ NTSTATUS fsync_wait_objects( DWORD count, const HANDLE *handles, BOOLEAN wait_an
         server_set_msgwait( 1 );
     }
 
-    ret = __fsync_wait_objects( count, handles, wait_any, alertable, timeout );
+    ret = __fsync_wait_objects( count, handles, wait_any, alertable, timeout, objs, futexes );
 
     if (msgwait)
         server_set_msgwait( 0 );
@@ -1241,6 +1454,50 @@ NTSTATUS fsync_wait_objects( DWORD count, const HANDLE *handles, BOOLEAN wait_an
     return ret;
 }
 
+/* The kernel refuses to wait on more than this many futexes at once. */
+#define FSYNC_MAX_WAIT_OBJECTS 128
+
+/* Returns how many handles fsync_wait_objects_any() can wait on together with
+ * the given one. Message queues need the msgwait dance above, so they are
+ * limited to regular waits. */
+ULONG fsync_get_max_wait_objects( HANDLE handle )
+{
+    struct fsync *obj;
+
+    if (get_object( handle, &obj ) || !obj || obj->type == FSYNC_QUEUE)
+        return MAXIMUM_WAIT_OBJECTS;
+    return FSYNC_MAX_WAIT_OBJECTS;
+}
+
+/* Non-alertable wait for any of a set of fsync objects, possibly larger than
+ * MAXIMUM_WAIT_OBJECTS. The index of the signaled object is returned
+ * separately, since it may not fit into the status code. Returns
+ * STATUS_NOT_SUPPORTED if the kernel can't wait on the whole set at once. */
+NTSTATUS fsync_wait_objects_any( DWORD count, const HANDLE *handles,
+                                 const LARGE_INTEGER *timeout, DWORD *index )
+{
+    struct futex_wait_block futexes[FSYNC_MAX_WAIT_OBJECTS + 1];
+    struct fsync *objs[FSYNC_MAX_WAIT_OBJECTS];
+    NTSTATUS ret;
+
+    if (count > FSYNC_MAX_WAIT_OBJECTS) return STATUS_NOT_SUPPORTED;
+
+    ret = __fsync_wait_objects( count, handles, TRUE, FALSE, timeout, objs, futexes );
+
+    /* With at most 128 objects and no APCs, the encoding is unambiguous. */
+    if ((ULONG)ret < count)
+    {
+        *index = ret;
+        return STATUS_WAIT_0;
+    }
+    if ((ULONG)ret >= STATUS_ABANDONED_WAIT_0 && (ULONG)ret < STATUS_ABANDONED_WAIT_0 + count)
+    {
+        *index = ret - STATUS_ABANDONED_WAIT_0;
+        return STATUS_ABANDONED_WAIT_0;
+    }
+    return ret;
+}
+
 NTSTATUS fsync_signal_and_wait( HANDLE signal, HANDLE wait, BOOLEAN alertable,
     const LARGE_INTEGER *timeout )
 {
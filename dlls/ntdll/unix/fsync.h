@@ -45,5 +45,8 @@ extern NTSTATUS fsync_query_mutex( HANDLE handle, void *info, ULONG *ret_len ) D
 
 extern NTSTATUS fsync_wait_objects( DWORD count, const HANDLE *handles, BOOLEAN wait_any,
                                     BOOLEAN alertable, const LARGE_INTEGER *timeout ) DECLSPEC_HIDDEN;
+extern ULONG fsync_get_max_wait_objects( HANDLE handle ) DECLSPEC_HIDDEN;
+extern NTSTATUS fsync_wait_objects_any( DWORD count, const HANDLE *handles,
+                                        const LARGE_INTEGER *timeout, DWORD *index ) DECLSPEC_HIDDEN;
 extern NTSTATUS fsync_signal_and_wait( HANDLE signal, HANDLE wait,
     BOOLEAN alertable, const LARGE_INTEGER *timeout ) DECLSPEC_HIDDEN;
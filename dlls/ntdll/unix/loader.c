@@ -1511,6 +1511,8 @@ static struct unix_funcs unix_funcs =
     fast_RtlSleepConditionVariableSRW,
     fast_RtlSleepConditionVariableCS,
     fast_RtlWakeConditionVariable,
+    get_max_wait_objects,
+    wait_objects_any,
     ntdll_atan,
     ntdll_ceil,
     ntdll_cos,
@@ -1544,6 +1546,7 @@ static struct unix_funcs unix_funcs =
     wine_nt_to_unix_file_name,
     wine_unix_to_nt_file_name,
     set_show_dot_files,
+    set_sort_directories,
     load_so_dll,
     load_builtin_dll,
     unload_builtin_dll,
@@ -34,10 +34,164 @@
 #include "wine/debug.h"
 
 WINE_DEFAULT_DEBUG_CHANNEL(reg);
+WINE_DECLARE_DEBUG_CHANNEL(regcache);
 
 /* maximum length of a value name in bytes (without terminating null) */
 #define MAX_VALUE_LENGTH (16383 * sizeof(WCHAR))
 
+/* cache of the results of value queries, indexed by key handle and value name; the entries
+ * are only valid as long as the registry generation counter set by the server is unchanged */
+struct value_cache_entry
+{
+    HANDLE      handle;      /* key handle */
+    LONG        generation;  /* registry generation when the entry was filled */
+    NTSTATUS    status;      /* query status (success or STATUS_OBJECT_NAME_NOT_FOUND) */
+    int         type;        /* value type */
+    data_size_t total;       /* value data length */
+    USHORT      name_len;    /* value name length in bytes */
+    WCHAR       name[1];     /* value name, followed by the value data */
+};
+
+#define VALUE_CACHE_SIZE     256   /* number of cache entries */
+#define MAX_CACHED_NAME_LEN  (256 * sizeof(WCHAR))  /* longest value name to cache */
+#define MAX_CACHED_DATA_LEN  1024  /* longest value data to cache */
+
+static struct value_cache_entry *value_cache[VALUE_CACHE_SIZE];
+static unsigned int value_cache_count;  /* number of used entries */
+static ULONG64 value_cache_handles;     /* bitmap of the handle hashes that may have entries */
+static pthread_mutex_t value_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* cache statistics, traced on the regcache channel */
+static struct
+{
+    unsigned int hits;    /* queries answered from the cache */
+    unsigned int misses;  /* queries sent to the server */
+    unsigned int stale;   /* entries found but out of date */
+} value_cache_stats;
+
+static inline LONG get_registry_generation(void)
+{
+    return *(volatile LONG *)((char *)user_shared_data + REGISTRY_GENERATION_OFFSET);
+}
+
+static inline ULONG64 value_cache_handle_bit( HANDLE handle )
+{
+    return (ULONG64)1 << ((HandleToULong( handle ) >> 2) % 64);
+}
+
+static unsigned int value_cache_hash( HANDLE handle, const UNICODE_STRING *name )
+{
+    unsigned int i, hash = HandleToULong( handle ) >> 2;
+
+    for (i = 0; i < name->Length / sizeof(WCHAR); i++) hash = hash * 65599 + towupper( name->Buffer[i] );
+    return hash % VALUE_CACHE_SIZE;
+}
+
+static BOOL value_cache_match( const struct value_cache_entry *entry, HANDLE handle,
+                               const UNICODE_STRING *name )
+{
+    unsigned int i;
+
+    if (entry->handle != handle || entry->name_len != name->Length) return FALSE;
+    for (i = 0; i < name->Length / sizeof(WCHAR); i++)
+        if (towupper( entry->name[i] ) != towupper( name->Buffer[i] )) return FALSE;
+    return TRUE;
+}
+
+static void trace_value_cache_stats( HANDLE handle, const UNICODE_STRING *name, const char *result )
+{
+    TRACE_(regcache)( "%p %s: %s (%u hits, %u misses, %u stale)\n", handle, debugstr_us(name), result,
+                      value_cache_stats.hits, value_cache_stats.misses, value_cache_stats.stale );
+}
+
+/* look up a value query in the cache, and copy up to size bytes of its data; return FALSE on a miss */
+static BOOL get_cached_value( HANDLE handle, const UNICODE_STRING *name, LONG generation,
+                              NTSTATUS *status, int *type, data_size_t *total, void *data, data_size_t size )
+{
+    struct value_cache_entry *entry;
+    unsigned int hash;
+    sigset_t sigset;
+    BOOL ret = FALSE;
+
+    if (!generation) return FALSE;
+    hash = value_cache_hash( handle, name );
+
+    server_enter_uninterrupted_section( &value_cache_mutex, &sigset );
+    if ((entry = value_cache[hash]) && value_cache_match( entry, handle, name ))
+    {
+        if (entry->generation == generation)
+        {
+            *status = entry->status;
+            *type   = entry->type;
+            *total  = entry->total;
+            memcpy( data, (char *)entry->name + entry->name_len, min( size, entry->total ));
+            value_cache_stats.hits++;
+            ret = TRUE;
+        }
+        else value_cache_stats.stale++;
+    }
+    if (!ret) value_cache_stats.misses++;
+    if (TRACE_ON(regcache)) trace_value_cache_stats( handle, name, ret ? "hit" : "miss" );
+    server_leave_uninterrupted_section( &value_cache_mutex, &sigset );
+    return ret;
+}
+
+/* store the result of a value query in the cache */
+static void cache_value( HANDLE handle, const UNICODE_STRING *name, LONG generation,
+                         NTSTATUS status, int type, data_size_t total, const void *data )
+{
+    struct value_cache_entry *entry, *old;
+    unsigned int hash;
+    sigset_t sigset;
+
+    if (!generation || name->Length > MAX_CACHED_NAME_LEN || total > MAX_CACHED_DATA_LEN) return;
+    if (!(entry = malloc( offsetof( struct value_cache_entry, name[name->Length / sizeof(WCHAR)] ) + total )))
+        return;
+    entry->handle     = handle;
+    entry->generation = generation;
+    entry->status     = status;
+    entry->type       = type;
+    entry->total      = total;
+    entry->name_len   = name->Length;
+    memcpy( entry->name, name->Buffer, name->Length );
+    memcpy( (char *)entry->name + name->Length, data, total );
+    hash = value_cache_hash( handle, name );
+
+    server_enter_uninterrupted_section( &value_cache_mutex, &sigset );
+    if (!(old = value_cache[hash])) value_cache_count++;
+    value_cache[hash] = entry;
+    /* read without the mutex by invalidate_cached_values */
+    __atomic_fetch_or( &value_cache_handles, value_cache_handle_bit( handle ), __ATOMIC_RELEASE );
+    server_leave_uninterrupted_section( &value_cache_mutex, &sigset );
+    free( old );
+}
+
+/***********************************************************************
+ *           invalidate_cached_values
+ *
+ * Forget the cached values of a key handle that is being closed.
+ */
+void invalidate_cached_values( HANDLE handle )
+{
+    struct value_cache_entry *entry;
+    unsigned int i;
+    sigset_t sigset;
+
+    /* this is called for every handle closed, don't take the mutex when nothing can be cached for it */
+    if (!(__atomic_load_n( &value_cache_handles, __ATOMIC_ACQUIRE ) & value_cache_handle_bit( handle ))) return;
+
+    server_enter_uninterrupted_section( &value_cache_mutex, &sigset );
+    for (i = 0; value_cache_count && i < VALUE_CACHE_SIZE; i++)
+    {
+        if (!(entry = value_cache[i]) || entry->handle != handle) continue;
+        value_cache[i] = NULL;
+        value_cache_count--;
+        free( entry );
+    }
+    if (!value_cache_count) __atomic_store_n( &value_cache_handles, 0, __ATOMIC_RELAXED );
+    server_leave_uninterrupted_section( &value_cache_mutex, &sigset );
+}
+
 
 /******************************************************************************
  *              NtCreateKey  (NTDLL.@)
@@ -432,6 +586,9 @@ NTSTATUS WINAPI NtQueryValueKey( HANDLE handle, const UNICODE_STRING *name,
     NTSTATUS ret;
     UCHAR *data_ptr;
     unsigned int fixed_size, min_size;
+    data_size_t data_size, total = 0;
+    LONG generation;
+    int type = 0;
 
     TRACE( "(%p,%s,%d,%p,%d)\n", handle, debugstr_us(name), info_class, info, length );
 
@@ -472,21 +629,35 @@ NTSTATUS WINAPI NtQueryValueKey( HANDLE handle, const UNICODE_STRING *name,
         return STATUS_INVALID_PARAMETER;
     }
 
-    SERVER_START_REQ( get_key_value )
+    data_size = (length > fixed_size && data_ptr) ? length - fixed_size : 0;
+
+    /* the generation must be read before the server call, so that any change made after it is noticed */
+    generation = get_registry_generation();
+    if (!get_cached_value( handle, name, generation, &ret, &type, &total, data_ptr, data_size ))
     {
-        req->hkey = wine_server_obj_handle( handle );
-        wine_server_add_data( req, name->Buffer, name->Length );
-        if (length > fixed_size && data_ptr) wine_server_set_reply( req, data_ptr, length - fixed_size );
-        if (!(ret = wine_server_call( req )))
+        SERVER_START_REQ( get_key_value )
         {
-            copy_key_value_info( info_class, info, length, reply->type,
-                                 name->Length, reply->total );
-            *result_len = fixed_size + (info_class == KeyValueBasicInformation ? 0 : reply->total);
-            if (length < min_size) ret = STATUS_BUFFER_TOO_SMALL;
-            else if (length < *result_len) ret = STATUS_BUFFER_OVERFLOW;
+            req->hkey = wine_server_obj_handle( handle );
+            wine_server_add_data( req, name->Buffer, name->Length );
+            if (data_size) wine_server_set_reply( req, data_ptr, data_size );
+            if (!(ret = wine_server_call( req )))
+            {
+                type  = reply->type;
+                total = reply->total;
+            }
         }
+        SERVER_END_REQ;
+        if ((!ret && total <= data_size) || ret == STATUS_OBJECT_NAME_NOT_FOUND)
+            cache_value( handle, name, generation, ret, type, total, data_ptr );
+    }
+
+    if (!ret)
+    {
+        copy_key_value_info( info_class, info, length, type, name->Length, total );
+        *result_len = fixed_size + (info_class == KeyValueBasicInformation ? 0 : total);
+        if (length < min_size) ret = STATUS_BUFFER_TOO_SMALL;
+        else if (length < *result_len) ret = STATUS_BUFFER_OVERFLOW;
     }
-    SERVER_END_REQ;
     return ret;
 }
 
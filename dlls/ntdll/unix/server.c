@@ -94,6 +94,7 @@
 #include "ddk/wdm.h"
 
 WINE_DEFAULT_DEBUG_CHANNEL(server);
+WINE_DECLARE_DEBUG_CHANNEL(fdcache);
 
 #ifndef MSG_CMSG_CLOEXEC
 #define MSG_CMSG_CLOEXEC 0
@@ -257,9 +258,28 @@ static void read_reply_data( void *buffer, size_t size )
  */
 static inline unsigned int wait_reply( struct __server_request_info *req )
 {
-    read_reply_data( &req->u.reply, sizeof(req->u.reply) );
-    if (req->u.reply.reply_header.reply_size)
-        read_reply_data( req->reply_data, req->u.reply.reply_header.reply_size );
+    data_size_t max_size = req->u.req.request_header.reply_size;
+    struct iovec vec[2];
+    int ret;
+
+    /* the server sends the reply header and data with a single writev, so in the
+     * common case both can be fetched with one syscall; short reads are completed
+     * (and errors reported) by read_reply_data */
+    vec[0].iov_base = &req->u.reply;
+    vec[0].iov_len  = sizeof(req->u.reply);
+    vec[1].iov_base = req->reply_data;
+    vec[1].iov_len  = max_size;
+    if ((ret = readv( ntdll_get_thread_data()->reply_fd, vec, max_size ? 2 : 1 )) < 0) ret = 0;
+
+    if (ret < sizeof(req->u.reply))
+    {
+        read_reply_data( (char *)&req->u.reply + ret, sizeof(req->u.reply) - ret );
+        ret = 0;
+    }
+    else ret -= sizeof(req->u.reply);
+
+    if (req->u.reply.reply_header.reply_size > ret)
+        read_reply_data( (char *)req->reply_data + ret, req->u.reply.reply_header.reply_size - ret );
     return req->u.reply.reply_header.error;
 }
 
@@ -870,6 +890,64 @@ int receive_fd( obj_handle_t *handle )
 }
 
 
+/* fds read from fd_socket on behalf of other threads, see receive_thread_fd() */
+struct pending_fd
+{
+    obj_handle_t tid;
+    int          fd;
+};
+
+static pthread_mutex_t fd_socket_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct pending_fd *pending_fds;
+static unsigned int pending_fds_count, pending_fds_size;
+
+/***********************************************************************
+ *           receive_thread_fd
+ *
+ * Receive the file descriptor sent by the server in reply to the last request
+ * of the current thread. The server tags it with our thread id, and since the
+ * socket is shared by all threads, fds meant for other threads are set aside
+ * for them. The fd is always queued before the reply, so this never waits on
+ * the server. Server signals must be blocked between the request and this call.
+ */
+int receive_thread_fd(void)
+{
+    obj_handle_t tid = GetCurrentThreadId(), fd_tid;
+    unsigned int i;
+    sigset_t sigset;
+    int fd;
+
+    server_enter_uninterrupted_section( &fd_socket_mutex, &sigset );
+    for (i = 0; i < pending_fds_count; i++)
+    {
+        if (pending_fds[i].tid != tid) continue;
+        fd = pending_fds[i].fd;
+        pending_fds[i] = pending_fds[--pending_fds_count];
+        goto done;
+    }
+    for (;;)
+    {
+        fd = receive_fd( &fd_tid );
+        if (fd_tid == tid) break;
+        if (pending_fds_count == pending_fds_size)
+        {
+            unsigned int new_size = max( 16, pending_fds_size * 2 );
+            struct pending_fd *new_fds = realloc( pending_fds, new_size * sizeof(*new_fds) );
+
+            if (!new_fds) server_protocol_error( "out of memory for pending fds\n" );
+            pending_fds = new_fds;
+            pending_fds_size = new_size;
+        }
+        pending_fds[pending_fds_count].tid = fd_tid;
+        pending_fds[pending_fds_count].fd = fd;
+        pending_fds_count++;
+    }
+done:
+    server_leave_uninterrupted_section( &fd_socket_mutex, &sigset );
+    return fd;
+}
+
+
 /***********************************************************************/
 /* fd cache support */
 
@@ -890,8 +968,26 @@ C_ASSERT( sizeof(union fd_cache_entry) == sizeof(LONG64) );
 #define FD_CACHE_BLOCK_SIZE  (65536 / sizeof(union fd_cache_entry))
 #define FD_CACHE_ENTRIES     128
 
-static union fd_cache_entry *fd_cache[FD_CACHE_ENTRIES];
-static union fd_cache_entry fd_cache_initial_block[FD_CACHE_BLOCK_SIZE];
+/* Each slot has a generation counter that is bumped by two when a close of the
+ * handle starts and again when it ends, with bit 0 set while a thread is inserting
+ * into the slot, and a count of the close requests in progress, which may overlap
+ * when the handle value is reused. A thread that missed the cache only inserts the
+ * fd it got from the server if no close is in progress and none started since it
+ * sent the request, so lookups and inserts never need a lock. */
+struct fd_cache_block
+{
+    union fd_cache_entry entries[FD_CACHE_BLOCK_SIZE];
+    LONG                 generation[FD_CACHE_BLOCK_SIZE];
+    LONG                 closing[FD_CACHE_BLOCK_SIZE];
+};
+
+#define FD_CACHE_INSERTING   1
+#define FD_CACHE_GENERATION  2
+
+static struct fd_cache_block *fd_cache[FD_CACHE_ENTRIES];
+static struct fd_cache_block fd_cache_initial_block;
+
+static LONG fd_cache_hits, fd_cache_misses, fd_cache_races;
 
 static inline unsigned int handle_to_index( HANDLE handle, unsigned int *entry )
 {
@@ -902,42 +998,82 @@ static inline unsigned int handle_to_index( HANDLE handle, unsigned int *entry )
 
 
 /***********************************************************************
- *           add_fd_to_cache
+ *           get_fd_cache_block
  *
- * Caller must hold fd_cache_mutex.
+ * Get the cache block for a handle, allocating it if needed.
  */
-static BOOL add_fd_to_cache( HANDLE handle, int fd, enum server_fd_type type,
-                            unsigned int access, unsigned int options )
+static struct fd_cache_block *get_fd_cache_block( HANDLE handle )
 {
-    unsigned int entry, idx = handle_to_index( handle, &entry );
-    union fd_cache_entry cache;
+    unsigned int entry;
+    struct fd_cache_block *block;
+
+    handle_to_index( handle, &entry );
+    if (entry >= FD_CACHE_ENTRIES) return NULL;
+    if ((block = fd_cache[entry])) return block;
 
-    if (entry >= FD_CACHE_ENTRIES)
+    if (!entry) block = &fd_cache_initial_block;
+    else
     {
-        FIXME( "too many allocated handles, not caching %p\n", handle );
-        return FALSE;
+        block = wine_anon_mmap( NULL, sizeof(*block), PROT_READ | PROT_WRITE, 0 );
+        if (block == MAP_FAILED) return NULL;
     }
-
-    if (!fd_cache[entry])  /* do we need to allocate a new block of entries? */
+    if (InterlockedCompareExchangePointer( (void **)&fd_cache[entry], block, NULL ))
     {
-        if (!entry) fd_cache[0] = fd_cache_initial_block;
-        else
-        {
-            void *ptr = wine_anon_mmap( NULL, FD_CACHE_BLOCK_SIZE * sizeof(union fd_cache_entry),
-                                        PROT_READ | PROT_WRITE, 0 );
-            if (ptr == MAP_FAILED) return FALSE;
-            fd_cache[entry] = ptr;
-        }
+        /* somebody else allocated it first */
+        if (entry) munmap( block, sizeof(*block) );
+        block = fd_cache[entry];
     }
+    return block;
+}
+
+
+/***********************************************************************
+ *           add_fd_to_cache
+ *
+ * Store an fd obtained from the server. generation is the slot generation
+ * read before sending the request. Returns FALSE if the fd could not be stored
+ * and belongs to the caller; *closed is set if the handle was closed meanwhile
+ * and the fd has already been closed along with it.
+ */
+static BOOL add_fd_to_cache( struct fd_cache_block *block, HANDLE handle, LONG generation, int fd,
+                             enum server_fd_type type, unsigned int access, unsigned int options,
+                             BOOL *closed )
+{
+    unsigned int entry, idx = handle_to_index( handle, &entry );
+    union fd_cache_entry cache;
+    BOOL ret = TRUE;
+
+    *closed = FALSE;
+    if (generation & FD_CACHE_INSERTING) return FALSE;
+    /* the server may have replied before processing a close that is still in progress */
+    if (InterlockedCompareExchange( &block->closing[idx], 0, 0 )) return FALSE;
+    if (InterlockedCompareExchange( &block->generation[idx], generation | FD_CACHE_INSERTING,
+                                    generation ) != generation)
+        return FALSE;  /* closed since the request, or somebody else is inserting */
 
     /* store fd+1 so that 0 can be used as the unset value */
     cache.s.fd = fd + 1;
     cache.s.type = type;
     cache.s.access = access;
     cache.s.options = options;
-    cache.data = interlocked_xchg64( &fd_cache[entry][idx].data, cache.data );
-    assert( !cache.s.fd );
-    return TRUE;
+    if (InterlockedCompareExchange64( &block->entries[idx].data, cache.data, 0 ))
+    {
+        InterlockedExchangeAdd( &block->generation[idx], -FD_CACHE_INSERTING );
+        return FALSE;
+    }
+
+    if (InterlockedCompareExchange( &block->generation[idx], generation,
+                                    generation | FD_CACHE_INSERTING ) == (generation | FD_CACHE_INSERTING))
+        return TRUE;
+
+    /* the handle was closed while we were inserting, and nobody else can have
+     * inserted in the meantime, so if the entry is still there it is ours */
+    if (InterlockedCompareExchange64( &block->entries[idx].data, 0, cache.data ) == cache.data)
+        ret = FALSE;
+    else
+        *closed = TRUE;
+    InterlockedExchangeAdd( &block->generation[idx], -FD_CACHE_INSERTING );
+    return ret;
 }
 
 
@@ -952,7 +1088,7 @@ static inline NTSTATUS get_cached_fd( HANDLE handle, int *fd, enum server_fd_typ
 
     if (entry >= FD_CACHE_ENTRIES || !fd_cache[entry]) return STATUS_INVALID_HANDLE;
 
-    cache.data = InterlockedCompareExchange64( &fd_cache[entry][idx].data, 0, 0 );
+    cache.data = InterlockedCompareExchange64( &fd_cache[entry]->entries[idx].data, 0, 0 );
     if (!cache.data) return STATUS_INVALID_HANDLE;
 
     /* if fd type is invalid, fd stores an error value */
@@ -967,9 +1103,12 @@ static inline NTSTATUS get_cached_fd( HANDLE handle, int *fd, enum server_fd_typ
 
 
 /***********************************************************************
- *           remove_fd_from_cache
+ *           begin_fd_cache_close
+ *
+ * Block inserts into the slot of a handle that is about to be closed, and
+ * remove the cached fd. Must be paired with end_fd_cache_close.
  */
-static int remove_fd_from_cache( HANDLE handle )
+static int begin_fd_cache_close( HANDLE handle )
 {
     unsigned int entry, idx = handle_to_index( handle, &entry );
     int fd = -1;
@@ -977,7 +1116,9 @@ static int remove_fd_from_cache( HANDLE handle )
     if (entry < FD_CACHE_ENTRIES && fd_cache[entry])
     {
         union fd_cache_entry cache;
-        cache.data = interlocked_xchg64( &fd_cache[entry][idx].data, 0 );
+        InterlockedIncrement( &fd_cache[entry]->closing[idx] );
+        InterlockedExchangeAdd( &fd_cache[entry]->generation[idx], FD_CACHE_GENERATION );
+        cache.data = interlocked_xchg64( &fd_cache[entry]->entries[idx].data, 0 );
         if (cache.s.type != FD_TYPE_INVALID) fd = cache.s.fd - 1;
     }
 
@@ -985,6 +1126,24 @@ static int remove_fd_from_cache( HANDLE handle )
 }
 
 
+/***********************************************************************
+ *           end_fd_cache_close
+ *
+ * Let the slot be used again once the server has closed the handle.
+ */
+static void end_fd_cache_close( HANDLE handle )
+{
+    unsigned int entry, idx = handle_to_index( handle, &entry );
+
+    if (entry < FD_CACHE_ENTRIES && fd_cache[entry])
+    {
+        /* requests sent during the close may have been answered before it */
+        InterlockedExchangeAdd( &fd_cache[entry]->generation[idx], FD_CACHE_GENERATION );
+        InterlockedDecrement( &fd_cache[entry]->closing[idx] );
+    }
+}
+
+
 /***********************************************************************
  *           server_get_unix_fd
  *
@@ -993,47 +1152,84 @@ static int remove_fd_from_cache( HANDLE handle )
 int server_get_unix_fd( HANDLE handle, unsigned int wanted_access, int *unix_fd,
                         int *needs_close, enum server_fd_type *type, unsigned int *options )
 {
+    struct fd_cache_block *block;
+    enum server_fd_type fd_type;
+    unsigned int access = 0, fd_options;
+    unsigned int entry, idx = handle_to_index( handle, &entry );
     sigset_t sigset;
-    obj_handle_t fd_handle;
+    LONG generation;
+    BOOL cacheable, closed;
     int ret, fd = -1;
-    unsigned int access = 0;
 
     *unix_fd = -1;
     *needs_close = 0;
     wanted_access &= FILE_READ_DATA | FILE_WRITE_DATA | FILE_APPEND_DATA;
 
     ret = get_cached_fd( handle, &fd, type, &access, options );
-    if (ret != STATUS_INVALID_HANDLE) goto done;
+    if (ret != STATUS_INVALID_HANDLE)
+    {
+        if (TRACE_ON(fdcache)) InterlockedIncrement( &fd_cache_hits );
+        goto done;
+    }
 
-    server_enter_uninterrupted_section( &fd_cache_mutex, &sigset );
-    ret = get_cached_fd( handle, &fd, type, &access, options );
-    if (ret == STATUS_INVALID_HANDLE)
+    /* the block must exist before reading the generation, so that a concurrent
+     * close of the handle is guaranteed to bump it */
+    block = get_fd_cache_block( handle );
+
+    for (;;)
     {
+        generation = block ? InterlockedCompareExchange( &block->generation[idx], 0, 0 ) : 0;
+        fd_type = FD_TYPE_INVALID;
+        fd_options = 0;
+        access = 0;
+        fd = -1;
+
+        pthread_sigmask( SIG_BLOCK, &server_block_set, &sigset );
         SERVER_START_REQ( get_handle_fd )
         {
             req->handle = wine_server_obj_handle( handle );
             if (!(ret = wine_server_call( req )))
             {
-                if (type) *type = reply->type;
-                if (options) *options = reply->options;
+                fd_type = reply->type;
+                fd_options = reply->options;
                 access = reply->access;
-                if ((fd = receive_fd( &fd_handle )) != -1)
-                {
-                    assert( wine_server_ptr_handle(fd_handle) == handle );
-                    *needs_close = (!reply->cacheable ||
-                                    !add_fd_to_cache( handle, fd, reply->type,
-                                                      reply->access, reply->options ));
-                }
-                else ret = STATUS_TOO_MANY_OPENED_FILES;
-            }
-            else if (reply->cacheable)
-            {
-                add_fd_to_cache( handle, ret, FD_TYPE_INVALID, 0, 0 );
+                if ((fd = receive_thread_fd()) == -1) ret = STATUS_TOO_MANY_OPENED_FILES;
             }
+            cacheable = reply->cacheable && ret != STATUS_TOO_MANY_OPENED_FILES;
         }
         SERVER_END_REQ;
+        pthread_sigmask( SIG_SETMASK, &sigset, NULL );
+
+        if (TRACE_ON(fdcache))
+            TRACE_(fdcache)( "%p: miss, %d hits %d misses %d races\n", handle, fd_cache_hits,
+                             InterlockedIncrement( &fd_cache_misses ), fd_cache_races );
+
+        if (!ret) *needs_close = 1;
+        if (!cacheable) break;
+        if (!block)
+        {
+            if (entry >= FD_CACHE_ENTRIES) FIXME( "too many allocated handles, not caching %p\n", handle );
+            break;
+        }
+        if (ret)
+        {
+            /* the error is cached, there is no fd to close */
+            add_fd_to_cache( block, handle, generation, ret, FD_TYPE_INVALID, 0, 0, &closed );
+            break;
+        }
+        if (add_fd_to_cache( block, handle, generation, fd, fd_type, access, fd_options, &closed ))
+            *needs_close = 0;
+        if (!closed) break;
+
+        /* the handle was closed, and possibly reused, while we were asking the server */
+        if (TRACE_ON(fdcache)) InterlockedIncrement( &fd_cache_races );
+        *needs_close = 0;
+    }
+    if (!ret)
+    {
+        if (type) *type = fd_type;
+        if (options) *options = fd_options;
     }
-    server_leave_uninterrupted_section( &fd_cache_mutex, &sigset );
 
 done:
     if (!ret && ((access & wanted_access) != wanted_access))
@@ -1617,6 +1813,11 @@ NTSTATUS WINAPI NtDuplicateObject( HANDLE source_process, HANDLE source, HANDLE
                                    ACCESS_MASK access, ULONG attributes, ULONG options )
 {
     NTSTATUS ret;
+    BOOL close_source = (options & DUPLICATE_CLOSE_SOURCE) && source_process == NtCurrentProcess();
+    int fd = -1;
+
+    /* inserts fail from now on until the server is done with the source handle */
+    if (close_source) fd = begin_fd_cache_close( source );
 
     SERVER_START_REQ( dup_handle )
     {
@@ -1629,14 +1830,19 @@ NTSTATUS WINAPI NtDuplicateObject( HANDLE source_process, HANDLE source, HANDLE
         if (!(ret = wine_server_call( req )))
         {
             if (dest) *dest = wine_server_ptr_handle( reply->handle );
-            if (reply->closed && reply->self)
+            if (reply->closed && reply->self && !close_source)
             {
-                int fd = remove_fd_from_cache( source );
-                if (fd != -1) close( fd );
+                /* our own process through a real handle, the slot could not be blocked beforehand */
+                fd = begin_fd_cache_close( source );
+                end_fd_cache_close( source );
             }
+            /* the source handle may also have been reused with different access rights */
+            if ((options & DUPLICATE_CLOSE_SOURCE) && reply->self) invalidate_cached_values( source );
         }
     }
     SERVER_END_REQ;
+    if (close_source) end_fd_cache_close( source );
+    if (fd != -1) close( fd );
     return ret;
 }
 
@@ -1648,7 +1854,8 @@ NTSTATUS WINAPI NtClose( HANDLE handle )
 {
     HANDLE port;
     NTSTATUS ret;
-    int fd = remove_fd_from_cache( handle );
+    /* inserts fail from now on until the server is done with the handle */
+    int fd = begin_fd_cache_close( handle );
 
     if (do_fsync())
         fsync_close( handle );
@@ -1662,7 +1869,9 @@ NTSTATUS WINAPI NtClose( HANDLE handle )
         ret = wine_server_call( req );
     }
     SERVER_END_REQ;
+    end_fd_cache_close( handle );
     if (fd != -1) close( fd );
+    invalidate_cached_values( handle );
 
     if (ret != STATUS_INVALID_HANDLE || !handle) return ret;
     if (!NtCurrentTeb()->Peb->BeingDebugged) return ret;
@@ -1373,6 +1373,109 @@ NTSTATUS WINAPI NtWaitForMultipleObjects( DWORD count, const HANDLE *handles, BO
 }
 
 
+/******************************************************************
+ *		get_max_wait_objects
+ *
+ * Returns how many handles wait_objects_any() can wait on together with the given one.
+ */
+ULONG CDECL get_max_wait_objects( HANDLE handle )
+{
+    if (do_fsync()) return fsync_get_max_wait_objects( handle );
+    if (do_esync()) return esync_get_max_wait_objects( handle );
+    return MAXIMUM_WAIT_OBJECTS;
+}
+
+
+/* wait for any of at most MAXIMUM_WAIT_OBJECTS handles, returning the index separately */
+static NTSTATUS wait_chunk_any( DWORD count, const HANDLE *handles, const LARGE_INTEGER *timeout,
+                                DWORD *index )
+{
+    NTSTATUS ret = NtWaitForMultipleObjects( count, handles, TRUE, FALSE, timeout );
+
+    if ((ULONG)ret < STATUS_WAIT_0 + count)
+    {
+        *index = ret - STATUS_WAIT_0;
+        return STATUS_WAIT_0;
+    }
+    if ((ULONG)ret >= STATUS_ABANDONED_WAIT_0 && (ULONG)ret < STATUS_ABANDONED_WAIT_0 + count)
+    {
+        *index = ret - STATUS_ABANDONED_WAIT_0;
+        return STATUS_ABANDONED_WAIT_0;
+    }
+    return ret;
+}
+
+#define WAIT_CHUNK_SLICE 10000  /* 1 ms */
+
+/* Wait for any of more than MAXIMUM_WAIT_OBJECTS handles, when the sync backend can't
+ * take them all at once. All the chunks are polled, then the thread blocks on one of
+ * them for a short slice, in turn, so a wakeup can be delayed by a slice per chunk. */
+static NTSTATUS wait_chunks_any( DWORD count, const HANDLE *handles, const LARGE_INTEGER *timeout,
+                                 DWORD *index )
+{
+    static const LARGE_INTEGER zero;
+    LARGE_INTEGER now, slice;
+    ULONGLONG end = 0;
+    DWORD start, chunk, next = 0;
+    NTSTATUS ret;
+
+    if (timeout && timeout->QuadPart != TIMEOUT_INFINITE)
+    {
+        NtQuerySystemTime( &now );
+        end = timeout->QuadPart > 0 ? timeout->QuadPart : now.QuadPart - timeout->QuadPart;
+    }
+    else timeout = NULL;
+
+    for (;;)
+    {
+        /* the lowest signaled index wins, like in a single wait */
+        for (start = 0; start < count; start += chunk)
+        {
+            chunk = min( count - start, MAXIMUM_WAIT_OBJECTS );
+            if ((ret = wait_chunk_any( chunk, handles + start, &zero, index )) != STATUS_TIMEOUT) goto done;
+        }
+
+        slice.QuadPart = -WAIT_CHUNK_SLICE;
+        if (timeout)
+        {
+            NtQuerySystemTime( &now );
+            if (now.QuadPart >= end) return STATUS_TIMEOUT;
+            if (end - now.QuadPart < WAIT_CHUNK_SLICE) slice.QuadPart = now.QuadPart - end;
+        }
+        start = next;
+        chunk = min( count - start, MAXIMUM_WAIT_OBJECTS );
+        if ((ret = wait_chunk_any( chunk, handles + start, &slice, index )) != STATUS_TIMEOUT) goto done;
+        if ((next += chunk) >= count) next = 0;
+    }
+
+done:
+    if (ret == STATUS_WAIT_0 || ret == STATUS_ABANDONED_WAIT_0) *index += start;
+    return ret;
+}
+
+
+/******************************************************************
+ *		wait_objects_any
+ *
+ * Non-alertable wait for any of the handles, which may be more than
+ * MAXIMUM_WAIT_OBJECTS. Returns STATUS_WAIT_0 or STATUS_ABANDONED_WAIT_0
+ * and the index of the signaled handle. Sets larger than what the sync
+ * backend can wait on at once are waited on in chunks.
+ */
+NTSTATUS CDECL wait_objects_any( DWORD count, const HANDLE *handles, const LARGE_INTEGER *timeout,
+                                 DWORD *index )
+{
+    NTSTATUS ret = STATUS_NOT_SUPPORTED;
+
+    if (count <= MAXIMUM_WAIT_OBJECTS) return wait_chunk_any( count, handles, timeout, index );
+
+    if (do_fsync()) ret = fsync_wait_objects_any( count, handles, timeout, index );
+    else if (do_esync()) ret = esync_wait_objects_any( count, handles, timeout, index );
+    if (ret != STATUS_NOT_SUPPORTED && ret != STATUS_NO_MEMORY) return ret;
+    return wait_chunks_any( count, handles, timeout, index );
+}
+
+
 /******************************************************************
  *		NtWaitForSingleObject (NTDLL.@)
  */
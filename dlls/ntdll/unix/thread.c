@@ -229,6 +229,8 @@ NTSTATUS WINAPI NtCreateThreadEx( HANDLE *handle, ACCESS_MASK access, OBJECT_ATT
     client_id.UniqueProcess = ULongToHandle( GetCurrentProcessId() );
     client_id.UniqueThread  = ULongToHandle( tid );
     teb->ClientId = client_id;
+    if (flags & THREAD_CREATE_FLAGS_LOADER_WORKER) teb->SameTebFlags |= TEB_SAME_FLAGS_LOADER_WORKER;
+    if (flags & THREAD_CREATE_FLAGS_SKIP_LOADER_INIT) teb->SameTebFlags |= TEB_SAME_FLAGS_SKIP_LOADER_INIT;
 
     teb->Tib.StackBase = stack.StackBase;
     teb->Tib.StackLimit = stack.StackLimit;
@@ -27,10 +27,14 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <signal.h>
 #include <sys/types.h>
+#ifdef HAVE_SYS_IOCTL_H
+# include <sys/ioctl.h>
+#endif
 #ifdef HAVE_SYS_SOCKET_H
 # include <sys/socket.h>
 #endif
@@ -43,6 +47,9 @@
 #ifdef HAVE_SYS_SYSINFO_H
 # include <sys/sysinfo.h>
 #endif
+#ifdef HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>
+#endif
 #ifdef HAVE_VALGRIND_VALGRIND_H
 # include <valgrind/valgrind.h>
 #endif
@@ -88,6 +95,16 @@ struct file_view
     void         *base;          /* base address */
     size_t        size;          /* size in bytes */
     unsigned int  protect;       /* protection for all pages at allocation time and SEC_* flags */
+    struct vprot_run *runs;      /* per-page protection, as runs of pages sorted by address */
+    unsigned int  runs_count;    /* number of protection runs */
+    unsigned int  runs_order;    /* log2 of the allocated number of protection runs */
+};
+
+/* range of pages of a view sharing the same protection byte, up to the start of the next run */
+struct vprot_run
+{
+    size_t start;                /* first page of the run, relative to the view base */
+    BYTE   vprot;                /* protection byte of all the pages of the run */
 };
 
 /* per-page protection flags */
@@ -102,6 +119,8 @@ struct file_view
 /* per-mapping protection flags */
 #define VPROT_SYSTEM     0x0200  /* system view (underlying mmap not under our control) */
 #define VPROT_NATIVE     0x0400
+#define VPROT_LARGE_PAGES 0x0800 /* backed by large pages */
+#define VPROT_KERNEL_WRITEWATCH 0x1000 /* write watches tracked by the kernel instead of page faults */
 
 /* Conversion from VPROT_* to Win32 flags */
 static const BYTE VIRTUAL_Win32Flags[16] =
@@ -131,6 +150,8 @@ static const BOOL is_win64 = (sizeof(void *) > sizeof(int));
 static const UINT page_shift = 12;
 static const UINT_PTR page_mask = 0xfff;
 static const UINT_PTR granularity_mask = 0xffff;
+/* must match LargePageMinimum in the shared user data */
+static const UINT_PTR large_page_mask = 0x1fffff;
 
 /* Note: these are Windows limits, you cannot change them. */
 #ifdef __i386__
@@ -178,14 +199,12 @@ static struct list teb_list = LIST_INIT( teb_list );
 #define MAP_FIXED_NOREPLACE 0
 #endif
 
-#ifdef _WIN64  /* on 64-bit the page protection bytes use a 2-level table */
-static const size_t pages_vprot_shift = 20;
-static const size_t pages_vprot_mask = (1 << 20) - 1;
-static size_t pages_vprot_size;
-static BYTE **pages_vprot;
-#else  /* on 32-bit we use a simple array with one byte per page */
-static BYTE *pages_vprot;
-#endif
+/* pool of protection run arrays, with a free list for each power of two size */
+static const unsigned int vprot_runs_min_order = 2;
+static const unsigned int vprot_runs_max_order = 12;  /* larger arrays are mapped directly */
+static const size_t vprot_runs_block_size = 0x10000;
+static void *free_vprot_runs_list[13];  /* up to vprot_runs_max_order */
+static char *vprot_runs_block_start, *vprot_runs_block_end;
 
 static struct file_view *view_block_start, *view_block_end, *next_free_view;
 #ifdef _WIN64
@@ -206,6 +225,79 @@ struct range_entry
 static struct range_entry *free_ranges;
 static struct range_entry *free_ranges_end;
 
+#ifdef __linux__
+/* Write watches can be tracked by the kernel without any page fault reaching us, using
+ * an asynchronous write-protect userfaultfd, and collected and reset with the PAGEMAP_SCAN
+ * ioctl. Both are available since Linux 6.7; the definitions come from linux/userfaultfd.h
+ * and linux/fs.h. */
+struct uffdio_api
+{
+    ULONGLONG api;
+    ULONGLONG features;
+    ULONGLONG ioctls;
+};
+
+struct uffdio_range
+{
+    ULONGLONG start;
+    ULONGLONG len;
+};
+
+struct uffdio_register
+{
+    struct uffdio_range range;
+    ULONGLONG mode;
+    ULONGLONG ioctls;
+};
+
+struct uffdio_writeprotect
+{
+    struct uffdio_range range;
+    ULONGLONG mode;
+};
+
+struct page_region
+{
+    ULONGLONG start;
+    ULONGLONG end;
+    ULONGLONG categories;
+};
+
+struct pm_scan_arg
+{
+    ULONGLONG size;
+    ULONGLONG flags;
+    ULONGLONG start;
+    ULONGLONG end;
+    ULONGLONG walk_end;
+    ULONGLONG vec;
+    ULONGLONG vec_len;
+    ULONGLONG max_pages;
+    ULONGLONG category_inverted;
+    ULONGLONG category_mask;
+    ULONGLONG category_anyof_mask;
+    ULONGLONG return_mask;
+};
+
+#define UFFD_USER_MODE_ONLY            1
+#define UFFD_API                       0xaa
+#define UFFD_FEATURE_WP_UNPOPULATED    (1 << 13)
+#define UFFD_FEATURE_WP_ASYNC          (1 << 15)
+#define UFFDIO_REGISTER_MODE_WP        (1 << 1)
+#define UFFDIO_WRITEPROTECT_MODE_WP    (1 << 0)
+#define UFFDIO_API                     _IOWR( 0xaa, 0x3f, struct uffdio_api )
+#define UFFDIO_REGISTER                _IOWR( 0xaa, 0x00, struct uffdio_register )
+#define UFFDIO_WRITEPROTECT            _IOWR( 0xaa, 0x06, struct uffdio_writeprotect )
+
+#define PAGE_IS_WRITTEN                (1 << 1)
+#define PM_SCAN_WP_MATCHING            (1 << 0)
+#define PM_SCAN_CHECK_WPASYNC          (1 << 1)
+#define PAGEMAP_SCAN                   _IOWR( 'f', 16, struct pm_scan_arg )
+
+static int uffd_fd = -1;     /* userfaultfd the write watch views are registered with */
+#endif
+static int pagemap_fd = -1;  /* /proc/self/pagemap, set if write watches are tracked by the kernel */
+
 
 static inline BOOL is_inside_signal_stack( void *ptr )
 {
@@ -672,93 +764,232 @@ static inline int is_view_valloc( const struct file_view *view )
 }
 
 /***********************************************************************
- *           get_page_vprot
+ *           alloc_vprot_runs
  *
- * Return the page protection byte.
+ * Allocate an array of 1 << order protection runs. virtual_mutex must be held by caller.
  */
-static BYTE get_page_vprot( const void *addr )
+static struct vprot_run *alloc_vprot_runs( unsigned int order )
 {
-    size_t idx = (size_t)addr >> page_shift;
+    size_t size = sizeof(struct vprot_run) << order;
+    void *ptr;
 
-#ifdef _WIN64
-    if ((idx >> pages_vprot_shift) >= pages_vprot_size) return 0;
-    if (!pages_vprot[idx >> pages_vprot_shift]) return 0;
-    return pages_vprot[idx >> pages_vprot_shift][idx & pages_vprot_mask];
-#else
-    return pages_vprot[idx];
-#endif
+    if (order > vprot_runs_max_order)
+    {
+        if ((ptr = wine_anon_mmap( NULL, size, PROT_READ | PROT_WRITE, 0 )) == (void *)-1) return NULL;
+        return ptr;
+    }
+    if ((ptr = free_vprot_runs_list[order]))
+    {
+        free_vprot_runs_list[order] = *(void **)ptr;
+        return ptr;
+    }
+    if (vprot_runs_block_end - vprot_runs_block_start < size)
+    {
+        if ((ptr = wine_anon_mmap( NULL, vprot_runs_block_size, PROT_READ | PROT_WRITE, 0 )) == (void *)-1)
+            return NULL;
+        vprot_runs_block_start = ptr;
+        vprot_runs_block_end = vprot_runs_block_start + vprot_runs_block_size;
+    }
+    ptr = vprot_runs_block_start;
+    vprot_runs_block_start += size;
+    return ptr;
 }
 
 
 /***********************************************************************
- *           set_page_vprot
+ *           free_vprot_runs
  *
- * Set a range of page protection bytes.
+ * Free an array of protection runs. virtual_mutex must be held by caller.
  */
-static void set_page_vprot( const void *addr, size_t size, BYTE vprot )
+static void free_vprot_runs( struct vprot_run *runs, unsigned int order )
 {
-    size_t idx = (size_t)addr >> page_shift;
-    size_t end = ((size_t)addr + size + page_mask) >> page_shift;
-
-#ifdef _WIN64
-    while (idx >> pages_vprot_shift != end >> pages_vprot_shift)
+    if (order > vprot_runs_max_order)
     {
-        size_t dir_size = pages_vprot_mask + 1 - (idx & pages_vprot_mask);
-        memset( pages_vprot[idx >> pages_vprot_shift] + (idx & pages_vprot_mask), vprot, dir_size );
-        idx += dir_size;
+        munmap( runs, sizeof(struct vprot_run) << order );
+        return;
     }
-    memset( pages_vprot[idx >> pages_vprot_shift] + (idx & pages_vprot_mask), vprot, end - idx );
-#else
-    memset( pages_vprot + idx, vprot, end - idx );
-#endif
+    *(void **)runs = free_vprot_runs_list[order];
+    free_vprot_runs_list[order] = runs;
 }
 
 
 /***********************************************************************
- *           set_page_vprot_bits
+ *           resize_vprot_runs
  *
- * Set or clear bits in a range of page protection bytes.
+ * Reallocate the protection runs of a view to the given order.
  */
-static void set_page_vprot_bits( const void *addr, size_t size, BYTE set, BYTE clear )
+static BOOL resize_vprot_runs( struct file_view *view, unsigned int order )
 {
-    size_t idx = (size_t)addr >> page_shift;
-    size_t end = ((size_t)addr + size + page_mask) >> page_shift;
+    struct vprot_run *runs;
 
-#ifdef _WIN64
-    for ( ; idx < end; idx++)
+    if (!(runs = alloc_vprot_runs( order ))) return FALSE;
+    memcpy( runs, view->runs, view->runs_count * sizeof(*runs) );
+    free_vprot_runs( view->runs, view->runs_order );
+    view->runs = runs;
+    view->runs_order = order;
+    return TRUE;
+}
+
+
+/***********************************************************************
+ *           find_vprot_run
+ *
+ * Find the index of the protection run containing a given page of a view.
+ */
+static unsigned int find_vprot_run( const struct file_view *view, size_t page )
+{
+    unsigned int min = 0, max = view->runs_count - 1;
+
+    while (min < max)
     {
-        BYTE *ptr = pages_vprot[idx >> pages_vprot_shift] + (idx & pages_vprot_mask);
-        *ptr = (*ptr & ~clear) | set;
+        unsigned int pos = (min + max + 1) / 2;
+
+        if (view->runs[pos].start <= page) min = pos;
+        else max = pos - 1;
     }
-#else
-    for ( ; idx < end; idx++) pages_vprot[idx] = (pages_vprot[idx] & ~clear) | set;
-#endif
+    return min;
 }
 
 
 /***********************************************************************
- *           alloc_pages_vprot
+ *           get_vprot_run_base
  *
- * Allocate the page protection bytes for a given range.
+ * Return the address of the first page of a protection run, or the end of
+ * the view for the index following the last run.
  */
-static BOOL alloc_pages_vprot( const void *addr, size_t size )
+static inline char *get_vprot_run_base( const struct file_view *view, unsigned int index )
 {
-#ifdef _WIN64
-    size_t idx = (size_t)addr >> page_shift;
-    size_t end = ((size_t)addr + size + page_mask) >> page_shift;
-    size_t i;
-    void *ptr;
+    if (index >= view->runs_count) return (char *)view->base + view->size;
+    return (char *)view->base + (view->runs[index].start << page_shift);
+}
+
+
+/***********************************************************************
+ *           split_vprot_run
+ *
+ * Make a protection run start at the given page, and return its index.
+ * There must be room for one more run.
+ */
+static unsigned int split_vprot_run( struct file_view *view, size_t page )
+{
+    unsigned int index = find_vprot_run( view, page );
+
+    if (view->runs[index].start == page) return index;
+    memmove( view->runs + index + 2, view->runs + index + 1,
+             (view->runs_count - index - 1) * sizeof(*view->runs) );
+    view->runs[index + 1].start = page;
+    view->runs[index + 1].vprot = view->runs[index].vprot;
+    view->runs_count++;
+    return index + 1;
+}
+
+
+/***********************************************************************
+ *           init_view_vprot
+ *
+ * Allocate the protection runs of a new view, with the same protection for all pages.
+ */
+static BOOL init_view_vprot( struct file_view *view, BYTE vprot )
+{
+    view->runs_order = vprot_runs_min_order;
+    if (!(view->runs = alloc_vprot_runs( view->runs_order ))) return FALSE;
+    view->runs_count = 1;
+    view->runs[0].start = 0;
+    view->runs[0].vprot = vprot;
+    return TRUE;
+}
+
+
+/***********************************************************************
+ *           get_view_vprot
+ *
+ * Return the protection byte of a page of a view, and optionally the end of
+ * the range of pages that share it.
+ */
+static BYTE get_view_vprot( const struct file_view *view, const void *addr, char **end )
+{
+    unsigned int index = find_vprot_run( view, ((const char *)addr - (char *)view->base) >> page_shift );
+
+    if (end) *end = get_vprot_run_base( view, index + 1 );
+    return view->runs[index].vprot;
+}
+
 
-    assert( end <= pages_vprot_size << pages_vprot_shift );
-    for (i = idx >> pages_vprot_shift; i < (end + pages_vprot_mask) >> pages_vprot_shift; i++)
+/***********************************************************************
+ *           reserve_view_vprot_runs
+ *
+ * Make room for the runs that set_view_vprot_bits may add, so that it can't fail.
+ * Callers that change the mapping first must call this before doing so.
+ */
+static BOOL reserve_view_vprot_runs( struct file_view *view )
+{
+    if (view->runs_count + 2 <= 1u << view->runs_order) return TRUE;
+    return resize_vprot_runs( view, view->runs_order + 1 );
+}
+
+
+/***********************************************************************
+ *           set_view_vprot_bits
+ *
+ * Set or clear bits in the protection bytes of a range of pages of a view.
+ */
+static NTSTATUS set_view_vprot_bits( struct file_view *view, const void *addr, size_t size, BYTE set, BYTE clear )
+{
+    size_t start = ((const char *)addr - (char *)view->base) >> page_shift;
+    size_t end = ((const char *)addr - (char *)view->base + size + page_mask) >> page_shift;
+    size_t pages = view->size >> page_shift;
+    unsigned int first, last, pos, i;
+
+    if (end > pages) end = pages;
+    if (start >= end) return STATUS_SUCCESS;
+
+    if (!reserve_view_vprot_runs( view ))
     {
-        if (pages_vprot[i]) continue;
-        if ((ptr = wine_anon_mmap( NULL, pages_vprot_mask + 1, PROT_READ | PROT_WRITE, 0 )) == (void *)-1)
-            return FALSE;
-        pages_vprot[i] = ptr;
+        ERR( "out of memory for page protections of %p-%p\n", (char *)view->base + (start << page_shift),
+             (char *)view->base + (end << page_shift) );
+        return STATUS_NO_MEMORY;
     }
-#endif
-    return TRUE;
+
+    first = split_vprot_run( view, start );
+    last = end < pages ? split_vprot_run( view, end ) : view->runs_count;
+    for (i = first; i < last; i++) view->runs[i].vprot = (view->runs[i].vprot & ~clear) | set;
+
+    /* merge the modified runs with each other and with their neighbours */
+    if (first) first--;
+    if (last == view->runs_count) last--;
+    for (pos = i = first; i < last; i++)
+    {
+        if (view->runs[i + 1].vprot == view->runs[pos].vprot) continue;
+        view->runs[++pos] = view->runs[i + 1];
+    }
+    if (pos < last)
+    {
+        memmove( view->runs + pos + 1, view->runs + last + 1,
+                 (view->runs_count - last - 1) * sizeof(*view->runs) );
+        view->runs_count -= last - pos;
+    }
+
+    if (view->runs_order > vprot_runs_min_order && view->runs_count <= 1u << (view->runs_order - 2))
+        resize_vprot_runs( view, view->runs_order - 1 );
+    return STATUS_SUCCESS;
+}
+
+
+/***********************************************************************
+ *           align_large_pages_range
+ *
+ * Extend a range in a large pages view to whole large pages, the only unit
+ * in which they can be committed or protected.
+ */
+static void *align_large_pages_range( struct file_view *view, void *base, SIZE_T *size )
+{
+    char *end;
+
+    if (!(view->protect & VPROT_LARGE_PAGES)) return base;
+    end = ROUND_ADDR( (char *)base + *size + large_page_mask, large_page_mask );
+    base = ROUND_ADDR( base, large_page_mask );
+    *size = end - (char *)base;
+    return base;
 }
 
 
@@ -820,9 +1051,8 @@ static int get_unix_prot( BYTE vprot )
  */
 static void dump_view( struct file_view *view )
 {
-    UINT i, count;
+    unsigned int i;
     char *addr = view->base;
-    BYTE prot = get_page_vprot( addr );
 
     TRACE( "View: %p - %p", addr, addr + view->size - 1 );
     if (view->protect & VPROT_NATIVE)
@@ -838,19 +1068,9 @@ static void dump_view( struct file_view *view )
     else
         TRACE( " (valloc)\n");
 
-    for (count = i = 1; i < view->size >> page_shift; i++, count++)
-    {
-        BYTE next = get_page_vprot( addr + (count << page_shift) );
-        if (next == prot) continue;
-        TRACE( "      %p - %p %s\n",
-                 addr, addr + (count << page_shift) - 1, get_prot_str(prot) );
-        addr += (count << page_shift);
-        prot = next;
-        count = 0;
-    }
-    if (count)
-        TRACE( "      %p - %p %s\n",
-                 addr, addr + (count << page_shift) - 1, get_prot_str(prot) );
+    for (i = 0; i < view->runs_count; i++)
+        TRACE( "      %p - %p %s\n", get_vprot_run_base( view, i ),
+               get_vprot_run_base( view, i + 1 ) - 1, get_prot_str( view->runs[i].vprot ) );
 }
 
 
@@ -905,6 +1125,59 @@ static struct file_view *find_view( const void *addr, size_t size )
 }
 
 
+/***********************************************************************
+ *           get_page_vprot_range
+ *
+ * Return the page protection byte, and the end of the range of pages that share it.
+ * virtual_mutex must be held by caller.
+ */
+static BYTE get_page_vprot_range( const void *addr, char **end )
+{
+    struct file_view *view = find_view( addr, 0 );
+
+    if (view) return get_view_vprot( view, addr, end );
+    *end = (char *)ROUND_ADDR( addr, page_mask ) + page_size;
+    return 0;
+}
+
+
+/***********************************************************************
+ *           get_page_vprot
+ *
+ * Return the page protection byte. virtual_mutex must be held by caller.
+ */
+static BYTE get_page_vprot( const void *addr )
+{
+    struct file_view *view = find_view( addr, 0 );
+
+    return view ? get_view_vprot( view, addr, NULL ) : 0;
+}
+
+
+/***********************************************************************
+ *           set_page_vprot_bits
+ *
+ * Set or clear bits in a range of page protection bytes. virtual_mutex must be held by caller.
+ */
+static void set_page_vprot_bits( const void *addr, size_t size, BYTE set, BYTE clear )
+{
+    struct file_view *view = find_view( addr, 0 );
+
+    if (view) set_view_vprot_bits( view, addr, size, set, clear );
+}
+
+
+/***********************************************************************
+ *           set_page_vprot
+ *
+ * Set a range of page protection bytes. virtual_mutex must be held by caller.
+ */
+static void set_page_vprot( const void *addr, size_t size, BYTE vprot )
+{
+    set_page_vprot_bits( addr, size, vprot, 0xff );
+}
+
+
 /***********************************************************************
  *           zero_bits_win_to_64
  *
@@ -1193,7 +1466,7 @@ static struct file_view *alloc_view(void)
 static void delete_view( struct file_view *view ) /* [in] View */
 {
     if (!(view->protect & VPROT_SYSTEM)) unmap_area( view->base, view->size );
-    set_page_vprot( view->base, view->size, 0 );
+    free_vprot_runs( view->runs, view->runs_order );
     free_ranges_remove_view( view );
     wine_rb_remove( &views_tree, &view->entry );
     *(struct file_view **)view = next_free_view;
@@ -1226,8 +1499,6 @@ static NTSTATUS create_view( struct file_view **view_ret, void *base, size_t siz
         delete_view( view );
     }
 
-    if (!alloc_pages_vprot( base, size )) return STATUS_NO_MEMORY;
-
     /* Create the view structure */
 
     if (!(view = alloc_view()))
@@ -1239,7 +1510,13 @@ static NTSTATUS create_view( struct file_view **view_ret, void *base, size_t siz
     view->base    = base;
     view->size    = size;
     view->protect = vprot;
-    set_page_vprot( base, size, vprot );
+    if (!init_view_vprot( view, vprot ))
+    {
+        FIXME( "out of memory for %p-%p\n", base, (char *)base + size );
+        *(struct file_view **)view = next_free_view;
+        next_free_view = view;
+        return STATUS_NO_MEMORY;
+    }
 
     wine_rb_put( &views_tree, view->base, &view->entry );
     free_ranges_insert_view( view );
@@ -1346,22 +1623,19 @@ static inline int mprotect_exec( void *base, size_t size, int unix_prot )
  */
 static void mprotect_range( void *base, size_t size, BYTE set, BYTE clear )
 {
-    size_t i, count;
-    char *addr = ROUND_ADDR( base, page_mask );
-    int prot, next;
+    char *start = ROUND_ADDR( base, page_mask ), *end = start + ROUND_SIZE( base, size );
+    char *addr, *next;
+    int prot = -1, next_prot;
 
-    size = ROUND_SIZE( base, size );
-    prot = get_unix_prot( (get_page_vprot( addr ) & ~clear ) | set );
-    for (count = i = 1; i < size >> page_shift; i++, count++)
+    for (addr = start; addr < end; addr = next)
     {
-        next = get_unix_prot( (get_page_vprot( addr + (count << page_shift) ) & ~clear) | set );
-        if (next == prot) continue;
-        mprotect_exec( addr, count << page_shift, prot );
-        addr += count << page_shift;
-        prot = next;
-        count = 0;
+        next_prot = get_unix_prot( (get_page_vprot_range( addr, &next ) & ~clear) | set );
+        if (next_prot == prot) continue;
+        if (addr > start) mprotect_exec( start, addr - start, prot );
+        start = addr;
+        prot = next_prot;
     }
-    if (count) mprotect_exec( addr, count << page_shift, prot );
+    if (end > start) mprotect_exec( start, end - start, prot );
 }
 
 
@@ -1370,16 +1644,19 @@ static void mprotect_range( void *base, size_t size, BYTE set, BYTE clear )
  *
  * Change the protection of a range of pages.
  */
-static BOOL set_vprot( struct file_view *view, void *base, size_t size, BYTE vprot )
+static NTSTATUS set_vprot( struct file_view *view, void *base, size_t size, BYTE vprot )
 {
     int unix_prot = get_unix_prot(vprot);
+    NTSTATUS status;
 
     if (view->protect & VPROT_WRITEWATCH)
     {
         /* each page may need different protections depending on write watch flag */
-        set_page_vprot_bits( base, size, vprot & ~VPROT_WRITEWATCH, ~vprot & ~VPROT_WRITEWATCH );
+        if ((status = set_view_vprot_bits( view, base, size, vprot & ~VPROT_WRITEWATCH,
+                                           ~vprot & ~VPROT_WRITEWATCH )))
+            return status;
         mprotect_range( base, size, 0, 0 );
-        return TRUE;
+        return STATUS_SUCCESS;
     }
 
     /* if setting stack guard pages, store the permissions first, as the guard may be
@@ -1388,16 +1665,19 @@ static BOOL set_vprot( struct file_view *view, void *base, size_t size, BYTE vpr
         (base >= NtCurrentTeb()->DeallocationStack) &&
         (base < NtCurrentTeb()->Tib.StackBase))
     {
-        set_page_vprot( base, size, vprot );
+        if ((status = set_view_vprot_bits( view, base, size, vprot, 0xff ))) return status;
         mprotect( base, size, unix_prot );
-        return TRUE;
+        return STATUS_SUCCESS;
     }
 
+    /* the protections can't be recorded after mprotect has succeeded if that needs memory */
+    if (!reserve_view_vprot_runs( view )) return STATUS_NO_MEMORY;
+
     if (mprotect_exec( base, size, unix_prot )) /* FIXME: last error */
-        return FALSE;
+        return STATUS_ACCESS_DENIED;
 
-    set_page_vprot( base, size, vprot );
-    return TRUE;
+    set_view_vprot_bits( view, base, size, vprot, 0xff );
+    return STATUS_SUCCESS;
 }
 
 
@@ -1422,8 +1702,108 @@ static NTSTATUS set_protection( struct file_view *view, void *base, SIZE_T size,
         if ((view->protect & access) != access) return STATUS_INVALID_PAGE_PROTECTION;
     }
 
-    if (!set_vprot( view, base, size, vprot | VPROT_COMMITTED )) return STATUS_ACCESS_DENIED;
-    return STATUS_SUCCESS;
+    return set_vprot( view, base, size, vprot | VPROT_COMMITTED );
+}
+
+
+#ifdef __linux__
+
+/***********************************************************************
+ *           kernel_reset_write_watches
+ *
+ * Write-protect a range so that the kernel tracks writes to it again.
+ */
+static BOOL kernel_reset_write_watches( void *base, size_t size )
+{
+    struct uffdio_writeprotect wp;
+
+    wp.range.start = (UINT_PTR)base;
+    wp.range.len   = size;
+    wp.mode        = UFFDIO_WRITEPROTECT_MODE_WP;
+    return !ioctl( uffd_fd, UFFDIO_WRITEPROTECT, &wp );
+}
+
+
+/***********************************************************************
+ *           kernel_watch_range
+ *
+ * Register a range with the write watch userfaultfd and write-protect it.
+ */
+static BOOL kernel_watch_range( void *base, size_t size )
+{
+    struct uffdio_register reg;
+
+    reg.range.start = (UINT_PTR)base;
+    reg.range.len   = size;
+    reg.mode        = UFFDIO_REGISTER_MODE_WP;
+    if (ioctl( uffd_fd, UFFDIO_REGISTER, &reg ))
+    {
+        WARN( "failed to register %p-%p: %s\n", base, (char *)base + size, strerror( errno ));
+        return FALSE;
+    }
+    return kernel_reset_write_watches( base, size );
+}
+
+
+/***********************************************************************
+ *           kernel_get_write_watches
+ *
+ * Collect the addresses of the pages written to in a range, optionally resetting them.
+ */
+static ULONG_PTR kernel_get_write_watches( void *base, size_t size, void **addresses,
+                                           ULONG_PTR count, BOOL reset )
+{
+    struct page_region regions[64];
+    struct pm_scan_arg arg;
+    ULONG_PTR pos = 0;
+    char *addr;
+    int i, ret;
+
+    memset( &arg, 0, sizeof(arg) );
+    arg.size          = sizeof(arg);
+    arg.flags         = PM_SCAN_CHECK_WPASYNC | (reset ? PM_SCAN_WP_MATCHING : 0);
+    arg.start         = (UINT_PTR)base;
+    arg.end           = (UINT_PTR)base + size;
+    arg.vec           = (UINT_PTR)regions;
+    arg.vec_len       = ARRAY_SIZE(regions);
+    arg.category_mask = PAGE_IS_WRITTEN;
+    arg.return_mask   = PAGE_IS_WRITTEN;
+
+    while (pos < count && arg.start < arg.end)
+    {
+        arg.max_pages = count - pos;
+        if ((ret = ioctl( pagemap_fd, PAGEMAP_SCAN, &arg )) < 0)
+        {
+            ERR( "PAGEMAP_SCAN failed for %p-%p: %s\n", (void *)(UINT_PTR)arg.start,
+                 (void *)(UINT_PTR)arg.end, strerror( errno ));
+            break;
+        }
+        for (i = 0; i < ret; i++)
+            for (addr = (char *)(UINT_PTR)regions[i].start; addr < (char *)(UINT_PTR)regions[i].end; addr += page_size)
+                addresses[pos++] = addr;
+        if (arg.walk_end <= arg.start) break;
+        arg.start = arg.walk_end;
+    }
+    return pos;
+}
+
+#endif  /* __linux__ */
+
+
+/***********************************************************************
+ *           enable_kernel_write_watch
+ *
+ * Let the kernel track writes to a new write watch view, so that its pages
+ * don't need to be write-protected.
+ */
+static void enable_kernel_write_watch( struct file_view *view )
+{
+#ifdef __linux__
+    if (pagemap_fd == -1 || !kernel_watch_range( view->base, view->size )) return;
+    view->protect |= VPROT_KERNEL_WRITEWATCH;
+    set_view_vprot_bits( view, view->base, view->size, 0, VPROT_WRITEWATCH );
+    mprotect_range( view->base, view->size, 0, 0 );
+#endif
 }
 
 
@@ -1445,9 +1825,17 @@ static void update_write_watches( void *base, size_t size, size_t accessed_size
  *
  * Reset write watches in a memory range.
  */
-static void reset_write_watches( void *base, SIZE_T size )
+static void reset_write_watches( struct file_view *view, void *base, SIZE_T size )
 {
-    set_page_vprot_bits( base, size, VPROT_WRITEWATCH, 0 );
+#ifdef __linux__
+    if (view->protect & VPROT_KERNEL_WRITEWATCH)
+    {
+        if (!kernel_reset_write_watches( base, size ))
+            ERR( "failed to reset %p-%p: %s\n", base, (char *)base + size, strerror( errno ));
+        return;
+    }
+#endif
+    set_view_vprot_bits( view, base, size, VPROT_WRITEWATCH, 0 );
     mprotect_range( base, size, 0, 0 );
 }
 
@@ -1783,6 +2171,32 @@ static NTSTATUS map_fixed_area( void *base, size_t size, unsigned int vprot )
     return STATUS_SUCCESS;
 }
 
+/***********************************************************************
+ *           map_large_pages
+ *
+ * Back an anonymous range with large pages, from the hugetlbfs pool if the
+ * system has one, else by asking for transparent huge pages.
+ */
+static void map_large_pages( void *base, size_t size, unsigned int vprot )
+{
+    int unix_prot = get_unix_prot( vprot );
+
+#ifdef MAP_HUGETLB
+    if (wine_anon_mmap( base, size, unix_prot, MAP_FIXED | MAP_HUGETLB ) == base)
+    {
+        TRACE( "%p-%p mapped from the huge pages pool\n", base, (char *)base + size - 1 );
+        return;
+    }
+    /* the range must stay mapped even if the kernel failed half-way */
+    wine_anon_mmap( base, size, unix_prot, MAP_FIXED );
+#endif
+#ifdef MADV_HUGEPAGE
+    if (!madvise( base, size, MADV_HUGEPAGE ))
+        TRACE( "%p-%p using transparent huge pages\n", base, (char *)base + size - 1 );
+#endif
+}
+
+
 static void clear_native_views(void)
 {
     struct file_view *view, *next_view;
@@ -1805,6 +2219,8 @@ static NTSTATUS map_view( struct file_view **view_ret, void *base, size_t size,
 {
     void *ptr;
     NTSTATUS status;
+    /* large pages need a large page aligned range, make room to align it */
+    size_t extra = (vprot & VPROT_LARGE_PAGES) ? large_page_mask - granularity_mask : 0;
 
     if (base)
     {
@@ -1815,15 +2231,25 @@ static NTSTATUS map_view( struct file_view **view_ret, void *base, size_t size,
         ptr = base;
     }
     else if (!(ptr = alloc_free_area( (void*)(get_zero_bits_64_mask( zero_bits_64 )
-            & (UINT_PTR)user_space_limit), size, top_down, get_unix_prot( vprot ) )))
+            & (UINT_PTR)user_space_limit), size + extra, top_down, get_unix_prot( vprot ) )))
     {
         WARN("Allocation failed, clearing native views.\n");
 
         clear_native_views();
         if (!(ptr = alloc_free_area( (void*)(get_zero_bits_64_mask( zero_bits_64 )
-                & (UINT_PTR)user_space_limit), size, top_down, get_unix_prot( vprot ) )))
+                & (UINT_PTR)user_space_limit), size + extra, top_down, get_unix_prot( vprot ) )))
             return STATUS_NO_MEMORY;
     }
+    if (extra)
+    {
+        char *start = ROUND_ADDR( (char *)ptr + large_page_mask, large_page_mask );
+
+        if (start > (char *)ptr) unmap_area( ptr, start - (char *)ptr );
+        if (start + size < (char *)ptr + size + extra)
+            unmap_area( start + size, (char *)ptr + size + extra - (start + size) );
+        ptr = start;
+    }
+    if (vprot & VPROT_LARGE_PAGES) map_large_pages( ptr, size, vprot );
     status = create_view( view_ret, ptr, size, vprot );
     if (status != STATUS_SUCCESS) unmap_area( ptr, size );
     return status;
@@ -1846,6 +2272,8 @@ static NTSTATUS map_file_into_view( struct file_view *view, int fd, size_t start
     assert( start < view->size );
     assert( start + size <= view->size );
 
+    if (!reserve_view_vprot_runs( view )) return STATUS_NO_MEMORY;
+
     if (force_exec_prot && (vprot & VPROT_READ))
     {
         TRACE( "forcing exec permission on mapping %p-%p\n",
@@ -1893,7 +2321,7 @@ static NTSTATUS map_file_into_view( struct file_view *view, int fd, size_t start
     pread( fd, ptr, size, offset );
     if (prot != (PROT_READ|PROT_WRITE)) mprotect( ptr, size, prot );  /* Set the right protection */
 done:
-    set_page_vprot( (char *)view->base + start, size, vprot );
+    set_view_vprot_bits( view, (char *)view->base + start, size, vprot, 0xff );
     return STATUS_SUCCESS;
 }
 
@@ -1906,10 +2334,12 @@ done:
  */
 static SIZE_T get_committed_size( struct file_view *view, void *base, BYTE *vprot )
 {
-    SIZE_T i, start;
+    SIZE_T start;
+    unsigned int index;
 
     start = ((char *)base - (char *)view->base) >> page_shift;
-    *vprot = get_page_vprot( base );
+    index = find_vprot_run( view, start );
+    *vprot = view->runs[index].vprot;
 
     if (view->protect & SEC_RESERVE)
     {
@@ -1924,16 +2354,16 @@ static SIZE_T get_committed_size( struct file_view *view, void *base, BYTE *vpro
                 if (reply->committed)
                 {
                     *vprot |= VPROT_COMMITTED;
-                    set_page_vprot_bits( base, ret, VPROT_COMMITTED, 0 );
+                    set_view_vprot_bits( view, base, ret, VPROT_COMMITTED, 0 );
                 }
             }
         }
         SERVER_END_REQ;
         return ret;
     }
-    for (i = start + 1; i < view->size >> page_shift; i++)
-        if ((*vprot ^ get_page_vprot( (char *)view->base + (i << page_shift) )) & VPROT_COMMITTED) break;
-    return (i - start) << page_shift;
+    while (++index < view->runs_count)
+        if ((*vprot ^ view->runs[index].vprot) & VPROT_COMMITTED) break;
+    return get_vprot_run_base( view, index ) - (char *)base;
 }
 
 
@@ -1945,9 +2375,18 @@ static SIZE_T get_committed_size( struct file_view *view, void *base, BYTE *vpro
  */
 static NTSTATUS decommit_pages( struct file_view *view, size_t start, size_t size )
 {
+    if (!reserve_view_vprot_runs( view )) return STATUS_NO_MEMORY;
     if (wine_anon_mmap( (char *)view->base + start, size, PROT_NONE, MAP_FIXED ) != (void *)-1)
     {
-        set_page_vprot_bits( (char *)view->base + start, size, 0, VPROT_COMMITTED );
+#ifdef MADV_HUGEPAGE
+        /* so that the pages are large again once recommitted */
+        if (view->protect & VPROT_LARGE_PAGES) madvise( (char *)view->base + start, size, MADV_HUGEPAGE );
+#endif
+#ifdef __linux__
+        /* the new mapping is not registered with the userfaultfd anymore */
+        if (view->protect & VPROT_KERNEL_WRITEWATCH) kernel_watch_range( (char *)view->base + start, size );
+#endif
+        set_view_vprot_bits( view, (char *)view->base + start, size, 0, VPROT_COMMITTED );
         return STATUS_SUCCESS;
     }
     return STATUS_NO_MEMORY;
@@ -2074,6 +2513,10 @@ static NTSTATUS map_image_into_view( struct file_view *view, int fd, void *orig_
     /* map the header */
 
     fstat( fd, &st );
+#ifdef POSIX_FADV_WILLNEED
+    /* start reading the whole file in the background, the sections are going to be accessed soon */
+    posix_fadvise( fd, 0, st.st_size, POSIX_FADV_WILLNEED );
+#endif
     header_size = min( header_size, st.st_size );
     if ((status = map_pe_header( view->base, header_size, fd, &removable ))) return status;
 
@@ -2234,7 +2677,8 @@ static NTSTATUS map_image_into_view( struct file_view *view, int fd, void *orig_
             (nt->OptionalHeader.AddressOfEntryPoint < sec->VirtualAddress + size))
             vprot |= VPROT_EXEC;
 
-        if (!set_vprot( view, ptr + sec->VirtualAddress, size, vprot ) && (vprot & VPROT_EXEC))
+        if (set_vprot( view, ptr + sec->VirtualAddress, size, vprot ) == STATUS_ACCESS_DENIED &&
+            (vprot & VPROT_EXEC))
             ERR( "failed to set %08x protection on section %.8s, noexec filesystem?\n",
                  sec->Characteristics, sec->Name );
     }
@@ -2425,6 +2869,63 @@ static int CDECL alloc_virtual_heap( void *base, SIZE_T size, void *arg )
     return (alloc->base != (void *)-1);
 }
 
+/***********************************************************************
+ *           init_kernel_write_watch
+ *
+ * Check whether the kernel can track write watches for us.
+ */
+static void init_kernel_write_watch(void)
+{
+#if defined(__linux__) && defined(__NR_userfaultfd)
+    static const ULONGLONG features = UFFD_FEATURE_WP_ASYNC | UFFD_FEATURE_WP_UNPOPULATED;
+    struct uffdio_api api = { UFFD_API, features };
+    const char *env = getenv( "WINE_DISABLE_KERNEL_WRITEWATCH" );
+    void *addresses[2];
+    char *page;
+    BOOL ok;
+
+    if (env && atoi( env )) return;
+
+    /* only faults from user mode are allowed without privileges on most systems, but since
+     * the write-protect faults are resolved by the kernel, syscalls writing to the pages
+     * are tracked as well */
+    if ((uffd_fd = syscall( __NR_userfaultfd, O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY )) == -1 &&
+        (uffd_fd = syscall( __NR_userfaultfd, O_CLOEXEC | O_NONBLOCK )) == -1)
+    {
+        TRACE( "no userfaultfd: %s\n", strerror( errno ));
+        return;
+    }
+    if (ioctl( uffd_fd, UFFDIO_API, &api ) || (api.features & features) != features)
+    {
+        TRACE( "asynchronous write protection not supported\n" );
+        goto failed;
+    }
+    if ((pagemap_fd = open( "/proc/self/pagemap", O_RDONLY | O_CLOEXEC )) == -1) goto failed;
+
+    /* check that a written page is reported exactly once */
+    if ((page = wine_anon_mmap( NULL, page_size, PROT_READ | PROT_WRITE, 0 )) == (void *)-1) goto failed;
+    if ((ok = kernel_watch_range( page, page_size )))
+    {
+        *(volatile char *)page = 1;
+        ok = kernel_get_write_watches( page, page_size, addresses, 2, TRUE ) == 1 &&
+             addresses[0] == page &&
+             !kernel_get_write_watches( page, page_size, addresses, 2, FALSE );
+    }
+    munmap( page, page_size );
+    if (ok)
+    {
+        TRACE( "using kernel write watches\n" );
+        return;
+    }
+
+failed:
+    if (pagemap_fd != -1) close( pagemap_fd );
+    close( uffd_fd );
+    pagemap_fd = uffd_fd = -1;
+#endif
+}
+
+
 /***********************************************************************
  *           virtual_init
  */
@@ -2462,13 +2963,8 @@ void virtual_init(void)
         TRACE("preload reserve %p-%p.\n", preload_reserve_start, preload_reserve_end);
     }
 
-    /* try to find space in a reserved area for the views and pages protection table */
-#ifdef _WIN64
-    pages_vprot_size = ((size_t)address_space_limit >> page_shift >> pages_vprot_shift) + 1;
-    alloc_views.size = 2 * view_block_size + pages_vprot_size * sizeof(*pages_vprot);
-#else
-    alloc_views.size = 2 * view_block_size + (1U << (32 - page_shift));
-#endif
+    /* try to find space in a reserved area for the views and free ranges */
+    alloc_views.size = 2 * view_block_size;
     if (mmap_enum_reserved_areas( alloc_virtual_heap, &alloc_views, 1 ))
         mmap_remove_reserved_area( alloc_views.base, alloc_views.size );
     else
@@ -2478,7 +2974,6 @@ void virtual_init(void)
     view_block_start = alloc_views.base;
     view_block_end = view_block_start + view_block_size / sizeof(*view_block_start);
     free_ranges = (void *)((char *)alloc_views.base + view_block_size);
-    pages_vprot = (void *)((char *)alloc_views.base + 2 * view_block_size);
     wine_rb_init( &views_tree, compare_view );
 
     free_ranges[0].base = (void *)0;
@@ -2489,6 +2984,8 @@ void virtual_init(void)
     size = (char *)address_space_start - (char *)0x10000;
     if (size && mmap_is_in_reserved_area( (void*)0x10000, size ) == 1)
         wine_anon_mmap( (void *)0x10000, size, PROT_READ | PROT_WRITE, MAP_FIXED );
+
+    init_kernel_write_watch();
 }
 
 
@@ -3064,13 +3561,12 @@ void *virtual_setup_exception( void *stack_ptr, size_t size, EXCEPTION_RECORD *r
  */
 static NTSTATUS check_write_access( void *base, size_t size, BOOL *has_write_watch )
 {
-    size_t i;
-    char *addr = ROUND_ADDR( base, page_mask );
+    char *addr = ROUND_ADDR( base, page_mask ), *ptr, *next;
 
     size = ROUND_SIZE( base, size );
-    for (i = 0; i < size; i += page_size)
+    for (ptr = addr; ptr < addr + size; ptr = next)
     {
-        BYTE vprot = get_page_vprot( addr + i );
+        BYTE vprot = get_page_vprot_range( ptr, &next );
         if (vprot & VPROT_WRITEWATCH) *has_write_watch = TRUE;
         if (!(get_unix_prot( vprot & ~VPROT_WRITEWATCH ) & PROT_WRITE))
             return STATUS_INVALID_USER_BUFFER;
@@ -3336,9 +3832,11 @@ SIZE_T virtual_uninterrupted_read_memory( const void *addr, void *buffer, SIZE_T
     {
         if (!(view->protect & VPROT_SYSTEM))
         {
-            while (bytes_read < size && (get_unix_prot( get_page_vprot( addr )) & PROT_READ))
+            char *end;
+
+            while (bytes_read < size && (get_unix_prot( get_view_vprot( view, addr, &end )) & PROT_READ))
             {
-                SIZE_T block_size = min( size - bytes_read, page_size - ((UINT_PTR)addr & page_mask) );
+                SIZE_T block_size = min( size - bytes_read, end - (const char *)addr );
                 memcpy( buffer, addr, block_size );
 
                 addr   = (const void *)((const char *)addr + block_size);
@@ -3579,12 +4077,23 @@ NTSTATUS WINAPI NtAllocateVirtualMemory( HANDLE process, PVOID *ret, ULONG_PTR z
     /* Compute the alloc type flags */
 
     if (!(type & (MEM_COMMIT | MEM_RESERVE | MEM_RESET)) ||
-        (type & ~(MEM_COMMIT | MEM_RESERVE | MEM_TOP_DOWN | MEM_WRITE_WATCH | MEM_RESET)))
+        (type & ~(MEM_COMMIT | MEM_RESERVE | MEM_TOP_DOWN | MEM_WRITE_WATCH | MEM_RESET | MEM_LARGE_PAGES)))
     {
         WARN("called with wrong alloc type flags (%08x) !\n", type);
         return STATUS_INVALID_PARAMETER;
     }
 
+    /* large pages must be reserved and committed at once, in whole large pages */
+    if ((type & MEM_LARGE_PAGES) &&
+        ((type & (MEM_COMMIT | MEM_RESERVE | MEM_WRITE_WATCH | MEM_RESET)) != (MEM_COMMIT | MEM_RESERVE) ||
+         (protect & (PAGE_GUARD | PAGE_NOCACHE | PAGE_WRITECOMBINE)) ||
+         ((UINT_PTR)base & large_page_mask) || (size & large_page_mask) || is_dos_memory))
+    {
+        WARN("invalid large pages allocation %p-%p type %08x prot %08x\n",
+             base, (char *)base + size, type, protect);
+        return STATUS_INVALID_PARAMETER;
+    }
+
     /* Reserve the memory */
 
     server_enter_uninterrupted_section( &virtual_mutex, &sigset );
@@ -3595,13 +4104,18 @@ NTSTATUS WINAPI NtAllocateVirtualMemory( HANDLE process, PVOID *ret, ULONG_PTR z
         {
             if (type & MEM_COMMIT) vprot |= VPROT_COMMITTED;
             if (type & MEM_WRITE_WATCH) vprot |= VPROT_WRITEWATCH;
+            if (type & MEM_LARGE_PAGES) vprot |= VPROT_LARGE_PAGES;
             if (protect & PAGE_NOCACHE) vprot |= SEC_NOCACHE;
 
             if (vprot & VPROT_WRITECOPY) status = STATUS_INVALID_PAGE_PROTECTION;
             else if (is_dos_memory) status = allocate_dos_memory( &view, vprot );
             else status = map_view( &view, base, size, type & MEM_TOP_DOWN, vprot, zero_bits_64 );
 
-            if (status == STATUS_SUCCESS) base = view->base;
+            if (status == STATUS_SUCCESS)
+            {
+                if (vprot & VPROT_WRITEWATCH) enable_kernel_write_watch( view );
+                base = view->base;
+            }
         }
     }
     else if (type & MEM_RESET)
@@ -3611,7 +4125,8 @@ NTSTATUS WINAPI NtAllocateVirtualMemory( HANDLE process, PVOID *ret, ULONG_PTR z
     }
     else  /* commit the pages */
     {
-        if (!(view = find_view( base, size ))) status = STATUS_NOT_MAPPED_VIEW;
+        if ((view = find_view( base, size ))) base = align_large_pages_range( view, base, &size );
+        if (!view) status = STATUS_NOT_MAPPED_VIEW;
         else if (view->protect & SEC_FILE) status = STATUS_ALREADY_COMMITTED;
         else if (!(status = set_protection( view, base, size, protect )) && (view->protect & SEC_RESERVE))
         {
@@ -3704,6 +4219,7 @@ NTSTATUS WINAPI NtFreeVirtualMemory( HANDLE process, PVOID *addr_ptr, SIZE_T *si
     }
     else if (type == MEM_DECOMMIT)
     {
+        base = align_large_pages_range( view, base, &size );
         status = decommit_pages( view, base - (char *)view->base, size );
         if (status == STATUS_SUCCESS)
         {
@@ -3775,6 +4291,8 @@ NTSTATUS WINAPI NtProtectVirtualMemory( HANDLE process, PVOID *addr_ptr, SIZE_T
 
     if ((view = find_view( base, size )))
     {
+        base = align_large_pages_range( view, base, &size );
+
         /* Make sure all the pages are committed */
         if (get_committed_size( view, base, &vprot ) >= size && (vprot & VPROT_COMMITTED))
         {
@@ -3957,7 +4475,7 @@ static NTSTATUS get_basic_memory_info( HANDLE process, LPCVOID addr,
     else
     {
         BYTE vprot;
-        char *ptr;
+        char *ptr, *next;
         SIZE_T range_size = get_committed_size( view, base, &vprot );
 
         info->State = (vprot & VPROT_COMMITTED) ? MEM_COMMIT : MEM_RESERVE;
@@ -3966,9 +4484,9 @@ static NTSTATUS get_basic_memory_info( HANDLE process, LPCVOID addr,
         if (view->protect & SEC_IMAGE) info->Type = MEM_IMAGE;
         else if (view->protect & (SEC_FILE | SEC_RESERVE | SEC_COMMIT)) info->Type = MEM_MAPPED;
         else info->Type = MEM_PRIVATE;
-        for (ptr = base; ptr < base + range_size; ptr += page_size)
-            if ((get_page_vprot( ptr ) ^ vprot) & ~VPROT_WRITEWATCH) break;
-        info->RegionSize = ptr - base;
+        for (ptr = base; ptr < base + range_size; ptr = next)
+            if ((get_view_vprot( view, ptr, &next ) ^ vprot) & ~VPROT_WRITEWATCH) break;
+        info->RegionSize = min( ptr, base + range_size ) - base;
     }
     server_leave_uninterrupted_section( &virtual_mutex, &sigset );
 
@@ -4022,7 +4540,10 @@ static NTSTATUS get_working_set_ex( HANDLE process, LPCVOID addr,
             if (p->VirtualAttributes.Shared && p->VirtualAttributes.Valid)
                 p->VirtualAttributes.ShareCount = 1; /* FIXME */
             if (p->VirtualAttributes.Valid)
+            {
                 p->VirtualAttributes.Win32Protection = get_win32_prot( vprot, view->protect );
+                p->VirtualAttributes.LargePage = !!(view->protect & VPROT_LARGE_PAGES);
+            }
         }
     }
     server_leave_uninterrupted_section( &virtual_mutex, &sigset );
@@ -4411,6 +4932,7 @@ NTSTATUS WINAPI NtFlushVirtualMemory( HANDLE process, LPCVOID *addr_ptr,
 NTSTATUS WINAPI NtGetWriteWatch( HANDLE process, ULONG flags, PVOID base, SIZE_T size, PVOID *addresses,
                                  ULONG_PTR *count, ULONG *granularity )
 {
+    struct file_view *view;
     NTSTATUS status = STATUS_SUCCESS;
     sigset_t sigset;
 
@@ -4428,18 +4950,27 @@ NTSTATUS WINAPI NtGetWriteWatch( HANDLE process, ULONG flags, PVOID base, SIZE_T
 
     server_enter_uninterrupted_section( &virtual_mutex, &sigset );
 
-    if (is_write_watch_range( base, size ))
+    if ((view = find_view( base, size )) && (view->protect & VPROT_WRITEWATCH))
     {
         ULONG_PTR pos = 0;
         char *addr = base;
         char *end = addr + size;
 
-        while (pos < *count && addr < end)
+#ifdef __linux__
+        if (view->protect & VPROT_KERNEL_WRITEWATCH)
+            pos = kernel_get_write_watches( base, size, addresses, *count, flags & WRITE_WATCH_FLAG_RESET );
+        else
+#endif
         {
-            if (!(get_page_vprot( addr ) & VPROT_WRITEWATCH)) addresses[pos++] = addr;
-            addr += page_size;
+            while (pos < *count && addr < end)
+            {
+                char *next;
+
+                if (get_view_vprot( view, addr, &next ) & VPROT_WRITEWATCH) addr = min( next, end );
+                else for ( ; pos < *count && addr < min( next, end ); addr += page_size) addresses[pos++] = addr;
+            }
+            if (flags & WRITE_WATCH_FLAG_RESET) reset_write_watches( view, base, addr - (char *)base );
         }
-        if (flags & WRITE_WATCH_FLAG_RESET) reset_write_watches( base, addr - (char *)base );
         *count = pos;
         *granularity = page_size;
     }
@@ -4456,6 +4987,7 @@ NTSTATUS WINAPI NtGetWriteWatch( HANDLE process, ULONG flags, PVOID base, SIZE_T
  */
 NTSTATUS WINAPI NtResetWriteWatch( HANDLE process, PVOID base, SIZE_T size )
 {
+    struct file_view *view;
     NTSTATUS status = STATUS_SUCCESS;
     sigset_t sigset;
 
@@ -4468,8 +5000,8 @@ NTSTATUS WINAPI NtResetWriteWatch( HANDLE process, PVOID base, SIZE_T size )
 
     server_enter_uninterrupted_section( &virtual_mutex, &sigset );
 
-    if (is_write_watch_range( base, size ))
-        reset_write_watches( base, size );
+    if ((view = find_view( base, size )) && (view->protect & VPROT_WRITEWATCH))
+        reset_write_watches( view, base, size );
     else
         status = STATUS_INVALID_PARAMETER;
 
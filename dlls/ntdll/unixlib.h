@@ -28,7 +28,7 @@ struct msghdr;
 struct _DISPATCHER_CONTEXT;
 
 /* increment this when you change the function table */
-#define NTDLL_UNIXLIB_VERSION 93
+#define NTDLL_UNIXLIB_VERSION 95
 
 struct unix_funcs
 {
@@ -60,6 +60,9 @@ struct unix_funcs
                                                              RTL_CRITICAL_SECTION *cs,
                                                              const LARGE_INTEGER *timeout );
     NTSTATUS      (CDECL *fast_RtlWakeConditionVariable)( RTL_CONDITION_VARIABLE *variable, int count );
+    ULONG         (CDECL *get_max_wait_objects)( HANDLE handle );
+    NTSTATUS      (CDECL *wait_objects_any)( DWORD count, const HANDLE *handles,
+                                             const LARGE_INTEGER *timeout, DWORD *index );
 
     /* math functions */
     double        (CDECL *atan)( double d );
@@ -111,6 +114,7 @@ struct unix_funcs
                                                  UINT disposition );
     NTSTATUS      (CDECL *unix_to_nt_file_name)( const char *name, WCHAR *buffer, SIZE_T *size );
     void          (CDECL *set_show_dot_files)( BOOL enable );
+    void          (CDECL *set_sort_directories)( BOOL enable );
 
     /* loader functions */
     NTSTATUS      (CDECL *load_so_dll)( UNICODE_STRING *nt_name, void **module );
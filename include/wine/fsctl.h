@@ -0,0 +1,29 @@
+/*
+ * Wine-specific file system controls
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef _INC_WINE_FSCTL
+#define _INC_WINE_FSCTL
+
+#include "winioctl.h"
+
+/* Copy a file range without reading it in user space; the input is a DUPLICATE_EXTENTS_DATA
+ * and the output the ULONGLONG count of bytes copied, which is only less than requested at the
+ * end of the source file. Unlike FSCTL_DUPLICATE_EXTENTS_TO_FILE, the data may be copied. */
+#define FSCTL_WINE_COPY_FILE_DATA          CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 0x800, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+#endif /* _INC_WINE_FSCTL */
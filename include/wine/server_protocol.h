@@ -2321,6 +2321,11 @@ struct write_process_memory_reply
 
 
 
+
+
+#define REGISTRY_GENERATION_OFFSET 0xffc
+
+
 struct create_key_request
 {
     struct request_header __header;
@@ -3097,6 +3102,37 @@ struct get_async_result_reply
 
 
 
+struct register_client_async_request
+{
+    struct request_header __header;
+    char __pad_12[4];
+    async_data_t   async;
+    unsigned int   access;
+    char __pad_60[4];
+};
+struct register_client_async_reply
+{
+    struct reply_header __header;
+};
+
+
+
+struct complete_client_async_request
+{
+    struct request_header __header;
+    char __pad_12[4];
+    client_ptr_t   user_arg;
+    unsigned int   status;
+    char __pad_28[4];
+    apc_param_t    total;
+};
+struct complete_client_async_reply
+{
+    struct reply_header __header;
+};
+
+
+
 struct read_request
 {
     struct request_header __header;
@@ -5546,7 +5582,7 @@ struct create_esync_reply
     obj_handle_t handle;
     int          type;
     unsigned int shm_idx;
-    char __pad_20[4];
+    int          has_fd;
 };
 
 struct open_esync_request
@@ -5565,7 +5601,7 @@ struct open_esync_reply
     obj_handle_t handle;
     int          type;
     unsigned int shm_idx;
-    char __pad_20[4];
+    int          has_fd;
 };
 
 
@@ -5573,12 +5609,16 @@ struct get_esync_fd_request
 {
     struct request_header __header;
     obj_handle_t handle;
+    int          alloc;
+    char __pad_20[4];
 };
 struct get_esync_fd_reply
 {
     struct reply_header __header;
     int          type;
     unsigned int shm_idx;
+    int          has_fd;
+    char __pad_20[4];
 };
 
 
@@ -5831,6 +5871,8 @@ enum request
     REQ_register_async,
     REQ_cancel_async,
     REQ_get_async_result,
+    REQ_register_client_async,
+    REQ_complete_client_async,
     REQ_read,
     REQ_write,
     REQ_ioctl,
@@ -6132,6 +6174,8 @@ union generic_request
     struct register_async_request register_async_request;
     struct cancel_async_request cancel_async_request;
     struct get_async_result_request get_async_result_request;
+    struct register_client_async_request register_client_async_request;
+    struct complete_client_async_request complete_client_async_request;
     struct read_request read_request;
     struct write_request write_request;
     struct ioctl_request ioctl_request;
@@ -6431,6 +6475,8 @@ union generic_reply
     struct register_async_reply register_async_reply;
     struct cancel_async_reply cancel_async_reply;
     struct get_async_result_reply get_async_result_reply;
+    struct register_client_async_reply register_client_async_reply;
+    struct complete_client_async_reply complete_client_async_reply;
     struct read_reply read_reply;
     struct write_reply write_reply;
     struct ioctl_reply ioctl_reply;
@@ -6590,7 +6636,7 @@ union generic_reply
 
 /* ### protocol_version begin ### */
 
-#define SERVER_PROTOCOL_VERSION 639
+#define SERVER_PROTOCOL_VERSION 643
 
 /* ### protocol_version end ### */
 
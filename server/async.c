@@ -572,6 +572,33 @@ DECL_HANDLER(cancel_async)
     }
 }
 
+/* store the result of an I/O carried out by the client */
+DECL_HANDLER(complete_client_async)
+{
+    struct async *async;
+
+    if (req->status == STATUS_PENDING)
+    {
+        set_error( STATUS_INVALID_PARAMETER );
+        return;
+    }
+
+    LIST_FOR_EACH_ENTRY( async, &current->process->asyncs, struct async, process_entry )
+    {
+        if (async->data.user != req->user_arg || async->iosb) continue;
+        if (async->status != STATUS_PENDING) continue;  /* cancelled, the client gets an APC */
+
+        grab_object( async );
+        async->direct_result = 1;  /* no need for an APC to get the result */
+        async_terminate( async, req->status );
+        async->direct_result = 0;
+        async_set_result( &async->obj, req->status, req->total );
+        release_object( async );
+        return;
+    }
+    set_error( STATUS_INVALID_PARAMETER );
+}
+
 /* get async result from associated iosb */
 DECL_HANDLER(get_async_result)
 {
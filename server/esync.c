@@ -111,7 +111,7 @@ static struct list mutex_list = LIST_INIT(mutex_list);
 struct esync
 {
     struct object   obj;            /* object header */
-    int             fd;             /* eventfd file descriptor */
+    int             fd;             /* eventfd file descriptor, -1 for events nobody waited on yet */
     enum esync_type type;
     unsigned int    shm_idx;        /* index into the shared memory section */
     struct list     mutex_entry;    /* entry in the mutex list (if applicable) */
@@ -151,7 +151,7 @@ static void esync_dump( struct object *obj, int verbose )
 {
     struct esync *esync = (struct esync *)obj;
     assert( obj->ops == &esync_ops );
-    fprintf( stderr, "esync fd=%d\n", esync->fd );
+    fprintf( stderr, "esync fd=%d idx=%u\n", esync->fd, esync->shm_idx );
 }
 
 static int esync_get_esync_fd( struct object *obj, enum esync_type *type )
@@ -171,12 +171,15 @@ static unsigned int esync_map_access( struct object *obj, unsigned int access )
     return access & ~(GENERIC_READ | GENERIC_WRITE | GENERIC_EXECUTE | GENERIC_ALL);
 }
 
+static void free_shm_idx( unsigned int idx );
+
 static void esync_destroy( struct object *obj )
 {
     struct esync *esync = (struct esync *)obj;
     if (esync->type == ESYNC_MUTEX)
         list_remove( &esync->mutex_entry );
-    close( esync->fd );
+    if (esync->fd != -1) close( esync->fd );
+    if (esync->shm_idx) free_shm_idx( esync->shm_idx );
 }
 
 static int type_matches( enum esync_type type1, enum esync_type type2 )
@@ -243,6 +246,109 @@ struct event
 };
 C_ASSERT(sizeof(struct event) == 8);
 
+/* Flags in event->locked. */
+#define ESYNC_EVENT_LOCKED  1   /* the spinlock */
+#define ESYNC_EVENT_HAS_FD  2   /* set once the event got an eventfd */
+
+/* Shared memory indices are allocated here rather than derived from the fd,
+ * since events only get an fd once somebody has to block on them. */
+static unsigned int shm_idx_counter = 1;  /* we keep index 0 reserved */
+static unsigned int *free_shm_idxs;
+static unsigned int free_shm_count, free_shm_size;
+
+static unsigned int alloc_shm_idx(void)
+{
+    unsigned int idx;
+
+    if (free_shm_count) return free_shm_idxs[--free_shm_count];
+
+    idx = shm_idx_counter++;
+    while (idx * 8 >= shm_size)
+    {
+        /* Better expand the shm section. */
+        shm_size += pagesize;
+        if (ftruncate( shm_fd, shm_size ) == -1)
+        {
+            fprintf( stderr, "esync: couldn't expand %s to size %ld: ",
+                shm_name, (long)shm_size );
+            perror( "ftruncate" );
+        }
+    }
+    return idx;
+}
+
+static void free_shm_idx( unsigned int idx )
+{
+    if (free_shm_count == free_shm_size)
+    {
+        unsigned int new_size = max( free_shm_size * 2, 256 );
+        unsigned int *new_idxs = realloc( free_shm_idxs, new_size * sizeof(*new_idxs) );
+
+        if (!new_idxs) return;  /* just leak it */
+        free_shm_idxs = new_idxs;
+        free_shm_size = new_size;
+    }
+    free_shm_idxs[free_shm_count++] = idx;
+}
+
+static inline void small_pause(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __asm__ __volatile__( "rep;nop" : : : "memory" );
+#else
+    __asm__ __volatile__( "" : : : "memory" );
+#endif
+}
+
+static void lock_event( struct event *event )
+{
+    int flags;
+
+    for (;;)
+    {
+        flags = __atomic_load_n( &event->locked, __ATOMIC_SEQ_CST ) & ~ESYNC_EVENT_LOCKED;
+        if (__sync_val_compare_and_swap( &event->locked, flags, flags | ESYNC_EVENT_LOCKED ) == flags)
+            break;
+        small_pause();
+    }
+}
+
+static void unlock_event( struct event *event )
+{
+    __atomic_fetch_and( &event->locked, ~ESYNC_EVENT_LOCKED, __ATOMIC_SEQ_CST );
+}
+
+/* Give an event its own eventfd, so that clients can block on it. Until then
+ * its state lives only in shared memory, which is authoritative. Clients grab
+ * auto-reset events under the event lock while it has no fd, and check the
+ * flag after changing the state, so whichever of them races with us either
+ * sees the flag or has its change picked up by the initial value. */
+static int esync_alloc_event_fd( struct esync *esync )
+{
+#ifdef HAVE_SYS_EVENTFD_H
+    struct event *event = get_shm( esync->shm_idx );
+
+    if (esync->fd != -1) return esync->fd;
+
+    lock_event( event );
+    __atomic_fetch_or( &event->locked, ESYNC_EVENT_HAS_FD, __ATOMIC_SEQ_CST );
+    esync->fd = eventfd( __atomic_load_n( &event->signaled, __ATOMIC_SEQ_CST ) ? 1 : 0,
+                         EFD_CLOEXEC | EFD_NONBLOCK );
+    if (esync->fd == -1)
+    {
+        perror( "eventfd" );
+        __atomic_fetch_and( &event->locked, ~ESYNC_EVENT_HAS_FD, __ATOMIC_SEQ_CST );
+    }
+    unlock_event( event );
+
+    if (debug_level)
+        fprintf( stderr, "esync: allocated fd %d for index %u\n", esync->fd, esync->shm_idx );
+    return esync->fd;
+#else
+    return -1;
+#endif
+}
+
 struct esync *create_esync( struct object *root, const struct unicode_str *name,
                             unsigned int attr, int initval, int max, enum esync_type type,
                             const struct security_descriptor *sd )
@@ -259,31 +365,21 @@ struct esync *create_esync( struct object *root, const struct unicode_str *name,
             if (type == ESYNC_SEMAPHORE)
                 flags |= EFD_SEMAPHORE;
 
-            /* initialize it if it didn't already exist */
-            esync->fd = eventfd( initval, flags );
-            if (esync->fd == -1)
+            /* initialize it if it didn't already exist; events get an fd
+             * only once somebody actually has to wait on them */
+            esync->fd = -1;
+            if (type != ESYNC_AUTO_EVENT && type != ESYNC_MANUAL_EVENT
+                    && (esync->fd = eventfd( initval, flags )) == -1)
             {
                 perror( "eventfd" );
                 file_set_error();
+                esync->type = 0;
+                esync->shm_idx = 0;
                 release_object( esync );
                 return NULL;
             }
             esync->type = type;
-
-            /* Use the fd as index, since that'll be unique across all
-             * processes, but should hopefully end up also allowing reuse. */
-            esync->shm_idx = esync->fd + 1; /* we keep index 0 reserved */
-            while (esync->shm_idx * 8 >= shm_size)
-            {
-                /* Better expand the shm section. */
-                shm_size += pagesize;
-                if (ftruncate( shm_fd, shm_size ) == -1)
-                {
-                    fprintf( stderr, "esync: couldn't expand %s to size %ld: ",
-                        shm_name, shm_size );
-                    perror( "ftruncate" );
-                }
-            }
+            esync->shm_idx = alloc_shm_idx();
 
             /* Initialize the shared memory portion. We want to do this on the
              * server side to avoid a potential though unlikely race whereby
@@ -373,7 +469,7 @@ void esync_wake_up( struct object *obj )
     if (obj->ops->get_esync_fd)
     {
         fd = obj->ops->get_esync_fd( obj, &dummy );
-        esync_wake_fd( fd );
+        if (fd != -1) esync_wake_fd( fd );
     }
 }
 
@@ -385,15 +481,6 @@ void esync_clear( int fd )
     read( fd, &value, sizeof(value) );
 }
 
-static inline void small_pause(void)
-{
-#ifdef __i386__
-    __asm__ __volatile__( "rep;nop" : : : "memory" );
-#else
-    __asm__ __volatile__( "" : : : "memory" );
-#endif
-}
-
 /* Server-side event support. */
 void esync_set_event( struct esync *esync )
 {
@@ -406,24 +493,18 @@ void esync_set_event( struct esync *esync )
     if (debug_level)
         fprintf( stderr, "esync_set_event() fd=%d\n", esync->fd );
 
+    /* We allocate the fds ourselves, so it can't appear in between. */
     if (esync->type == ESYNC_MANUAL_EVENT)
-    {
-        /* Acquire the spinlock. */
-        while (__sync_val_compare_and_swap( &event->locked, 0, 1 ))
-            small_pause();
-    }
+        lock_event( event );
 
-    if (!__atomic_exchange_n( &event->signaled, 1, __ATOMIC_SEQ_CST ))
+    if (!__atomic_exchange_n( &event->signaled, 1, __ATOMIC_SEQ_CST ) && esync->fd != -1)
     {
         if (write( esync->fd, &value, sizeof(value) ) == -1)
             perror( "esync: write" );
     }
 
     if (esync->type == ESYNC_MANUAL_EVENT)
-    {
-        /* Release the spinlock. */
-        event->locked = 0;
-    }
+        unlock_event( event );
 }
 
 void esync_reset_event( struct esync *esync )
@@ -438,24 +519,17 @@ void esync_reset_event( struct esync *esync )
         fprintf( stderr, "esync_reset_event() fd=%d\n", esync->fd );
 
     if (esync->type == ESYNC_MANUAL_EVENT)
-    {
-        /* Acquire the spinlock. */
-        while (__sync_val_compare_and_swap( &event->locked, 0, 1 ))
-            small_pause();
-    }
+        lock_event( event );
 
     /* Only bother signaling the fd if we weren't already signaled. */
-    if (__atomic_exchange_n( &event->signaled, 0, __ATOMIC_SEQ_CST ))
+    if (__atomic_exchange_n( &event->signaled, 0, __ATOMIC_SEQ_CST ) && esync->fd != -1)
     {
         /* we don't care about the return value */
         read( esync->fd, &value, sizeof(value) );
     }
 
     if (esync->type == ESYNC_MANUAL_EVENT)
-    {
-        /* Release the spinlock. */
-        event->locked = 0;
-    }
+        unlock_event( event );
 }
 
 void esync_abandon_mutexes( struct thread *thread )
@@ -509,7 +583,8 @@ DECL_HANDLER(create_esync)
 
         reply->type = esync->type;
         reply->shm_idx = esync->shm_idx;
-        send_client_fd( current->process, esync->fd, reply->handle );
+        if ((reply->has_fd = (esync->fd != -1)))
+            send_client_fd( current->process, esync->fd, current->id );
         release_object( esync );
     }
 
@@ -542,7 +617,8 @@ DECL_HANDLER(open_esync)
         reply->type = esync->type;
         reply->shm_idx = esync->shm_idx;
 
-        send_client_fd( current->process, esync->fd, reply->handle );
+        if ((reply->has_fd = (esync->fd != -1)))
+            send_client_fd( current->process, esync->fd, current->id );
         release_object( esync );
     }
 }
@@ -566,10 +642,13 @@ DECL_HANDLER(get_esync_fd)
         {
             struct esync *esync = (struct esync *)obj;
             reply->shm_idx = esync->shm_idx;
+            if (fd == -1 && req->alloc)
+                fd = esync_alloc_event_fd( esync );
         }
         else
             reply->shm_idx = 0;
-        send_client_fd( current->process, fd, req->handle );
+        if ((reply->has_fd = (fd != -1)))
+            send_client_fd( current->process, fd, current->id );
     }
     else
     {
@@ -108,6 +108,7 @@
 #include "winternl.h"
 #include "winioctl.h"
 #include "ddk/wdm.h"
+#include "wine/rbtree.h"
 
 #if !defined(O_SYMLINK) && defined(O_PATH)
 # define O_SYMLINK (O_NOFOLLOW | O_PATH)
@@ -162,6 +163,14 @@ static inline int epoll_wait( int epfd, struct epoll_event *events, int maxevent
 # define USE_EVENT_PORTS
 #endif /* HAVE_PORT_H && HAVE_PORT_CREATE */
 
+#if defined(USE_EPOLL) && defined(HAVE_LINUX_IO_URING_H) && defined(__NR_io_uring_setup)
+# include <sys/mman.h>
+# include <linux/io_uring.h>
+# ifdef IORING_FEAT_EXT_ARG
+#  define USE_IO_URING
+# endif
+#endif /* USE_EPOLL && HAVE_LINUX_IO_URING_H */
+
 /* Because of the stupid Posix locking semantics, we need to keep
  * track of all file descriptors referencing a given file, and not
  * close a single one until all the locks are gone (sigh).
@@ -383,14 +392,32 @@ static file_pos_t max_unix_offset = OFF_T_MAX;
 
 struct timeout_user
 {
-    struct list           entry;      /* entry in sorted timeout list */
+    struct wine_rb_entry  rb_entry;   /* entry in sorted timeout tree */
+    struct wine_rb_tree  *tree;       /* tree we are in, NULL once expired */
+    struct list           entry;      /* entry in expired list */
     abstime_t             when;       /* timeout expiry */
+    unsigned long long    seq;        /* insertion order, for timeouts with the same expiry */
     timeout_callback      callback;   /* callback function */
     void                 *private;    /* callback private data */
 };
 
-static struct list abs_timeout_list = LIST_INIT(abs_timeout_list); /* sorted absolute timeouts list */
-static struct list rel_timeout_list = LIST_INIT(rel_timeout_list); /* sorted relative timeouts list */
+/* sort timeouts by expiry; relative timeouts are stored negated so compare the magnitude */
+static int compare_timeout_user( const void *key, const struct wine_rb_entry *entry )
+{
+    const struct timeout_user *user = key;
+    const struct timeout_user *timeout = WINE_RB_ENTRY_VALUE( entry, const struct timeout_user, rb_entry );
+    abstime_t when1 = user->when > 0 ? user->when : -user->when;
+    abstime_t when2 = timeout->when > 0 ? timeout->when : -timeout->when;
+
+    if (when1 != when2) return when1 < when2 ? -1 : 1;
+    /* identical expiry, expire them in the order they were added */
+    if (user->seq != timeout->seq) return user->seq < timeout->seq ? -1 : 1;
+    return 0;
+}
+
+static struct wine_rb_tree abs_timeout_tree = { compare_timeout_user }; /* sorted absolute timeouts */
+static struct wine_rb_tree rel_timeout_tree = { compare_timeout_user }; /* sorted relative timeouts */
+static unsigned long long timeout_seq;  /* sequence number of the last added timeout */
 timeout_t current_time;
 timeout_t monotonic_time;
 
@@ -448,39 +475,22 @@ void set_current_time(void)
 struct timeout_user *add_timeout_user( timeout_t when, timeout_callback func, void *private )
 {
     struct timeout_user *user;
-    struct list *ptr;
 
     if (!(user = mem_alloc( sizeof(*user) ))) return NULL;
     user->when     = timeout_to_abstime( when );
     user->callback = func;
     user->private  = private;
-
-    /* Now insert it in the linked list */
-
-    if (user->when > 0)
-    {
-        LIST_FOR_EACH( ptr, &abs_timeout_list )
-        {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
-            if (timeout->when >= user->when) break;
-        }
-    }
-    else
-    {
-        LIST_FOR_EACH( ptr, &rel_timeout_list )
-        {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
-            if (timeout->when <= user->when) break;
-        }
-    }
-    list_add_before( ptr, &user->entry );
+    user->seq      = ++timeout_seq;
+    user->tree     = user->when > 0 ? &abs_timeout_tree : &rel_timeout_tree;
+    wine_rb_put( user->tree, user, &user->rb_entry );
     return user;
 }
 
 /* remove a timeout user */
 void remove_timeout_user( struct timeout_user *user )
 {
-    list_remove( &user->entry );
+    if (user->tree) wine_rb_remove( user->tree, &user->rb_entry );
+    else list_remove( &user->entry );  /* expired but callback not called yet */
     free( user );
 }
 
@@ -539,10 +549,310 @@ static inline void fd_poll_event( struct fd *fd, int event )
 
 #ifdef USE_EPOLL
 
+#ifdef USE_IO_URING
+
+/* io_uring poller: each poll user has at most one oneshot POLL_ADD request armed,
+ * registration changes are queued in the submission ring and submitted together
+ * with the wait for completions, so a loop iteration costs a single syscall */
+
+static int uring_fd = -1;
+static unsigned int uring_sq_entries;
+static unsigned int uring_sq_mask;
+static unsigned int uring_cq_mask;
+static unsigned int *uring_sq_head;
+static unsigned int *uring_sq_tail;
+static unsigned int *uring_cq_head;
+static unsigned int *uring_cq_tail;
+static struct io_uring_sqe *uring_sqes;
+static struct io_uring_cqe *uring_cqes;
+static void *uring_ring_ptr;
+static size_t uring_ring_size;
+static unsigned long long *uring_armed;     /* user_data of the armed request for each poll user */
+static int uring_armed_size;                /* count of allocated entries in uring_armed */
+static unsigned int uring_seq;              /* sequence number used to tell stale completions apart */
+static int *uring_rearm;                    /* poll users that couldn't be armed because the ring was full */
+static int uring_rearm_count;               /* count of users in uring_rearm */
+static int uring_rearm_size;                /* count of allocated entries in uring_rearm */
+
+#define URING_REARM (~0ull)                 /* uring_armed value of users waiting in uring_rearm */
+
+static inline int io_uring_enter( int fd, unsigned int to_submit, unsigned int min_complete,
+                                  unsigned int flags, const void *arg, size_t argsz )
+{
+    return syscall( __NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz );
+}
+
+static int init_uring(void)
+{
+    struct io_uring_params params;
+    void *ptr;
+    unsigned int i;
+    int fd;
+
+    memset( &params, 0, sizeof(params) );
+    if ((fd = syscall( __NR_io_uring_setup, 256, &params )) == -1) return 0;
+
+    /* we need the timeout argument of io_uring_enter and a single ring mapping (Linux 5.11) */
+    if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_SINGLE_MMAP))
+        goto error;
+
+    uring_ring_size = max( params.sq_off.array + params.sq_entries * sizeof(unsigned int),
+                           params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe) );
+    uring_ring_ptr = mmap( NULL, uring_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, IORING_OFF_SQ_RING );
+    if (uring_ring_ptr == MAP_FAILED) goto error;
+    ptr = mmap( NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                MAP_SHARED, fd, IORING_OFF_SQES );
+    if (ptr == MAP_FAILED)
+    {
+        munmap( uring_ring_ptr, uring_ring_size );
+        goto error;
+    }
+    uring_sqes       = ptr;
+    uring_sq_entries = params.sq_entries;
+    uring_sq_mask    = *(unsigned int *)((char *)uring_ring_ptr + params.sq_off.ring_mask);
+    uring_sq_head    = (unsigned int *)((char *)uring_ring_ptr + params.sq_off.head);
+    uring_sq_tail    = (unsigned int *)((char *)uring_ring_ptr + params.sq_off.tail);
+    uring_cq_mask    = *(unsigned int *)((char *)uring_ring_ptr + params.cq_off.ring_mask);
+    uring_cq_head    = (unsigned int *)((char *)uring_ring_ptr + params.cq_off.head);
+    uring_cq_tail    = (unsigned int *)((char *)uring_ring_ptr + params.cq_off.tail);
+    uring_cqes       = (struct io_uring_cqe *)((char *)uring_ring_ptr + params.cq_off.cqes);
+
+    /* submission entries are always used in order */
+    for (i = 0; i < uring_sq_entries; i++)
+        ((unsigned int *)((char *)uring_ring_ptr + params.sq_off.array))[i] = i;
+
+    uring_fd = fd;
+    return 1;
+
+error:
+    close( fd );
+    return 0;
+}
+
+/* give up on io_uring, the normal poll loop will take over */
+static void close_uring(void)
+{
+    perror( "io_uring_enter" );  /* should not happen */
+    munmap( uring_sqes, uring_sq_entries * sizeof(struct io_uring_sqe) );
+    munmap( uring_ring_ptr, uring_ring_size );
+    close( uring_fd );
+    uring_fd = -1;
+    free( uring_armed );
+    uring_armed = NULL;
+    uring_armed_size = 0;
+    free( uring_rearm );
+    uring_rearm = NULL;
+    uring_rearm_count = uring_rearm_size = 0;
+}
+
+static inline unsigned int uring_pending_submissions(void)
+{
+    return *uring_sq_tail - __atomic_load_n( uring_sq_head, __ATOMIC_ACQUIRE );
+}
+
+/* get a free submission entry, flushing the ring if it is full */
+static struct io_uring_sqe *get_uring_sqe( unsigned char opcode, unsigned long long user_data )
+{
+    struct io_uring_sqe *sqe;
+    unsigned int tail = *uring_sq_tail;
+
+    if (uring_pending_submissions() == uring_sq_entries &&
+        io_uring_enter( uring_fd, uring_sq_entries, 0, 0, NULL, 0 ) == -1 && errno != EINTR)
+    {
+        close_uring();
+        return NULL;
+    }
+    if (uring_pending_submissions() == uring_sq_entries) return NULL;
+
+    sqe = &uring_sqes[tail & uring_sq_mask];
+    memset( sqe, 0, sizeof(*sqe) );
+    sqe->opcode = opcode;
+    sqe->user_data = user_data;
+    __atomic_store_n( uring_sq_tail, tail + 1, __ATOMIC_RELEASE );
+    return sqe;
+}
+
+/* cancel the request armed for a poll user, if any */
+static void uring_poll_remove( int user )
+{
+    struct io_uring_sqe *sqe;
+
+    if (user >= uring_armed_size || !uring_armed[user]) return;
+    /* if the remove can't be queued, the request fires later and is ignored as stale */
+    if (uring_armed[user] != URING_REARM &&
+        (sqe = get_uring_sqe( IORING_OP_POLL_REMOVE, 0 )))  /* completions with user_data 0 are ignored */
+    {
+        sqe->fd = -1;
+        sqe->addr = uring_armed[user];
+    }
+    uring_armed[user] = 0;
+}
+
+/* arm a oneshot poll request for a poll user, or queue it for uring_rearm_users if the ring is full */
+static void uring_poll_add( int user, int unix_fd, int events )
+{
+    struct io_uring_sqe *sqe;
+    unsigned long long user_data;
+
+    if (user >= uring_armed_size)
+    {
+        unsigned long long *new_armed;
+        int new_size = max( user + 1, uring_armed_size ? uring_armed_size * 2 : 64 );
+
+        if (!(new_armed = realloc( uring_armed, new_size * sizeof(*new_armed) )))
+        {
+            close_uring();
+            return;
+        }
+        memset( new_armed + uring_armed_size, 0, (new_size - uring_armed_size) * sizeof(*new_armed) );
+        uring_armed = new_armed;
+        uring_armed_size = new_size;
+    }
+
+    if (!++uring_seq) uring_seq++;
+    user_data = ((unsigned long long)uring_seq << 32) | (unsigned int)user;
+    if (!(sqe = get_uring_sqe( IORING_OP_POLL_ADD, user_data )))
+    {
+        if (uring_fd == -1) return;
+        if (uring_rearm_count == uring_rearm_size)
+        {
+            int *new_rearm, new_size = uring_rearm_size ? uring_rearm_size * 2 : 64;
+
+            if (!(new_rearm = realloc( uring_rearm, new_size * sizeof(*new_rearm) )))
+            {
+                close_uring();
+                return;
+            }
+            uring_rearm = new_rearm;
+            uring_rearm_size = new_size;
+        }
+        uring_rearm[uring_rearm_count++] = user;
+        uring_armed[user] = URING_REARM;
+        return;
+    }
+    sqe->fd = unix_fd;
+#ifdef WORDS_BIGENDIAN
+    sqe->poll32_events = ((unsigned int)events << 16) | ((unsigned int)events >> 16);
+#else
+    sqe->poll32_events = events;
+#endif
+    uring_armed[user] = user_data;
+}
+
+/* arm the users that were left out because the ring was full */
+static void uring_rearm_users(void)
+{
+    while (uring_rearm_count && uring_fd != -1)
+    {
+        int user = uring_rearm[--uring_rearm_count];
+
+        if (uring_armed[user] != URING_REARM) continue;  /* removed or re-armed meanwhile */
+        uring_armed[user] = 0;
+        if (pollfd[user].fd == -1) continue;
+        uring_poll_add( user, pollfd[user].fd, pollfd[user].events );
+        if (uring_armed[user] == URING_REARM) break;  /* still full, retry on the next iteration */
+    }
+}
+
+/* set the events that io_uring waits for on this fd; helper for set_fd_epoll_events */
+static void set_fd_uring_events( struct fd *fd, int user, int events )
+{
+    if (events == -1)  /* stop waiting on this fd completely */
+    {
+        if (pollfd[user].fd == -1) return;  /* already removed */
+        uring_poll_remove( user );
+        return;
+    }
+    if (pollfd[user].fd == -1)
+    {
+        if (pollfd[user].events) return;  /* stopped waiting on it, don't restart */
+    }
+    else if (pollfd[user].events == events) return;  /* nothing to do, a fired request is re-armed by the loop */
+
+    uring_poll_remove( user );
+    if (uring_fd != -1) uring_poll_add( user, fd->unix_fd, events );
+}
+
+static inline void main_loop_uring(void)
+{
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    int i, ret, timeout, count, users[128];
+    unsigned int head, tail;
+
+    while (active_users)
+    {
+        timeout = get_next_timeout();
+
+        if (!active_users) break;  /* last user removed by a timeout */
+        if (uring_fd == -1) break;  /* an error occurred with io_uring */
+
+        memset( &arg, 0, sizeof(arg) );
+        if (timeout != -1)
+        {
+            ts.tv_sec  = timeout / 1000;
+            ts.tv_nsec = (timeout % 1000) * 1000000;
+            arg.ts = (unsigned long)&ts;
+        }
+
+        /* submit the pending registration changes and wait for events in one go,
+         * without blocking if some users still need to be armed */
+        ret = io_uring_enter( uring_fd, uring_pending_submissions(), uring_rearm_count ? 0 : 1,
+                              IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg) );
+        if (ret == -1 && errno != EINTR && errno != ETIME && errno != EBUSY && errno != EAGAIN)
+        {
+            close_uring();
+            break;
+        }
+        set_current_time();
+
+        /* put the events into the pollfd array first, like poll does */
+        count = 0;
+        head = *uring_cq_head;
+        tail = __atomic_load_n( uring_cq_tail, __ATOMIC_ACQUIRE );
+        while (head != tail && count < ARRAY_SIZE( users ))
+        {
+            struct io_uring_cqe *cqe = &uring_cqes[head++ & uring_cq_mask];
+            int user = (unsigned int)cqe->user_data;
+
+            if (!cqe->user_data || user >= uring_armed_size || uring_armed[user] != cqe->user_data)
+                continue;  /* cancel completion or stale request */
+            uring_armed[user] = 0;
+            pollfd[user].revents = cqe->res < 0 ? POLLERR : cqe->res;
+            users[count++] = user;
+        }
+        __atomic_store_n( uring_cq_head, head, __ATOMIC_RELEASE );
+
+        /* read events from the pollfd array, as set_fd_events may modify them */
+        for (i = 0; i < count; i++)
+        {
+            int user = users[i];
+            if (pollfd[user].revents) fd_poll_event( poll_users[user], pollfd[user].revents );
+            if (uring_fd == -1) break;
+            /* re-arm the oneshot request unless the fd was removed or already re-armed */
+            if (pollfd[user].fd != -1 && !uring_armed[user])
+                uring_poll_add( user, pollfd[user].fd, pollfd[user].events );
+        }
+        uring_rearm_users();
+    }
+}
+
+#else /* USE_IO_URING */
+
+static const int uring_fd = -1;
+
+static inline int init_uring(void) { return 0; }
+static inline void set_fd_uring_events( struct fd *fd, int user, int events ) { }
+static inline void uring_poll_remove( int user ) { }
+static inline void main_loop_uring(void) { }
+
+#endif /* USE_IO_URING */
+
 static int epoll_fd = -1;
 
 static inline void init_epoll(void)
 {
+    if (init_uring()) return;
     epoll_fd = epoll_create( 128 );
 }
 
@@ -552,6 +862,11 @@ static inline void set_fd_epoll_events( struct fd *fd, int user, int events )
     struct epoll_event ev;
     int ctl;
 
+    if (uring_fd != -1)
+    {
+        set_fd_uring_events( fd, user, events );
+        return;
+    }
     if (epoll_fd == -1) return;
 
     if (events == -1)  /* stop waiting on this fd completely */
@@ -587,6 +902,11 @@ static inline void set_fd_epoll_events( struct fd *fd, int user, int events )
 
 static inline void remove_epoll_user( struct fd *fd, int user )
 {
+    if (uring_fd != -1)
+    {
+        uring_poll_remove( user );
+        return;
+    }
     if (epoll_fd == -1) return;
 
     if (pollfd[user].fd != -1)
@@ -606,6 +926,11 @@ static inline void main_loop_epoll(void)
     assert( POLLERR == EPOLLERR );
     assert( POLLHUP == EPOLLHUP );
 
+    if (uring_fd != -1)
+    {
+        main_loop_uring();
+        return;
+    }
     if (epoll_fd == -1) return;
 
     while (active_users)
@@ -928,31 +1253,34 @@ static int get_next_timeout(void)
 {
     int ret = user_shared_data ? user_shared_data_timeout : -1;
 
-    if (!list_empty( &abs_timeout_list ) || !list_empty( &rel_timeout_list ))
+    if (abs_timeout_tree.root || rel_timeout_tree.root)
     {
         struct list expired_list, *ptr;
+        struct wine_rb_entry *entry;
 
-        /* first remove all expired timers from the list */
+        /* first remove all expired timers from the trees */
 
         list_init( &expired_list );
-        while ((ptr = list_head( &abs_timeout_list )) != NULL)
+        while ((entry = wine_rb_head( abs_timeout_tree.root )) != NULL)
         {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
+            struct timeout_user *timeout = WINE_RB_ENTRY_VALUE( entry, struct timeout_user, rb_entry );
 
             if (timeout->when <= current_time)
             {
-                list_remove( &timeout->entry );
+                wine_rb_remove( &abs_timeout_tree, &timeout->rb_entry );
+                timeout->tree = NULL;
                 list_add_tail( &expired_list, &timeout->entry );
             }
             else break;
         }
-        while ((ptr = list_head( &rel_timeout_list )) != NULL)
+        while ((entry = wine_rb_head( rel_timeout_tree.root )) != NULL)
         {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
+            struct timeout_user *timeout = WINE_RB_ENTRY_VALUE( entry, struct timeout_user, rb_entry );
 
             if (-timeout->when <= monotonic_time)
             {
-                list_remove( &timeout->entry );
+                wine_rb_remove( &rel_timeout_tree, &timeout->rb_entry );
+                timeout->tree = NULL;
                 list_add_tail( &expired_list, &timeout->entry );
             }
             else break;
@@ -968,17 +1296,17 @@ static int get_next_timeout(void)
             free( timeout );
         }
 
-        if ((ptr = list_head( &abs_timeout_list )) != NULL)
+        if ((entry = wine_rb_head( abs_timeout_tree.root )) != NULL)
         {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
+            struct timeout_user *timeout = WINE_RB_ENTRY_VALUE( entry, struct timeout_user, rb_entry );
             int diff = (timeout->when - current_time + 9999) / 10000;
             if (diff < 0) diff = 0;
             if (ret == -1 || diff < ret) ret = diff;
         }
 
-        if ((ptr = list_head( &rel_timeout_list )) != NULL)
+        if ((entry = wine_rb_head( rel_timeout_tree.root )) != NULL)
         {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
+            struct timeout_user *timeout = WINE_RB_ENTRY_VALUE( entry, struct timeout_user, rb_entry );
             int diff = (-timeout->when - monotonic_time + 9999) / 10000;
             if (diff < 0) diff = 0;
             if (ret == -1 || diff < ret) ret = diff;
@@ -2877,7 +3205,7 @@ DECL_HANDLER(get_handle_fd)
             reply->type = fd->fd_ops->get_fd_type( fd );
             reply->options = fd->options;
             reply->access = get_handle_access( current->process, req->handle );
-            send_client_fd( current->process, unix_fd, req->handle );
+            send_client_fd( current->process, unix_fd, current->id );
         }
         release_object( fd );
     }
@@ -2966,6 +3294,25 @@ DECL_HANDLER(register_async)
     }
 }
 
+/* create an async for an I/O carried out by the client */
+DECL_HANDLER(register_client_async)
+{
+    struct async *async;
+    struct fd *fd;
+
+    if (!(fd = get_handle_fd_obj( current->process, req->async.handle, req->access ))) return;
+
+    if (get_unix_fd( fd ) == -1 || !is_fd_overlapped( fd ))
+        set_error( STATUS_NOT_SUPPORTED );  /* the client does the I/O synchronously */
+    else if ((async = create_async( fd, current, &req->async, NULL )))
+    {
+        /* the wait queue is never woken up for regular files, the client completes the async */
+        fd_queue_async( fd, async, ASYNC_TYPE_WAIT );
+        release_object( async );
+    }
+    release_object( fd );
+}
+
 /* attach completion object to a fd */
 DECL_HANDLER(set_completion_info)
 {
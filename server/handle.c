@@ -45,13 +45,29 @@ struct handle_entry
     unsigned int   access;    /* access rights */
 };
 
+/* bitmap of table entries */
+struct entry_map
+{
+    DWORD *bits;      /* one bit per entry */
+    DWORD *summary;   /* bitmap of the words of bits that have a bit set */
+};
+
+/* index of the entries holding objects of a given type */
+struct type_index
+{
+    struct list              entry;   /* entry in the table list of indexes */
+    const struct object_ops *ops;     /* object type */
+    struct entry_map         map;     /* entries holding an object of this type */
+};
+
 struct handle_table
 {
     struct object        obj;         /* object header */
     struct process      *process;     /* process owning this table */
     int                  count;       /* number of allocated entries */
     int                  last;        /* last used entry */
-    int                  free;        /* first entry that may be free */
+    struct entry_map     free_map;    /* free entries up to the last used one */
+    struct list          type_indexes;/* indexes of the object types that have been looked up */
     struct handle_entry *entries;     /* handle entries */
 };
 
@@ -79,6 +95,87 @@ static inline int handle_to_index( obj_handle_t handle )
     return (handle >> 2) - 1;
 }
 
+/* entry bitmap helpers */
+
+static inline int map_words( int count )
+{
+    return (count + 31) / 32;
+}
+static inline int map_summary_words( int count )
+{
+    return (map_words( count ) + 31) / 32;
+}
+static inline void set_map_bit( struct entry_map *map, int index )
+{
+    map->bits[index / 32] |= 1u << (index % 32);
+    map->summary[index / 1024] |= 1u << ((index / 32) % 32);
+}
+static inline void clear_map_bit( struct entry_map *map, int index )
+{
+    if (!(map->bits[index / 32] &= ~(1u << (index % 32))))
+        map->summary[index / 1024] &= ~(1u << ((index / 32) % 32));
+}
+static inline void mark_entry_free( struct handle_table *table, int index )
+{
+    set_map_bit( &table->free_map, index );
+}
+static inline void mark_entry_used( struct handle_table *table, int index )
+{
+    clear_map_bit( &table->free_map, index );
+}
+
+/* allocate a cleared bitmap for count entries */
+static int alloc_entry_map( struct entry_map *map, int count )
+{
+    map->bits    = calloc( map_words( count ), sizeof(*map->bits) );
+    map->summary = calloc( map_summary_words( count ), sizeof(*map->summary) );
+    return map->bits && map->summary;
+}
+
+static void free_entry_map( struct entry_map *map )
+{
+    free( map->bits );
+    free( map->summary );
+}
+
+/* resize a bitmap from old_count to count entries, clearing the new bits */
+static int resize_entry_map( struct entry_map *map, int old_count, int count )
+{
+    int old_words = map_words( old_count ), words = map_words( count );
+    int old_summary = map_summary_words( old_count ), summary = map_summary_words( count );
+    DWORD *ptr;
+
+    if (!(ptr = realloc( map->bits, words * sizeof(*ptr) ))) return 0;
+    map->bits = ptr;
+    if (words > old_words) memset( ptr + old_words, 0, (words - old_words) * sizeof(*ptr) );
+    if (!(ptr = realloc( map->summary, summary * sizeof(*ptr) ))) return 0;
+    map->summary = ptr;
+    if (summary > old_summary) memset( ptr + old_summary, 0, (summary - old_summary) * sizeof(*ptr) );
+    return 1;
+}
+
+/* find the first set bit between start and last, or return -1 */
+static int find_map_bit( const struct entry_map *map, int start, int last )
+{
+    DWORD bit, bits, mask;
+    int i, word = start / 32;
+
+    if (start > last) return -1;
+    if (!(bits = map->bits[word] & (~0u << (start % 32))))
+    {
+        word++;
+        for (i = word / 32, mask = ~0u << (word % 32); i <= last / 1024; i++, mask = ~0u)
+            if (map->summary[i] & mask) break;
+        if (i > last / 1024) return -1;
+        BitScanForward( &bit, map->summary[i] & mask );
+        word = i * 32 + bit;
+        bits = map->bits[word];
+    }
+    BitScanForward( &bit, bits );
+    i = word * 32 + bit;
+    return i <= last ? i : -1;
+}
+
 /* global handle conversion */
 
 #define HANDLE_OBFUSCATOR 0x544a4def
@@ -169,6 +266,7 @@ static void handle_table_destroy( struct object *obj )
     int i;
     struct handle_table *table = (struct handle_table *)obj;
     struct handle_entry *entry;
+    struct type_index *index, *next;
 
     assert( obj->ops == &handle_table_ops );
 
@@ -189,6 +287,12 @@ static void handle_table_destroy( struct object *obj )
         if (obj) release_object_from_handle( obj );
     }
     free( table->entries );
+    free_entry_map( &table->free_map );
+    LIST_FOR_EACH_ENTRY_SAFE( index, next, &table->type_indexes, struct type_index, entry )
+    {
+        free_entry_map( &index->map );
+        free( index );
+    }
 }
 
 /* close all the process handles and free the handle table */
@@ -211,19 +315,46 @@ struct handle_table *alloc_handle_table( struct process *process, int count )
     table->process = process;
     table->count   = count;
     table->last    = -1;
-    table->free    = 0;
-    if ((table->entries = mem_alloc( count * sizeof(*table->entries) ))) return table;
+    list_init( &table->type_indexes );
+    table->entries = malloc( count * sizeof(*table->entries) );
+    if (alloc_entry_map( &table->free_map, count ) && table->entries) return table;
+    set_error( STATUS_NO_MEMORY );
     release_object( table );
     return NULL;
 }
 
+/* resize the table bitmaps for a new entry count */
+static int resize_table_maps( struct handle_table *table, int count )
+{
+    struct type_index *index;
+
+    if (!resize_entry_map( &table->free_map, table->count, count )) return 0;
+    LIST_FOR_EACH_ENTRY( index, &table->type_indexes, struct type_index, entry )
+        if (!resize_entry_map( &index->map, table->count, count )) return 0;
+    return 1;
+}
+
+/* update the type index of an object, if there is one, for an entry being set or cleared */
+static void update_type_index( struct handle_table *table, const struct object *obj, int i, int used )
+{
+    struct type_index *index;
+
+    LIST_FOR_EACH_ENTRY( index, &table->type_indexes, struct type_index, entry )
+    {
+        if (index->ops != obj->ops) continue;
+        if (used) set_map_bit( &index->map, i );
+        else clear_map_bit( &index->map, i );
+        break;
+    }
+}
+
 /* grow a handle table */
 static int grow_handle_table( struct handle_table *table )
 {
     struct handle_entry *new_entries;
     int count = min( table->count * 2, MAX_HANDLE_ENTRIES );
 
-    if (count == table->count ||
+    if (count == table->count || !resize_table_maps( table, count ) ||
         !(new_entries = realloc( table->entries, count * sizeof(struct handle_entry) )))
     {
         set_error( STATUS_INSUFFICIENT_RESOURCES );
@@ -234,23 +365,33 @@ static int grow_handle_table( struct handle_table *table )
     return 1;
 }
 
+/* find the first free entry below the last used one, or return -1 */
+static int find_free_entry( struct handle_table *table )
+{
+    return find_map_bit( &table->free_map, 0, table->last );
+}
+
 /* allocate the first free entry in the handle table */
 static obj_handle_t alloc_entry( struct handle_table *table, void *obj, unsigned int access )
 {
-    struct handle_entry *entry = table->entries + table->free;
+    struct handle_entry *entry;
     int i;
 
-    for (i = table->free; i <= table->last; i++, entry++) if (!entry->ptr) goto found;
-    if (i >= table->count)
+    if ((i = find_free_entry( table )) != -1)
     {
-        if (!grow_handle_table( table )) return 0;
-        entry = table->entries + i;  /* the entries may have moved */
+        mark_entry_used( table, i );
+        entry = table->entries + i;
+    }
+    else
+    {
+        i = table->last + 1;
+        if (i >= table->count && !grow_handle_table( table )) return 0;
+        entry = table->entries + i;
+        table->last = i;
     }
-    table->last = i;
- found:
-    table->free = i + 1;
     entry->ptr    = grab_object_for_handle( obj );
     entry->access = access;
+    update_type_index( table, obj, i, 1 );
     return index_to_handle(i);
 }
 
@@ -344,6 +485,7 @@ static void shrink_handle_table( struct handle_table *table )
     while (table->last >= 0)
     {
         if (entry->ptr) break;
+        mark_entry_used( table, table->last );
         table->last--;
         entry--;
     }
@@ -351,6 +493,7 @@ static void shrink_handle_table( struct handle_table *table )
     if (count < MIN_HANDLE_ENTRIES * 2) return;  /* too small to shrink */
     count /= 2;
     if (!(new_entries = realloc( table->entries, count * sizeof(*new_entries) ))) return;
+    resize_table_maps( table, count );  /* the bitmaps only need to be large enough */
     table->count   = count;
     table->entries = new_entries;
 }
@@ -375,9 +518,13 @@ struct handle_table *copy_handle_table( struct process *process, struct process
         memcpy( ptr, parent_table->entries, (table->last + 1) * sizeof(struct handle_entry) );
         for (i = 0; i <= table->last; i++, ptr++)
         {
-            if (!ptr->ptr) continue;
-            if (ptr->access & RESERVED_INHERIT) grab_object_for_handle( ptr->ptr );
-            else ptr->ptr = NULL; /* don't inherit this entry */
+            if (!ptr->ptr) mark_entry_free( table, i );
+            else if (ptr->access & RESERVED_INHERIT) grab_object_for_handle( ptr->ptr );
+            else
+            {
+                ptr->ptr = NULL; /* don't inherit this entry */
+                mark_entry_free( table, i );
+            }
         }
     }
     /* attempt to shrink the table */
@@ -398,8 +545,9 @@ unsigned int close_handle( struct process *process, obj_handle_t handle )
     if (!obj->ops->close_handle( obj, process, handle )) return STATUS_HANDLE_NOT_CLOSABLE;
     entry->ptr = NULL;
     table = handle_is_global(handle) ? global_table : process->handles;
-    if (entry < table->entries + table->free) table->free = entry - table->entries;
+    update_type_index( table, obj, entry - table->entries, 0 );
     if (entry == table->entries + table->last) shrink_handle_table( table );
+    else mark_entry_free( table, entry - table->entries );
     release_object_from_handle( obj );
     return STATUS_SUCCESS;
 }
@@ -469,22 +617,56 @@ unsigned int get_handle_access( struct process *process, obj_handle_t handle )
     return entry->access & ~RESERVED_ALL;
 }
 
+/* get the index of the entries holding objects of a given type, creating it on first use */
+static struct type_index *get_type_index( struct handle_table *table, const struct object_ops *ops )
+{
+    struct type_index *index;
+    struct handle_entry *entry;
+    int i;
+
+    LIST_FOR_EACH_ENTRY( index, &table->type_indexes, struct type_index, entry )
+        if (index->ops == ops) return index;
+
+    if (!(index = malloc( sizeof(*index) ))) return NULL;
+    if (!alloc_entry_map( &index->map, table->count ))
+    {
+        free_entry_map( &index->map );
+        free( index );
+        return NULL;
+    }
+    index->ops = ops;
+    for (i = 0, entry = table->entries; i <= table->last; i++, entry++)
+        if (entry->ptr && entry->ptr->ops == ops) set_map_bit( &index->map, i );
+    list_add_tail( &table->type_indexes, &index->entry );
+    return index;
+}
+
+/* find the first entry from start on that holds an object of the given type, or return -1 */
+static int find_typed_entry( struct handle_table *table, const struct object_ops *ops, int start )
+{
+    struct type_index *index;
+    struct handle_entry *entry;
+    int i;
+
+    if ((index = get_type_index( table, ops ))) return find_map_bit( &index->map, start, table->last );
+
+    /* no memory for the index, walk the table */
+    for (i = start, entry = table->entries + start; i <= table->last; i++, entry++)
+        if (entry->ptr && entry->ptr->ops == ops) return i;
+    return -1;
+}
+
 /* find the first inherited handle of the given type */
 /* this is needed for window stations and desktops (don't ask...) */
 obj_handle_t find_inherited_handle( struct process *process, const struct object_ops *ops )
 {
     struct handle_table *table = process->handles;
-    struct handle_entry *ptr;
     int i;
 
     if (!table) return 0;
 
-    for (i = 0, ptr = table->entries; i <= table->last; i++, ptr++)
-    {
-        if (!ptr->ptr) continue;
-        if (ptr->ptr->ops != ops) continue;
-        if (ptr->access & RESERVED_INHERIT) return index_to_handle(i);
-    }
+    for (i = find_typed_entry( table, ops, 0 ); i != -1; i = find_typed_entry( table, ops, i + 1 ))
+        if (table->entries[i].access & RESERVED_INHERIT) return index_to_handle(i);
     return 0;
 }
 
@@ -494,19 +676,13 @@ obj_handle_t enumerate_handles( struct process *process, const struct object_ops
                                 unsigned int *index )
 {
     struct handle_table *table = process->handles;
-    unsigned int i;
-    struct handle_entry *entry;
+    int i;
 
-    if (!table) return 0;
+    if (!table || table->last < 0 || *index > (unsigned int)table->last) return 0;
 
-    for (i = *index, entry = &table->entries[i]; i <= table->last; i++, entry++)
-    {
-        if (!entry->ptr) continue;
-        if (entry->ptr->ops != ops) continue;
-        *index = i + 1;
-        return index_to_handle(i);
-    }
-    return 0;
+    if ((i = find_typed_entry( table, ops, *index )) == -1) return 0;
+    *index = i + 1;
+    return index_to_handle(i);
 }
 
 /* get/set the handle reserved flags */
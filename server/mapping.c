@@ -974,6 +974,7 @@ struct object *create_user_data_mapping( struct object *root, const struct unico
     {
         user_shared_data = ptr;
         user_shared_data->SystemCall = 1;
+        *(LONG *)((char *)ptr + REGISTRY_GENERATION_OFFSET) = 1;
     }
     return &mapping->obj;
 }
@@ -59,6 +59,13 @@ struct notify
     struct process   *process;  /* process in which the hkey is valid */
 };
 
+/* hash index on the names of the subkeys or values of a key */
+struct name_index
+{
+    unsigned int      size;        /* number of buckets (power of 2), 0 if not indexed */
+    const void      **buckets;     /* subkey or value in each bucket, NULL if empty */
+};
+
 /* a registry key */
 struct key
 {
@@ -71,9 +78,11 @@ struct key
     int               last_subkey; /* last in use subkey */
     int               nb_subkeys;  /* count of allocated subkeys */
     struct key      **subkeys;     /* subkeys array */
+    struct name_index subkey_index; /* hash index on the subkey names */
     int               last_value;  /* last in use value */
     int               nb_values;   /* count of allocated values in array */
-    struct key_value *values;      /* values array */
+    struct key_value **values;     /* values array */
+    struct name_index value_index; /* hash index on the value names */
     unsigned int      flags;       /* flags */
     timeout_t         modif;       /* last modification time */
     struct list       notify_list; /* list of notifications */
@@ -99,6 +108,7 @@ struct key_value
 
 #define MIN_SUBKEYS  8   /* min. number of allocated subkeys per key */
 #define MIN_VALUES   8   /* min. number of allocated values per key */
+#define MIN_INDEXED  64  /* min. number of subkeys or values to build a name index */
 
 #define MAX_NAME_LEN  256    /* max. length of a key name */
 #define MAX_VALUE_LEN 16383  /* max. length of a value name */
@@ -205,6 +215,7 @@ static void dump_path( const struct key *key, const struct key *base, FILE *f )
 /* dump a value to a text file */
 static void dump_value( const struct key_value *value, FILE *f )
 {
+    static const char hex[] = "0123456789abcdef";
     unsigned int i, dw;
     int count;
 
@@ -242,7 +253,10 @@ static void dump_value( const struct key_value *value, FILE *f )
     else count += fprintf( f, "hex(%x):", value->type );
     for (i = 0; i < value->len; i++)
     {
-        count += fprintf( f, "%02x", *((unsigned char *)value->data + i) );
+        unsigned char byte = *((unsigned char *)value->data + i);
+        fputc( hex[byte >> 4], f );
+        fputc( hex[byte & 0x0f], f );
+        count += 2;
         if (i < value->len-1)
         {
             fputc( ',', f );
@@ -277,7 +291,7 @@ static void save_subkeys( const struct key *key, const struct key *base, FILE *f
             fprintf( f, "\"\n" );
         }
         if (key->flags & KEY_SYMLINK) fputs( "#link\n", f );
-        for (i = 0; i <= key->last_value; i++) dump_value( &key->values[i], f );
+        for (i = 0; i <= key->last_value; i++) dump_value( key->values[i], f );
     }
     for (i = 0; i <= key->last_subkey; i++) save_subkeys( key->subkeys[i], base, f );
 }
@@ -395,12 +409,24 @@ static struct security_descriptor *key_get_sd( struct object *obj )
     return key_default_sd;
 }
 
+/* invalidate the registry data cached by the clients */
+static void invalidate_client_caches(void)
+{
+    volatile LONG *generation;
+
+    if (!user_shared_data) return;
+    generation = (volatile LONG *)((char *)user_shared_data + REGISTRY_GENERATION_OFFSET);
+    if (!++*generation) *generation = 1;  /* 0 would disable caching */
+}
+
 /* close the notification associated with a handle */
 static int key_close_handle( struct object *obj, struct process *process, obj_handle_t handle )
 {
     struct key * key = (struct key *) obj;
     struct notify *notify = find_notify( key, process, handle );
     if (notify) do_notification( key, notify, 1 );
+    /* clients only forget about cached data for the handles that they close themselves */
+    if (!current || current->process != process) invalidate_client_caches();
     return 1;  /* ok to close */
 }
 
@@ -415,16 +441,18 @@ static void key_destroy( struct object *obj )
     free( key->class );
     for (i = 0; i <= key->last_value; i++)
     {
-        free( key->values[i].name );
-        free( key->values[i].data );
+        free( key->values[i]->data );
+        free( key->values[i] );
     }
     free( key->values );
+    free( key->value_index.buckets );
     for (i = 0; i <= key->last_subkey; i++)
     {
         key->subkeys[i]->parent = NULL;
         release_object( key->subkeys[i] );
     }
     free( key->subkeys );
+    free( key->subkey_index.buckets );
     /* unconditionally notify everything waiting on this key */
     while ((ptr = list_head( &key->notify_list )))
     {
@@ -490,6 +518,10 @@ static struct key *alloc_key( const struct unicode_str *name, timeout_t modif )
         key->nb_values   = 0;
         key->last_value  = -1;
         key->values      = NULL;
+        key->subkey_index.size    = 0;
+        key->subkey_index.buckets = NULL;
+        key->value_index.size     = 0;
+        key->value_index.buckets  = NULL;
         key->modif       = modif;
         key->parent      = NULL;
         list_init( &key->notify_list );
@@ -544,6 +576,7 @@ static void touch_key( struct key *key, unsigned int change )
 
     key->modif = current_time;
     make_dirty( key );
+    invalidate_client_caches();
 
     /* do notifications */
     check_notify( key, change, 1 );
@@ -551,6 +584,105 @@ static void touch_key( struct key *key, unsigned int change )
         check_notify( k, change, 0 );
 }
 
+typedef const WCHAR *(*get_entry_name_func)( const void *entry, data_size_t *len );
+
+static const WCHAR *get_subkey_name( const void *entry, data_size_t *len )
+{
+    const struct key *key = entry;
+    *len = key->namelen;
+    return key->name;
+}
+
+static const WCHAR *get_value_name( const void *entry, data_size_t *len )
+{
+    const struct key_value *value = entry;
+    *len = value->namelen;
+    return value->name;
+}
+
+static void free_name_index( struct name_index *index )
+{
+    free( index->buckets );
+    index->buckets = NULL;
+    index->size = 0;
+}
+
+/* make sure the index has room for count entries; return 1 if it has to be filled again */
+/* failing to allocate it is not an error, lookups simply fall back to a binary search */
+static int grow_name_index( struct name_index *index, int count )
+{
+    const void **buckets;
+    unsigned int size;
+
+    if (count < MIN_INDEXED || count * 4 <= index->size * 3) return 0;  /* keep it at most 75% full */
+    for (size = MIN_INDEXED * 2; size < count * 2; size *= 2) ;
+    if (!(buckets = calloc( size, sizeof(*buckets) )))
+    {
+        free_name_index( index );
+        return 0;
+    }
+    free( index->buckets );
+    index->buckets = buckets;
+    index->size = size;
+    return 1;
+}
+
+/* add a subkey or value to the index, using linear probing */
+static void add_name_index( struct name_index *index, const void *entry, get_entry_name_func get_name )
+{
+    unsigned int bucket;
+    const WCHAR *name;
+    data_size_t len;
+
+    if (!index->size) return;
+    name = get_name( entry, &len );
+    for (bucket = hash_strW( name, len, index->size ); index->buckets[bucket];
+         bucket = (bucket + 1) & (index->size - 1)) ;
+    index->buckets[bucket] = entry;
+}
+
+/* remove a subkey or value from the index */
+static void remove_name_index( struct name_index *index, const void *entry, get_entry_name_func get_name )
+{
+    unsigned int i, j, bucket, mask = index->size - 1;
+    const WCHAR *name;
+    data_size_t len;
+
+    if (!index->size) return;
+    name = get_name( entry, &len );
+    for (i = hash_strW( name, len, index->size ); index->buckets[i] != entry; i = (i + 1) & mask)
+        assert( index->buckets[i] );
+    index->buckets[i] = NULL;
+
+    /* move back the following entries that could no longer be found from their hash bucket */
+    for (j = (i + 1) & mask; index->buckets[j]; j = (j + 1) & mask)
+    {
+        name = get_name( index->buckets[j], &len );
+        bucket = hash_strW( name, len, index->size );
+        if (((j - bucket) & mask) < ((j - i) & mask)) continue;
+        index->buckets[i] = index->buckets[j];
+        index->buckets[j] = NULL;
+        i = j;
+    }
+}
+
+/* find a subkey or value in the index */
+static const void *find_name_index( const struct name_index *index, const struct unicode_str *str,
+                                    get_entry_name_func get_name )
+{
+    unsigned int bucket;
+    const WCHAR *name;
+    data_size_t len;
+
+    for (bucket = hash_strW( str->str, str->len, index->size ); index->buckets[bucket];
+         bucket = (bucket + 1) & (index->size - 1))
+    {
+        name = get_name( index->buckets[bucket], &len );
+        if (len == str->len && !memicmp_strW( name, str->str, len )) return index->buckets[bucket];
+    }
+    return NULL;
+}
+
 /* try to grow the array of subkeys; return 1 if OK, 0 on error */
 static int grow_subkeys( struct key *key )
 {
@@ -596,9 +728,15 @@ static struct key *alloc_subkey( struct key *parent, const struct unicode_str *n
     if ((key = alloc_key( name, modif )) != NULL)
     {
         key->parent = parent;
-        for (i = ++parent->last_subkey; i > index; i--)
-            parent->subkeys[i] = parent->subkeys[i-1];
+        memmove( parent->subkeys + index + 1, parent->subkeys + index,
+                 (++parent->last_subkey - index) * sizeof(*parent->subkeys) );
         parent->subkeys[index] = key;
+        if (grow_name_index( &parent->subkey_index, parent->last_subkey + 1 ))
+        {
+            for (i = 0; i <= parent->last_subkey; i++)
+                add_name_index( &parent->subkey_index, parent->subkeys[i], get_subkey_name );
+        }
+        else add_name_index( &parent->subkey_index, key, get_subkey_name );
         if (is_wow6432node( key->name, key->namelen ) && !is_wow6432node( parent->name, parent->namelen ))
             parent->flags |= KEY_WOW64;
     }
@@ -609,14 +747,17 @@ static struct key *alloc_subkey( struct key *parent, const struct unicode_str *n
 static void free_subkey( struct key *parent, int index )
 {
     struct key *key;
-    int i, nb_subkeys;
+    int nb_subkeys;
 
     assert( index >= 0 );
     assert( index <= parent->last_subkey );
 
     key = parent->subkeys[index];
-    for (i = index; i < parent->last_subkey; i++) parent->subkeys[i] = parent->subkeys[i + 1];
+    memmove( parent->subkeys + index, parent->subkeys + index + 1,
+             (parent->last_subkey - index) * sizeof(*parent->subkeys) );
     parent->last_subkey--;
+    if (parent->last_subkey + 1 < MIN_INDEXED / 2) free_name_index( &parent->subkey_index );
+    else remove_name_index( &parent->subkey_index, key, get_subkey_name );
     key->flags |= KEY_DELETED;
     key->parent = NULL;
     if (is_wow6432node( key->name, key->namelen )) parent->flags &= ~KEY_WOW64;
@@ -635,8 +776,8 @@ static void free_subkey( struct key *parent, int index )
     }
 }
 
-/* find the named child of a given key and return its index */
-static struct key *find_subkey( const struct key *key, const struct unicode_str *name, int *index )
+/* binary search for the named child of a given key and return its index */
+static struct key *search_subkey( const struct key *key, const struct unicode_str *name, int *index )
 {
     int i, min, max, res;
     data_size_t len;
@@ -661,6 +802,17 @@ static struct key *find_subkey( const struct key *key, const struct unicode_str
     return NULL;
 }
 
+/* find the named child of a given key; the index is only returned if it is not found */
+static struct key *find_subkey( const struct key *key, const struct unicode_str *name, int *index )
+{
+    struct key *subkey;
+
+    if (key->subkey_index.size &&
+        (subkey = (struct key *)find_name_index( &key->subkey_index, name, get_subkey_name )))
+        return subkey;
+    return search_subkey( key, name, index );
+}
+
 /* return the wow64 variant of the key, or the key itself if none */
 static struct key *find_wow64_subkey( struct key *key, const struct unicode_str *name )
 {
@@ -928,8 +1080,8 @@ static void enum_key( const struct key *key, int index, int info_class,
         }
         for (i = 0; i <= key->last_value; i++)
         {
-            if (key->values[i].namelen > max_value) max_value = key->values[i].namelen;
-            if (key->values[i].len > max_data) max_data = key->values[i].len;
+            if (key->values[i]->namelen > max_value) max_value = key->values[i]->namelen;
+            if (key->values[i]->len > max_data) max_data = key->values[i]->len;
         }
         reply->max_subkey = max_subkey;
         reply->max_class  = max_class;
@@ -987,6 +1139,7 @@ static int delete_key( struct key *key, int recurse )
 {
     int index;
     struct key *parent = key->parent;
+    struct unicode_str name;
 
     /* must find parent and index */
     if (key == root_key)
@@ -1000,9 +1153,10 @@ static int delete_key( struct key *key, int recurse )
         if (0 > delete_key(key->subkeys[key->last_subkey], 1))
             return -1;
 
-    for (index = 0; index <= parent->last_subkey; index++)
-        if (parent->subkeys[index] == key) break;
-    assert( index <= parent->last_subkey );
+    name.str = key->name;
+    name.len = key->namelen;
+    search_subkey( parent, &name, &index );
+    assert( index <= parent->last_subkey && parent->subkeys[index] == key );
 
     /* we can only delete a key that has no subkeys */
     if (key->last_subkey >= 0)
@@ -1020,7 +1174,7 @@ static int delete_key( struct key *key, int recurse )
 /* try to grow the array of values; return 1 if OK, 0 on error */
 static int grow_values( struct key *key )
 {
-    struct key_value *new_val;
+    struct key_value **new_val;
     int nb_values;
 
     if (key->nb_values)
@@ -1042,8 +1196,8 @@ static int grow_values( struct key *key )
     return 1;
 }
 
-/* find the named value of a given key and return its index in the array */
-static struct key_value *find_value( const struct key *key, const struct unicode_str *name, int *index )
+/* binary search for the named value of a given key and return its index in the array */
+static struct key_value *search_value( const struct key *key, const struct unicode_str *name, int *index )
 {
     int i, min, max, res;
     data_size_t len;
@@ -1053,13 +1207,13 @@ static struct key_value *find_value( const struct key *key, const struct unicode
     while (min <= max)
     {
         i = (min + max) / 2;
-        len = min( key->values[i].namelen, name->len );
-        res = memicmp_strW( key->values[i].name, name->str, len );
-        if (!res) res = key->values[i].namelen - name->len;
+        len = min( key->values[i]->namelen, name->len );
+        res = memicmp_strW( key->values[i]->name, name->str, len );
+        if (!res) res = key->values[i]->namelen - name->len;
         if (!res)
         {
             *index = i;
-            return &key->values[i];
+            return key->values[i];
         }
         if (res > 0) max = i - 1;
         else min = i + 1;
@@ -1068,11 +1222,21 @@ static struct key_value *find_value( const struct key *key, const struct unicode
     return NULL;
 }
 
+/* find the named value of a given key; the index is only returned if it is not found */
+static struct key_value *find_value( const struct key *key, const struct unicode_str *name, int *index )
+{
+    struct key_value *value;
+
+    if (key->value_index.size &&
+        (value = (struct key_value *)find_name_index( &key->value_index, name, get_value_name )))
+        return value;
+    return search_value( key, name, index );
+}
+
 /* insert a new value; the index must have been returned by find_value */
 static struct key_value *insert_value( struct key *key, const struct unicode_str *name, int index )
 {
     struct key_value *value;
-    WCHAR *new_name = NULL;
     int i;
 
     if (name->len > MAX_VALUE_LEN * sizeof(WCHAR))
@@ -1084,13 +1248,22 @@ static struct key_value *insert_value( struct key *key, const struct unicode_str
     {
         if (!grow_values( key )) return NULL;
     }
-    if (name->len && !(new_name = memdup( name->str, name->len ))) return NULL;
-    for (i = ++key->last_value; i > index; i--) key->values[i] = key->values[i - 1];
-    value = &key->values[index];
-    value->name    = new_name;
+    /* the name is stored right after the value structure */
+    if (!(value = mem_alloc( sizeof(*value) + name->len ))) return NULL;
+    value->name    = (WCHAR *)(value + 1);
     value->namelen = name->len;
     value->len     = 0;
     value->data    = NULL;
+    memcpy( value->name, name->str, name->len );
+    memmove( key->values + index + 1, key->values + index,
+             (++key->last_value - index) * sizeof(*key->values) );
+    key->values[index] = value;
+    if (grow_name_index( &key->value_index, key->last_value + 1 ))
+    {
+        for (i = 0; i <= key->last_value; i++)
+            add_name_index( &key->value_index, key->values[i], get_value_name );
+    }
+    else add_name_index( &key->value_index, value, get_value_name );
     return value;
 }
 
@@ -1173,7 +1346,7 @@ static void enum_value( struct key *key, int i, int info_class, struct enum_key_
         void *data;
         data_size_t namelen, maxlen;
 
-        value = &key->values[i];
+        value = key->values[i];
         reply->type = value->type;
         namelen = value->namelen;
 
@@ -1217,25 +1390,28 @@ static void enum_value( struct key *key, int i, int info_class, struct enum_key_
 static void delete_value( struct key *key, const struct unicode_str *name )
 {
     struct key_value *value;
-    int i, index, nb_values;
+    int index, nb_values;
 
-    if (!(value = find_value( key, name, &index )))
+    if (!(value = search_value( key, name, &index )))
     {
         set_error( STATUS_OBJECT_NAME_NOT_FOUND );
         return;
     }
     if (debug_level > 1) dump_operation( key, value, "Delete" );
-    free( value->name );
-    free( value->data );
-    for (i = index; i < key->last_value; i++) key->values[i] = key->values[i + 1];
+    memmove( key->values + index, key->values + index + 1,
+             (key->last_value - index) * sizeof(*key->values) );
     key->last_value--;
+    if (key->last_value + 1 < MIN_INDEXED / 2) free_name_index( &key->value_index );
+    else remove_name_index( &key->value_index, value, get_value_name );
+    free( value->data );
+    free( value );
     touch_key( key, REG_NOTIFY_CHANGE_LAST_SET );
 
     /* try to shrink the array */
     nb_values = key->nb_values;
     if (nb_values > MIN_VALUES && key->last_value < nb_values / 2)
     {
-        struct key_value *new_val;
+        struct key_value **new_val;
         nb_values -= nb_values / 3;  /* shrink by 33% */
         if (nb_values < MIN_VALUES) nb_values = MIN_VALUES;
         if (!(new_val = realloc( key->values, nb_values * sizeof(*new_val) ))) return;
@@ -1474,15 +1650,20 @@ static int parse_hex( unsigned char *dest, data_size_t *len, const char *buffer
 {
     const char *p = buffer;
     data_size_t count = 0;
-    char *end;
 
     while (isxdigit(*p))
     {
-        unsigned int val = strtoul( p, &end, 16 );
-        if (end == p || val > 0xff) return -1;
+        unsigned int val = 0;
+
+        /* accept a 0x prefix, like strtoul does */
+        if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X') && isxdigit(p[2])) p += 2;
+        do
+        {
+            val = val * 16 + (isdigit(*p) ? *p - '0' : tolower(*p) - 'a' + 10);
+            if (val > 0xff) return -1;
+        } while (isxdigit(*++p));
         if (count++ >= *len) return -1;  /* dest buffer overflow */
         *dest++ = val;
-        p = end;
         while (isspace(*p)) p++;
         if (*p == ',') p++;
         while (isspace(*p)) p++;
@@ -2221,6 +2402,7 @@ DECL_HANDLER(load_registry)
         if ((key = create_key( parent, &name, NULL, 0, KEY_WOW64_64KEY, 0, sd, &dummy )))
         {
             load_registry( key, req->file );
+            invalidate_client_caches();
             release_object( key );
         }
         release_object( parent );
@@ -334,12 +334,26 @@ static void call_req_handler( struct thread *thread )
 /* read a request from a thread */
 void read_request( struct thread *thread )
 {
+    static char req_buffer[4096];  /* scratch space for the data following the request header */
+    struct iovec vec[2];
     int ret;
 
     if (!thread->req_toread)  /* no pending request */
     {
-        if ((ret = read( get_unix_fd( thread->request_fd ), &thread->req,
-                         sizeof(thread->req) )) != sizeof(thread->req)) goto error;
+        /* a client only has a single request in flight, so we can read the header
+         * and (usually) the whole variable sized data with a single syscall */
+        vec[0].iov_base = &thread->req;
+        vec[0].iov_len  = sizeof(thread->req);
+        vec[1].iov_base = req_buffer;
+        vec[1].iov_len  = sizeof(req_buffer);
+        if ((ret = readv( get_unix_fd( thread->request_fd ), vec, 2 )) < (int)sizeof(thread->req))
+            goto error;
+        ret -= sizeof(thread->req);
+        if ((data_size_t)ret > thread->req.request_header.request_size)
+        {
+            fatal_protocol_error( thread, "request overrun %d\n", ret );
+            return;
+        }
         if (!(thread->req_toread = thread->req.request_header.request_size))
         {
             /* no data, handle request at once */
@@ -352,6 +366,14 @@ void read_request( struct thread *thread )
                                   thread->req_toread, thread->req.request_header.req );
             return;
         }
+        memcpy( thread->req_data, req_buffer, ret );
+        if (!(thread->req_toread -= ret))
+        {
+            call_req_handler( thread );
+            free( thread->req_data );
+            thread->req_data = NULL;
+            return;
+        }
     }
 
     /* read the variable sized data */
@@ -467,7 +489,7 @@ int receive_fd( struct process *process )
     return -1;
 }
 
-/* send an fd to a client */
+/* send an fd to a client, tagged with the handle or thread id the client expects */
 int send_client_fd( struct process *process, int fd, obj_handle_t handle )
 {
     struct iovec vec;
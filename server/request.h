@@ -258,6 +258,8 @@ DECL_HANDLER(set_serial_info);
 DECL_HANDLER(register_async);
 DECL_HANDLER(cancel_async);
 DECL_HANDLER(get_async_result);
+DECL_HANDLER(register_client_async);
+DECL_HANDLER(complete_client_async);
 DECL_HANDLER(read);
 DECL_HANDLER(write);
 DECL_HANDLER(ioctl);
@@ -558,6 +560,8 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
     (req_handler)req_register_async,
     (req_handler)req_cancel_async,
     (req_handler)req_get_async_result,
+    (req_handler)req_register_client_async,
+    (req_handler)req_complete_client_async,
     (req_handler)req_read,
     (req_handler)req_write,
     (req_handler)req_ioctl,
@@ -1506,6 +1510,13 @@ C_ASSERT( FIELD_OFFSET(struct get_async_result_request, user_arg) == 16 );
 C_ASSERT( sizeof(struct get_async_result_request) == 24 );
 C_ASSERT( FIELD_OFFSET(struct get_async_result_reply, size) == 8 );
 C_ASSERT( sizeof(struct get_async_result_reply) == 16 );
+C_ASSERT( FIELD_OFFSET(struct register_client_async_request, async) == 16 );
+C_ASSERT( FIELD_OFFSET(struct register_client_async_request, access) == 56 );
+C_ASSERT( sizeof(struct register_client_async_request) == 64 );
+C_ASSERT( FIELD_OFFSET(struct complete_client_async_request, user_arg) == 16 );
+C_ASSERT( FIELD_OFFSET(struct complete_client_async_request, status) == 24 );
+C_ASSERT( FIELD_OFFSET(struct complete_client_async_request, total) == 32 );
+C_ASSERT( sizeof(struct complete_client_async_request) == 40 );
 C_ASSERT( FIELD_OFFSET(struct read_request, async) == 16 );
 C_ASSERT( FIELD_OFFSET(struct read_request, pos) == 56 );
 C_ASSERT( sizeof(struct read_request) == 64 );
@@ -2333,6 +2344,7 @@ C_ASSERT( sizeof(struct create_esync_request) == 32 );
 C_ASSERT( FIELD_OFFSET(struct create_esync_reply, handle) == 8 );
 C_ASSERT( FIELD_OFFSET(struct create_esync_reply, type) == 12 );
 C_ASSERT( FIELD_OFFSET(struct create_esync_reply, shm_idx) == 16 );
+C_ASSERT( FIELD_OFFSET(struct create_esync_reply, has_fd) == 20 );
 C_ASSERT( sizeof(struct create_esync_reply) == 24 );
 C_ASSERT( FIELD_OFFSET(struct open_esync_request, access) == 12 );
 C_ASSERT( FIELD_OFFSET(struct open_esync_request, attributes) == 16 );
@@ -2342,12 +2354,15 @@ C_ASSERT( sizeof(struct open_esync_request) == 32 );
 C_ASSERT( FIELD_OFFSET(struct open_esync_reply, handle) == 8 );
 C_ASSERT( FIELD_OFFSET(struct open_esync_reply, type) == 12 );
 C_ASSERT( FIELD_OFFSET(struct open_esync_reply, shm_idx) == 16 );
+C_ASSERT( FIELD_OFFSET(struct open_esync_reply, has_fd) == 20 );
 C_ASSERT( sizeof(struct open_esync_reply) == 24 );
 C_ASSERT( FIELD_OFFSET(struct get_esync_fd_request, handle) == 12 );
-C_ASSERT( sizeof(struct get_esync_fd_request) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_esync_fd_request, alloc) == 16 );
+C_ASSERT( sizeof(struct get_esync_fd_request) == 24 );
 C_ASSERT( FIELD_OFFSET(struct get_esync_fd_reply, type) == 8 );
 C_ASSERT( FIELD_OFFSET(struct get_esync_fd_reply, shm_idx) == 12 );
-C_ASSERT( sizeof(struct get_esync_fd_reply) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_esync_fd_reply, has_fd) == 16 );
+C_ASSERT( sizeof(struct get_esync_fd_reply) == 24 );
 C_ASSERT( FIELD_OFFSET(struct esync_msgwait_request, in_msgwait) == 12 );
 C_ASSERT( sizeof(struct esync_msgwait_request) == 16 );
 C_ASSERT( sizeof(struct get_esync_apc_fd_request) == 16 );
@@ -2807,6 +2807,19 @@ static void dump_get_async_result_reply( const struct get_async_result_reply *re
     dump_varargs_bytes( ", out_data=", cur_size );
 }
 
+static void dump_register_client_async_request( const struct register_client_async_request *req )
+{
+    dump_async_data( " async=", &req->async );
+    fprintf( stderr, ", access=%08x", req->access );
+}
+
+static void dump_complete_client_async_request( const struct complete_client_async_request *req )
+{
+    dump_uint64( " user_arg=", &req->user_arg );
+    fprintf( stderr, ", status=%08x", req->status );
+    dump_uint64( ", total=", &req->total );
+}
+
 static void dump_read_request( const struct read_request *req )
 {
     dump_async_data( " async=", &req->async );
@@ -4464,6 +4477,7 @@ static void dump_create_esync_reply( const struct create_esync_reply *req )
     fprintf( stderr, " handle=%04x", req->handle );
     fprintf( stderr, ", type=%d", req->type );
     fprintf( stderr, ", shm_idx=%08x", req->shm_idx );
+    fprintf( stderr, ", has_fd=%d", req->has_fd );
 }
 
 static void dump_open_esync_request( const struct open_esync_request *req )
@@ -4480,17 +4494,20 @@ static void dump_open_esync_reply( const struct open_esync_reply *req )
     fprintf( stderr, " handle=%04x", req->handle );
     fprintf( stderr, ", type=%d", req->type );
     fprintf( stderr, ", shm_idx=%08x", req->shm_idx );
+    fprintf( stderr, ", has_fd=%d", req->has_fd );
 }
 
 static void dump_get_esync_fd_request( const struct get_esync_fd_request *req )
 {
     fprintf( stderr, " handle=%04x", req->handle );
+    fprintf( stderr, ", alloc=%d", req->alloc );
 }
 
 static void dump_get_esync_fd_reply( const struct get_esync_fd_reply *req )
 {
     fprintf( stderr, " type=%d", req->type );
     fprintf( stderr, ", shm_idx=%08x", req->shm_idx );
+    fprintf( stderr, ", has_fd=%d", req->has_fd );
 }
 
 static void dump_esync_msgwait_request( const struct esync_msgwait_request *req )
@@ -4699,6 +4716,8 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_register_async_request,
     (dump_func)dump_cancel_async_request,
     (dump_func)dump_get_async_result_request,
+    (dump_func)dump_register_client_async_request,
+    (dump_func)dump_complete_client_async_request,
     (dump_func)dump_read_request,
     (dump_func)dump_write_request,
     (dump_func)dump_ioctl_request,
@@ -4996,6 +5015,8 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     NULL,
     NULL,
     (dump_func)dump_get_async_result_reply,
+    NULL,
+    NULL,
     (dump_func)dump_read_reply,
     (dump_func)dump_write_reply,
     (dump_func)dump_ioctl_reply,
@@ -5293,6 +5314,8 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "register_async",
     "cancel_async",
     "get_async_result",
+    "register_client_async",
+    "complete_client_async",
     "read",
     "write",
     "ioctl",